@@ -28,9 +28,14 @@ val buildConfigDir = layout.buildDirectory.dir("generated/buildconfig")
 val generateBuildConfig = tasks.register("generateBuildConfig") {
     val isRelease = isReleaseTask()
     val defaultLogLevel = if (isRelease) "INFO" else "DEBUG"
+    // Lowest level whose lazy call sites (Logger.debug { ... }) are compiled
+    // in: 0 = TRACE, 1 = DEBUG, ... Release builds drop TRACE; pass
+    // -PminLogLevel=2 to drop DEBUG as well.
+    val minLogLevel = (findProperty("minLogLevel") as String?)?.toInt() ?: if (isRelease) 1 else 0
 
     // Track build type as input to invalidate cache when it changes
     inputs.property("buildType", if (isRelease) "release" else "debug")
+    inputs.property("minLogLevel", minLogLevel)
 
     // Declare outputs using Provider to wire task dependencies
     outputs.dir(buildConfigDir)
@@ -48,6 +53,7 @@ val generateBuildConfig = tasks.register("generateBuildConfig") {
              */
             object BuildConfig {
                 const val DEFAULT_LOG_LEVEL = "$defaultLogLevel"
+                const val MIN_LOG_LEVEL = $minLogLevel
             }
             """.trimIndent(),
         )
@@ -57,7 +63,35 @@ val generateBuildConfig = tasks.register("generateBuildConfig") {
 // Build C bootstrap library. Gradle 9 removed Project.exec() / Project.copy()
 // from inside task actions — the old `doLast { exec { ... } }` block no longer
 // compiles. Split into three sequential tasks (compile, archive, stage).
+// The parked-init waiter is a freestanding x86_64 program that bootstrap.c
+// embeds with .incbin, so it must be linked first.
+val compileParkWaiter = tasks.register<Exec>("compileParkWaiter") {
+    workingDir = file("src/nativeInterop/cinterop/bootstrap")
+    doFirst { file("${workingDir}/build").mkdirs() }
+    commandLine(
+        "gcc",
+        "-Os",
+        "-Wall",
+        "-Wextra",
+        "-ffreestanding",
+        "-fno-builtin",
+        "-fno-stack-protector",
+        "-fno-asynchronous-unwind-tables",
+        "-fno-tree-loop-distribute-patterns",
+        "-fno-pie",
+        "-no-pie",
+        "-nostdlib",
+        "-static",
+        "-Wl,--build-id=none",
+        "-Wl,-z,noexecstack",
+        "parkwait.c",
+        "-o",
+        "build/parkwait",
+    )
+}
+
 val compileBootstrap = tasks.register<Exec>("compileBootstrap") {
+    dependsOn(compileParkWaiter)
     workingDir = file("src/nativeInterop/cinterop/bootstrap")
     doFirst { file("${workingDir}/build").mkdirs() }
     commandLine(
@@ -107,6 +141,28 @@ kotlin {
             }
         }
 
+        // Benchmark harness (src/nativeBenchmark): its own executable over the
+        // main sources, including their internal declarations. See the
+        // `benchmark` task below.
+        val benchmarkCompilation =
+            compilations.create("benchmark") {
+                associateWith(compilations.getByName("main"))
+                defaultSourceSet {
+                    kotlin.srcDir("src/nativeBenchmark/kotlin")
+                    dependencies {
+                        implementation(libs.kotlinxSerializationJson)
+                        implementation(libs.kotlinxCli)
+                    }
+                }
+            }
+        binaries {
+            executable("bench", listOf(RELEASE)) {
+                compilation = benchmarkCompilation
+                entryPoint = "benchmark.main"
+                baseName = "kontainer-bench"
+            }
+        }
+
         compilations.getByName("main").cinterops {
             create("libseccomp")
             create("socket")
@@ -123,6 +179,7 @@ kotlin {
         nativeMain {
             dependencies {
                 implementation(libs.kotlinxSerializationJson)
+                implementation(libs.kotlinxSerializationCbor)
                 implementation(libs.kotlinxCli)
             }
             // Add generated BuildConfig to source set using Provider
@@ -175,6 +232,21 @@ ktlint {
     }
 }
 
+// Run the benchmark harness against a release build of the runtime:
+//   ./gradlew benchmark                                  (microbenchmarks)
+//   sudo ./gradlew benchmark -PbenchmarkArgs="lifecycle --rootfs /path/to/rootfs -c 4"
+tasks.register<Exec>("benchmark") {
+    group = "verification"
+    description = "Run kontainer-bench; arguments go in -PbenchmarkArgs (default: micro)"
+    val target = kotlin.targets.getByName<org.jetbrains.kotlin.gradle.plugin.mpp.KotlinNativeTarget>("linuxX64")
+    val bench = target.binaries.getExecutable("bench", "RELEASE")
+    val runtime = target.binaries.getExecutable("RELEASE")
+    dependsOn(bench.linkTaskProvider, runtime.linkTaskProvider)
+    executable = bench.outputFile.absolutePath
+    args((findProperty("benchmarkArgs") as String? ?: "micro").split(" ").filter { it.isNotEmpty() })
+    environment("KONTAINER_BENCH_RUNTIME", runtime.outputFile.absolutePath)
+}
+
 // Ensure bootstrap C library is built before cinterop
 tasks.named("cinteropBootstrapLinuxX64") {
     dependsOn(buildBootstrap)
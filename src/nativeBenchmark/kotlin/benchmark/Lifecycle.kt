@@ -0,0 +1,231 @@
+package benchmark
+
+import bootstrap.kontainer_spawn
+import kotlinx.cinterop.*
+import kotlinx.serialization.SerialName
+import kotlinx.serialization.Serializable
+import logger.Logger
+import platform.posix.*
+import state.loadState
+import trace.Tracer
+import utils.JsonCodec
+import utils.RealFileSystem
+
+/**
+ * Options of one lifecycle benchmark run
+ *
+ * @property runtime Path of the kontainer-runtime binary under test
+ * @property root State root passed to every command (--root)
+ * @property workDir Scratch directory for the bundles and the runtime log
+ * @property rootfs Root filesystem shared read-only by every container
+ * @property args Container process; must keep running until killed
+ * @property cycles create/start/kill/delete cycles per profile
+ * @property concurrency Cycles in flight at once
+ * @property mountCount tmpfs mounts of the mounts profile
+ * @property trace Run the runtime with KONTAINER_TRACE=1 and report its spans
+ */
+class LifecycleOptions(
+    val runtime: String,
+    val root: String,
+    val workDir: String,
+    val rootfs: String,
+    val args: List<String>,
+    val cycles: Int,
+    val concurrency: Int,
+    val mountCount: Int,
+    val trace: Boolean,
+)
+
+/**
+ * What one profile's cycles measured
+ *
+ * @property phases Wall time of each command, and of whole cycles
+ * @property spans Trace span durations by "stage/name" (with tracing)
+ * @property rss Peak RSS in KiB: of each command, including the children it
+ *   reaped (stage-1 for create), and of the container's init
+ */
+class LifecycleResult(
+    val profile: Profile,
+    val phases: SampleSet,
+    val spans: SampleSet,
+    val rss: SampleSet,
+    val failures: Int,
+)
+
+/** One line of `<root>/<id>/trace.json`, see trace.formatSpan */
+@Serializable
+private data class TraceRecord(
+    val stage: String,
+    val name: String,
+    @SerialName("duration_ns") val durationNs: Long,
+)
+
+private enum class Phase(
+    val label: String,
+) {
+    CREATE("create"),
+    START("start"),
+    KILL("kill"),
+    DELETE("delete"),
+}
+
+/**
+ * One cycle in flight
+ *
+ * @property failed A command failed; the lane skips to a forced delete
+ */
+private class Lane(
+    val id: String,
+    val cycleStart: Long,
+) {
+    var phase = Phase.CREATE
+    var phaseStart = 0L
+    var initPid = -1
+    var failed = false
+}
+
+/**
+ * Drive [LifecycleOptions.cycles] create/start/kill/delete cycles of
+ * [profile] through the runtime binary, up to [LifecycleOptions.concurrency]
+ * at a time
+ *
+ * Every command is a separate process, as under a container engine. The
+ * commands' rusage comes from wait4(); the init's peak RSS is its VmHWM
+ * just before the kill.
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun runLifecycle(
+    options: LifecycleOptions,
+    profile: Profile,
+): LifecycleResult =
+    memScoped {
+        val fs = RealFileSystem()
+        val bundle = "${options.workDir}/bundle-${profile.label}"
+        fs.createDirectories(bundle)
+        fs.writeTextFile(
+            "$bundle/config.json",
+            JsonCodec.encode(benchmarkSpec(profile, options.rootfs, options.args, options.mountCount), prettyPrint = true),
+        )
+        fs.createDirectories(options.root)
+
+        val phases = SampleSet()
+        val spans = SampleSet()
+        val rss = SampleSet()
+        var failures = 0
+        var started = 0
+        var finished = 0
+        val running = mutableMapOf<Int, Lane>()
+        val devNull = open("/dev/null", O_RDONLY or O_CLOEXEC)
+        val status = alloc<IntVar>()
+        val usage = alloc<rusage>()
+        val log = "${options.workDir}/runtime.log"
+
+        fun launch(lane: Lane) {
+            val command =
+                when (lane.phase) {
+                    Phase.CREATE -> listOf("create", "--bundle", bundle, lane.id)
+                    Phase.START -> listOf("start", lane.id)
+                    Phase.KILL -> listOf("kill", lane.id, "KILL")
+                    Phase.DELETE -> listOf("delete", "--force", lane.id)
+                }
+            val argv = listOf(options.runtime, "--root", options.root, "--log", log) + command
+            lane.phaseStart = monotonicNanos()
+            val pid = spawn(argv, devNull)
+            if (pid < 0) {
+                Logger.error("failed to run ${options.runtime} (errno=$errno)")
+                failures++
+                finished++
+                return
+            }
+            running[pid] = lane
+        }
+
+        while (finished < options.cycles) {
+            while (started < options.cycles && running.size < options.concurrency) {
+                launch(Lane("bench-${profile.label}-${getpid()}-$started", monotonicNanos()))
+                started++
+            }
+            if (running.isEmpty()) continue
+
+            val pid = wait4(-1, status.ptr, 0, usage.ptr)
+            if (pid < 0) {
+                if (errno == EINTR) continue
+                Logger.error("wait4 failed (errno=$errno)")
+                break
+            }
+            // Stage-1 and the inits are cloned with CLONE_PARENT, so they
+            // are our children as well; only the commands are tracked
+            val lane = running.remove(pid) ?: continue
+            val phase = lane.phase
+            phases.add(phase.label, monotonicNanos() - lane.phaseStart)
+            rss.add(phase.label, usage.ru_maxrss)
+            val ok = (status.value and 0x7f) == 0 && ((status.value shr 8) and 0xff) == 0
+            if (!ok) {
+                Logger.warn("${lane.id}: ${phase.label} failed (status ${status.value}), see $log")
+                lane.failed = true
+            }
+
+            val next =
+                when {
+                    phase == Phase.DELETE -> null
+                    lane.failed -> Phase.DELETE
+                    else -> Phase.entries[phase.ordinal + 1]
+                }
+            if (phase == Phase.CREATE && ok) {
+                lane.initPid = runCatching { loadState(fs, options.root, lane.id).pid }.getOrNull() ?: -1
+            }
+            if (next == Phase.KILL) {
+                if (options.trace) readTrace(fs, "${options.root}/${lane.id}/${Tracer.TRACE_FILE}", spans)
+                if (lane.initPid > 0) readPeakRss(fs, lane.initPid)?.let { rss.add("init", it) }
+            }
+            if (next == null) {
+                if (lane.failed) failures++ else phases.add("cycle", monotonicNanos() - lane.cycleStart)
+                finished++
+            } else {
+                lane.phase = next
+                launch(lane)
+            }
+        }
+        close(devNull)
+        LifecycleResult(profile, phases, spans, rss, failures)
+    }
+
+/**
+ * Start [argv] with stdin from [stdin]; stdout and stderr are inherited
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun spawn(
+    argv: List<String>,
+    stdin: Int,
+): Int =
+    memScoped {
+        val cArgv = allocArray<CPointerVar<ByteVar>>(argv.size + 1)
+        argv.forEachIndexed { i, a -> cArgv[i] = a.cstr.ptr }
+        cArgv[argv.size] = null
+        kontainer_spawn(argv[0], cArgv, null, stdin)
+    }
+
+private fun readTrace(
+    fs: RealFileSystem,
+    path: String,
+    spans: SampleSet,
+) {
+    val text = runCatching { fs.readTextFile(path) }.getOrNull() ?: return
+    for (line in text.lineSequence()) {
+        if (line.isBlank()) continue
+        val record = runCatching { JsonCodec.decode<TraceRecord>(line) }.getOrNull() ?: continue
+        spans.add("${record.stage}/${record.name}", record.durationNs)
+    }
+}
+
+/**
+ * VmHWM of [pid] in KiB
+ */
+private fun readPeakRss(
+    fs: RealFileSystem,
+    pid: Int,
+): Long? {
+    val status = runCatching { fs.readProcFile("/proc/$pid/status") }.getOrNull() ?: return null
+    val line = status.lineSequence().firstOrNull { it.startsWith("VmHWM:") } ?: return null
+    return line.removePrefix("VmHWM:").trim().removeSuffix("kB").trim().toLongOrNull()
+}
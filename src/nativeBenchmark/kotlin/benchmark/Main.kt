@@ -0,0 +1,130 @@
+package benchmark
+
+import kotlinx.cinterop.ExperimentalForeignApi
+import kotlinx.cinterop.toKString
+import kotlinx.cli.*
+import logger.Logger
+import platform.posix.exit
+import platform.posix.getenv
+import platform.posix.getpid
+import platform.posix.setenv
+import trace.Tracer
+
+/** Default for `lifecycle --runtime`, set by the `benchmark` Gradle task */
+private const val RUNTIME_ENV = "KONTAINER_BENCH_RUNTIME"
+
+/**
+ * Kontainer benchmark harness
+ *
+ * Commands:
+ *   micro [--iterations|-n <count>] [--warmup <count>] [--filter <name>]         - Time hot paths in-process
+ *   lifecycle --rootfs <path> [--profile <name>]... [--cycles|-n <count>]
+ *             [--concurrency|-c <count>] [--trace]                              - Time create/start/kill/delete
+ */
+@OptIn(ExperimentalForeignApi::class, ExperimentalCli::class)
+fun main(args: Array<String>) {
+    // The runtime code under test logs at debug level in non-release builds
+    Logger.setLogLevel(Logger.Level.WARN)
+
+    val parser = ArgParser("kontainer-bench")
+
+    class MicroCommand : Subcommand("micro", "Microbenchmarks of the runtime's hot paths") {
+        val iterations by option(ArgType.Int, shortName = "n", fullName = "iterations", description = "Timed iterations")
+            .default(1000)
+        val warmup by option(ArgType.Int, fullName = "warmup", description = "Untimed iterations first").default(100)
+        val filter by option(ArgType.String, fullName = "filter", description = "Only benchmarks whose name contains this")
+        val workDir by option(ArgType.String, fullName = "work-dir", description = "Scratch directory (tmpfs recommended)")
+            .default("/dev/shm/kontainer-bench-${getpid()}")
+
+        override fun execute() {
+            val results = runMicroBenchmarks(workDir, iterations, warmup, filter)
+            print(formatLatencyTable("microbenchmarks ($iterations iterations)", results.all))
+        }
+    }
+
+    class LifecycleCommand : Subcommand("lifecycle", "Time create/start/kill/delete cycles of the runtime binary") {
+        val runtime by option(ArgType.String, fullName = "runtime", description = "kontainer-runtime binary ($RUNTIME_ENV)")
+        val rootfs by option(ArgType.String, fullName = "rootfs", description = "Root filesystem shared by the containers")
+            .required()
+        val profiles by option(
+            ArgType.Choice(Profile.entries.map { it.label }, { it }),
+            fullName = "profile",
+            description = "Spec profile (default: all)",
+        ).multiple()
+        val cycles by option(ArgType.Int, shortName = "n", fullName = "cycles", description = "Cycles per profile").default(50)
+        val concurrency by option(ArgType.Int, shortName = "c", fullName = "concurrency", description = "Cycles in flight")
+            .default(1)
+        val mounts by option(ArgType.Int, fullName = "mounts", description = "tmpfs mounts of the mounts profile").default(64)
+        val command by option(ArgType.String, fullName = "command", description = "Container process, split on spaces")
+            .default("sleep 3600")
+        val trace by option(ArgType.Boolean, fullName = "trace", description = "Collect the runtime's trace spans")
+            .default(false)
+        val root by option(ArgType.String, fullName = "root", description = "State root for the containers")
+            .default("/run/kontainer-bench")
+        val workDir by option(ArgType.String, fullName = "work-dir", description = "Scratch directory for bundles and logs")
+            .default("/tmp/kontainer-bench-${getpid()}")
+
+        override fun execute() {
+            val runtimePath = runtime ?: getenv(RUNTIME_ENV)?.toKString()
+            if (runtimePath == null) {
+                Logger.error("no runtime binary: pass --runtime or set $RUNTIME_ENV")
+                exit(1)
+                return
+            }
+            if (cycles < 1 || concurrency < 1) {
+                Logger.error("--cycles and --concurrency must be at least 1")
+                exit(1)
+            }
+            if (trace) setenv(Tracer.TRACE_ENV, "1", 1)
+            val options =
+                LifecycleOptions(
+                    runtime = runtimePath,
+                    root = root,
+                    workDir = workDir,
+                    rootfs = rootfs,
+                    args = command.split(' ').filter { it.isNotEmpty() },
+                    cycles = cycles,
+                    concurrency = concurrency,
+                    mountCount = mounts,
+                    trace = trace,
+                )
+            var failed = false
+            try {
+                for (label in profiles.ifEmpty { Profile.entries.map { it.label } }) {
+                    val result = runLifecycle(options, Profile.fromLabel(label))
+                    val title = "${result.profile.label}: $cycles cycles, concurrency $concurrency"
+                    print(formatLatencyTable("$title, latency", result.phases.all))
+                    if (!result.spans.isEmpty()) print(formatLatencyTable("$title, trace spans", result.spans.all))
+                    print(formatRssTable("$title, peak RSS", result.rss.all))
+                    if (result.failures > 0) {
+                        println("${result.failures} cycles failed, see $workDir/runtime.log")
+                        failed = true
+                    }
+                    println()
+                }
+            } finally {
+                if (!failed) removeTree(workDir)
+            }
+            if (failed) exit(1)
+        }
+    }
+
+    parser.subcommands(MicroCommand(), LifecycleCommand())
+
+    if (args.isEmpty()) {
+        println("Usage: kontainer-bench <command> [options]")
+        println()
+        println("Commands:")
+        println("  micro [--iterations|-n <count>] [--warmup <count>] [--filter <name>]   Time hot paths in-process")
+        println("  lifecycle --rootfs <path> [--profile <minimal|seccomp|userns|mounts>]... [--cycles|-n <count>]")
+        println("            [--concurrency|-c <count>] [--mounts <count>] [--trace]     Time create/start/kill/delete")
+        exit(1)
+    }
+
+    try {
+        parser.parse(args)
+    } catch (e: Exception) {
+        Logger.error(e.message ?: "unknown error")
+        exit(1)
+    }
+}
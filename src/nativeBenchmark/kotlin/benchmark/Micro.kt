@@ -0,0 +1,211 @@
+package benchmark
+
+import cgroup.CgroupV2
+import kotlinx.cinterop.*
+import libseccomp.seccomp_release
+import platform.posix.*
+import process.buildIdMapping
+import seccomp.buildSeccompFilter
+import seccomp.compileSeccompBpf
+import spec.LinuxCpu
+import spec.LinuxIdMapping
+import spec.LinuxMemory
+import spec.LinuxPids
+import spec.LinuxResources
+import spec.loadSpec
+import spec.loadSpecCached
+import spec.loadSpecHooks
+import utils.DirectoryHandle
+import utils.FileSystem
+import utils.JsonCodec
+import utils.RealFileSystem
+
+/** cgroupfs path the runtime uses; [TmpfsCgroupFileSystem] maps it elsewhere */
+private const val CGROUP_ROOT = "/sys/fs/cgroup"
+
+/**
+ * Microbenchmarks of the runtime's hot paths, run in this process
+ *
+ * Each one runs [warmup] untimed iterations and then [iterations] timed
+ * ones.
+ *
+ * Loading a seccomp filter cannot be repeated in one process (filters only
+ * stack up), so `initializeSeccomp` is measured as its two halves that can:
+ * building the libseccomp filter, and fetching the compiled program from the
+ * BPF cache.
+ *
+ * @param workDir Scratch directory, preferably on tmpfs; removed afterwards
+ * @param filter Only run benchmarks whose name contains this
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun runMicroBenchmarks(
+    workDir: String,
+    iterations: Int,
+    warmup: Int,
+    filter: String?,
+): SampleSet {
+    val fs = RealFileSystem()
+    val results = SampleSet()
+    fs.createDirectories(workDir)
+
+    fun bench(
+        name: String,
+        block: (Int) -> Unit,
+    ) {
+        if (filter != null && !name.contains(filter)) return
+        repeat(warmup) { block(it) }
+        for (i in warmup until warmup + iterations) {
+            val start = monotonicNanos()
+            block(i)
+            results.add(name, monotonicNanos() - start)
+        }
+    }
+
+    try {
+        for (profile in listOf(Profile.SECCOMP, Profile.MOUNTS)) {
+            val path = "$workDir/config-${profile.label}.json"
+            fs.writeTextFile(path, JsonCodec.encode(benchmarkSpec(profile, "/", listOf("/bin/true")), prettyPrint = true))
+            bench("loadSpec.${profile.label}") { loadSpec(fs, path) }
+            // The first warmup call stores the entry the rest hit
+            bench("loadSpecCached.${profile.label}") { loadSpecCached(workDir, path) }
+            bench("loadSpecHooks.${profile.label}") { loadSpecHooks(workDir, path) }
+        }
+
+        val seccomp = defaultSeccompProfile()
+        bench("seccomp.buildFilter") { seccomp_release(buildSeccompFilter(seccomp)) }
+        val seccompRoot = "$workDir/seccomp-root"
+        fs.createDirectories(seccompRoot)
+        compileSeccompBpf(seccomp, seccompRoot) ?: throw Exception("seccomp profile could not be compiled")
+        bench("seccomp.cachedBpf") { compileSeccompBpf(seccomp, seccompRoot) }
+
+        val cgroupFs = TmpfsCgroupFileSystem("$workDir/cgroup", fs)
+        val cgroup = CgroupV2(cgroupFs)
+        val resources =
+            LinuxResources(
+                memory = LinuxMemory(limit = 512L shl 20, reservation = 256L shl 20),
+                cpu = LinuxCpu(shares = 1024, quota = 50000, period = 100000),
+                pids = LinuxPids(limit = 1024),
+            )
+        bench("CgroupV2.setup") { i -> cgroup.setup(getpid(), "kontainer-runtime/bench-$i", resources) }
+
+        val mappings = List(5) { LinuxIdMapping(containerID = it * 65536u, hostID = 100000u + it * 65536u, size = 65536u) }
+        bench("buildIdMapping") { buildIdMapping(mappings, 0u) }
+    } finally {
+        removeTree(workDir)
+    }
+    return results
+}
+
+/**
+ * [FileSystem] that puts the cgroup hierarchy in a plain directory
+ *
+ * Paths under /sys/fs/cgroup are moved to [root]; everything else goes to
+ * [delegate] unchanged. Interface files are created on first write, since a
+ * tmpfs directory has none. The root starts with every controller listed in
+ * cgroup.controllers and none in cgroup.subtree_control, so the first setup
+ * also pays for enabling them.
+ */
+private class TmpfsCgroupFileSystem(
+    private val root: String,
+    private val delegate: FileSystem,
+) : FileSystem by delegate {
+    init {
+        delegate.createDirectories(root)
+        delegate.writeTextFile("$root/cgroup.controllers", "cpuset cpu io memory hugetlb pids\n")
+        delegate.writeTextFile("$root/cgroup.subtree_control", "")
+    }
+
+    private fun map(path: String): String =
+        if (path == CGROUP_ROOT || path.startsWith("$CGROUP_ROOT/")) root + path.removePrefix(CGROUP_ROOT) else path
+
+    override fun writeTextFile(
+        path: String,
+        content: String,
+    ) = delegate.writeTextFile(map(path), content)
+
+    override fun readTextFile(path: String): String = delegate.readTextFile(map(path))
+
+    override fun readProcFile(path: String): String = delegate.readProcFile(map(path))
+
+    override fun createDirectories(
+        path: String,
+        mode: UInt,
+    ) = delegate.createDirectories(map(path), mode)
+
+    override fun fileExists(path: String): Boolean = delegate.fileExists(map(path))
+
+    override fun removeDirectory(path: String): Boolean = delegate.removeDirectory(map(path))
+
+    override fun openDirectory(path: String): DirectoryHandle = TmpfsDirectoryHandle(map(path))
+}
+
+@OptIn(ExperimentalForeignApi::class)
+private class TmpfsDirectoryHandle(
+    override val path: String,
+) : DirectoryHandle {
+    private val fd = open(path, O_RDONLY or O_DIRECTORY or O_CLOEXEC)
+
+    init {
+        if (fd < 0) throw Exception("Failed to open directory $path (errno=$errno)")
+    }
+
+    override fun writeFile(
+        name: String,
+        content: String,
+    ) {
+        val file = openat(fd, name, O_WRONLY or O_CREAT or O_TRUNC or O_CLOEXEC, 0x1A4u) // 0o644
+        if (file < 0) throw Exception("Failed to open $path/$name (errno=$errno)")
+        try {
+            val bytes = content.encodeToByteArray()
+            val written = if (bytes.isEmpty()) 0L else bytes.usePinned { write(file, it.addressOf(0), bytes.size.convert()) }
+            if (written != bytes.size.toLong()) throw Exception("Failed to write $path/$name (errno=$errno)")
+        } finally {
+            platform.posix.close(file)
+        }
+    }
+
+    override fun readFile(name: String): String {
+        val file = openat(fd, name, O_RDONLY or O_CLOEXEC)
+        if (file < 0) throw Exception("Failed to open $path/$name (errno=$errno)")
+        try {
+            val buf = ByteArray(4096)
+            val n = buf.usePinned { read(file, it.addressOf(0), buf.size.convert()) }
+            if (n < 0) throw Exception("Failed to read $path/$name (errno=$errno)")
+            return buf.decodeToString(0, n.toInt())
+        } finally {
+            platform.posix.close(file)
+        }
+    }
+
+    override fun close() {
+        platform.posix.close(fd)
+    }
+}
+
+/**
+ * rm -r [path]; errors are ignored
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun removeTree(path: String) {
+    memScoped {
+        val st = alloc<stat>()
+        if (lstat(path, st.ptr) != 0) return
+        if ((st.st_mode.toInt() and S_IFMT) == S_IFDIR) {
+            val dir = opendir(path) ?: return
+            val names = mutableListOf<String>()
+            try {
+                while (true) {
+                    val entry = readdir(dir) ?: break
+                    val name = entry.pointed.d_name.toKString()
+                    if (name != "." && name != "..") names += name
+                }
+            } finally {
+                closedir(dir)
+            }
+            names.forEach { removeTree("$path/$it") }
+            rmdir(path)
+        } else {
+            unlink(path)
+        }
+    }
+}
@@ -0,0 +1,133 @@
+package benchmark
+
+import spec.Linux
+import spec.LinuxIdMapping
+import spec.LinuxSeccomp
+import spec.LinuxSyscall
+import spec.Mount
+import spec.Namespace
+import spec.Process
+import spec.Root
+import spec.Spec
+
+/**
+ * Spec profiles the benchmarks run with
+ *
+ * - [MINIMAL]: pid/mount/ipc/uts/network namespaces, the standard mounts,
+ *   nothing else
+ * - [SECCOMP]: [MINIMAL] plus an allowlist profile the size of the
+ *   container engines' default one
+ * - [USERNS]: [MINIMAL] plus a user namespace mapping 65536 IDs
+ * - [MOUNTS]: [MINIMAL] plus many tmpfs mounts
+ */
+enum class Profile(
+    val label: String,
+) {
+    MINIMAL("minimal"),
+    SECCOMP("seccomp"),
+    USERNS("userns"),
+    MOUNTS("mounts"),
+    ;
+
+    companion object {
+        fun fromLabel(label: String): Profile =
+            entries.firstOrNull { it.label == label }
+                ?: throw Exception("unknown profile '$label' (one of ${entries.joinToString { it.label }})")
+    }
+}
+
+/** Syscalls allowed by [defaultSeccompProfile]; everything else gets EPERM */
+private val allowedSyscalls =
+    """
+    accept accept4 access adjtimex alarm arch_prctl bind brk capget capset chdir chmod chown
+    clock_adjtime clock_getres clock_gettime clock_nanosleep clone clone3 close close_range connect
+    copy_file_range creat dup dup2 dup3 epoll_create epoll_create1 epoll_ctl epoll_pwait epoll_pwait2
+    epoll_wait eventfd eventfd2 execve execveat exit exit_group faccessat faccessat2 fadvise64
+    fallocate fanotify_mark fchdir fchmod fchmodat fchown fchownat fcntl fdatasync fgetxattr
+    flistxattr flock fork fremovexattr fsetxattr fstat fstatfs fsync ftruncate futex futex_waitv
+    futimesat getcpu getcwd getdents getdents64 getegid geteuid getgid getgroups getitimer
+    getpeername getpgid getpgrp getpid getppid getpriority getrandom getresgid getresuid getrlimit
+    get_robust_list getrusage getsid getsockname getsockopt get_thread_area gettid gettimeofday
+    getuid getxattr inotify_add_watch inotify_init inotify_init1 inotify_rm_watch io_cancel ioctl
+    io_destroy io_getevents io_pgetevents ioprio_get ioprio_set io_setup io_submit kill lchown
+    lgetxattr link linkat listen listxattr llistxattr lremovexattr lseek lsetxattr lstat madvise
+    membarrier memfd_create mincore mkdir mkdirat mknod mknodat mlock mlock2 mlockall mmap mprotect
+    mq_getsetattr mq_notify mq_open mq_timedreceive mq_timedsend mq_unlink mremap msgctl msgget
+    msgrcv msgsnd msync munlock munlockall munmap name_to_handle_at nanosleep newfstatat open openat
+    openat2 pause pidfd_open pidfd_send_signal pipe pipe2 poll ppoll prctl pread64 preadv preadv2
+    prlimit64 pselect6 pwrite64 pwritev pwritev2 read readahead readlink readlinkat readv recvfrom
+    recvmmsg recvmsg remap_file_pages removexattr rename renameat renameat2 restart_syscall rmdir
+    rseq rt_sigaction rt_sigpending rt_sigprocmask rt_sigqueueinfo rt_sigreturn rt_sigsuspend
+    rt_sigtimedwait rt_tgsigqueueinfo sched_getaffinity sched_getattr sched_getparam
+    sched_get_priority_max sched_get_priority_min sched_getscheduler sched_rr_get_interval
+    sched_setaffinity sched_setattr sched_setparam sched_setscheduler sched_yield seccomp select
+    semctl semget semop semtimedop sendfile sendmmsg sendmsg sendto setfsgid setfsuid setgid
+    setgroups setitimer setpgid setpriority setregid setresgid setresuid setreuid setrlimit
+    set_robust_list setsid setsockopt set_thread_area set_tid_address setuid setxattr shmat shmctl
+    shmdt shmget shutdown sigaltstack signalfd signalfd4 socket socketpair splice stat statfs statx
+    symlink symlinkat sync sync_file_range syncfs sysinfo tee tgkill time timer_create timer_delete
+    timer_getoverrun timer_gettime timer_settime timerfd_create timerfd_gettime timerfd_settime
+    times tkill truncate umask uname unlink unlinkat utime utimensat utimes vfork vmsplice wait4
+    waitid write writev
+    """.trimIndent().split(Regex("\\s+")).filter { it.isNotEmpty() }
+
+/**
+ * An allowlist profile shaped like the default one of Docker and containerd:
+ * EPERM by default, a few hundred syscalls allowed
+ */
+fun defaultSeccompProfile(): LinuxSeccomp =
+    LinuxSeccomp(
+        defaultAction = "SCMP_ACT_ERRNO",
+        defaultErrnoRet = 1u, // EPERM
+        architectures = listOf("SCMP_ARCH_X86_64", "SCMP_ARCH_X86", "SCMP_ARCH_X32"),
+        syscalls = listOf(LinuxSyscall(names = allowedSyscalls, action = "SCMP_ACT_ALLOW")),
+    )
+
+/**
+ * The spec of [profile] for a container running [args] in [rootfs]
+ *
+ * The rootfs is read-only so concurrent containers can share it. No
+ * cgroupsPath is set, so each container gets one named after its ID.
+ *
+ * @param mountCount Number of tmpfs mounts for [Profile.MOUNTS]
+ */
+fun benchmarkSpec(
+    profile: Profile,
+    rootfs: String,
+    args: List<String>,
+    mountCount: Int = 64,
+): Spec {
+    val namespaces = listOf("pid", "mount", "ipc", "uts", "network").map { Namespace(it) }
+    val mounts =
+        mutableListOf(
+            Mount("/proc", "proc", "proc"),
+            Mount("/dev", "tmpfs", "tmpfs", listOf("nosuid", "strictatime", "mode=755", "size=65536k")),
+            Mount("/dev/pts", "devpts", "devpts", listOf("nosuid", "noexec", "newinstance", "ptmxmode=0666", "mode=0620")),
+            Mount("/dev/shm", "tmpfs", "shm", listOf("nosuid", "noexec", "nodev", "mode=1777", "size=65536k")),
+            Mount("/sys", "sysfs", "sysfs", listOf("nosuid", "noexec", "nodev", "ro")),
+            Mount("/tmp", "tmpfs", "tmpfs", listOf("nosuid", "nodev", "mode=1777")),
+        )
+    if (profile == Profile.MOUNTS) {
+        for (i in 0 until mountCount) {
+            mounts += Mount("/tmp/bench-$i", "tmpfs", "tmpfs", listOf("nosuid", "nodev", "size=1m"))
+        }
+    }
+    val idMappings = listOf(LinuxIdMapping(containerID = 0u, hostID = 100000u, size = 65536u))
+    val userns = profile == Profile.USERNS
+    return Spec(
+        ociVersion = "1.0.2",
+        root = Root(path = rootfs, readonly = true),
+        process = Process(args = args, env = listOf("PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin")),
+        hostname = "bench",
+        mounts = mounts,
+        linux =
+            Linux(
+                namespaces = if (userns) namespaces + Namespace("user") else namespaces,
+                uidMappings = if (userns) idMappings else null,
+                gidMappings = if (userns) idMappings else null,
+                seccomp = if (profile == Profile.SECCOMP) defaultSeccompProfile() else null,
+                maskedPaths = listOf("/proc/kcore", "/proc/keys", "/proc/timer_list", "/sys/firmware"),
+                readonlyPaths = listOf("/proc/bus", "/proc/fs", "/proc/irq", "/proc/sys", "/proc/sysrq-trigger"),
+            ),
+    )
+}
@@ -0,0 +1,108 @@
+package benchmark
+
+import kotlinx.cinterop.*
+import platform.posix.*
+
+/**
+ * Samples of one measured quantity (nanoseconds or KiB)
+ */
+class Samples(
+    val name: String,
+) {
+    private val values = ArrayList<Long>()
+
+    val count: Int get() = values.size
+
+    fun add(value: Long) {
+        values.add(value)
+    }
+
+    /**
+     * Nearest-rank percentile, [p] in 0..100
+     */
+    fun percentile(p: Int): Long {
+        if (values.isEmpty()) return 0
+        val sorted = values.sorted()
+        val rank = (p * sorted.size + 99) / 100
+        return sorted[(rank - 1).coerceIn(0, sorted.size - 1)]
+    }
+
+    fun max(): Long = values.maxOrNull() ?: 0
+
+    fun mean(): Long = if (values.isEmpty()) 0 else values.sum() / values.size
+}
+
+/**
+ * Samples by name, in first-seen order
+ */
+class SampleSet {
+    private val byName = LinkedHashMap<String, Samples>()
+
+    fun add(
+        name: String,
+        value: Long,
+    ) {
+        byName.getOrPut(name) { Samples(name) }.add(value)
+    }
+
+    val all: Collection<Samples> get() = byName.values
+
+    fun isEmpty(): Boolean = byName.isEmpty()
+}
+
+/**
+ * CLOCK_MONOTONIC in nanoseconds (same clock as the runtime's trace spans)
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun monotonicNanos(): Long =
+    memScoped {
+        val ts = alloc<timespec>()
+        clock_gettime(CLOCK_MONOTONIC, ts.ptr)
+        ts.tv_sec * 1_000_000_000L + ts.tv_nsec
+    }
+
+/**
+ * Table of latency samples: count, p50, p99, max and mean in microseconds
+ */
+fun formatLatencyTable(
+    title: String,
+    samples: Collection<Samples>,
+): String = formatTable(title, "us", samples) { it / 1000.0 }
+
+/**
+ * Table of peak RSS samples in KiB
+ */
+fun formatRssTable(
+    title: String,
+    samples: Collection<Samples>,
+): String = formatTable(title, "KiB", samples) { it.toDouble() }
+
+private fun formatTable(
+    title: String,
+    unit: String,
+    samples: Collection<Samples>,
+    scale: (Long) -> Double,
+): String {
+    val nameWidth = maxOf(samples.maxOfOrNull { it.name.length } ?: 0, 4)
+    val out = StringBuilder()
+    out.append(title).append('\n')
+    out.append("NAME".padEnd(nameWidth))
+    for (column in listOf("N", "P50", "P99", "MAX", "MEAN")) {
+        out.append("  ").append((if (column == "N") column else "$column($unit)").padStart(12))
+    }
+    out.append('\n')
+    for (s in samples) {
+        out.append(s.name.padEnd(nameWidth))
+        out.append("  ").append(s.count.toString().padStart(12))
+        for (value in listOf(s.percentile(50), s.percentile(99), s.max(), s.mean())) {
+            out.append("  ").append(formatNumber(scale(value)).padStart(12))
+        }
+        out.append('\n')
+    }
+    return out.toString()
+}
+
+private fun formatNumber(value: Double): String {
+    val hundredths = (value * 100).toLong()
+    return "${hundredths / 100}.${(hundredths % 100).toString().padStart(2, '0')}"
+}
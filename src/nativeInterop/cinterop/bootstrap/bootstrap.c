@@ -5,12 +5,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <spawn.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
 #include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
 #include <sched.h>
 #include <sys/syscall.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
 
 // Clone flags (in case not defined)
 #ifndef CLONE_NEWUSER
@@ -38,116 +43,426 @@
 // Environment variable names
 #define ENV_IS_BOOTSTRAP "_KONTAINER_IS_BOOTSTRAP"
 #define ENV_SYNCPIPE "_KONTAINER_SYNCPIPE"
-#define ENV_CLONE_FLAGS "_KONTAINER_CLONE_FLAGS"
-// One env var per namespace whose spec entry includes a path:
-//   _KONTAINER_NS_PATH_MOUNT, _NS_PATH_NETWORK, _NS_PATH_UTS, _NS_PATH_IPC,
-//   _NS_PATH_PID, _NS_PATH_USER, _NS_PATH_CGROUP
-#define ENV_NS_PATH_PREFIX "_KONTAINER_NS_PATH_"
+#define ENV_PARK "_KONTAINER_PARK" /* read by parkwait.c */
 
 #ifndef CLONE_NEWCGROUP
 #define CLONE_NEWCGROUP 0x02000000
 #endif
 
-/**
- * If env var `_KONTAINER_NS_PATH_<name>` is set, open that path and setns(2)
- * into it. Called for each namespace type before the unshare loop so that
- * pid-ns joining (which the kernel forbids post-fork) and mount-ns joining
- * (which requires a single-threaded process — bootstrap.c is single-threaded;
- * the Kotlin runtime is not) both work.
+/*
+ * Span tracer. Spans are buffered in a small static array and appended to the
+ * trace fd as JSON lines (same format as Tracer.kt) with one write(2) per
+ * stage, so stage-1 and stage-2 never interleave partial records.
  */
-static void maybe_setns_by_path(const char *name, int nstype) {
-    char env_name[64];
-    snprintf(env_name, sizeof(env_name), "%s%s", ENV_NS_PATH_PREFIX, name);
-    const char *path = getenv(env_name);
-    if (!path || !*path) return;
-    int fd = open(path, O_RDONLY);
-    if (fd < 0) {
-        fprintf(stderr, "[stage-1] failed to open %s namespace path %s: %s\n",
-                name, path, strerror(errno));
-        exit(1);
+#define TRACE_MAX_SPANS 24
+
+struct trace_span {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+static int trace_fd = -1;
+static int trace_span_count = 0;
+static struct trace_span trace_spans[TRACE_MAX_SPANS];
+static uint64_t trace_handoff_ns = 0;
+
+static uint64_t trace_now(void) {
+    struct timespec ts;
+    if (trace_fd < 0) return 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/** Record a span that started at `start_ns` and ends now. */
+static void trace_span(const char *name, uint64_t start_ns) {
+    if (trace_fd < 0 || start_ns == 0 || trace_span_count >= TRACE_MAX_SPANS) return;
+    trace_spans[trace_span_count].name = name;
+    trace_spans[trace_span_count].start_ns = start_ns;
+    trace_spans[trace_span_count].end_ns = trace_now();
+    trace_span_count++;
+}
+
+/** Append the buffered spans for `stage` to the trace fd and clear them. */
+static void trace_flush(const char *stage) {
+    char buf[TRACE_MAX_SPANS * 160];
+    size_t len = 0;
+    int i;
+
+    if (trace_fd < 0 || trace_span_count == 0) return;
+    for (i = 0; i < trace_span_count; i++) {
+        int n = snprintf(buf + len, sizeof(buf) - len,
+                         "{\"stage\":\"%s\",\"name\":\"%s\",\"start_ns\":%llu,"
+                         "\"end_ns\":%llu,\"duration_ns\":%llu}\n",
+                         stage, trace_spans[i].name,
+                         (unsigned long long)trace_spans[i].start_ns,
+                         (unsigned long long)trace_spans[i].end_ns,
+                         (unsigned long long)(trace_spans[i].end_ns - trace_spans[i].start_ns));
+        if (n < 0 || (size_t)n >= sizeof(buf) - len) break;
+        len += (size_t)n;
     }
-    if (setns(fd, nstype) != 0) {
-        fprintf(stderr, "[stage-1] setns(%s, %s) failed: %s\n",
-                path, name, strerror(errno));
-        close(fd);
-        exit(1);
+    trace_span_count = 0;
+    if (write(trace_fd, buf, len) < 0) {
+        fprintf(stderr, "[%s] Failed to write trace spans: %s\n", stage, strerror(errno));
     }
-    close(fd);
-    fprintf(stderr, "[stage-1] joined %s namespace at %s\n", name, path);
 }
 
-// Global state
-static int is_init_process = 0;
+/*
+ * Frame I/O (see struct kontainer_frame in bootstrap.h)
+ *
+ * One frame per SOCK_SEQPACKET packet, so a single sendmsg/recvmsg moves a
+ * whole frame and there are no partial reads to resume.
+ */
+#define FRAME_MAX_FDS 16
+#define FRAME_EOF (-2)
 
-// Synchronization protocol
-enum sync_t {
-    SYNC_USERMAP_PLS = 0x40,    /* Request UID/GID mapping */
-    SYNC_USERMAP_ACK = 0x41,    /* Mapping is complete */
-    SYNC_GRANDCHILD = 0x44,     /* Stage-2 is ready to run */
-    SYNC_CHILD_FINISH = 0x45,   /* Stage-2 has finished setup */
-};
+static int send_frame(int fd, uint32_t type, const void *payload, uint32_t len,
+                      const int *fds, int nfds) {
+    struct kontainer_frame hdr = { .type = type, .len = len };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * FRAME_MAX_FDS)];
+        struct cmsghdr align;
+    } cmsg_buf;
+    struct iovec iov[2] = {
+        { .iov_base = &hdr, .iov_len = sizeof(hdr) },
+        { .iov_base = (void *)payload, .iov_len = len },
+    };
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    if (nfds < 0 || nfds > FRAME_MAX_FDS || len > KONTAINER_FRAME_MAX_PAYLOAD) {
+        errno = EINVAL;
+        return -1;
+    }
+    msg.msg_iov = iov;
+    msg.msg_iovlen = len ? 2 : 1;
+    if (nfds > 0) {
+        memset(&cmsg_buf, 0, sizeof(cmsg_buf));
+        msg.msg_control = cmsg_buf.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)nfds);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)nfds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * (size_t)nfds);
+    }
+    do {
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n < 0 ? -1 : 0;
+}
 
 /**
- * Get integer value from environment variable
- * Returns -1 if not found or invalid
+ * Receive one frame with at most `max` payload bytes into `buf`. With `fds`
+ * set, up to FRAME_MAX_FDS attached fds are stored there and counted in
+ * `nfds`; otherwise a frame carrying fds is an error.
+ * Returns the payload length, FRAME_EOF if the peer closed the socket, or -1
+ * (errno set; EPROTO for an oversized or malformed frame).
  */
-static int getenv_int(const char *name) {
-    char *val = getenv(name);
-    if (!val) {
+static ssize_t recv_frame(int fd, uint32_t *type, void *buf, size_t max, int *fds, int *nfds) {
+    struct kontainer_frame hdr;
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * FRAME_MAX_FDS)];
+        struct cmsghdr align;
+    } cmsg_buf;
+    struct iovec iov[2] = {
+        { .iov_base = &hdr, .iov_len = sizeof(hdr) },
+        { .iov_base = buf, .iov_len = max },
+    };
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    msg.msg_iov = iov;
+    msg.msg_iovlen = max ? 2 : 1;
+    if (fds) {
+        msg.msg_control = cmsg_buf.buf;
+        msg.msg_controllen = sizeof(cmsg_buf.buf);
+        *nfds = 0;
+    }
+    do {
+        n = recvmsg(fd, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n == 0) return FRAME_EOF;
+    if (n < 0) return -1;
+    if ((size_t)n < sizeof(hdr) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ||
+        hdr.len != (size_t)n - sizeof(hdr)) {
+        errno = EPROTO;
         return -1;
     }
-    return atoi(val);
+    if (fds) {
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                *nfds = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+                memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * (size_t)*nfds);
+            }
+        }
+    }
+    *type = hdr.type;
+    return (ssize_t)hdr.len;
 }
 
-/**
- * Parse hexadecimal string to unsigned int
- * Supports both "0x" prefix and plain hex strings
- * Returns 0 on NULL or invalid input
+/** Send a sync frame whose payload is `count` int32 values. */
+static int send_sync(int fd, uint32_t type, const int32_t *values, uint32_t count) {
+    return send_frame(fd, type, values, count * (uint32_t)sizeof(int32_t), NULL, 0);
+}
+
+/** Receive a sync frame of `type` carrying exactly `count` int32 values. */
+static int recv_sync(int fd, uint32_t type, int32_t *values, uint32_t count) {
+    uint32_t got;
+    ssize_t n = recv_frame(fd, &got, values, count * sizeof(int32_t), NULL, NULL);
+    if (n == FRAME_EOF) errno = EPIPE;
+    if (n < 0) return -1;
+    if (got != type || (size_t)n != count * sizeof(int32_t)) {
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Bootstrap config message (main -> stage-1 -> stage-2)
+ *
+ * A versioned, netlink-style attribute list written once by Create.kt (see
+ * process/BootstrapConfig.kt for the layout). Stage-1 reads the attributes it
+ * needs directly from the buffer; stage-2 inherits the buffer through
+ * clone(2) and the Kotlin side decodes the rest via
+ * kontainer_bootstrap_config().
  */
-static unsigned int parse_hex(const char *str) {
-    unsigned int result = 0;
+#define BOOTSTRAP_MAX_LEN (16U << 20)
+#define BOOTSTRAP_ALIGN(len) (((len) + 3U) & ~3U)
 
-    if (!str) {
-        return 0;
+struct bootstrap_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t total_len;
+};
+
+struct bootstrap_attr {
+    uint32_t len; /* header + payload, without padding */
+    uint32_t type;
+};
+
+static char *bootstrap_config = NULL;
+static uint32_t bootstrap_config_len = 0;
+
+/** Attribute starting at `offset`, or NULL past the end of the message. */
+static struct bootstrap_attr *config_attr_at(size_t offset) {
+    struct bootstrap_attr *attr;
+    if (offset + sizeof(*attr) > bootstrap_config_len) return NULL;
+    attr = (struct bootstrap_attr *)(bootstrap_config + offset);
+    if (attr->len < sizeof(*attr) || offset + attr->len > bootstrap_config_len) return NULL;
+    return attr;
+}
+
+static struct bootstrap_attr *config_attr_next(struct bootstrap_attr *attr) {
+    return config_attr_at((size_t)((char *)attr - bootstrap_config) + BOOTSTRAP_ALIGN(attr->len));
+}
+
+#define for_each_config_attr(attr) \
+    for (attr = config_attr_at(sizeof(struct bootstrap_hdr)); attr; attr = config_attr_next(attr))
+
+static void *config_attr_data(struct bootstrap_attr *attr) {
+    return (char *)attr + sizeof(*attr);
+}
+
+static uint32_t config_attr_payload_len(struct bootstrap_attr *attr) {
+    return attr->len - (uint32_t)sizeof(*attr);
+}
+
+/** First 32-bit word of the first attribute of `type`, or `fallback`. */
+static uint32_t config_u32(uint32_t type, uint32_t fallback) {
+    struct bootstrap_attr *attr;
+    for_each_config_attr(attr) {
+        if (attr->type == type && config_attr_payload_len(attr) >= 4) {
+            return *(uint32_t *)config_attr_data(attr);
+        }
     }
+    return fallback;
+}
 
-    // Skip "0x" or "0X" prefix if present
-    if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
-        str += 2;
+/** FD for `role` from the KONTAINER_BOOTSTRAP_ATTR_FD attributes, or -1. */
+static int config_fd(uint32_t role) {
+    struct bootstrap_attr *attr;
+    for_each_config_attr(attr) {
+        uint32_t *data = config_attr_data(attr);
+        if (attr->type == KONTAINER_BOOTSTRAP_ATTR_FD && config_attr_payload_len(attr) >= 8 &&
+            data[0] == role) {
+            return (int)data[1];
+        }
     }
+    return -1;
+}
 
-    while (*str) {
-        char c = *str;
-        unsigned int digit;
+/** First frame of the config, which holds its header */
+static char config_first_frame[KONTAINER_FRAME_MAX_PAYLOAD];
+
+/**
+ * Receive the config frames from `fd` and validate the message. With `fds`
+ * set, the fds attached to the first frame are stored there (see
+ * recv_frame). Exits on any error: without a config there is nothing
+ * stage-1 can do.
+ * Returns 0, or FRAME_EOF if the socket was closed before the first frame.
+ */
+static int recv_bootstrap_config(int fd, const char *stage, int *fds, int *nfds) {
+    struct bootstrap_hdr hdr;
+    struct bootstrap_attr *attr;
+    uint32_t type;
+    size_t end = sizeof(hdr);
+    size_t off;
+    ssize_t n;
+
+    n = recv_frame(fd, &type, config_first_frame, sizeof(config_first_frame), fds, nfds);
+    if (n == FRAME_EOF) return FRAME_EOF;
+    if (n < 0 || type != KONTAINER_FRAME_CONFIG || (size_t)n < sizeof(hdr)) {
+        fprintf(stderr, "[%s] Failed to receive bootstrap config: %s\n", stage,
+                n < 0 ? strerror(errno) : "unexpected frame");
+        exit(1);
+    }
+    memcpy(&hdr, config_first_frame, sizeof(hdr));
+    if (hdr.magic != KONTAINER_BOOTSTRAP_MAGIC || hdr.version != KONTAINER_BOOTSTRAP_VERSION ||
+        hdr.total_len < (size_t)n || hdr.total_len > BOOTSTRAP_MAX_LEN) {
+        fprintf(stderr, "[%s] Invalid bootstrap config header\n", stage);
+        exit(1);
+    }
+    bootstrap_config = malloc(hdr.total_len);
+    if (!bootstrap_config) {
+        fprintf(stderr, "[%s] Failed to allocate bootstrap config\n", stage);
+        exit(1);
+    }
+    memcpy(bootstrap_config, config_first_frame, (size_t)n);
+    // A frame larger than what is left fails with EPROTO (MSG_TRUNC)
+    for (off = (size_t)n; off < hdr.total_len; off += (size_t)n) {
+        n = recv_frame(fd, &type, bootstrap_config + off, hdr.total_len - off, NULL, NULL);
+        if (n <= 0 || type != KONTAINER_FRAME_CONFIG) {
+            fprintf(stderr, "[%s] Failed to read bootstrap config: %s\n", stage,
+                    n < 0 && n != FRAME_EOF ? strerror(errno) : "unexpected frame");
+            exit(1);
+        }
+    }
+    bootstrap_config_len = hdr.total_len;
 
-        if (c >= '0' && c <= '9') {
-            digit = c - '0';
-        } else if (c >= 'a' && c <= 'f') {
-            digit = c - 'a' + 10;
-        } else if (c >= 'A' && c <= 'F') {
-            digit = c - 'A' + 10;
-        } else {
-            // Invalid character, stop parsing
+    // The attribute list must cover the message exactly, and the string
+    // attributes read here must be NUL-terminated.
+    for_each_config_attr(attr) {
+        if (attr->type == KONTAINER_BOOTSTRAP_ATTR_NS_PATH &&
+            (config_attr_payload_len(attr) < 5 || ((char *)attr)[attr->len - 1] != '\0')) {
             break;
         }
+        end = (size_t)((char *)attr - bootstrap_config) + BOOTSTRAP_ALIGN(attr->len);
+    }
+    if (end < bootstrap_config_len) {
+        fprintf(stderr, "[%s] Malformed bootstrap config attribute at offset %zu\n", stage, end);
+        exit(1);
+    }
+    return 0;
+}
 
-        result = (result << 4) | digit;
-        str++;
+/**
+ * Pick up the trace fd from the config and record the span from the main
+ * process's handoff (exec or spawner message) to now as `span_name`.
+ */
+static void config_trace_setup(const char *span_name) {
+    struct bootstrap_attr *attr;
+    trace_fd = config_fd(KONTAINER_BOOTSTRAP_FD_TRACE);
+    if (trace_fd < 0) return;
+    /* Inherited without FD_CLOEXEC; keep it from the container process and
+     * hooks. kontainer_park() clears the flag for the one exec that needs it. */
+    fcntl(trace_fd, F_SETFD, FD_CLOEXEC);
+    for_each_config_attr(attr) {
+        if (attr->type == KONTAINER_BOOTSTRAP_ATTR_TRACE_START_NS &&
+            config_attr_payload_len(attr) >= 8) {
+            uint64_t start_ns;
+            memcpy(&start_ns, config_attr_data(attr), sizeof(start_ns));
+            trace_span(span_name, start_ns);
+        }
     }
+}
 
-    return result;
+/**
+ * setrlimit(2) each KONTAINER_BOOTSTRAP_ATTR_RLIMIT on stage-1 itself. Done
+ * before unsharing the user namespace (raising a hard limit needs
+ * CAP_SYS_RESOURCE in the initial one) and before stage-2 is cloned, so
+ * stage-2 inherits them. A limit that cannot be set is only reported, as
+ * process.rlimits were when main applied them with prlimit.
+ */
+static void config_apply_rlimits(void) {
+    struct bootstrap_attr *attr;
+    uint64_t t = trace_now();
+    int any = 0;
+
+    for_each_config_attr(attr) {
+        uint32_t resource;
+        uint64_t limits[2];
+        struct rlimit rl;
+
+        if (attr->type != KONTAINER_BOOTSTRAP_ATTR_RLIMIT || config_attr_payload_len(attr) < 20) continue;
+        memcpy(&resource, config_attr_data(attr), sizeof(resource));
+        memcpy(limits, (char *)config_attr_data(attr) + 4, sizeof(limits));
+        rl.rlim_cur = limits[0];
+        rl.rlim_max = limits[1];
+        if (setrlimit((int)resource, &rl) != 0) {
+            fprintf(stderr, "[stage-1] failed to set rlimit %u: %s\n", resource, strerror(errno));
+        }
+        any = 1;
+    }
+    if (any) trace_span("rlimits.apply", t);
 }
 
 /**
- * Get unsigned integer value from environment variable (for hex values)
- * Returns 0 if not found or invalid
+ * If the config has a namespace path for `nstype`, open that path and
+ * setns(2) into it. Called for each namespace type before the unshare loop
+ * so that pid-ns joining (which the kernel forbids post-fork) and mount-ns
+ * joining (which requires a single-threaded process — bootstrap.c is
+ * single-threaded; the Kotlin runtime is not) both work.
  */
-static unsigned int getenv_uint_hex(const char *name) {
+static void maybe_setns_by_path(const char *name, int nstype, const char *span_name) {
+    struct bootstrap_attr *attr;
+    const char *path = NULL;
+    uint64_t t;
+    int fd;
+
+    for_each_config_attr(attr) {
+        uint32_t *data = config_attr_data(attr);
+        if (attr->type == KONTAINER_BOOTSTRAP_ATTR_NS_PATH && data[0] == (uint32_t)nstype) {
+            path = (const char *)(data + 1);
+        }
+    }
+    if (!path || !*path) return;
+    t = trace_now();
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "[stage-1] failed to open %s namespace path %s: %s\n",
+                name, path, strerror(errno));
+        exit(1);
+    }
+    if (setns(fd, nstype) != 0) {
+        fprintf(stderr, "[stage-1] setns(%s, %s) failed: %s\n",
+                path, name, strerror(errno));
+        close(fd);
+        exit(1);
+    }
+    close(fd);
+    trace_span(span_name, t);
+    fprintf(stderr, "[stage-1] joined %s namespace at %s\n", name, path);
+}
+
+// Global state
+static int is_init_process = 0;
+
+
+/**
+ * Get integer value from environment variable
+ * Returns -1 if not found or invalid
+ */
+static int getenv_int(const char *name) {
     char *val = getenv(name);
     if (!val) {
-        return 0;
+        return -1;
     }
-    return parse_hex(val);
+    return atoi(val);
 }
 
 /**
@@ -174,44 +489,95 @@ static pid_t clone_parent(void) {
     return pid;
 }
 
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+/* struct clone_args up to CLONE_ARGS_SIZE_VER2 (Linux 5.7, adds `cgroup`) */
+struct kontainer_clone_args {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+};
+
 /**
- * Bootstrap constructor - called before Kotlin runtime starts
+ * Like clone_parent(), but spawn the child directly in the cgroup opened as
+ * `cgroup_fd` with clone3(CLONE_INTO_CGROUP). That avoids migrating a running
+ * task afterwards, which takes the global cgroup_threadgroup_rwsem.
  *
- * This creates a simplified 2-stage bootstrap process:
- * - Stage-1 (this process): unshare namespaces, clone Stage-2
- * - Stage-2: becomes container init (PID 1)
+ * Falls back to clone_parent() if `cgroup_fd` is -1 or clone3 fails (kernel
+ * older than 5.7, or no permission to write the cgroup's cgroup.procs); the
+ * caller must then move the child itself.
+ *
+ * `in_cgroup` is set to 1 if the child was placed in the cgroup.
+ * Returns: PID of cloned child on success, -1 on error
  */
-__attribute__((constructor))
-void kontainer_bootstrap(void) {
-    int sync_fd;
+static pid_t clone_parent_into_cgroup(int cgroup_fd, int *in_cgroup) {
+    struct kontainer_clone_args args;
+    pid_t pid;
+
+    *in_cgroup = 0;
+    if (cgroup_fd >= 0) {
+        memset(&args, 0, sizeof(args));
+        args.flags = CLONE_PARENT | CLONE_INTO_CGROUP;
+        // clone3 rejects an exit signal with CLONE_PARENT; the child gets
+        // ours (SIGCHLD), same as clone_parent()
+        args.exit_signal = 0;
+        args.cgroup = (uint64_t)cgroup_fd;
+        pid = syscall(SYS_clone3, &args, sizeof(args));
+        if (pid >= 0) {
+            *in_cgroup = 1;
+            return pid;
+        }
+        fprintf(stderr, "[clone_parent] clone3(CLONE_INTO_CGROUP) failed: %s, falling back to clone\n",
+                strerror(errno));
+    }
+    return clone_parent();
+}
+
+/**
+ * Stage-1 body: unshare namespaces, clone Stage-2
+ *
+ * Runs either in a process exec'd as `__init__` (legacy path) or in the
+ * pre-forked spawner once the main process has handed over the bootstrap
+ * environment. Stage-1 always exits here; the function only returns in
+ * Stage-2, which then goes on to start the Kotlin runtime.
+ *
+ * @param sync_fd Socket shared with the Main Process
+ */
+static void run_stage1(int sync_fd) {
     int sync_pipe[2];
     pid_t stage2_pid = -1;
-    enum sync_t s;
+    int32_t placement[2];
     unsigned int clone_flags;
-
-    // Check if bootstrap mode is enabled
-    if (!getenv(ENV_IS_BOOTSTRAP)) {
-        return;
-    }
+    int cgroup_fd;
+    int in_cgroup = 0;
+    uint64_t t;
 
     // This is Stage-1: unshare namespaces and create Stage-2
 
     fprintf(stderr, "[stage-1] Starting namespace setup\n");
 
-    // Get clone flags from environment variable
-    clone_flags = getenv_uint_hex(ENV_CLONE_FLAGS);
+    // Get clone flags from the bootstrap config
+    clone_flags = config_u32(KONTAINER_BOOTSTRAP_ATTR_CLONE_FLAGS, 0);
     fprintf(stderr, "[stage-1] Clone flags: 0x%x\n", clone_flags);
-
-    // Get sync pipe FD from environment variable (passed from Main Process)
-    sync_fd = getenv_int(ENV_SYNCPIPE);
-    if (sync_fd < 0) {
-        fprintf(stderr, "[stage-1] Missing %s environment variable\n", ENV_SYNCPIPE);
-        exit(1);
-    }
     fprintf(stderr, "[stage-1] Using sync FD from Main Process: %d\n", sync_fd);
 
+    config_apply_rlimits();
+
     // Create socketpair for Stage-1 <-> Stage-2 communication
-    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sync_pipe) < 0) {
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sync_pipe) < 0) {
         fprintf(stderr, "[stage-1] Failed to create sync socketpair: %s\n", strerror(errno));
         exit(1);
     }
@@ -219,47 +585,40 @@ void kontainer_bootstrap(void) {
     // Step 1: Unshare user namespace FIRST (if configured)
     if (clone_flags & CLONE_NEWUSER) {
         fprintf(stderr, "[stage-1] Unsharing user namespace (CLONE_NEWUSER)\n");
+        t = trace_now();
         if (unshare(CLONE_NEWUSER) < 0) {
             fprintf(stderr, "[stage-1] Failed to unshare user namespace: %s (errno=%d)\n",
                     strerror(errno), errno);
             exit(1);
         }
+        trace_span("unshare.user", t);
         fprintf(stderr, "[stage-1] Successfully unshared user namespace\n");
 
         // Step 2: Make process dumpable so Main Process can write to uid_map/gid_map
         // See: man 7 user_namespaces
         fprintf(stderr, "[stage-1] Setting dumpable to allow uid/gid mapping\n");
+        t = trace_now();
         if (prctl(PR_SET_DUMPABLE, 1, 0, 0, 0) < 0) {
             fprintf(stderr, "[stage-1] Failed to set dumpable: %s\n", strerror(errno));
             exit(1);
         }
 
-        // Step 3: Request UID/GID mapping from Main Process
-        fprintf(stderr, "[stage-1] Requesting UID/GID mapping from Main Process\n");
-        s = SYNC_USERMAP_PLS;
-        if (write(sync_fd, &s, sizeof(s)) != sizeof(s)) {
+        // Step 3: Request UID/GID mapping from Main Process, with our PID
+        // so it can write to /proc/<pid>/uid_map
+        int32_t my_pid = getpid();
+        fprintf(stderr, "[stage-1] Requesting UID/GID mapping for PID=%d from Main Process\n", my_pid);
+        if (send_sync(sync_fd, KONTAINER_FRAME_USERMAP_PLS, &my_pid, 1) < 0) {
             fprintf(stderr, "[stage-1] Failed to send mapping request: %s\n", strerror(errno));
             exit(1);
         }
 
-        // Send our PID so Main Process can write to /proc/<pid>/uid_map
-        pid_t my_pid = getpid();
-        fprintf(stderr, "[stage-1] Sending my PID=%d to Main Process\n", my_pid);
-        if (write(sync_fd, &my_pid, sizeof(my_pid)) != sizeof(my_pid)) {
-            fprintf(stderr, "[stage-1] Failed to send PID: %s\n", strerror(errno));
-            exit(1);
-        }
-
         // Step 4: Wait for mapping completion from Main Process
         fprintf(stderr, "[stage-1] Waiting for mapping ack from Main Process\n");
-        if (read(sync_fd, &s, sizeof(s)) != sizeof(s)) {
+        if (recv_sync(sync_fd, KONTAINER_FRAME_USERMAP_ACK, NULL, 0) < 0) {
             fprintf(stderr, "[stage-1] Failed to read mapping ack: %s\n", strerror(errno));
             exit(1);
         }
-        if (s != SYNC_USERMAP_ACK) {
-            fprintf(stderr, "[stage-1] Expected SYNC_USERMAP_ACK, got %u\n", s);
-            exit(1);
-        }
+        trace_span("usermap.handshake", t);
         fprintf(stderr, "[stage-1] Received mapping ack from Main Process\n");
 
         // Step 5: Restore non-dumpable state
@@ -288,50 +647,58 @@ void kontainer_bootstrap(void) {
     // joining works only here (kernel forbids it post-fork); mount joining
     // works because bootstrap.c is single-threaded (the Kotlin runtime, which
     // would otherwise be multi-threaded, hasn't started yet).
-    maybe_setns_by_path("MOUNT",   CLONE_NEWNS);
-    maybe_setns_by_path("NETWORK", CLONE_NEWNET);
-    maybe_setns_by_path("UTS",     CLONE_NEWUTS);
-    maybe_setns_by_path("IPC",     CLONE_NEWIPC);
-    maybe_setns_by_path("USER",    CLONE_NEWUSER);
-    maybe_setns_by_path("CGROUP",  CLONE_NEWCGROUP);
-    maybe_setns_by_path("PID",     CLONE_NEWPID);
+    maybe_setns_by_path("MOUNT", CLONE_NEWNS, "setns.mount");
+    maybe_setns_by_path("NETWORK", CLONE_NEWNET, "setns.network");
+    maybe_setns_by_path("UTS", CLONE_NEWUTS, "setns.uts");
+    maybe_setns_by_path("IPC", CLONE_NEWIPC, "setns.ipc");
+    maybe_setns_by_path("USER", CLONE_NEWUSER, "setns.user");
+    maybe_setns_by_path("CGROUP", CLONE_NEWCGROUP, "setns.cgroup");
+    maybe_setns_by_path("PID", CLONE_NEWPID, "setns.pid");
 
     // Step 7: Unshare other namespaces (mount, network, uts, ipc)
     // These must be done AFTER user namespace mapping is complete
     if (clone_flags & CLONE_NEWNS) {
         fprintf(stderr, "[stage-1] Unsharing mount namespace (CLONE_NEWNS)\n");
+        t = trace_now();
         if (unshare(CLONE_NEWNS) < 0) {
             fprintf(stderr, "[stage-1] Failed to unshare mount namespace: %s (errno=%d)\n",
                     strerror(errno), errno);
             exit(1);
         }
+        trace_span("unshare.mount", t);
     }
 
     if (clone_flags & CLONE_NEWNET) {
         fprintf(stderr, "[stage-1] Unsharing network namespace (CLONE_NEWNET)\n");
+        t = trace_now();
         if (unshare(CLONE_NEWNET) < 0) {
             fprintf(stderr, "[stage-1] Failed to unshare network namespace: %s (errno=%d)\n",
                     strerror(errno), errno);
             exit(1);
         }
+        trace_span("unshare.network", t);
     }
 
     if (clone_flags & CLONE_NEWUTS) {
         fprintf(stderr, "[stage-1] Unsharing UTS namespace (CLONE_NEWUTS)\n");
+        t = trace_now();
         if (unshare(CLONE_NEWUTS) < 0) {
             fprintf(stderr, "[stage-1] Failed to unshare UTS namespace: %s (errno=%d)\n",
                     strerror(errno), errno);
             exit(1);
         }
+        trace_span("unshare.uts", t);
     }
 
     if (clone_flags & CLONE_NEWIPC) {
         fprintf(stderr, "[stage-1] Unsharing IPC namespace (CLONE_NEWIPC)\n");
+        t = trace_now();
         if (unshare(CLONE_NEWIPC) < 0) {
             fprintf(stderr, "[stage-1] Failed to unshare IPC namespace: %s (errno=%d)\n",
                     strerror(errno), errno);
             exit(1);
         }
+        trace_span("unshare.ipc", t);
     }
 
     // Step 8: Unshare PID namespace LAST
@@ -339,31 +706,28 @@ void kontainer_bootstrap(void) {
     // Only child processes created AFTER unshare will be in the new PID namespace.
     if (clone_flags & CLONE_NEWPID) {
         fprintf(stderr, "[stage-1] Unsharing PID namespace (CLONE_NEWPID)\n");
+        t = trace_now();
         if (unshare(CLONE_NEWPID) < 0) {
             fprintf(stderr, "[stage-1] Failed to unshare PID namespace: %s (errno=%d)\n",
                     strerror(errno), errno);
             exit(1);
         }
+        trace_span("unshare.pid", t);
     }
 
-    // Older kernel headers may not define CLONE_NEWCGROUP; fall back to the well-known value.
-    #ifndef CLONE_NEWCGROUP
-    #define CLONE_NEWCGROUP 0x02000000
-    #endif
-    if (clone_flags & CLONE_NEWCGROUP) {
-        fprintf(stderr, "[stage-1] Unsharing cgroup namespace (CLONE_NEWCGROUP)\n");
-        if (unshare(CLONE_NEWCGROUP) < 0) {
-            fprintf(stderr, "[stage-1] Failed to unshare cgroup namespace: %s (errno=%d)\n",
-                    strerror(errno), errno);
-            exit(1);
-        }
-    }
+    // The cgroup namespace is unshared by stage-2 instead: its root is the
+    // cgroup of the unsharing process, and only stage-2 is placed in the
+    // container cgroup (see clone_parent_into_cgroup()).
 
     fprintf(stderr, "[stage-1] Successfully unshared all requested namespaces\n");
 
-    // Clone Stage-2 (init process) with CLONE_PARENT
+    // Clone Stage-2 (init process) with CLONE_PARENT, directly into the
+    // container cgroup when the kernel supports it
     fprintf(stderr, "[stage-1] Cloning stage-2 with CLONE_PARENT (init process)\n");
-    stage2_pid = clone_parent();
+    t = trace_now();
+    cgroup_fd = config_fd(KONTAINER_BOOTSTRAP_FD_CGROUP);
+    stage2_pid = clone_parent_into_cgroup(cgroup_fd, &in_cgroup);
+    if (cgroup_fd >= 0) close(cgroup_fd);
 
     if (stage2_pid < 0) {
         fprintf(stderr, "[stage-1] Failed to clone stage-2: %s\n", strerror(errno));
@@ -375,19 +739,33 @@ void kontainer_bootstrap(void) {
         close(sync_pipe[1]); // Close write end, we only read
         close(sync_fd);      // Close sync pipe to Main Process
 
+        // Spans recorded so far belong to stage-1, which flushes them itself
+        trace_span_count = 0;
+        t = trace_now();
+
         fprintf(stderr, "[stage-2] Started, PID=%d\n", getpid());
 
-        // Wait for SYNC_GRANDCHILD signal from Stage-1
-        fprintf(stderr, "[stage-2] Waiting for SYNC_GRANDCHILD from stage-1\n");
-        if (read(sync_pipe[0], &s, sizeof(s)) != sizeof(s)) {
-            fprintf(stderr, "[stage-2] Failed to read SYNC_GRANDCHILD: %s\n", strerror(errno));
+        // Wait for the GRANDCHILD frame from Stage-1
+        fprintf(stderr, "[stage-2] Waiting for GRANDCHILD from stage-1\n");
+        if (recv_sync(sync_pipe[0], KONTAINER_FRAME_GRANDCHILD, NULL, 0) < 0) {
+            fprintf(stderr, "[stage-2] Failed to read GRANDCHILD: %s\n", strerror(errno));
             _exit(1);
         }
-        if (s != SYNC_GRANDCHILD) {
-            fprintf(stderr, "[stage-2] Expected SYNC_GRANDCHILD, got %u\n", s);
-            _exit(1);
+        fprintf(stderr, "[stage-2] Received GRANDCHILD from stage-1\n");
+
+        // Stage-2 is in the container cgroup by now (cloned into it, or moved
+        // by the Main Process before GRANDCHILD), so the new cgroup
+        // namespace is rooted there
+        if (clone_flags & CLONE_NEWCGROUP) {
+            fprintf(stderr, "[stage-2] Unsharing cgroup namespace (CLONE_NEWCGROUP)\n");
+            uint64_t ns_t = trace_now();
+            if (unshare(CLONE_NEWCGROUP) < 0) {
+                fprintf(stderr, "[stage-2] Failed to unshare cgroup namespace: %s (errno=%d)\n",
+                        strerror(errno), errno);
+                _exit(1);
+            }
+            trace_span("unshare.cgroup", ns_t);
         }
-        fprintf(stderr, "[stage-2] Received SYNC_GRANDCHILD from stage-1\n");
 
         // Create new session
         if (setsid() < 0) {
@@ -397,16 +775,19 @@ void kontainer_bootstrap(void) {
         fprintf(stderr, "[stage-2] Created new session\n");
 
         // Signal completion to Stage-1
-        fprintf(stderr, "[stage-2] Sending SYNC_CHILD_FINISH to stage-1\n");
-        s = SYNC_CHILD_FINISH;
-        if (write(sync_pipe[0], &s, sizeof(s)) != sizeof(s)) {
-            fprintf(stderr, "[stage-2] Failed to write SYNC_CHILD_FINISH: %s\n", strerror(errno));
+        fprintf(stderr, "[stage-2] Sending CHILD_FINISH to stage-1\n");
+        if (send_sync(sync_pipe[0], KONTAINER_FRAME_CHILD_FINISH, NULL, 0) < 0) {
+            fprintf(stderr, "[stage-2] Failed to write CHILD_FINISH: %s\n", strerror(errno));
             _exit(1);
         }
 
         // Close sync pipe
         close(sync_pipe[0]);
 
+        trace_span("stage2.sync", t);
+        trace_flush("stage-2");
+        trace_handoff_ns = trace_now();
+
         // Set flag for Kotlin code to check
         is_init_process = 1;
 
@@ -417,51 +798,545 @@ void kontainer_bootstrap(void) {
 
     // Stage-1 continues here (parent)
     close(sync_pipe[0]); // Close read end, we only write
+    trace_span("clone.stage2", t);
+    t = trace_now();
 
     fprintf(stderr, "[stage-1] Forked stage-2, PID=%d\n", stage2_pid);
 
-    // Send Stage-2 PID to Main Process
+    // Send the Stage-2 PID to the Main Process, and whether stage-2 is
+    // already in its cgroup. If not, main moves stage-2 there itself, and
+    // stage-2 must not run (and unshare its cgroup namespace) until that is
+    // done.
     fprintf(stderr, "[stage-1] Sending stage-2 PID to Main Process\n");
-    if (write(sync_fd, &stage2_pid, sizeof(stage2_pid)) != sizeof(stage2_pid)) {
-        fprintf(stderr, "[stage-1] Failed to send stage-2 PID to Main Process\n");
+    placement[0] = stage2_pid;
+    placement[1] = in_cgroup;
+    if (send_sync(sync_fd, KONTAINER_FRAME_STAGE2_PID, placement, 2) < 0) {
+        fprintf(stderr, "[stage-1] Failed to send stage-2 PID to Main Process: %s\n", strerror(errno));
         exit(1);
     }
+    if (!in_cgroup) {
+        fprintf(stderr, "[stage-1] Waiting for cgroup ack from Main Process\n");
+        if (recv_sync(sync_fd, KONTAINER_FRAME_CGROUP_ACK, NULL, 0) < 0) {
+            fprintf(stderr, "[stage-1] Failed to read cgroup ack from Main Process: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
 
     // Sync with Stage-2
     fprintf(stderr, "[stage-1] Syncing with stage-2\n");
 
-    // Send SYNC_GRANDCHILD to Stage-2
-    fprintf(stderr, "[stage-1] Sending SYNC_GRANDCHILD to stage-2\n");
-    s = SYNC_GRANDCHILD;
-    if (write(sync_pipe[1], &s, sizeof(s)) != sizeof(s)) {
-        fprintf(stderr, "[stage-1] Failed to write SYNC_GRANDCHILD: %s\n", strerror(errno));
+    fprintf(stderr, "[stage-1] Sending GRANDCHILD to stage-2\n");
+    if (send_sync(sync_pipe[1], KONTAINER_FRAME_GRANDCHILD, NULL, 0) < 0) {
+        fprintf(stderr, "[stage-1] Failed to write GRANDCHILD: %s\n", strerror(errno));
         exit(1);
     }
 
-    // Wait for SYNC_CHILD_FINISH from Stage-2
-    fprintf(stderr, "[stage-1] Waiting for SYNC_CHILD_FINISH from stage-2\n");
-    if (read(sync_pipe[1], &s, sizeof(s)) != sizeof(s)) {
-        fprintf(stderr, "[stage-1] Failed to read from stage-2: %s\n", strerror(errno));
+    fprintf(stderr, "[stage-1] Waiting for CHILD_FINISH from stage-2\n");
+    if (recv_sync(sync_pipe[1], KONTAINER_FRAME_CHILD_FINISH, NULL, 0) < 0) {
+        fprintf(stderr, "[stage-1] Failed to read CHILD_FINISH from stage-2: %s\n", strerror(errno));
         exit(1);
     }
 
-    if (s != SYNC_CHILD_FINISH) {
-        fprintf(stderr, "[stage-1] Expected SYNC_CHILD_FINISH, got %u\n", s);
-        exit(1);
-    }
-
-    fprintf(stderr, "[stage-1] Received SYNC_CHILD_FINISH from stage-2\n");
+    trace_span("stage2.sync", t);
+    fprintf(stderr, "[stage-1] Received CHILD_FINISH from stage-2\n");
     fprintf(stderr, "[stage-1] Stage-2 setup complete\n");
 
     // Clean up
     close(sync_pipe[1]);
     close(sync_fd);
+    trace_flush("stage-1");
 
     // Stage-1 exits here - Stage-2 continues as init process
     fprintf(stderr, "[stage-1] Exiting, stage-2 continues as init\n");
     _exit(0);
 }
 
+/*
+ * Pre-forked spawner
+ *
+ * The constructor clones a spawner (CLONE_PARENT, so it is a sibling of
+ * main just like the exec'd stage-1) before the Kotlin runtime starts. The
+ * spawner blocks on a socketpair until main sends the bootstrap environment,
+ * then runs stage-1 in place. This saves the second execve of the Kotlin
+ * binary and its runtime init and page faults on every create.
+ *
+ * The command line is not interpreted here: that is Main.kt's job, and it
+ * only runs once the runtime is up, too late to clone. So the spawner is
+ * cloned for every invocation, and main releases it
+ * (kontainer_spawner_release()) for every command but `create`.
+ *
+ * Handoff message (main -> spawner), over the same socket that then carries
+ * the sync protocol: the bootstrap config message as KONTAINER_FRAME_CONFIG
+ * frames, with the FDs it names attached to the first frame via SCM_RIGHTS. The KONTAINER_BOOTSTRAP_ATTR_FD
+ * attributes carry main's fd numbers; the spawner rewrites them, in order,
+ * with the numbers the fds received here.
+ *
+ * If main releases the spawner or exits without handing over (create failed
+ * early), the spawner sees EOF and exits quietly.
+ */
+#define ENV_SPAWNER "KONTAINER_SPAWNER"
+
+static int spawner_fd = -1;
+static pid_t spawner_pid = -1;
+
+/**
+ * Spawner body: wait for the handoff, import the config and fds, then run
+ * stage-1. Returns only in stage-2.
+ */
+static void spawner_main(int fd) {
+    struct bootstrap_attr *attr;
+    int fds[FRAME_MAX_FDS];
+    int nfds = 0;
+    int i = 0;
+
+    if (recv_bootstrap_config(fd, "spawner", fds, &nfds) == FRAME_EOF) {
+        _exit(0); // main gave up before handing over
+    }
+
+    // Main's fd numbers mean nothing here; substitute the received ones
+    for_each_config_attr(attr) {
+        if (attr->type != KONTAINER_BOOTSTRAP_ATTR_FD || config_attr_payload_len(attr) < 8) continue;
+        if (i >= nfds) break;
+        ((uint32_t *)config_attr_data(attr))[1] = (uint32_t)fds[i++];
+    }
+    if (i != nfds || i < 1) {
+        fprintf(stderr, "[spawner] Config names %d fds, received %d\n", i, nfds);
+        _exit(1);
+    }
+
+    config_trace_setup("spawner.handoff");
+    run_stage1(fd);
+}
+
+/**
+ * Clone the spawner. On any failure the spawner is simply not available and
+ * Create.kt falls back to exec'ing `__init__`.
+ */
+static void start_spawner(void) {
+    int sv[2];
+    pid_t pid;
+    const char *opt = getenv(ENV_SPAWNER);
+
+    if (opt && !strcmp(opt, "0")) return;
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) return;
+
+    pid = clone_parent();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        spawner_main(sv[1]);
+        return; // Stage-2: start Kotlin runtime
+    }
+    close(sv[1]);
+    spawner_fd = sv[0];
+    spawner_pid = pid;
+}
+
+/**
+ * Bootstrap constructor - called before Kotlin runtime starts
+ *
+ * This creates a simplified 2-stage bootstrap process:
+ * - Stage-1 (this process, or the pre-forked spawner): unshare namespaces,
+ *   clone Stage-2
+ * - Stage-2: becomes container init (PID 1)
+ */
+__attribute__((constructor))
+void kontainer_bootstrap(void) {
+    int sync_fd;
+
+    // Not exec'd as stage-1: pre-fork the spawner, in case this is `create`
+    if (!getenv(ENV_IS_BOOTSTRAP)) {
+        start_spawner();
+        return;
+    }
+
+    // Get sync pipe FD from environment variable (passed from Main Process)
+    sync_fd = getenv_int(ENV_SYNCPIPE);
+    if (sync_fd < 0) {
+        fprintf(stderr, "[stage-1] Missing %s environment variable\n", ENV_SYNCPIPE);
+        exit(1);
+    }
+
+    // Everything else arrives as the bootstrap config message on that socket
+    if (recv_bootstrap_config(sync_fd, "stage-1", NULL, NULL) == FRAME_EOF) {
+        fprintf(stderr, "[stage-1] Sync socket closed before the bootstrap config\n");
+        exit(1);
+    }
+
+    // Tracing: the span from the main process's execv to here is the cost of
+    // loading this binary again for stage-1.
+    config_trace_setup("exec");
+
+    run_stage1(sync_fd);
+}
+
 int kontainer_is_init_process(void) {
     return is_init_process;
 }
+
+unsigned long long kontainer_trace_handoff_ns(void) {
+    return trace_handoff_ns;
+}
+
+int kontainer_spawner_fd(void) {
+    return spawner_fd;
+}
+
+int kontainer_spawner_pid(void) {
+    return spawner_pid;
+}
+
+const void *kontainer_bootstrap_config(void) {
+    return bootstrap_config;
+}
+
+int kontainer_bootstrap_config_len(void) {
+    return (int)bootstrap_config_len;
+}
+
+void kontainer_spawner_release(void) {
+    if (spawner_fd < 0) return;
+    close(spawner_fd);
+    spawner_fd = -1;
+    spawner_pid = -1;
+}
+
+int kontainer_spawner_start(const void *config, int config_len, const int *fds, int nfds) {
+    if (spawner_fd < 0 || nfds < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    return kontainer_send_config(spawner_fd, config, config_len, fds, nfds);
+}
+
+int kontainer_send_config(int fd, const void *config, int config_len, const int *fds, int nfds) {
+    size_t off = 0;
+    size_t chunk;
+
+    if (config_len < (int)sizeof(struct bootstrap_hdr) || nfds > FRAME_MAX_FDS) {
+        errno = EINVAL;
+        return -1;
+    }
+    while (off < (size_t)config_len) {
+        chunk = (size_t)config_len - off;
+        if (chunk > KONTAINER_FRAME_MAX_PAYLOAD) chunk = KONTAINER_FRAME_MAX_PAYLOAD;
+        if (send_frame(fd, KONTAINER_FRAME_CONFIG, (const char *)config + off, (uint32_t)chunk,
+                       off == 0 ? fds : NULL, off == 0 ? nfds : 0) < 0) {
+            return -1;
+        }
+        off += chunk;
+    }
+    return 0;
+}
+
+int kontainer_userns_holder(void) {
+    pid_t pid = (pid_t)syscall(SYS_clone, CLONE_NEWUSER | SIGCHLD, NULL, NULL, NULL, NULL);
+    if (pid != 0) return pid;
+    // Child: a copy of one thread of a running Kotlin process, so nothing
+    // but async-signal-safe calls until the caller kills it
+    prctl(PR_SET_PDEATHSIG, SIGKILL, 0, 0, 0);
+    for (;;) pause();
+}
+
+int kontainer_spawn(const char *path, char *const argv[], char *const envp[], int stdin_fd) {
+    posix_spawn_file_actions_t actions;
+    pid_t pid;
+    int err;
+
+    err = posix_spawn_file_actions_init(&actions);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    err = posix_spawn_file_actions_adddup2(&actions, stdin_fd, STDIN_FILENO);
+    if (!err) err = posix_spawn(&pid, path, &actions, NULL, argv, envp ? envp : environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+/* Namespaces of the init joined by exec, in setns order: user first, so the
+ * others are joined with the container's credentials */
+static const struct {
+    const char *name;
+    int type;
+} exec_namespaces[] = {
+    {"user", CLONE_NEWUSER}, {"ipc", CLONE_NEWIPC}, {"uts", CLONE_NEWUTS},    {"net", CLONE_NEWNET},
+    {"mnt", CLONE_NEWNS},    {"cgroup", CLONE_NEWCGROUP}, {"pid", CLONE_NEWPID},
+};
+#define EXEC_NAMESPACE_COUNT (sizeof(exec_namespaces) / sizeof(exec_namespaces[0]))
+
+static size_t append_str(char *buf, size_t n, size_t cap, const char *s) {
+    size_t len = strlen(s);
+    if (len > cap - n) len = cap - n;
+    memcpy(buf + n, s, len);
+    return n + len;
+}
+
+/* "exec: <what>[ <arg>]: errno <err>" on stderr, with write(2) only */
+static void exec_fail(const char *what, const char *arg, int err) {
+    char buf[512];
+    char digits[12];
+    char *p = digits + sizeof(digits);
+    size_t n = 0;
+
+    *--p = '\0';
+    do {
+        *--p = (char)('0' + err % 10);
+        err /= 10;
+    } while (err > 0 && p > digits);
+
+    n = append_str(buf, n, sizeof(buf), "exec: ");
+    n = append_str(buf, n, sizeof(buf), what);
+    if (arg) {
+        n = append_str(buf, n, sizeof(buf), " ");
+        n = append_str(buf, n, sizeof(buf), arg);
+    }
+    n = append_str(buf, n, sizeof(buf), ": errno ");
+    n = append_str(buf, n, sizeof(buf), p);
+    n = append_str(buf, n, sizeof(buf), "\n");
+    if (write(STDERR_FILENO, buf, n) < 0) return;
+}
+
+/**
+ * Join the namespaces in `nstypes`: one setns(pidfd, nstypes) call
+ * (Linux 5.8+), else one setns per file of `ns_paths`, which the parent
+ * formatted as /proc/<pid>/ns/<name> in exec_namespaces order
+ */
+static int exec_join_namespaces(char ns_paths[][64], int pidfd, int nstypes) {
+    int fds[EXEC_NAMESPACE_COUNT];
+    size_t i;
+    int rc = 0;
+
+    if (nstypes == 0) return 0;
+    if (pidfd >= 0) {
+        if (setns(pidfd, nstypes) == 0) return 0;
+        // Older kernels take namespace fds only and reject a pidfd with EINVAL
+        if (errno != EINVAL) {
+            exec_fail("setns(pidfd)", NULL, errno);
+            return -1;
+        }
+    }
+
+    // All files are opened first: once in the mount namespace, /proc is the
+    // container's
+    for (i = 0; i < EXEC_NAMESPACE_COUNT; i++) {
+        fds[i] = -1;
+        if (!(nstypes & exec_namespaces[i].type)) continue;
+        fds[i] = open(ns_paths[i], O_RDONLY | O_CLOEXEC);
+        if (fds[i] < 0) {
+            exec_fail("open", ns_paths[i], errno);
+            rc = -1;
+        }
+    }
+    for (i = 0; i < EXEC_NAMESPACE_COUNT && rc == 0; i++) {
+        if (fds[i] >= 0 && setns(fds[i], exec_namespaces[i].type) != 0) {
+            exec_fail("setns", exec_namespaces[i].name, errno);
+            rc = -1;
+        }
+    }
+    for (i = 0; i < EXEC_NAMESPACE_COUNT; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+    return rc;
+}
+
+/**
+ * execve `argv` with the PATH search of execvp, but with fixed buffers and
+ * no allocation, so it can run in a child of a multithreaded process. PATH
+ * is read from environ by hand (getenv is not async-signal-safe). There is
+ * no /bin/sh fallback for ENOEXEC. Returns only on failure, errno set.
+ */
+static void exec_search_path(char *const argv[]) {
+    const char *path = "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin";
+    const char *name = argv[0];
+    size_t name_len = strlen(name);
+    char buf[4096];
+    char **env;
+    int err = ENOENT;
+
+    if (strchr(name, '/') != NULL) {
+        execve(name, argv, environ);
+        return;
+    }
+    for (env = environ; env && *env; env++) {
+        if (strncmp(*env, "PATH=", 5) == 0) {
+            path = *env + 5;
+            break;
+        }
+    }
+    while (1) {
+        const char *end = strchr(path, ':');
+        size_t dir_len = end ? (size_t)(end - path) : strlen(path);
+        if (dir_len + 1 + name_len < sizeof(buf)) {
+            // An empty entry means the current directory
+            size_t n = 0;
+            if (dir_len > 0) {
+                memcpy(buf, path, dir_len);
+                n = dir_len;
+                buf[n++] = '/';
+            }
+            memcpy(buf + n, name, name_len + 1);
+            execve(buf, argv, environ);
+            // Like execvp: remember a permission error, keep looking past misses
+            if (errno == EACCES) err = EACCES;
+            else if (errno != ENOENT && errno != ENOTDIR) err = errno;
+        }
+        if (!end) break;
+        path = end + 1;
+    }
+    errno = err;
+}
+
+int kontainer_exec(int pid, int pidfd, int nstypes, int cgroup_fd, char *const argv[]) {
+    struct kontainer_clone_args args;
+    char ns_paths[EXEC_NAMESPACE_COUNT][64];
+    pid_t child = -1;
+    pid_t cmd;
+    int in_cgroup = 0;
+    int status;
+    int procs;
+    size_t i;
+
+    // Formatted here: snprintf is not async-signal-safe, the child below is
+    for (i = 0; i < EXEC_NAMESPACE_COUNT; i++) {
+        snprintf(ns_paths[i], sizeof(ns_paths[i]), "/proc/%d/ns/%s", pid, exec_namespaces[i].name);
+    }
+
+    if (cgroup_fd >= 0) {
+        memset(&args, 0, sizeof(args));
+        args.flags = CLONE_INTO_CGROUP;
+        args.exit_signal = SIGCHLD;
+        args.cgroup = (uint64_t)cgroup_fd;
+        child = syscall(SYS_clone3, &args, sizeof(args));
+        if (child >= 0) in_cgroup = 1;
+    }
+    if (child < 0) child = syscall(SYS_clone, SIGCHLD, NULL, NULL, NULL, NULL);
+    if (child != 0) return child;
+
+    // Child: a copy of one thread of a running Kotlin process, so only
+    // async-signal-safe calls from here on
+    if (cgroup_fd >= 0 && !in_cgroup) {
+        // clone3 or CLONE_INTO_CGROUP unavailable: move ourselves ("0" is
+        // the writer) before the command inherits the cgroup
+        procs = openat(cgroup_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+        if (procs < 0 || write(procs, "0", 1) != 1) exec_fail("joining the container cgroup", NULL, errno);
+        if (procs >= 0) close(procs);
+    }
+    if (exec_join_namespaces(ns_paths, pidfd, nstypes) != 0) _exit(1);
+    if (chdir("/") != 0) exec_fail("chdir", "/", errno);
+
+    // The PID namespace applies to children only. A vfork child borrows
+    // this copy's memory until it execs, so nothing more is copied.
+    cmd = vfork();
+    if (cmd < 0) {
+        exec_fail("vfork", NULL, errno);
+        _exit(1);
+    }
+    if (cmd == 0) {
+        // Searched in the container's mount namespace, hence not in the parent
+        exec_search_path(argv);
+        exec_fail("execve", argv[0], errno);
+        _exit(127);
+    }
+    while (waitpid(cmd, &status, 0) < 0) {
+        if (errno != EINTR) _exit(1);
+    }
+    _exit(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+}
+
+/*
+ * Parked init
+ *
+ * kontainer_park() execs the waiter program (parkwait.c) with the container
+ * process's argv and final environment plus ENV_PARK, which names the notify
+ * socket and trace fds. The waiter is freestanding and a few KB: the parked
+ * image is its code and stack, with no libc, GC heap, spec or libseccomp
+ * context. The Kotlin runtime's threads and memory go away at execve.
+ *
+ * compileParkWaiter links it before this file is compiled, and it is
+ * embedded below. kontainer_park() writes it into a sealed memfd and execs
+ * that, so it works after pivot_root without /proc or anything from the
+ * image, whether or not the runtime itself is static, and the parked init
+ * holds no handle on a host binary that the image could reopen for writing
+ * (CVE-2019-5736).
+ */
+__asm__(".section .rodata\n"
+        ".balign 16\n"
+        "park_waiter_start:\n"
+        ".incbin \"build/parkwait\"\n"
+        "park_waiter_end:\n"
+        ".previous\n");
+
+extern const char park_waiter_start[] __attribute__((visibility("hidden")));
+extern const char park_waiter_end[] __attribute__((visibility("hidden")));
+
+/** Sealed memfd holding the waiter program, or -1 (errno set) */
+static int park_waiter_fd(void) {
+    size_t len = (size_t)(park_waiter_end - park_waiter_start);
+    size_t off = 0;
+    int fd;
+    int err;
+
+    fd = memfd_create("kontainer-init", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return -1;
+    while (off < len) {
+        ssize_t n = write(fd, park_waiter_start + off, len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n == 0) errno = EIO;
+            goto fail;
+        }
+        off += (size_t)n;
+    }
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE) < 0) goto fail;
+    return fd;
+
+fail:
+    err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+}
+
+int kontainer_park(int notify_fd, int trace, unsigned long long wait_start_ns,
+                   char *const argv[], char *const envp[]) {
+    static char marker[96];
+    size_t n = 0;
+    size_t i;
+    int exe_fd;
+    int err;
+
+    while (envp[n]) n++;
+    {
+        // No malloc, so the fork child of a threaded process may call this too
+        char *env[n + 2];
+
+        for (i = 0; i < n; i++) env[i] = envp[i];
+        snprintf(marker, sizeof(marker), ENV_PARK "=%d:%d:%llu", notify_fd, trace, wait_start_ns);
+        env[n] = marker;
+        env[n + 1] = NULL;
+
+        exe_fd = park_waiter_fd();
+        if (exe_fd < 0) return -1;
+        // Both fds cross this exec; the waiter closes them before the final one
+        if (fcntl(notify_fd, F_SETFD, 0) < 0 || (trace >= 0 && fcntl(trace, F_SETFD, 0) < 0)) {
+            err = errno;
+            close(exe_fd);
+            errno = err;
+            return -1;
+        }
+        fexecve(exe_fd, argv, env);
+    }
+    err = errno;
+    close(exe_fd);
+    errno = err;
+    return -1;
+}
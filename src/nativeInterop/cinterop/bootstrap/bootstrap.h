@@ -1,6 +1,67 @@
 #ifndef KONTAINER_BOOTSTRAP_H
 #define KONTAINER_BOOTSTRAP_H
 
+/*
+ * Bootstrap config message (see process/BootstrapConfig.kt for the layout)
+ * These values must match the constants in BootstrapConfig.
+ */
+#define KONTAINER_BOOTSTRAP_MAGIC 0x4b425354U /* "KBST" */
+#define KONTAINER_BOOTSTRAP_VERSION 1
+
+#define KONTAINER_BOOTSTRAP_ATTR_CLONE_FLAGS 1    /* u32 */
+#define KONTAINER_BOOTSTRAP_ATTR_NS_PATH 2        /* u32 CLONE_NEW* flag, NUL-terminated path */
+#define KONTAINER_BOOTSTRAP_ATTR_BUNDLE_PATH 3    /* NUL-terminated string */
+#define KONTAINER_BOOTSTRAP_ATTR_ROOTFS_PATH 4    /* NUL-terminated string */
+#define KONTAINER_BOOTSTRAP_ATTR_CONTAINER_ID 5   /* NUL-terminated string */
+#define KONTAINER_BOOTSTRAP_ATTR_NOTIFY_SOCKET 6  /* NUL-terminated string */
+#define KONTAINER_BOOTSTRAP_ATTR_FD 7             /* u32 role, i32 fd */
+#define KONTAINER_BOOTSTRAP_ATTR_TRACE_START_NS 8 /* u64 CLOCK_MONOTONIC at handoff */
+#define KONTAINER_BOOTSTRAP_ATTR_SPEC 9           /* CBOR-encoded spec, Kotlin only */
+#define KONTAINER_BOOTSTRAP_ATTR_SECCOMP_BPF 10   /* struct sock_filter[], Kotlin only */
+#define KONTAINER_BOOTSTRAP_ATTR_RLIMIT 11        /* u32 RLIMIT_*, u64 soft, u64 hard */
+
+#define KONTAINER_BOOTSTRAP_FD_MAIN_SENDER 1
+#define KONTAINER_BOOTSTRAP_FD_INIT_RECEIVER 2
+#define KONTAINER_BOOTSTRAP_FD_NOTIFY_LISTENER 3
+#define KONTAINER_BOOTSTRAP_FD_TRACE 4
+#define KONTAINER_BOOTSTRAP_FD_CGROUP 5 /* O_DIRECTORY fd of the container cgroup */
+
+/*
+ * Frames (see channel/Frame.kt)
+ *
+ * Every socket between the runtime's processes is a SOCK_SEQPACKET
+ * socketpair carrying one frame per packet: this header, then `len` bytes
+ * of payload, with any fds attached via SCM_RIGHTS. Host byte order.
+ * These values must match the constants in Frame.kt.
+ */
+struct kontainer_frame {
+    unsigned int type;
+    unsigned int len; /* payload bytes following the header */
+};
+
+#define KONTAINER_FRAME_MAX_PAYLOAD (64U << 10)
+
+/* main <-> init channels (channel.Message) */
+#define KONTAINER_FRAME_INIT_READY 0x01
+#define KONTAINER_FRAME_WRITE_MAPPING 0x02
+#define KONTAINER_FRAME_MAPPING_WRITTEN 0x03
+#define KONTAINER_FRAME_SECCOMP_NOTIFY 0x04      /* + notify fd */
+#define KONTAINER_FRAME_SECCOMP_NOTIFY_DONE 0x05
+#define KONTAINER_FRAME_IDMAPPED_MOUNT 0x06      /* + detached tree fd */
+#define KONTAINER_FRAME_DEV_TEMPLATE 0x07        /* + detached tree fd */
+#define KONTAINER_FRAME_NO_DEV_TEMPLATE 0x08
+#define KONTAINER_FRAME_EXEC_FAILED 0x09         /* UTF-8 error */
+#define KONTAINER_FRAME_OTHER_ERROR 0x0a         /* UTF-8 error */
+
+/* main <-> stage-1 <-> stage-2 sync sockets (bootstrap.c) */
+#define KONTAINER_FRAME_CONFIG 0x30        /* bootstrap config chunk, fds on the first */
+#define KONTAINER_FRAME_USERMAP_PLS 0x40   /* i32 stage-1 pid: write its uid/gid maps */
+#define KONTAINER_FRAME_USERMAP_ACK 0x41   /* mapping is complete */
+#define KONTAINER_FRAME_STAGE2_PID 0x42    /* i32 stage-2 pid, i32 placed in cgroup */
+#define KONTAINER_FRAME_GRANDCHILD 0x44    /* stage-2 may run */
+#define KONTAINER_FRAME_CHILD_FINISH 0x45  /* stage-2 has finished setup */
+#define KONTAINER_FRAME_CGROUP_ACK 0x46    /* main moved stage-2 into its cgroup */
+
 /**
  * Check if the current process is the init process
  * Returns 1 if init process, 0 otherwise
@@ -13,4 +74,113 @@ int kontainer_is_init_process(void);
  */
 int kontainer_get_init_pid(void);
 
+/**
+ * Get the CLOCK_MONOTONIC time (ns) at which stage-2 returned from the
+ * bootstrap constructor to start the Kotlin runtime
+ * Returns 0 if tracing is disabled
+ */
+unsigned long long kontainer_trace_handoff_ns(void);
+
+/**
+ * Get the control socket of the pre-forked spawner
+ * After kontainer_spawner_start() the same socket carries the sync protocol
+ * Returns the fd or -1 if no spawner is available
+ */
+int kontainer_spawner_fd(void);
+
+/**
+ * Get the spawner PID (it becomes Stage-1 after the handoff)
+ * Returns the PID or -1 if no spawner is available
+ */
+int kontainer_spawner_pid(void);
+
+/**
+ * Get the bootstrap config message read by Stage-1 (inherited by Stage-2)
+ * Returns NULL if this process was not started through bootstrap.c
+ */
+const void *kontainer_bootstrap_config(void);
+
+/**
+ * Get the length in bytes of kontainer_bootstrap_config()
+ */
+int kontainer_bootstrap_config_len(void);
+
+/**
+ * Let the spawner go: it sees EOF and exits. Main calls this for every
+ * command but `create`; a no-op if no spawner is available.
+ */
+void kontainer_spawner_release(void);
+
+/**
+ * Hand the bootstrap config message to the spawner, which then runs Stage-1
+ *
+ * fds: the fds named by the config's FD attributes, in attribute order; they
+ *      are passed via SCM_RIGHTS and the spawner rewrites the attributes with
+ *      the numbers they received
+ * Returns 0 on success, -1 on error (errno set)
+ */
+int kontainer_spawner_start(const void *config, int config_len, const int *fds, int nfds);
+
+/**
+ * Send the bootstrap config message over the SOCK_SEQPACKET socket `fd`
+ *
+ * The message goes as KONTAINER_FRAME_CONFIG frames of at most
+ * KONTAINER_FRAME_MAX_PAYLOAD bytes; `fds` (may be NULL if nfds is 0) ride
+ * on the first one.
+ * Returns 0 on success, -1 on error (errno set)
+ */
+int kontainer_send_config(int fd, const void *config, int config_len, const int *fds, int nfds);
+
+/**
+ * Fork a child into a new user namespace that does nothing until killed
+ *
+ * The caller writes /proc/<pid>/uid_map and gid_map, opens
+ * /proc/<pid>/ns/user and then kills and reaps the child. Used for
+ * idmapped mounts whose mappings differ from the container's.
+ * Returns the child PID, or -1 on error (errno set)
+ */
+int kontainer_userns_holder(void);
+
+/**
+ * Start `path` with posix_spawn (a vfork-style clone followed by execve, so
+ * no copy of the calling multi-threaded process ever runs), with `stdin_fd`
+ * as its standard input
+ *
+ * envp: NULL to inherit the caller's environment
+ * Returns the child PID, or -1 on error (errno set, including exec failures
+ * such as ENOENT)
+ */
+int kontainer_spawn(const char *path, char *const argv[], char *const envp[], int stdin_fd);
+
+/**
+ * Run `argv` inside the namespaces and cgroup of the container whose init is
+ * `pid`, for `exec`
+ *
+ * One clone: with clone3(CLONE_INTO_CGROUP) the child starts in `cgroup_fd`
+ * (-1: stay in the caller's cgroup), else it moves itself there. It joins
+ * the namespaces in `nstypes` (CLONE_NEW* flags) with a single
+ * setns(pidfd, nstypes), falling back to the /proc/<pid>/ns files before
+ * Linux 5.8 or when `pidfd` is -1. The command then runs in a vfork() child,
+ * which is in the container's PID namespace.
+ *
+ * Returns the PID of the clone, whose exit status is the command's (127 if
+ * it could not be executed, 1 if joining failed), or -1 on error (errno set)
+ */
+int kontainer_exec(int pid, int pidfd, int nstypes, int cgroup_fd, char *const argv[]);
+
+/**
+ * Exec the parked-init waiter (parkwait.c, embedded in this library) in
+ * place of the Kotlin runtime, which frees all of its memory
+ *
+ * The waiter accepts on `notify_fd` until a start message arrives, appends
+ * the wait.start and execve spans to `trace_fd` (-1: not tracing) with
+ * `wait_start_ns` as the start of the wait, closes both and execs `argv`
+ * with execvp's PATH lookup and `envp` as its environment. Exec failures
+ * exit with 127.
+ *
+ * Returns only if the exec failed: -1 (errno set)
+ */
+int kontainer_park(int notify_fd, int trace_fd, unsigned long long wait_start_ns,
+                   char *const argv[], char *const envp[]);
+
 #endif // KONTAINER_BOOTSTRAP_H
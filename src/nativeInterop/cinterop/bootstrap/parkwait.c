@@ -0,0 +1,300 @@
+/*
+ * Parked init waiter (see "Parked init" in bootstrap.c)
+ *
+ * A freestanding program: no libc, no dynamic loader, only the raw syscalls
+ * below. compileParkWaiter links it with -nostdlib -static and bootstrap.c
+ * embeds the result, so a parked init maps a few pages of this code instead
+ * of the runtime binary, whatever the container image holds. x86_64 only,
+ * like the runtime build.
+ *
+ * kontainer_park() execs it as the container process: argv is the
+ * process's argv and envp its final environment plus ENV_PARK
+ * ("<notify fd>:<trace fd>:<wait start ns>"). The waiter speaks the listener
+ * side of the notify protocol (see channel/NotifySocket.kt): one message per
+ * connection, read to EOF. Any message other than a process update releases
+ * the init; it then appends the wait.start and execve spans to the trace fd
+ * and execs argv[0] with execvp's PATH lookup.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/* Must match ENV_PARK in bootstrap.c */
+#define ENV_PARK "_KONTAINER_PARK"
+
+#define SYS_WRITE 1
+#define SYS_CLOSE 3
+#define SYS_RECVFROM 45
+#define SYS_EXECVE 59
+#define SYS_EXIT 60
+#define SYS_PRCTL 157
+#define SYS_CLOCK_GETTIME 228
+#define SYS_ACCEPT4 288
+
+#define E_NOENT 2
+#define E_INTR 4
+#define E_NOEXEC 8
+#define E_ACCES 13
+#define E_NODEV 19
+#define E_NOTDIR 20
+#define E_TIMEDOUT 110
+#define E_STALE 116
+
+#define PR_SET_NAME 15
+#define SOCK_CLOEXEC 02000000
+#define CLOCK_MONOTONIC 1
+#define PATH_MAX 4096
+
+#define NOTIFY_UPDATE_PREFIX "update "
+#define NOTIFY_UPDATE_PREFIX_LEN (sizeof(NOTIFY_UPDATE_PREFIX) - 1)
+
+/* Entry: hand the initial stack (argc, argv..., NULL, envp..., NULL) to C */
+__asm__(".text\n"
+        ".global _start\n"
+        "_start:\n"
+        "    xor %rbp, %rbp\n"
+        "    mov %rsp, %rdi\n"
+        "    and $-16, %rsp\n"
+        "    call park_start\n"
+        "    hlt\n");
+
+/** Raw syscall; returns -errno on failure */
+static long sys6(long n, long a, long b, long c, long d, long e, long f) {
+    register long r10 __asm__("r10") = d;
+    register long r8 __asm__("r8") = e;
+    register long r9 __asm__("r9") = f;
+    long ret;
+
+    __asm__ volatile("syscall"
+                     : "=a"(ret)
+                     : "a"(n), "D"(a), "S"(b), "d"(c), "r"(r10), "r"(r8), "r"(r9)
+                     : "rcx", "r11", "memory");
+    return ret;
+}
+
+#define sys3(n, a, b, c) sys6(n, (long)(a), (long)(b), (long)(c), 0, 0, 0)
+
+static size_t str_len(const char *s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+static int has_prefix(const char *s, const char *prefix) {
+    while (*prefix) {
+        if (*s++ != *prefix++) return 0;
+    }
+    return 1;
+}
+
+static void put(int fd, const char *s) {
+    sys3(SYS_WRITE, fd, s, str_len(s));
+}
+
+static __attribute__((noreturn)) void die(const char *msg, int status) {
+    put(2, "[init] ");
+    put(2, msg);
+    put(2, "\n");
+    for (;;) sys3(SYS_EXIT, status, 0, 0);
+}
+
+/** Parse a decimal number ending at `end`; returns the character after it */
+static const char *parse_u64(const char *s, char end, uint64_t *out) {
+    uint64_t v = 0;
+    int neg = 0;
+
+    if (*s == '-') {
+        neg = 1;
+        s++;
+    }
+    if (*s < '0' || *s > '9') return NULL;
+    while (*s >= '0' && *s <= '9') v = v * 10 + (uint64_t)(*s++ - '0');
+    if (*s != end) return NULL;
+    *out = neg ? (uint64_t)-(int64_t)v : v;
+    return s + 1;
+}
+
+static char *append(char *p, const char *s) {
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+static char *append_u64(char *p, uint64_t v) {
+    char digits[20];
+    int n = 0;
+
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n) *p++ = digits[--n];
+    return p;
+}
+
+static uint64_t mono_now(void) {
+    struct {
+        long tv_sec;
+        long tv_nsec;
+    } ts;
+
+    if (sys3(SYS_CLOCK_GETTIME, CLOCK_MONOTONIC, &ts, 0) < 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/** One JSON line in the format of trace_flush() in bootstrap.c */
+static char *append_span(char *p, const char *name, uint64_t start_ns, uint64_t end_ns) {
+    p = append(p, "{\"stage\":\"init\",\"name\":\"");
+    p = append(p, name);
+    p = append(p, "\",\"start_ns\":");
+    p = append_u64(p, start_ns);
+    p = append(p, ",\"end_ns\":");
+    p = append_u64(p, end_ns);
+    p = append(p, ",\"duration_ns\":");
+    p = append_u64(p, end_ns - start_ns);
+    return append(p, "}\n");
+}
+
+/** Block until a start message; process updates are skipped */
+static void wait_for_start(int notify_fd) {
+    char head[NOTIFY_UPDATE_PREFIX_LEN];
+    char buf[4096];
+    size_t head_len;
+    size_t i;
+    long client;
+    long n;
+
+    for (;;) {
+        client = sys6(SYS_ACCEPT4, notify_fd, 0, 0, SOCK_CLOEXEC, 0, 0);
+        if (client == -E_INTR) continue;
+        if (client < 0) die("Failed to accept on the notify socket", 1);
+        head_len = 0;
+        for (;;) {
+            n = sys6(SYS_RECVFROM, client, (long)buf, sizeof(buf), 0, 0, 0);
+            if (n == -E_INTR) continue;
+            if (n <= 0) break;
+            for (i = 0; head_len < sizeof(head) && i < (size_t)n; i++) head[head_len++] = buf[i];
+        }
+        if (n < 0) die("Failed to receive start signal", 1);
+        sys3(SYS_CLOSE, client, 0, 0);
+        if (head_len == sizeof(head) && has_prefix(head, NOTIFY_UPDATE_PREFIX)) {
+            put(2, "[init] Ignoring process update: a parked init cannot apply it\n");
+            continue;
+        }
+        return;
+    }
+}
+
+/** execve; a file without a #! line runs under /bin/sh, as with execvp */
+static long exec_file(const char *file, char **argv, char **envp) {
+    long err = sys3(SYS_EXECVE, file, argv, envp);
+    size_t argc = 0;
+
+    if (err != -E_NOEXEC) return err;
+    while (argv[argc]) argc++;
+    {
+        char *sh_argv[argc + 2];
+        size_t i;
+
+        sh_argv[0] = "/bin/sh";
+        sh_argv[1] = (char *)file;
+        for (i = 1; i <= argc; i++) sh_argv[i + 1] = argv[i];
+        sys3(SYS_EXECVE, sh_argv[0], sh_argv, envp);
+    }
+    return err;
+}
+
+/** execvp(argv[0], argv) with `envp`, searching its PATH; returns -errno */
+static long exec_path(char **argv, char **envp) {
+    const char *file = argv[0];
+    const char *path = "/bin:/usr/bin";
+    char buf[PATH_MAX];
+    size_t file_len = str_len(file);
+    int seen_eacces = 0;
+    long err = -E_NOENT;
+    size_t i;
+
+    for (i = 0; file[i]; i++) {
+        if (file[i] == '/') return exec_file(file, argv, envp);
+    }
+    if (file_len == 0) return -E_NOENT;
+    for (i = 0; envp[i]; i++) {
+        if (has_prefix(envp[i], "PATH=")) path = envp[i] + 5;
+    }
+    for (;;) {
+        const char *end = path;
+        size_t dir_len;
+        char *p = buf;
+
+        while (*end && *end != ':') end++;
+        dir_len = (size_t)(end - path);
+        if (dir_len + 1 + file_len < sizeof(buf)) {
+            for (i = 0; i < dir_len; i++) *p++ = path[i];
+            if (dir_len) *p++ = '/';
+            for (i = 0; i <= file_len; i++) *p++ = file[i];
+            err = exec_file(buf, argv, envp);
+            if (err == -E_ACCES) {
+                seen_eacces = 1;
+            } else if (err != -E_NOENT && err != -E_NOTDIR && err != -E_NODEV &&
+                       err != -E_TIMEDOUT && err != -E_STALE) {
+                return err;
+            }
+        }
+        if (!*end) break;
+        path = end + 1;
+    }
+    return seen_eacces ? -E_ACCES : err;
+}
+
+__attribute__((used)) void park_start(long *sp) {
+    char **argv = (char **)(sp + 1);
+    char **envp = argv + sp[0] + 1;
+    const char *value = NULL;
+    uint64_t notify_fd = 0;
+    uint64_t trace_fd = 0;
+    uint64_t start_ns = 0;
+    const char *p;
+    size_t i;
+    size_t j;
+
+    // Find ENV_PARK and take it out of the environment the process gets
+    for (i = 0; envp[i]; i++) {
+        if (!has_prefix(envp[i], ENV_PARK "=")) continue;
+        value = envp[i] + sizeof(ENV_PARK);
+        for (j = i; envp[j]; j++) envp[j] = envp[j + 1];
+        break;
+    }
+    if (!value || !(p = parse_u64(value, ':', &notify_fd)) || !(p = parse_u64(p, ':', &trace_fd)) ||
+        !parse_u64(p, '\0', &start_ns) || (int64_t)notify_fd < 0) {
+        die("Invalid " ENV_PARK " value", 1);
+    }
+    if (!argv[0]) die("No process to execute", 1);
+    // comm is the fd number after fexecve; argv already shows the command
+    sys3(SYS_PRCTL, PR_SET_NAME, "kontainer-init", 0);
+
+    wait_for_start((int)notify_fd);
+    sys3(SYS_CLOSE, notify_fd, 0, 0);
+
+    // Same spans as the Kotlin init records around the wait and the exec
+    if ((int64_t)trace_fd >= 0) {
+        char line[2 * 160];
+        char *end = line;
+        uint64_t now = mono_now();
+
+        if (start_ns) end = append_span(end, "wait.start", start_ns, now);
+        end = append_span(end, "execve", now, now);
+        if (sys3(SYS_WRITE, trace_fd, line, end - line) < 0) put(2, "[init] Failed to write trace spans\n");
+        sys3(SYS_CLOSE, trace_fd, 0, 0);
+    }
+
+    {
+        long err = exec_path(argv, envp);
+        char msg[32];
+        char *end = append(msg, " (errno ");
+
+        end = append_u64(end, (uint64_t)-err);
+        *append(end, ")\n") = '\0';
+        put(2, "[init] Failed to execute ");
+        put(2, argv[0]);
+        put(2, msg);
+    }
+    for (;;) sys3(SYS_EXIT, 127, 0, 0);
+}
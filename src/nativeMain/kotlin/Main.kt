@@ -1,20 +1,30 @@
+import bootstrap.kontainer_bootstrap_config
+import bootstrap.kontainer_bootstrap_config_len
 import bootstrap.kontainer_is_init_process
+import bootstrap.kontainer_spawner_release
+import bootstrap.kontainer_trace_handoff_ns
 import cgroup.CgroupV2
 import channel.SocketInitReceiver
 import channel.SocketMainSender
 import channel.SocketNotifyListener
+import daemon.DaemonOp
+import daemon.DaemonRequest
 import command.*
+import kotlinx.cinterop.ByteVar
 import kotlinx.cinterop.ExperimentalForeignApi
 import kotlinx.cinterop.memScoped
-import kotlinx.cinterop.toKString
+import kotlinx.cinterop.readBytes
+import kotlinx.cinterop.reinterpret
 import kotlinx.cli.*
 import logger.Logger
 import platform.posix.exit
-import platform.posix.getenv
 import platform.posix.getpid
+import process.BootstrapConfig
 import process.runInitProcess
-import spec.loadSpec
+import spec.Spec
 import syscall.LinuxSyscall
+import trace.Tracer
+import utils.CborCodec
 import utils.RealFileSystem
 
 /**
@@ -28,6 +38,11 @@ import utils.RealFileSystem
  *   state <container-id>                                             - Display container state
  *   kill <container-id> <signal>                                     - Send a signal to a container
  *   delete [--force|-f] <container-id>                               - Delete a container
+ *   pool [--bundle|-b <path>] [--size|-n <count>]                    - Pre-create containers for a bundle
+ *   create-batch [--file|-f <path>] [--jobs|-j <count>]              - Create many containers at once
+ *   daemon                                                           - Serve state/kill/start/delete over a socket
+ *   events [--memory-pressure <trigger>] <container-id>              - Stream exit/OOM/pids-limit/PSI events
+ *   stats [<container-id>...]                                        - Print resource statistics
  */
 @OptIn(ExperimentalForeignApi::class, ExperimentalCli::class)
 fun main(args: Array<String>): Unit =
@@ -46,41 +61,49 @@ fun main(args: Array<String>): Unit =
         if (isInit != 0 || (args.size == 1 && args[0] == "__init__")) {
             Logger.debug("running as init process (Stage-2, forked by bootstrap.c)")
 
+            // Decode the bootstrap config that Stage-1 read from the main
+            // process (see process/BootstrapConfig.kt). It carries the channel
+            // FDs, paths and the already-parsed spec.
+            val configPtr = kontainer_bootstrap_config()
+            val config =
+                try {
+                    if (configPtr == null) throw Exception("no bootstrap config from Stage-1")
+                    BootstrapConfig.decode(
+                        configPtr.reinterpret<ByteVar>().readBytes(kontainer_bootstrap_config_len()),
+                    )
+                } catch (e: Exception) {
+                    Logger.error("failed to read bootstrap config: ${e.message ?: "unknown error"}")
+                    exit(1)
+                    return
+                }
+
+            // Pick up the trace fd inherited from the main process and time the
+            // Kotlin runtime start-up since bootstrap.c handed control back.
+            Tracer.setStage("init")
+            Tracer.attach(config.traceFd)
+            Tracer.record("runtime.init", kontainer_trace_handoff_ns().toLong())
+
             // Note: bootstrap.c Stage-1 has already sent our PID to Main Process
             // We don't need to sync with bootstrap parent here
 
-            // Restore channel FDs from environment variables
-            val mainSenderFdStr = getenv("_KONTAINER_MAIN_SENDER_FD")?.toKString()
-            val initReceiverFdStr = getenv("_KONTAINER_INIT_RECEIVER_FD")?.toKString()
-            val notifyListenerFdStr = getenv("_KONTAINER_NOTIFY_LISTENER_FD")?.toKString()
-            val bundlePath = getenv("_KONTAINER_BUNDLE_PATH")?.toKString()
-            val rootfsPath = getenv("_KONTAINER_ROOTFS_PATH")?.toKString()
-
-            if (mainSenderFdStr == null || initReceiverFdStr == null || notifyListenerFdStr == null ||
-                bundlePath == null || rootfsPath == null
-            ) {
-                Logger.error("missing required environment variables for init process")
-                exit(1)
-                return
-            }
-
-            val mainSenderFd = mainSenderFdStr.toIntOrNull()
-            val initReceiverFd = initReceiverFdStr.toIntOrNull()
-            val notifyListenerFd = notifyListenerFdStr.toIntOrNull()
+            val mainSenderFd = config.mainSenderFd
+            val initReceiverFd = config.initReceiverFd
+            val notifyListenerFd = config.notifyListenerFd
+            val bundlePath = config.bundlePath
+            val rootfsPath = config.rootfsPath
 
-            if (mainSenderFd == null || initReceiverFd == null || notifyListenerFd == null) {
-                Logger.error("invalid FD values in environment variables")
+            if (mainSenderFd < 0 || initReceiverFd < 0 || notifyListenerFd < 0) {
+                Logger.error("missing channel FDs in bootstrap config")
                 exit(1)
                 return
             }
 
-            // Load spec from bundle
-            Logger.debug("loading spec from $bundlePath/config.json")
+            // The main process already parsed config.json; decode its binary copy
             val spec =
                 try {
-                    loadSpec(fs, "$bundlePath/config.json")
+                    Tracer.span("spec.decode") { CborCodec.decode<Spec>(config.specCbor) }
                 } catch (e: Exception) {
-                    Logger.error("failed to load spec: ${e.message ?: "unknown error"}")
+                    Logger.error("failed to decode spec: ${e.message ?: "unknown error"}")
                     exit(1)
                     return
                 }
@@ -92,12 +115,22 @@ fun main(args: Array<String>): Unit =
 
             val pid = getpid()
             Logger.info("init process (Stage-2, PID=$pid) started successfully via bootstrap.c")
-            Logger.debug("bundle=$bundlePath, rootfs=$rootfsPath")
-            Logger.debug("restored FDs: main_sender=$mainSenderFd, init_receiver=$initReceiverFd, notify_listener=$notifyListenerFd")
+            Logger.debug { "bundle=$bundlePath, rootfs=$rootfsPath" }
+            Logger.debug { "restored FDs: main_sender=$mainSenderFd, init_receiver=$initReceiverFd, notify_listener=$notifyListenerFd" }
 
             // Run init process logic (Stage-2 / PID 1)
             // This will eventually call execve() and replace this process with the container process
-            runInitProcess(syscall, spec, rootfsPath, mainSender, initReceiver, notifyListener)
+            runInitProcess(
+                syscall,
+                spec,
+                rootfsPath,
+                bundlePath,
+                config.containerId,
+                config.seccompBpf,
+                mainSender,
+                initReceiver,
+                notifyListener,
+            )
 
             // Should not reach here (runInitProcess calls execve or _exit)
             Logger.error("runInitProcess returned unexpectedly")
@@ -158,29 +191,31 @@ fun main(args: Array<String>): Unit =
             }
         }
 
-        class StartCommand : Subcommand("start", "Start a created container") {
+        class StartCommand : SpawnerlessSubcommand("start", "Start a created container") {
             val containerId by argument(
                 ArgType.String,
                 description = "Container ID",
             )
 
-            override fun execute() {
+            override fun run() {
+                if (runViaDaemon(rootPath, DaemonRequest(DaemonOp.START, containerId))) return
                 start(fs, rootPath, containerId)
             }
         }
 
-        class StateCommand : Subcommand("state", "Display container state") {
+        class StateCommand : SpawnerlessSubcommand("state", "Display container state") {
             val containerId by argument(
                 ArgType.String,
                 description = "Container ID",
             )
 
-            override fun execute() {
+            override fun run() {
+                if (runViaDaemon(rootPath, DaemonRequest(DaemonOp.STATE, containerId))) return
                 state(fs, rootPath, containerId)
             }
         }
 
-        class KillCommand : Subcommand("kill", "Send a signal to a container") {
+        class KillCommand : SpawnerlessSubcommand("kill", "Send a signal to a container") {
             val containerId by argument(
                 ArgType.String,
                 description = "Container ID",
@@ -191,12 +226,13 @@ fun main(args: Array<String>): Unit =
                 description = "Signal to send",
             )
 
-            override fun execute() {
+            override fun run() {
+                if (runViaDaemon(rootPath, DaemonRequest(DaemonOp.KILL, containerId, signal = signal))) return
                 kill(syscall, fs, rootPath, containerId, signal)
             }
         }
 
-        class DeleteCommand : Subcommand("delete", "Delete a container") {
+        class DeleteCommand : SpawnerlessSubcommand("delete", "Delete a container") {
             val force by option(
                 ArgType.Boolean,
                 shortName = "f",
@@ -209,12 +245,13 @@ fun main(args: Array<String>): Unit =
                 description = "Container ID",
             )
 
-            override fun execute() {
+            override fun run() {
+                if (runViaDaemon(rootPath, DaemonRequest(DaemonOp.DELETE, containerId, force = force))) return
                 delete(syscall, fs, cgroup, rootPath, containerId, force)
             }
         }
 
-        class PsCommand : Subcommand("ps", "List processes in a container") {
+        class PsCommand : SpawnerlessSubcommand("ps", "List processes in a container") {
             val format by option(
                 ArgType.String,
                 shortName = "f",
@@ -227,12 +264,106 @@ fun main(args: Array<String>): Unit =
                 description = "Container ID",
             )
 
-            override fun execute() {
+            override fun run() {
                 ps(fs, cgroup, rootPath, containerId, format)
             }
         }
 
-        class ExecCommand : Subcommand("exec", "Execute a process in a running container") {
+        class ListCommand : SpawnerlessSubcommand("list", "List containers under the root") {
+            val format by option(
+                ArgType.String,
+                shortName = "f",
+                fullName = "format",
+                description = "Output format (table or json)",
+            ).default("table")
+
+            val quiet by option(
+                ArgType.Boolean,
+                shortName = "q",
+                fullName = "quiet",
+                description = "Print container IDs only",
+            ).default(false)
+
+            override fun run() {
+                list(fs, rootPath, format, quiet)
+            }
+        }
+
+        class PoolCommand : SpawnerlessSubcommand("pool", "Keep warm pre-created containers for a bundle") {
+            val bundle by option(
+                ArgType.String,
+                shortName = "b",
+                fullName = "bundle",
+                description = "Bundle path",
+            ).default(".")
+
+            val size by option(
+                ArgType.Int,
+                shortName = "n",
+                fullName = "size",
+                description = "Number of pre-created containers to keep",
+            ).default(1)
+
+            override fun run() {
+                pool(fs, rootPath, bundle, size)
+            }
+        }
+
+        class CreateBatchCommand : SpawnerlessSubcommand("create-batch", "Create many containers from one request") {
+            val file by option(
+                ArgType.String,
+                shortName = "f",
+                fullName = "file",
+                description = "JSON array of {id, bundle, pidFile} (- for stdin)",
+            ).default("-")
+
+            val jobs by option(
+                ArgType.Int,
+                shortName = "j",
+                fullName = "jobs",
+                description = "Maximum number of concurrent creates",
+            ).default(8)
+
+            override fun run() {
+                createBatch(fs, rootPath, file, jobs)
+            }
+        }
+
+        class EventsCommand : SpawnerlessSubcommand("events", "Stream exit, OOM, pids-limit and memory pressure events of a container") {
+            val containerId by argument(
+                ArgType.String,
+                description = "Container ID",
+            )
+
+            val memoryPressure by option(
+                ArgType.String,
+                fullName = "memory-pressure",
+                description = "PSI trigger on memory.pressure, e.g. \"some 150000 1000000\"",
+            )
+
+            override fun run() {
+                events(fs, cgroup, rootPath, containerId, memoryPressure)
+            }
+        }
+
+        class StatsCommand : SpawnerlessSubcommand("stats", "Print resource statistics of containers") {
+            val containerIds by argument(
+                ArgType.String,
+                description = "Container IDs (default: all containers)",
+            ).vararg().optional()
+
+            override fun run() {
+                stats(fs, cgroup, rootPath, containerIds)
+            }
+        }
+
+        class DaemonCommand : SpawnerlessSubcommand("daemon", "Serve container commands from a long-running process") {
+            override fun run() {
+                daemon(syscall, fs, cgroup, rootPath)
+            }
+        }
+
+        class ExecCommand : SpawnerlessSubcommand("exec", "Execute a process in a running container") {
             val containerId by argument(
                 ArgType.String,
                 description = "Container ID",
@@ -243,7 +374,7 @@ fun main(args: Array<String>): Unit =
                 description = "Command and arguments to run in the container",
             ).vararg()
 
-            override fun execute() {
+            override fun run() {
                 exec(fs, rootPath, containerId, processArgs)
             }
         }
@@ -255,7 +386,13 @@ fun main(args: Array<String>): Unit =
             KillCommand(),
             DeleteCommand(),
             PsCommand(),
+            ListCommand(),
             ExecCommand(),
+            PoolCommand(),
+            CreateBatchCommand(),
+            DaemonCommand(),
+            EventsCommand(),
+            StatsCommand(),
         )
 
         if (args.isEmpty()) {
@@ -274,7 +411,13 @@ fun main(args: Array<String>): Unit =
             println("  kill <container-id> <signal>                                       Send a signal to a container")
             println("  delete [--force|-f] <container-id>                                 Delete a container")
             println("  ps [--format|-f <json|table>] <container-id>                       List processes in a container")
+            println("  list [--format|-f <table|json>] [--quiet|-q]                       List containers under the root")
             println("  exec <container-id> <command> [args...]                            Run a process in a running container")
+            println("  pool [--bundle|-b <path>] [--size|-n <count>]                      Pre-create containers for later creates")
+            println("  create-batch [--file|-f <path>] [--jobs|-j <count>]                Create containers listed in a JSON request")
+            println("  daemon                                                             Serve state/kill/start/delete from one process")
+            println("  events [--memory-pressure <trigger>] <container-id>                Stream exit, OOM, pids-limit and PSI events as JSON lines")
+            println("  stats [<container-id>...]                                          Print runc-compatible stats (all containers by default)")
             exit(1)
         }
 
@@ -294,3 +437,24 @@ fun main(args: Array<String>): Unit =
             Logger.setLogLevel(logger.Logger.Level.DEBUG)
         }
     }
+
+/**
+ * Subcommand that creates no container of its own
+ *
+ * bootstrap.c pre-forks the stage-1 spawner before the Kotlin runtime starts
+ * (see start_spawner()), when it cannot know the command yet. Only create
+ * hands it a container, so every other command releases it first and it
+ * exits.
+ */
+@OptIn(ExperimentalForeignApi::class, ExperimentalCli::class)
+abstract class SpawnerlessSubcommand(
+    name: String,
+    actionDescription: String,
+) : Subcommand(name, actionDescription) {
+    abstract fun run()
+
+    override fun execute() {
+        kontainer_spawner_release()
+        run()
+    }
+}
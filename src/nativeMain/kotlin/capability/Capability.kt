@@ -205,7 +205,7 @@ fun applyBoundingSet(
     val boundingCaps = parseCapabilities(capabilities.bounding)
 
     if (capabilities.bounding != null) {
-        Logger.debug("setting bounding capabilities: ${boundingCaps.map { it.capName }}")
+        Logger.debug { "setting bounding capabilities: ${boundingCaps.map { it.capName }}" }
         dropBoundingCapabilities(syscall, boundingCaps)
     }
 
@@ -233,9 +233,9 @@ fun applyCapabilities(
     val permittedMask = capabilitiesToMask(permittedCaps)
     val inheritableMask = capabilitiesToMask(inheritableCaps)
 
-    Logger.debug("setting effective capabilities: ${effectiveCaps.map { it.capName }}")
-    Logger.debug("setting permitted capabilities: ${permittedCaps.map { it.capName }}")
-    Logger.debug("setting inheritable capabilities: ${inheritableCaps.map { it.capName }}")
+    Logger.debug { "setting effective capabilities: ${effectiveCaps.map { it.capName }}" }
+    Logger.debug { "setting permitted capabilities: ${permittedCaps.map { it.capName }}" }
+    Logger.debug { "setting inheritable capabilities: ${inheritableCaps.map { it.capName }}" }
 
     syscall.setCapabilities(
         CapabilitySets(
@@ -246,7 +246,7 @@ fun applyCapabilities(
     )
 
     if (capabilities.ambient != null) {
-        Logger.debug("setting ambient capabilities: ${ambientCaps.map { it.capName }}")
+        Logger.debug { "setting ambient capabilities: ${ambientCaps.map { it.capName }}" }
         setAmbientCapabilities(syscall, ambientCaps)
     }
 
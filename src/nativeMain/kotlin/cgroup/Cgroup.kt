@@ -15,7 +15,8 @@ interface Cgroup {
      * controllers required by [resources] in every ancestor's cgroup.subtree_control,
      * place [pid] in the leaf cgroup.procs, and apply the resource limits.
      *
-     * No-op when both [cgroupPath] and [resources] are null.
+     * No-op when both [cgroupPath] and [resources] are null. Equivalent to
+     * [prepare] followed by [addProcess].
      */
     fun setup(
         pid: Int,
@@ -23,6 +24,62 @@ interface Cgroup {
         resources: LinuxResources?,
     )
 
+    /**
+     * Create the cgroup at [cgroupPath], enable the controllers required by
+     * [resources] in every ancestor and apply the resource limits, without
+     * placing any process in it. Used before the container process exists,
+     * so it can be cloned straight into the cgroup.
+     */
+    fun prepare(
+        cgroupPath: String,
+        resources: LinuxResources?,
+    )
+
+    /**
+     * Move [pid] into the cgroup at [cgroupPath] by writing its cgroup.procs.
+     */
+    fun addProcess(
+        pid: Int,
+        cgroupPath: String,
+    )
+
+    /**
+     * Open the cgroup directory at [cgroupPath] for clone3(CLONE_INTO_CGROUP).
+     * The fd is not close-on-exec, so an exec'd stage-1 can inherit it.
+     *
+     * @return The fd, or -1 if it cannot be opened (callers then fall back to
+     *   [addProcess])
+     */
+    fun openDirectoryFd(cgroupPath: String): Int
+
+    /**
+     * Open the interface file [name] (e.g. "cgroup.events") of the cgroup at
+     * [cgroupPath] read-only. The kernel signals EPOLLPRI on the fd when a
+     * notifying file such as cgroup.events or memory.events changes.
+     *
+     * @return The fd (close-on-exec), or -1 if the file does not exist
+     */
+    fun openInterfaceFile(
+        cgroupPath: String,
+        name: String,
+    ): Int
+
+    /**
+     * Register the PSI trigger [trigger] ("some 150000 1000000": stall time
+     * and window in microseconds) on the `<resource>.pressure` file of the
+     * cgroup at [cgroupPath]. The kernel signals EPOLLPRI on the returned fd
+     * each time the stall exceeds the threshold within a window; the trigger
+     * lives as long as the fd.
+     *
+     * @return The fd (close-on-exec), or -1 if the file does not exist or
+     *   the kernel rejects the trigger
+     */
+    fun openPressureTrigger(
+        cgroupPath: String,
+        resource: String,
+        trigger: String,
+    ): Int
+
     /**
      * Best-effort removal of the cgroup directory at [cgroupPath]. Logs a warning
      * on failure (e.g. cgroup not empty) and never throws.
@@ -33,4 +90,10 @@ interface Cgroup {
      * Read the PIDs in the cgroup at [cgroupPath] from cgroup.procs.
      */
     fun getPids(cgroupPath: String): List<Int>
+
+    /**
+     * Read CPU, memory, pids and I/O statistics of the cgroup at [cgroupPath].
+     * Files of controllers that are not enabled read as zero.
+     */
+    fun readStats(cgroupPath: String): Stats
 }
@@ -0,0 +1,388 @@
+package cgroup
+
+import kotlinx.cinterop.*
+import kotlinx.serialization.SerialName
+import kotlinx.serialization.Serializable
+import platform.posix.*
+
+/**
+ * Container resource statistics in the schema of `runc events --stats`
+ * (libcontainer types.Stats), so existing consumers can read them unchanged
+ *
+ * All counters are uint64 like runc's. Times are in nanoseconds even though
+ * cgroup v2 reports microseconds, again as runc does.
+ */
+@Serializable
+data class StatsEvent(
+    val type: String,
+    val id: String,
+    val data: Stats,
+)
+
+@Serializable
+data class Stats(
+    val cpu: CpuStats,
+    val memory: MemoryStats,
+    val pids: PidsStats,
+    val blkio: BlkioStats,
+)
+
+@Serializable
+data class CpuStats(
+    val usage: CpuUsage,
+    val throttling: CpuThrottling,
+)
+
+@Serializable
+data class CpuUsage(
+    val total: ULong,
+    val kernel: ULong,
+    val user: ULong,
+)
+
+@Serializable
+data class CpuThrottling(
+    val periods: ULong,
+    @SerialName("throttled_periods") val throttledPeriods: ULong,
+    @SerialName("throttled_time") val throttledTime: ULong,
+)
+
+/**
+ * @property limit memory.max ("max" is reported as 2^64-1, as by runc)
+ * @property max Peak usage (memory.peak, 0 on kernels without it)
+ * @property failcnt Times the limit was hit ("max" in memory.events)
+ */
+@Serializable
+data class MemoryEntry(
+    val limit: ULong,
+    val usage: ULong,
+    val max: ULong,
+    val failcnt: ULong,
+)
+
+/**
+ * @property cache Page cache ("file" in memory.stat)
+ * @property raw All of memory.stat
+ */
+@Serializable
+data class MemoryStats(
+    val cache: ULong,
+    val usage: MemoryEntry,
+    val swap: MemoryEntry,
+    val raw: Map<String, ULong>,
+)
+
+/**
+ * @property limit pids.max, 0 if unlimited (as by runc)
+ */
+@Serializable
+data class PidsStats(
+    val current: ULong,
+    val limit: ULong,
+)
+
+@Serializable
+data class BlkioEntry(
+    val major: ULong,
+    val minor: ULong,
+    val op: String,
+    val value: ULong,
+)
+
+@Serializable
+data class BlkioStats(
+    val ioServiceBytesRecursive: List<BlkioEntry>,
+    val ioServicedRecursive: List<BlkioEntry>,
+)
+
+/**
+ * Reads the stats files of a cgroup into one reusable buffer
+ *
+ * Every file is read with pread into [buffer] and parsed in place: numbers
+ * are decoded from the bytes and keys are matched against byte constants,
+ * so a line costs no String. Only memory.stat keys (for the raw map) and the
+ * io.stat operation names are materialized. One reader can serve any number
+ * of containers.
+ */
+@OptIn(ExperimentalForeignApi::class)
+class CgroupStatsReader(
+    private val cgroupRoot: String = "/sys/fs/cgroup",
+) {
+    private val buffer = ByteArray(BUFFER_SIZE)
+    private var length = 0
+
+    /**
+     * Read all statistics of the cgroup at [cgroupPath]; files that do not
+     * exist (controller not enabled) read as zero
+     */
+    fun read(cgroupPath: String): Stats {
+        val dir = "$cgroupRoot/${cgroupPath.removePrefix("/")}"
+
+        val cpu = if (load("$dir/cpu.stat")) parseCpuStat(buffer, length) else parseCpuStat(buffer, 0)
+
+        val raw = if (load("$dir/memory.stat")) parseMemoryStat(buffer, length) else emptyMap()
+        val memoryEvents = if (load("$dir/memory.events")) valueOfKey(buffer, length, KEY_MAX) else 0uL
+        val usage =
+            MemoryEntry(
+                limit = readLimit("$dir/memory.max", unlimited = ULong.MAX_VALUE),
+                usage = readSingle("$dir/memory.current"),
+                max = readSingle("$dir/memory.peak"),
+                failcnt = memoryEvents,
+            )
+        val swapEvents = if (load("$dir/memory.swap.events")) valueOfKey(buffer, length, KEY_MAX) else 0uL
+        val swap =
+            MemoryEntry(
+                limit = readLimit("$dir/memory.swap.max", unlimited = ULong.MAX_VALUE),
+                usage = readSingle("$dir/memory.swap.current"),
+                max = readSingle("$dir/memory.swap.peak"),
+                failcnt = swapEvents,
+            )
+
+        val pids =
+            PidsStats(
+                current = readSingle("$dir/pids.current"),
+                limit = readLimit("$dir/pids.max", unlimited = 0uL),
+            )
+
+        val blkio = if (load("$dir/io.stat")) parseIoStat(buffer, length) else BlkioStats(emptyList(), emptyList())
+
+        return Stats(
+            cpu = cpu,
+            memory = MemoryStats(cache = raw["file"] ?: 0uL, usage = usage, swap = swap, raw = raw),
+            pids = pids,
+            blkio = blkio,
+        )
+    }
+
+    private fun readSingle(path: String): ULong = if (load(path)) parseSingleValue(buffer, length) ?: 0uL else 0uL
+
+    private fun readLimit(
+        path: String,
+        unlimited: ULong,
+    ): ULong {
+        if (!load(path)) return unlimited
+        return parseSingleValue(buffer, length) ?: unlimited
+    }
+
+    /**
+     * pread [path] into [buffer]
+     *
+     * @return false if the file cannot be opened or read
+     */
+    private fun load(path: String): Boolean {
+        val fd = open(path, O_RDONLY or O_CLOEXEC)
+        if (fd < 0) return false
+        try {
+            var done = 0
+            buffer.usePinned { pinned ->
+                while (done < buffer.size) {
+                    val n = pread(fd, pinned.addressOf(done), (buffer.size - done).convert(), done.toLong())
+                    if (n < 0 && errno == EINTR) continue
+                    if (n < 0) return false
+                    if (n == 0L) break
+                    done += n.toInt()
+                }
+            }
+            length = done
+            return true
+        } finally {
+            close(fd)
+        }
+    }
+
+    private companion object {
+        /** memory.stat is the largest file, well under 8 KiB */
+        const val BUFFER_SIZE = 65536
+    }
+}
+
+private val KEY_USAGE_USEC = "usage_usec".encodeToByteArray()
+private val KEY_USER_USEC = "user_usec".encodeToByteArray()
+private val KEY_SYSTEM_USEC = "system_usec".encodeToByteArray()
+private val KEY_NR_PERIODS = "nr_periods".encodeToByteArray()
+private val KEY_NR_THROTTLED = "nr_throttled".encodeToByteArray()
+private val KEY_THROTTLED_USEC = "throttled_usec".encodeToByteArray()
+private val KEY_MAX = "max".encodeToByteArray()
+private val KEY_RBYTES = "rbytes".encodeToByteArray()
+private val KEY_WBYTES = "wbytes".encodeToByteArray()
+private val KEY_RIOS = "rios".encodeToByteArray()
+private val KEY_WIOS = "wios".encodeToByteArray()
+
+private const val SPACE = ' '.code.toByte()
+private const val NEWLINE = '\n'.code.toByte()
+private const val COLON = ':'.code.toByte()
+private const val EQUALS = '='.code.toByte()
+
+/**
+ * Call [action] with the [start, end) bounds of every line of bytes[0, length)
+ */
+private inline fun forEachLine(
+    bytes: ByteArray,
+    length: Int,
+    action: (start: Int, end: Int) -> Unit,
+) {
+    var start = 0
+    while (start < length) {
+        var end = start
+        while (end < length && bytes[end] != NEWLINE) end++
+        if (end > start) action(start, end)
+        start = end + 1
+    }
+}
+
+private fun indexOf(
+    bytes: ByteArray,
+    byte: Byte,
+    start: Int,
+    end: Int,
+): Int {
+    for (i in start until end) if (bytes[i] == byte) return i
+    return -1
+}
+
+private fun regionEquals(
+    bytes: ByteArray,
+    start: Int,
+    end: Int,
+    key: ByteArray,
+): Boolean {
+    if (end - start != key.size) return false
+    for (i in key.indices) if (bytes[start + i] != key[i]) return false
+    return true
+}
+
+/**
+ * Decode the unsigned decimal in bytes[start, end)
+ *
+ * @return The value, or null if the region is empty or not all digits
+ */
+internal fun parseUnsigned(
+    bytes: ByteArray,
+    start: Int,
+    end: Int,
+): ULong? {
+    if (start >= end) return null
+    var value = 0uL
+    for (i in start until end) {
+        val digit = bytes[i] - '0'.code.toByte()
+        if (digit !in 0..9) return null
+        value = value * 10uL + digit.toULong()
+    }
+    return value
+}
+
+/**
+ * Value of a single-value file ("123\n"); null for "max" or garbage
+ */
+internal fun parseSingleValue(
+    bytes: ByteArray,
+    length: Int,
+): ULong? {
+    var end = length
+    while (end > 0 && (bytes[end - 1] == NEWLINE || bytes[end - 1] == SPACE)) end--
+    return parseUnsigned(bytes, 0, end)
+}
+
+/**
+ * Value of [key] in a flat keyed file ("key value" lines), 0 if absent
+ */
+internal fun valueOfKey(
+    bytes: ByteArray,
+    length: Int,
+    key: ByteArray,
+): ULong {
+    forEachLine(bytes, length) { start, end ->
+        val space = indexOf(bytes, SPACE, start, end)
+        if (space > 0 && regionEquals(bytes, start, space, key)) {
+            return parseUnsigned(bytes, space + 1, end) ?: 0uL
+        }
+    }
+    return 0uL
+}
+
+/**
+ * Parse cpu.stat, converting microseconds to nanoseconds
+ */
+internal fun parseCpuStat(
+    bytes: ByteArray,
+    length: Int,
+): CpuStats {
+    var total = 0uL
+    var user = 0uL
+    var system = 0uL
+    var periods = 0uL
+    var throttled = 0uL
+    var throttledTime = 0uL
+    forEachLine(bytes, length) { start, end ->
+        val space = indexOf(bytes, SPACE, start, end)
+        if (space < 0) return@forEachLine
+        val value = parseUnsigned(bytes, space + 1, end) ?: return@forEachLine
+        when {
+            regionEquals(bytes, start, space, KEY_USAGE_USEC) -> total = value * 1000uL
+            regionEquals(bytes, start, space, KEY_USER_USEC) -> user = value * 1000uL
+            regionEquals(bytes, start, space, KEY_SYSTEM_USEC) -> system = value * 1000uL
+            regionEquals(bytes, start, space, KEY_NR_PERIODS) -> periods = value
+            regionEquals(bytes, start, space, KEY_NR_THROTTLED) -> throttled = value
+            regionEquals(bytes, start, space, KEY_THROTTLED_USEC) -> throttledTime = value * 1000uL
+        }
+    }
+    return CpuStats(
+        usage = CpuUsage(total = total, kernel = system, user = user),
+        throttling = CpuThrottling(periods = periods, throttledPeriods = throttled, throttledTime = throttledTime),
+    )
+}
+
+/**
+ * Parse memory.stat into the raw map
+ */
+internal fun parseMemoryStat(
+    bytes: ByteArray,
+    length: Int,
+): Map<String, ULong> {
+    val raw = LinkedHashMap<String, ULong>(64)
+    forEachLine(bytes, length) { start, end ->
+        val space = indexOf(bytes, SPACE, start, end)
+        if (space <= start) return@forEachLine
+        val value = parseUnsigned(bytes, space + 1, end) ?: return@forEachLine
+        raw[bytes.decodeToString(start, space)] = value
+    }
+    return raw
+}
+
+/**
+ * Parse io.stat ("8:0 rbytes=1 wbytes=2 rios=3 wios=4 dbytes=0 dios=0")
+ * into runc's per-device Read/Write entries
+ */
+internal fun parseIoStat(
+    bytes: ByteArray,
+    length: Int,
+): BlkioStats {
+    val serviceBytes = mutableListOf<BlkioEntry>()
+    val serviced = mutableListOf<BlkioEntry>()
+    forEachLine(bytes, length) { start, end ->
+        val colon = indexOf(bytes, COLON, start, end)
+        if (colon < 0) return@forEachLine
+        var fieldStart = indexOf(bytes, SPACE, colon, end)
+        val major = parseUnsigned(bytes, start, colon) ?: return@forEachLine
+        val minor = parseUnsigned(bytes, colon + 1, if (fieldStart < 0) end else fieldStart) ?: return@forEachLine
+        while (fieldStart in 0 until end) {
+            val keyStart = fieldStart + 1
+            val next = indexOf(bytes, SPACE, keyStart, end)
+            val fieldEnd = if (next < 0) end else next
+            val eq = indexOf(bytes, EQUALS, keyStart, fieldEnd)
+            if (eq > 0) {
+                val value = parseUnsigned(bytes, eq + 1, fieldEnd)
+                if (value != null) {
+                    when {
+                        regionEquals(bytes, keyStart, eq, KEY_RBYTES) -> serviceBytes += BlkioEntry(major, minor, "Read", value)
+                        regionEquals(bytes, keyStart, eq, KEY_WBYTES) -> serviceBytes += BlkioEntry(major, minor, "Write", value)
+                        regionEquals(bytes, keyStart, eq, KEY_RIOS) -> serviced += BlkioEntry(major, minor, "Read", value)
+                        regionEquals(bytes, keyStart, eq, KEY_WIOS) -> serviced += BlkioEntry(major, minor, "Write", value)
+                    }
+                }
+            }
+            fieldStart = next
+        }
+    }
+    return BlkioStats(ioServiceBytesRecursive = serviceBytes, ioServicedRecursive = serviced)
+}
@@ -1,9 +1,21 @@
 package cgroup
 
 import kotlinx.cinterop.ExperimentalForeignApi
-import kotlinx.cinterop.memScoped
+import kotlinx.cinterop.addressOf
+import kotlinx.cinterop.convert
+import kotlinx.cinterop.usePinned
 import logger.Logger
+import platform.posix.O_CLOEXEC
+import platform.posix.O_DIRECTORY
+import platform.posix.O_NONBLOCK
+import platform.posix.O_RDONLY
+import platform.posix.O_RDWR
+import platform.posix.close
+import platform.posix.errno
+import platform.posix.open
+import platform.posix.write
 import spec.LinuxResources
+import utils.DirectoryHandle
 import utils.FileSystem
 
 /**
@@ -22,60 +34,142 @@ class CgroupV2(
             return
         }
 
-        memScoped {
-            // cgroupPath is expected to be the FINAL relative-to-cgroup-root
-            // path the runtime has already resolved (see resolveCgroupPath()
-            // in this file). If the caller passes null we fall back to a PID-
-            // suffixed leaf under our runtime's subtree — this is mainly for
-            // tests that don't go through MainProcess's resolver.
-            val normalizedPath = cgroupPath?.removePrefix("/") ?: "kontainer-runtime/kontainer-$pid"
-            val fullPath = "$CGROUP_ROOT/$normalizedPath"
-
-            Logger.debug("setting up cgroup at $fullPath")
-
-            fs.createDirectories(fullPath, 0x1EDu) // 0o755
-            Logger.debug("created cgroup directory: $fullPath")
-
-            // Enable controllers at every ancestor of the leaf cgroup.
-            // In cgroup v2 a controller is only available in a child cgroup if its
-            // parent's cgroup.subtree_control contains +<controller>. For a nested
-            // path like "default/test-verify" we must enable controllers in both
-            // /sys/fs/cgroup/cgroup.subtree_control and
-            // /sys/fs/cgroup/default/cgroup.subtree_control, otherwise opening
-            // memory.max etc. in the leaf fails with EACCES.
-            val requiredControllers = getRequiredControllers(resources)
-            if (requiredControllers.isNotEmpty()) {
-                val segments = normalizedPath.split("/").filter { it.isNotEmpty() }
-                val ancestorPaths = mutableListOf(CGROUP_ROOT)
-                for (i in 0 until segments.size - 1) {
-                    ancestorPaths.add("${ancestorPaths.last()}/${segments[i]}")
-                }
+        // cgroupPath is expected to be the FINAL relative-to-cgroup-root
+        // path the runtime has already resolved (see resolveCgroupPath()
+        // in this file). If the caller passes null we fall back to a PID-
+        // suffixed leaf under our runtime's subtree — this is mainly for
+        // tests that don't go through MainProcess's resolver.
+        val path = cgroupPath ?: "kontainer-runtime/kontainer-$pid"
+        prepare(path, resources)
+        addProcess(pid, path)
+    }
 
-                for (ancestorPath in ancestorPaths) {
-                    val subtreeControlPath = "$ancestorPath/$CGROUP_SUBTREE_CONTROL"
-                    for (controller in requiredControllers) {
-                        try {
-                            fs.writeTextFile(subtreeControlPath, "+$controller")
-                            Logger.debug("enabled $controller controller in $ancestorPath")
-                        } catch (e: Exception) {
-                            Logger.error("failed to enable $controller controller in $ancestorPath: ${e.message}")
-                            throw Exception("Failed to enable required cgroup controller: $controller in $ancestorPath", e)
-                        }
-                    }
-                }
+    override fun prepare(
+        cgroupPath: String,
+        resources: LinuxResources?,
+    ) {
+        val normalizedPath = cgroupPath.removePrefix("/")
+        val fullPath = "$CGROUP_ROOT/$normalizedPath"
+
+        Logger.debug { "setting up cgroup at $fullPath" }
+
+        fs.createDirectories(fullPath, 0x1EDu) // 0o755
+        Logger.debug { "created cgroup directory: $fullPath" }
+
+        // Enable controllers at every ancestor of the leaf cgroup.
+        // In cgroup v2 a controller is only available in a child cgroup if its
+        // parent's cgroup.subtree_control contains +<controller>. For a nested
+        // path like "default/test-verify" we must enable controllers in both
+        // /sys/fs/cgroup/cgroup.subtree_control and
+        // /sys/fs/cgroup/default/cgroup.subtree_control, otherwise opening
+        // memory.max etc. in the leaf fails with EACCES.
+        val requiredControllers = getRequiredControllers(resources)
+        if (requiredControllers.isNotEmpty()) {
+            val segments = normalizedPath.split("/").filter { it.isNotEmpty() }
+            val ancestorPaths = mutableListOf(CGROUP_ROOT)
+            for (i in 0 until segments.size - 1) {
+                ancestorPaths.add("${ancestorPaths.last()}/${segments[i]}")
             }
 
-            val procsPath = "$fullPath/$CGROUP_PROCS"
-            try {
-                fs.writeTextFile(procsPath, pid.toString())
-                Logger.debug("added PID $pid to cgroup")
-            } catch (e: Exception) {
-                Logger.error("failed to add PID to cgroup: ${e.message}")
-                throw Exception("Failed to add PID to cgroup", e)
+            for (ancestorPath in ancestorPaths) {
+                enableControllers(ancestorPath, requiredControllers)
             }
+        }
+
+        if (resources != null) {
+            // All leaf files go through one O_DIRECTORY fd
+            fs.openDirectory(fullPath).use { leaf -> applyResources(leaf, resources) }
+        }
+    }
+
+    override fun addProcess(
+        pid: Int,
+        cgroupPath: String,
+    ) {
+        val fullPath = "$CGROUP_ROOT/${cgroupPath.removePrefix("/")}"
+        try {
+            fs.openDirectory(fullPath).use { leaf -> leaf.writeFile(CGROUP_PROCS, pid.toString()) }
+            Logger.debug { "added PID $pid to cgroup" }
+        } catch (e: Exception) {
+            Logger.error("failed to add PID to cgroup: ${e.message}")
+            throw Exception("Failed to add PID to cgroup", e)
+        }
+    }
+
+    override fun openDirectoryFd(cgroupPath: String): Int {
+        val fullPath = "$CGROUP_ROOT/${cgroupPath.removePrefix("/")}"
+        val fd = open(fullPath, O_RDONLY or O_DIRECTORY)
+        if (fd < 0) {
+            Logger.warn("failed to open cgroup directory $fullPath (errno=$errno)")
+        }
+        return fd
+    }
+
+    override fun openPressureTrigger(
+        cgroupPath: String,
+        resource: String,
+        trigger: String,
+    ): Int {
+        val fullPath = "$CGROUP_ROOT/${cgroupPath.removePrefix("/")}/$resource.pressure"
+        val fd = open(fullPath, O_RDWR or O_NONBLOCK or O_CLOEXEC)
+        if (fd < 0) {
+            Logger.debug { "cannot open $fullPath (errno=$errno)" }
+            return -1
+        }
+        val bytes = trigger.encodeToByteArray()
+        val written = bytes.usePinned { write(fd, it.addressOf(0), bytes.size.convert()) }
+        if (written != bytes.size.toLong()) {
+            Logger.warn("failed to register PSI trigger \"$trigger\" on $fullPath (errno=$errno)")
+            close(fd)
+            return -1
+        }
+        Logger.debug { "registered PSI trigger \"$trigger\" on $fullPath" }
+        return fd
+    }
+
+    override fun openInterfaceFile(
+        cgroupPath: String,
+        name: String,
+    ): Int {
+        val fullPath = "$CGROUP_ROOT/${cgroupPath.removePrefix("/")}/$name"
+        val fd = open(fullPath, O_RDONLY or O_CLOEXEC)
+        if (fd < 0) {
+            Logger.debug { "cannot open $fullPath (errno=$errno)" }
+        }
+        return fd
+    }
 
-            if (resources != null) {
-                applyResources(fullPath, resources)
+    /**
+     * Enable [controllers] in [cgroupDir]'s cgroup.subtree_control
+     *
+     * Controllers already listed there are skipped, and the rest are enabled
+     * with a single write ("+memory +pids"). Ancestors such as the cgroup
+     * root are shared by every container, and each write takes the kernel's
+     * global cgroup mutex, so on a warm host this usually writes nothing.
+     */
+    private fun enableControllers(
+        cgroupDir: String,
+        controllers: List<String>,
+    ) {
+        fs.openDirectory(cgroupDir).use { dir ->
+            val enabled =
+                try {
+                    parseControllers(dir.readFile(CGROUP_SUBTREE_CONTROL))
+                } catch (e: Exception) {
+                    Logger.debug { "could not read $cgroupDir/$CGROUP_SUBTREE_CONTROL: ${e.message}" }
+                    emptySet()
+                }
+            val missing = controllers.filter { it !in enabled }
+            if (missing.isEmpty()) {
+                Logger.debug { "controllers ${controllers.joinToString(",")} already enabled in $cgroupDir" }
+                return
+            }
+            try {
+                dir.writeFile(CGROUP_SUBTREE_CONTROL, missing.joinToString(" ") { "+$it" })
+                Logger.debug { "enabled ${missing.joinToString(",")} controllers in $cgroupDir" }
+            } catch (e: Exception) {
+                Logger.error("failed to enable ${missing.joinToString(",")} controllers in $cgroupDir: ${e.message}")
+                throw Exception("Failed to enable required cgroup controller: ${missing.joinToString(",")} in $cgroupDir", e)
             }
         }
     }
@@ -88,19 +182,24 @@ class CgroupV2(
 
         val normalizedPath = cgroupPath.removePrefix("/")
         val fullPath = "$CGROUP_ROOT/$normalizedPath"
-        Logger.debug("cleaning up cgroup at $fullPath")
+        Logger.debug { "cleaning up cgroup at $fullPath" }
 
         // removeDirectory returns false on missing directory or error; in either
         // case cleanup is best-effort and we already log inside the impl.
         fs.removeDirectory(fullPath)
     }
 
+    /** Shared by every [readStats] call, so a multi-container read reuses one buffer */
+    private val statsReader by lazy { CgroupStatsReader(CGROUP_ROOT) }
+
+    override fun readStats(cgroupPath: String): Stats = statsReader.read(cgroupPath)
+
     override fun getPids(cgroupPath: String): List<Int> {
         val normalizedPath = cgroupPath.removePrefix("/")
         val fullPath = "$CGROUP_ROOT/$normalizedPath"
         val procsPath = "$fullPath/$CGROUP_PROCS"
 
-        Logger.debug("reading PIDs from $procsPath")
+        Logger.debug { "reading PIDs from $procsPath" }
 
         val content =
             try {
@@ -117,87 +216,88 @@ class CgroupV2(
                 .filter { it.isNotBlank() }
                 .mapNotNull { line ->
                     line.trim().toIntOrNull()?.also {
-                        Logger.debug("found PID: $it")
+                        Logger.debug { "found PID: $it" }
                     }
                 }
 
-        Logger.debug("found ${pids.size} PIDs in cgroup")
+        Logger.debug { "found ${pids.size} PIDs in cgroup" }
         return pids
     }
 
     private fun applyResources(
-        cgroupPath: String,
+        cgroup: DirectoryHandle,
         resources: LinuxResources,
     ) {
         resources.memory?.let { memory ->
-            applyMemoryLimits(cgroupPath, memory.limit, memory.reservation, memory.swap)
+            applyMemoryLimits(cgroup, memory.limit, memory.reservation, memory.swap)
         }
         resources.cpu?.let { cpu ->
-            applyCpuLimits(cgroupPath, cpu.shares, cpu.quota, cpu.period)
+            applyCpuLimits(cgroup, cpu.shares, cpu.quota, cpu.period)
+            applyCpuset(cgroup, cpu.cpus, cpu.mems)
         }
         resources.pids?.let { pids ->
-            applyPidsLimit(cgroupPath, pids.limit)
+            applyPidsLimit(cgroup, pids.limit)
         }
         resources.hugepageLimits?.forEach { hp ->
-            applyHugepageLimit(cgroupPath, hp.pageSize, hp.limit)
+            applyHugepageLimit(cgroup, hp.pageSize, hp.limit)
+        }
+        resources.unified?.forEach { (name, value) ->
+            writeCgroupFile(cgroup, name, value)
         }
     }
 
     private fun applyPidsLimit(
-        cgroupPath: String,
+        cgroup: DirectoryHandle,
         limit: Long?,
     ) {
         if (limit == null) return
         val value = if (limit <= 0) "max" else limit.toString()
-        writeCgroupFile("$cgroupPath/$PIDS_MAX", value, "pids.max")
+        writeCgroupFile(cgroup, PIDS_MAX, value)
     }
 
     private fun applyHugepageLimit(
-        cgroupPath: String,
+        cgroup: DirectoryHandle,
         pageSize: String,
         limit: Long,
     ) {
         // cgroup v2 file name: hugetlb.<size>.max (e.g. hugetlb.2MB.max).
         val fileName = "hugetlb.${pageSize}.max"
         val value = if (limit <= 0) "max" else limit.toString()
-        writeCgroupFile("$cgroupPath/$fileName", value, fileName)
+        writeCgroupFile(cgroup, fileName, value)
     }
 
     private fun applyMemoryLimits(
-        cgroupPath: String,
+        cgroup: DirectoryHandle,
         limit: Long?,
         reservation: Long?,
         swap: Long?,
     ) {
         limit?.let {
-            val memoryMaxPath = "$cgroupPath/$MEMORY_MAX"
             val value = if (it == -1L) "max" else it.toString()
-            writeCgroupFile(memoryMaxPath, value, "memory.max")
+            writeCgroupFile(cgroup, MEMORY_MAX, value)
         }
 
         reservation?.let {
-            val memoryLowPath = "$cgroupPath/$MEMORY_LOW"
             val value = if (it == -1L) "max" else it.toString()
-            writeCgroupFile(memoryLowPath, value, "memory.low")
+            writeCgroupFile(cgroup, MEMORY_LOW, value)
         }
 
         // In cgroup v2 swap is separate from memory (unlike v1 where swap was
         // memory+swap), so swap.max receives swap minus the limit.
         swap?.let { swapValue ->
             limit?.let { limitValue ->
-                val memorySwapPath = "$cgroupPath/$MEMORY_SWAP_MAX"
                 val value =
                     when {
                         swapValue == -1L || limitValue == -1L -> "max"
                         else -> (swapValue - limitValue).toString()
                     }
-                writeCgroupFile(memorySwapPath, value, "memory.swap.max")
+                writeCgroupFile(cgroup, MEMORY_SWAP_MAX, value)
             }
         }
     }
 
     private fun applyCpuLimits(
-        cgroupPath: String,
+        cgroup: DirectoryHandle,
         shares: Long?,
         quota: Long?,
         period: Long?,
@@ -214,15 +314,13 @@ class CgroupV2(
                         minOf(w, 10000L) // MAX_CPU_WEIGHT
                     }
                 if (weight != 0L) {
-                    val cpuWeightPath = "$cgroupPath/$CPU_WEIGHT"
-                    writeCgroupFile(cpuWeightPath, weight.toString(), "cpu.weight")
+                    writeCgroupFile(cgroup, CPU_WEIGHT, weight.toString())
                 }
             }
         }
 
         // Set cpu.max (format: "quota period")
         if (quota != null || period != null) {
-            val cpuMaxPath = "$cgroupPath/$CPU_MAX"
             val quotaStr =
                 when {
                     quota == null -> null
@@ -240,19 +338,28 @@ class CgroupV2(
                 }
 
             value?.let {
-                writeCgroupFile(cpuMaxPath, it, "cpu.max")
+                writeCgroupFile(cgroup, CPU_MAX, it)
             }
         }
     }
 
+    private fun applyCpuset(
+        cgroup: DirectoryHandle,
+        cpus: String?,
+        mems: String?,
+    ) {
+        cpus?.let { writeCgroupFile(cgroup, CPUSET_CPUS, it) }
+        mems?.let { writeCgroupFile(cgroup, CPUSET_MEMS, it) }
+    }
+
     private fun writeCgroupFile(
-        path: String,
-        value: String,
+        cgroup: DirectoryHandle,
         name: String,
+        value: String,
     ) {
         try {
-            fs.writeTextFile(path, value)
-            Logger.debug("set $name = $value")
+            cgroup.writeFile(name, value)
+            Logger.debug { "set $name = $value" }
         } catch (e: Exception) {
             // Warn-only because resource limits are best-effort
             Logger.warn("failed to write $name: ${e.message}")
@@ -265,10 +372,14 @@ class CgroupV2(
         }
         val controllers = mutableListOf<String>()
         if (resources.memory != null) controllers.add("memory")
-        if (resources.cpu != null) controllers.add("cpu")
+        resources.cpu?.let { cpu ->
+            if (cpu.shares != null || cpu.quota != null || cpu.period != null) controllers.add("cpu")
+            if (cpu.cpus != null || cpu.mems != null) controllers.add("cpuset")
+        }
         if (resources.pids != null) controllers.add("pids")
         if (!resources.hugepageLimits.isNullOrEmpty()) controllers.add("hugetlb")
-        return controllers
+        resources.unified?.keys?.forEach { controllers.add(unifiedController(it)) }
+        return controllers.distinct()
     }
 
     companion object {
@@ -296,6 +407,48 @@ class CgroupV2(
                 else -> "$RUNTIME_CGROUP_PREFIX/$specPath"
             }
 
+        /**
+         * Controller of the unified key [name] ("memory.high" -> "memory")
+         *
+         * Only files of the controllers below can be set. cgroup.* core files
+         * are refused: they move processes and shape the hierarchy, which the
+         * runtime owns.
+         *
+         * @throws Exception if [name] is not a controller interface file
+         */
+        fun unifiedController(name: String): String {
+            val controller = name.substringBefore('.', "")
+            if ('/' in name || controller !in UNIFIED_CONTROLLERS || name.length == controller.length + 1) {
+                throw Exception("Invalid linux.resources.unified key: \"$name\"")
+            }
+            return controller
+        }
+
+        private val UNIFIED_CONTROLLERS = setOf("cpu", "cpuset", "io", "memory", "pids", "hugetlb", "rdma", "misc")
+
+        /**
+         * Parse cgroup.subtree_control / cgroup.controllers ("cpu memory pids")
+         */
+        fun parseControllers(content: String): Set<String> =
+            content
+                .split(' ', '\n', '\t')
+                .map { it.removePrefix("+") }
+                .filter { it.isNotEmpty() }
+                .toSet()
+
+        /**
+         * Parse a flat keyed file such as cgroup.events or memory.events
+         * ("populated 1\nfrozen 0\n"); lines without a numeric value are skipped
+         */
+        fun parseKeyedCounters(content: String): Map<String, Long> =
+            content
+                .lineSequence()
+                .mapNotNull { line ->
+                    val parts = line.trim().split(' ')
+                    if (parts.size != 2) return@mapNotNull null
+                    parts[1].toLongOrNull()?.let { parts[0] to it }
+                }.toMap()
+
         private const val CGROUP_ROOT = "/sys/fs/cgroup"
         private const val CGROUP_PROCS = "cgroup.procs"
         private const val CGROUP_SUBTREE_CONTROL = "cgroup.subtree_control"
@@ -304,6 +457,8 @@ class CgroupV2(
         private const val MEMORY_SWAP_MAX = "memory.swap.max"
         private const val CPU_WEIGHT = "cpu.weight"
         private const val CPU_MAX = "cpu.max"
+        private const val CPUSET_CPUS = "cpuset.cpus"
+        private const val CPUSET_MEMS = "cpuset.mems"
         private const val PIDS_MAX = "pids.max"
     }
 }
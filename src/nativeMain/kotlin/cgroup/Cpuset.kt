@@ -0,0 +1,212 @@
+package cgroup
+
+import kotlinx.cinterop.*
+import logger.Logger
+import platform.posix.*
+import spec.ANNOTATION_CPUSET_AUTOPIN
+import spec.Linux
+import spec.LinuxCpu
+import spec.LinuxResources
+import spec.Spec
+import spec.annotationEnabled
+import syscall.Syscall
+import utils.FileSystem
+
+/*
+ * CPU and NUMA placement
+ *
+ * linux.resources.cpu.cpus/mems go to the cgroup's cpuset.cpus/cpuset.mems
+ * (see CgroupV2.applyResources). The init additionally pins itself with
+ * sched_setaffinity and binds its memory with set_mempolicy (see
+ * [applyCpuPlacement]), so the placement holds from the first instruction of
+ * the container process and first-touch allocations land on the right node
+ * even where the cpuset controller is not delegated.
+ *
+ * With [ANNOTATION_CPUSET_AUTOPIN], a spec that sets neither cpus nor mems is
+ * pinned by create to one NUMA node: the node used by the fewest sibling
+ * cgroups ([pickNumaNode]).
+ */
+
+private const val NODE_SYSFS = "/sys/devices/system/node"
+
+/**
+ * Parse a cpuset list ("0-3,8,10-11") into sorted, distinct ids
+ *
+ * @throws Exception if [list] is malformed
+ */
+fun parseCpuList(list: String): List<Int> {
+    val ids = sortedSetOf<Int>()
+    for (part in list.trim().split(',')) {
+        if (part.isEmpty()) continue
+        val bounds = part.split('-')
+        val first = bounds[0].toIntOrNull()
+        val last = bounds.getOrNull(1)?.toIntOrNull() ?: first
+        if (first == null || last == null || bounds.size > 2 || first < 0 || last < first) {
+            throw Exception("Invalid cpuset list: \"$list\"")
+        }
+        for (id in first..last) ids.add(id)
+    }
+    return ids.toList()
+}
+
+/**
+ * An online NUMA node and its CPUs
+ */
+data class NumaNode(
+    val id: Int,
+    val cpus: List<Int>,
+)
+
+/**
+ * A sibling cgroup's requested placement; empty lists mean "not restricted"
+ */
+data class CpusetUsage(
+    val cpus: List<Int>,
+    val mems: List<Int>,
+)
+
+/**
+ * Online NUMA nodes that have CPUs, from sysfs
+ *
+ * Memory-only nodes (CXL, some HBM) are skipped: pinning a container to
+ * one would leave it no CPU.
+ *
+ * @return The nodes in id order; empty if sysfs has no node information
+ */
+fun readNumaNodes(fs: FileSystem): List<NumaNode> {
+    val online =
+        try {
+            parseCpuList(fs.readProcFile("$NODE_SYSFS/online"))
+        } catch (e: Exception) {
+            Logger.debug { "no NUMA node information: ${e.message}" }
+            return emptyList()
+        }
+    return online.mapNotNull { id ->
+        val cpus = runCatching { parseCpuList(fs.readProcFile("$NODE_SYSFS/node$id/cpulist")) }.getOrDefault(emptyList())
+        if (cpus.isEmpty()) null else NumaNode(id, cpus)
+    }
+}
+
+/**
+ * The node used by the fewest of [siblings]; ties go to the lowest id
+ *
+ * A sibling counts against the nodes in its mems or, if it only restricts
+ * CPUs, against every node it has a CPU on. Siblings restricted to nothing
+ * count against no node.
+ */
+fun pickNumaNode(
+    nodes: List<NumaNode>,
+    siblings: List<CpusetUsage>,
+): NumaNode? =
+    nodes.minByOrNull { node ->
+        siblings.count { sibling ->
+            if (sibling.mems.isNotEmpty()) {
+                node.id in sibling.mems
+            } else {
+                sibling.cpus.any { it in node.cpus }
+            }
+        }
+    }
+
+/**
+ * Requested placement of the cgroups next to [cgroupPath], which is itself
+ * excluded
+ *
+ * Reads cpuset.cpus/cpuset.mems (what the siblings asked for), not the
+ * .effective files, which show the parent's whole set for every unpinned
+ * sibling. Entries without cpuset files (interface files, siblings without
+ * the controller) are skipped.
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun readSiblingCpusets(
+    fs: FileSystem,
+    cgroupPath: String,
+    cgroupRoot: String = "/sys/fs/cgroup",
+): List<CpusetUsage> {
+    val normalized = cgroupPath.trim('/')
+    val parent = "$cgroupRoot/${normalized.substringBeforeLast('/', "")}".trimEnd('/')
+    val leaf = normalized.substringAfterLast('/')
+    val dir = opendir(parent) ?: return emptyList()
+    val names = mutableListOf<String>()
+    try {
+        while (true) {
+            val entry = readdir(dir) ?: break
+            val name = entry.pointed.d_name.toKString()
+            if (name == "." || name == ".." || name == leaf) continue
+            names.add(name)
+        }
+    } finally {
+        closedir(dir)
+    }
+    return names.mapNotNull { name ->
+        runCatching {
+            CpusetUsage(
+                cpus = parseCpuList(fs.readProcFile("$parent/$name/cpuset.cpus")),
+                mems = parseCpuList(fs.readProcFile("$parent/$name/cpuset.mems")),
+            )
+        }.getOrNull()
+    }
+}
+
+/**
+ * Pin [spec] to the least-used NUMA node if it asks for it
+ *
+ * Only when [ANNOTATION_CPUSET_AUTOPIN] is set, the spec leaves both cpus and
+ * mems unset and the host has more than one node with CPUs. Two creates
+ * racing for the same cgroup parent can pick the same node; the choice is a
+ * balancing hint, not a reservation.
+ *
+ * @return [spec] with linux.resources.cpu.cpus/mems set to the chosen node,
+ *   or [spec] unchanged
+ */
+fun autoPinCpuset(
+    fs: FileSystem,
+    spec: Spec,
+    cgroupPath: String,
+    cgroupRoot: String = "/sys/fs/cgroup",
+): Spec {
+    if (!spec.annotationEnabled(ANNOTATION_CPUSET_AUTOPIN)) return spec
+    val cpu = spec.linux?.resources?.cpu
+    if (cpu?.cpus != null || cpu?.mems != null) {
+        Logger.debug { "cpuset auto-pin skipped: spec sets cpus or mems" }
+        return spec
+    }
+    val nodes = readNumaNodes(fs)
+    if (nodes.size < 2) {
+        Logger.debug { "cpuset auto-pin skipped: ${nodes.size} NUMA nodes with CPUs" }
+        return spec
+    }
+    val node = pickNumaNode(nodes, readSiblingCpusets(fs, cgroupPath, cgroupRoot)) ?: return spec
+    Logger.debug { "cpuset auto-pin: node ${node.id}" }
+
+    val linux = spec.linux ?: Linux()
+    val resources = linux.resources ?: LinuxResources()
+    val pinned = (cpu ?: LinuxCpu()).copy(cpus = node.cpus.joinToString(","), mems = "${node.id}")
+    return spec.copy(linux = linux.copy(resources = resources.copy(cpu = pinned)))
+}
+
+/**
+ * Pin the calling process to [cpu]'s cpus and bind its memory to [cpu]'s
+ * mems
+ *
+ * Both are inherited across fork and execve. Best-effort: the cgroup's
+ * cpuset already enforces the placement where the controller is
+ * available, so a failure is only logged.
+ */
+fun applyCpuPlacement(
+    syscall: Syscall,
+    cpu: LinuxCpu?,
+) {
+    cpu?.cpus?.let { list ->
+        val cpus = runCatching { parseCpuList(list) }.getOrDefault(emptyList())
+        if (cpus.isNotEmpty() && syscall.setCpuAffinity(cpus) != 0) {
+            Logger.warn("failed to set CPU affinity to $list (errno=$errno)")
+        }
+    }
+    cpu?.mems?.let { list ->
+        val nodes = runCatching { parseCpuList(list) }.getOrDefault(emptyList())
+        if (nodes.isNotEmpty() && syscall.bindMemoryPolicy(nodes) != 0) {
+            Logger.warn("failed to bind memory to NUMA nodes $list (errno=$errno)")
+        }
+    }
+}
@@ -53,6 +53,12 @@ interface InitSender {
 
     fun seccompNotifyDone()
 
+    /** Hand over a detached, idmapped mount tree (see rootfs.createIdmappedTrees) */
+    fun idmappedMount(fd: Int)
+
+    /** Hand over the /dev template clone, or -1 to have init populate /dev (see rootfs.openDevTemplate) */
+    fun devTemplate(fd: Int)
+
     fun close()
 }
 
@@ -66,5 +72,11 @@ interface InitReceiver {
 
     fun waitForSeccompRequestDone()
 
+    /** @return The fd of the next idmapped mount tree sent by main */
+    fun waitForIdmappedMount(): Int
+
+    /** @return The fd of the /dev template clone sent by main, or -1 if there is none */
+    fun waitForDevTemplate(): Int
+
     fun close()
 }
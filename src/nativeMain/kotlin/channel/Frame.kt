@@ -0,0 +1,271 @@
+package channel
+
+import kotlinx.cinterop.*
+import platform.linux.*
+import platform.posix.*
+
+/*
+ * Binary framing shared by every socket between the runtime's processes
+ *
+ * The main and init channels, the sync socket to stage-1 and the handoff to
+ * the spawner are all SOCK_SEQPACKET socketpairs carrying one frame per
+ * packet:
+ *
+ *   u32 type, u32 payload length, payload
+ *
+ * in host byte order, with at most one fd attached via SCM_RIGHTS (the
+ * bootstrap config may carry several, see bootstrap.c). The kernel keeps
+ * packet boundaries, so a frame is one sendmsg and one recvmsg and decoding
+ * it is reading the 8-byte header.
+ *
+ * Constants must match KONTAINER_FRAME_* in bootstrap.h.
+ */
+
+internal const val FRAME_HEADER_SIZE = 8
+
+/** Largest payload of a main/init channel frame (error messages are cut) */
+internal const val CHANNEL_MAX_PAYLOAD = 4096
+
+internal const val FRAME_INIT_READY = 0x01
+internal const val FRAME_WRITE_MAPPING = 0x02
+internal const val FRAME_MAPPING_WRITTEN = 0x03
+internal const val FRAME_SECCOMP_NOTIFY = 0x04
+internal const val FRAME_SECCOMP_NOTIFY_DONE = 0x05
+internal const val FRAME_IDMAPPED_MOUNT = 0x06
+internal const val FRAME_DEV_TEMPLATE = 0x07
+internal const val FRAME_NO_DEV_TEMPLATE = 0x08
+internal const val FRAME_EXEC_FAILED = 0x09
+internal const val FRAME_OTHER_ERROR = 0x0A
+
+// Sync socket between main and stage-1
+internal const val FRAME_USERMAP_PLS = 0x40
+internal const val FRAME_USERMAP_ACK = 0x41
+internal const val FRAME_STAGE2_PID = 0x42
+internal const val FRAME_CGROUP_ACK = 0x46
+
+/**
+ * A received frame; its payload is the first [length] bytes of the buffer
+ * passed to [receiveFrame]
+ *
+ * @property fd Attached fd, or -1
+ */
+internal class Frame(
+    val type: Int,
+    val length: Int,
+    val fd: Int,
+)
+
+internal fun Message.frameType(): Int =
+    when (this) {
+        Message.InitReady -> FRAME_INIT_READY
+        Message.WriteMapping -> FRAME_WRITE_MAPPING
+        Message.MappingWritten -> FRAME_MAPPING_WRITTEN
+        Message.SeccompNotify -> FRAME_SECCOMP_NOTIFY
+        Message.SeccompNotifyDone -> FRAME_SECCOMP_NOTIFY_DONE
+        Message.IdmappedMount -> FRAME_IDMAPPED_MOUNT
+        Message.DevTemplate -> FRAME_DEV_TEMPLATE
+        Message.NoDevTemplate -> FRAME_NO_DEV_TEMPLATE
+        is Message.ExecFailed -> FRAME_EXEC_FAILED
+        is Message.OtherError -> FRAME_OTHER_ERROR
+    }
+
+private val emptyPayload = ByteArray(0)
+
+internal fun Message.framePayload(): ByteArray =
+    when (this) {
+        is Message.ExecFailed -> errorPayload(error)
+        is Message.OtherError -> errorPayload(error)
+        else -> emptyPayload
+    }
+
+private fun errorPayload(error: String): ByteArray {
+    val bytes = error.encodeToByteArray()
+    return if (bytes.size <= CHANNEL_MAX_PAYLOAD) bytes else bytes.copyOf(CHANNEL_MAX_PAYLOAD)
+}
+
+/**
+ * The [Message] of a frame of [type] whose payload is the first [length]
+ * bytes of [payload]
+ *
+ * @throws Exception for an unknown type
+ */
+internal fun messageOf(
+    type: Int,
+    payload: ByteArray,
+    length: Int,
+): Message =
+    when (type) {
+        FRAME_INIT_READY -> Message.InitReady
+        FRAME_WRITE_MAPPING -> Message.WriteMapping
+        FRAME_MAPPING_WRITTEN -> Message.MappingWritten
+        FRAME_SECCOMP_NOTIFY -> Message.SeccompNotify
+        FRAME_SECCOMP_NOTIFY_DONE -> Message.SeccompNotifyDone
+        FRAME_IDMAPPED_MOUNT -> Message.IdmappedMount
+        FRAME_DEV_TEMPLATE -> Message.DevTemplate
+        FRAME_NO_DEV_TEMPLATE -> Message.NoDevTemplate
+        FRAME_EXEC_FAILED -> Message.ExecFailed(payload.decodeToString(0, length))
+        FRAME_OTHER_ERROR -> Message.OtherError(payload.decodeToString(0, length))
+        else -> throw Exception("Unknown frame type 0x${type.toString(16)}")
+    }
+
+/**
+ * Send one frame, with [fd] attached if it is not -1
+ *
+ * @throws Exception if sendmsg fails
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun sendFrame(
+    socket: Int,
+    type: Int,
+    payload: ByteArray = emptyPayload,
+    fd: Int = -1,
+) {
+    memScoped {
+        val header = allocArray<UIntVar>(2)
+        header[0] = type.toUInt()
+        header[1] = payload.size.toUInt()
+        val pinned = payload.pin()
+        try {
+            val iov = allocArray<iovec>(2)
+            iov[0].iov_base = header
+            iov[0].iov_len = FRAME_HEADER_SIZE.toULong()
+            if (payload.isNotEmpty()) {
+                iov[1].iov_base = pinned.addressOf(0)
+                iov[1].iov_len = payload.size.toULong()
+            }
+
+            val msg = alloc<msghdr>()
+            msg.msg_iov = iov
+            msg.msg_iovlen = if (payload.isEmpty()) 1u else 2u
+            if (fd >= 0) {
+                val cmsgSpace = _CMSG_SPACE(sizeOf<IntVar>().toULong())
+                val cmsgBuf = allocArray<ByteVar>(cmsgSpace.toInt())
+                msg.msg_control = cmsgBuf
+                msg.msg_controllen = cmsgSpace
+                val cmsg = _CMSG_FIRSTHDR(msg.ptr)!!.pointed
+                cmsg.cmsg_level = SOL_SOCKET
+                cmsg.cmsg_type = SCM_RIGHTS
+                cmsg.cmsg_len = _CMSG_LEN(sizeOf<IntVar>().toULong())
+                _CMSG_DATA(cmsg.ptr)!!.reinterpret<IntVar>().pointed.value = fd
+            }
+
+            while (sendmsg(socket, msg.ptr, MSG_NOSIGNAL) < 0) {
+                if (errno == EINTR) continue
+                throw Exception("Failed to send frame 0x${type.toString(16)} (errno=$errno)")
+            }
+        } finally {
+            pinned.unpin()
+        }
+    }
+}
+
+/**
+ * Receive one frame, its payload into [buffer]
+ *
+ * @throws Exception if recvmsg fails, the peer closed the socket, or the
+ *   frame does not fit [buffer]
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun receiveFrame(
+    socket: Int,
+    buffer: ByteArray,
+): Frame {
+    memScoped {
+        val header = allocArray<UIntVar>(2)
+        val pinned = buffer.pin()
+        try {
+            val iov = allocArray<iovec>(2)
+            iov[0].iov_base = header
+            iov[0].iov_len = FRAME_HEADER_SIZE.toULong()
+            if (buffer.isNotEmpty()) {
+                iov[1].iov_base = pinned.addressOf(0)
+                iov[1].iov_len = buffer.size.toULong()
+            }
+
+            val cmsgSpace = _CMSG_SPACE(sizeOf<IntVar>().toULong())
+            val cmsgBuf = allocArray<ByteVar>(cmsgSpace.toInt())
+            val msg = alloc<msghdr>()
+            msg.msg_iov = iov
+            msg.msg_iovlen = if (buffer.isEmpty()) 1u else 2u
+            msg.msg_control = cmsgBuf
+            msg.msg_controllen = cmsgSpace
+
+            var received: Long
+            do {
+                received = recvmsg(socket, msg.ptr, 0)
+            } while (received < 0 && errno == EINTR)
+            if (received < 0) throw Exception("Failed to receive frame (errno=$errno)")
+            if (received == 0L) throw Exception("Connection closed")
+
+            var fd = -1
+            val cmsg = _CMSG_FIRSTHDR(msg.ptr)
+            if (cmsg != null && cmsg.pointed.cmsg_level == SOL_SOCKET && cmsg.pointed.cmsg_type == SCM_RIGHTS) {
+                fd = _CMSG_DATA(cmsg)!!.reinterpret<IntVar>().pointed.value
+            }
+
+            val length = header[1].toInt()
+            if (received < FRAME_HEADER_SIZE || (msg.msg_flags and (MSG_TRUNC or MSG_CTRUNC)) != 0 ||
+                length.toLong() != received - FRAME_HEADER_SIZE
+            ) {
+                if (fd >= 0) close(fd)
+                throw Exception("Malformed frame ($received bytes, flags=0x${msg.msg_flags.toString(16)})")
+            }
+            return Frame(header[0].toInt(), length, fd)
+        } finally {
+            pinned.unpin()
+        }
+    }
+}
+
+/**
+ * Send a bootstrap sync frame whose payload is [values] as int32s
+ *
+ * @throws Exception with [errorMessage] if the send fails
+ */
+internal fun sendSyncFrame(
+    socket: Int,
+    type: Int,
+    errorMessage: String,
+    vararg values: Int,
+) {
+    val payload = ByteArray(values.size * 4)
+    values.forEachIndexed { i, v ->
+        for (b in 0 until 4) payload[i * 4 + b] = (v shr (8 * b)).toByte()
+    }
+    try {
+        sendFrame(socket, type, payload)
+    } catch (e: Exception) {
+        throw Exception("$errorMessage: ${e.message}")
+    }
+}
+
+/**
+ * Receive a bootstrap sync frame of [type] carrying [count] int32s
+ *
+ * @throws Exception with [errorMessage] if the receive fails or the frame
+ *   has another type or size
+ */
+internal fun receiveSyncFrame(
+    socket: Int,
+    type: Int,
+    count: Int,
+    errorMessage: String,
+): IntArray {
+    val payload = ByteArray(count * 4)
+    val frame =
+        try {
+            receiveFrame(socket, payload)
+        } catch (e: Exception) {
+            throw Exception("$errorMessage: ${e.message}")
+        }
+    if (frame.fd >= 0) close(frame.fd)
+    if (frame.type != type || frame.length != payload.size) {
+        throw Exception(
+            "$errorMessage: expected frame 0x${type.toString(16)} with ${payload.size} bytes, " +
+                "got 0x${frame.type.toString(16)} with ${frame.length}",
+        )
+    }
+    return IntArray(count) { i ->
+        (0 until 4).fold(0) { acc, b -> acc or ((payload[i * 4 + b].toInt() and 0xFF) shl (8 * b)) }
+    }
+}
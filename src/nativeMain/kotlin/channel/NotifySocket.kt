@@ -1,9 +1,11 @@
 package channel
 
 import kotlinx.cinterop.*
+import kotlinx.serialization.Serializable
 import logger.Logger
 import platform.linux.sockaddr_un
 import platform.posix.*
+import utils.JsonCodec
 
 /**
  * Notify socket abstractions for container start signaling.
@@ -13,11 +15,27 @@ import platform.posix.*
  * `start` command connects via [NotifySocket] and sends a message.
  *
  * Implementations live in the same file because they're tightly coupled (they
- * have to agree on the socket protocol).
+ * have to agree on the socket protocol): one message per connection, ended by
+ * the client closing it. "start container" releases the init process;
+ * "update <json>" carries a [ProcessUpdate] and the init keeps waiting.
  */
 
 const val NOTIFY_FILE = "notify.sock"
 
+private const val START_MESSAGE = "start container"
+private const val UPDATE_PREFIX = "update "
+
+/**
+ * Per-instance process overrides for an init process parked in the created
+ * state, applied before it execs. Sent when a pooled container is claimed
+ * (see pool.claimPooledContainer); null fields keep the spec's value.
+ */
+@Serializable
+data class ProcessUpdate(
+    val args: List<String>? = null,
+    val env: List<String>? = null,
+)
+
 /**
  * Server side of the notify socket. Owned by the init process (and inherited
  * across exec via [fd]).
@@ -26,8 +44,11 @@ interface NotifyListener {
     /** FD of the listening socket; passed across exec via env vars. */
     fun fd(): Int
 
-    /** Block until a client connects and sends a start message. */
-    fun waitForContainerStart()
+    /**
+     * Block until a client connects and sends a start message. Update
+     * messages received before it are passed to [onUpdate].
+     */
+    fun waitForContainerStart(onUpdate: (ProcessUpdate) -> Unit = {})
 
     fun close()
 }
@@ -38,6 +59,9 @@ interface NotifyListener {
 interface NotifySocket {
     /** Connect and send the start message. */
     fun notifyContainerStart()
+
+    /** Connect and send [update] to the waiting init process. */
+    fun sendProcessUpdate(update: ProcessUpdate)
 }
 
 /**
@@ -51,7 +75,7 @@ class SocketNotifyListener : NotifyListener {
     private val socket: Int
 
     constructor(socketPath: String) {
-        Logger.debug("NotifyListener: creating socket at $socketPath")
+        Logger.debug { "NotifyListener: creating socket at $socketPath" }
 
         memScoped {
             socket = socket(AF_UNIX, SOCK_STREAM, 0)
@@ -91,43 +115,61 @@ class SocketNotifyListener : NotifyListener {
                 throw Exception("Failed to listen on socket")
             }
 
-            Logger.debug("NotifyListener: listening on $socketPath (fd=$socket)")
+            Logger.debug { "NotifyListener: listening on $socketPath (fd=$socket)" }
         }
     }
 
     constructor(fd: Int) {
-        Logger.debug("NotifyListener: reusing existing socket fd=$fd")
+        Logger.debug { "NotifyListener: reusing existing socket fd=$fd" }
         socket = fd
     }
 
     override fun fd(): Int = socket
 
-    override fun waitForContainerStart() {
-        memScoped {
-            Logger.debug("NotifyListener: waiting for container start signal...")
+    override fun waitForContainerStart(onUpdate: (ProcessUpdate) -> Unit) {
+        Logger.debug("NotifyListener: waiting for container start signal...")
+
+        while (true) {
+            val message = receiveMessage()
+            Logger.debug { "NotifyListener: received: $message" }
+
+            if (!message.startsWith(UPDATE_PREFIX)) return
+            val update =
+                try {
+                    JsonCodec.decode<ProcessUpdate>(message.removePrefix(UPDATE_PREFIX))
+                } catch (e: Exception) {
+                    throw Exception("Invalid process update: ${e.message}")
+                }
+            onUpdate(update)
+        }
+    }
 
+    /** Accept one connection and read its message until the client closes it */
+    private fun receiveMessage(): String =
+        memScoped {
             val clientSocket = accept(socket, null, null)
             if (clientSocket == -1) {
                 perror("accept")
                 throw Exception("Failed to accept connection")
             }
 
-            val buffer = allocArray<ByteVar>(256)
-            val n = recv(clientSocket, buffer, 255.toULong(), 0)
-            if (n == -1L) {
-                perror("recv")
-                close(clientSocket)
-                throw Exception("Failed to receive start signal")
+            val chunk = allocArray<ByteVar>(4096)
+            var message = ByteArray(0)
+            while (true) {
+                val n = recv(clientSocket, chunk, 4096.toULong(), 0)
+                if (n == -1L && errno == EINTR) continue
+                if (n == -1L) {
+                    perror("recv")
+                    close(clientSocket)
+                    throw Exception("Failed to receive start signal")
+                }
+                if (n == 0L) break
+                message += chunk.readBytes(n.toInt())
             }
 
-            buffer[n.toInt()] = 0
-            val message = buffer.toKString()
-
-            Logger.debug("NotifyListener: received: $message")
-
             close(clientSocket)
+            message.decodeToString()
         }
-    }
 
     override fun close() {
         close(socket)
@@ -142,7 +184,17 @@ class SocketNotifySocket(
     private val socketPath: String,
 ) : NotifySocket {
     override fun notifyContainerStart() {
-        Logger.debug("NotifySocket: connecting to $socketPath")
+        sendMessage(START_MESSAGE)
+        Logger.debug("NotifySocket: sent start signal")
+    }
+
+    override fun sendProcessUpdate(update: ProcessUpdate) {
+        sendMessage(UPDATE_PREFIX + JsonCodec.encode(update))
+        Logger.debug("NotifySocket: sent process update")
+    }
+
+    private fun sendMessage(message: String) {
+        Logger.debug { "NotifySocket: connecting to $socketPath" }
 
         memScoped {
             val sock = socket(AF_UNIX, SOCK_STREAM, 0)
@@ -174,15 +226,22 @@ class SocketNotifySocket(
                 throw Exception("Failed to connect to socket: $socketPath")
             }
 
-            val message = "start container"
-            val sent = send(sock, message.cstr.ptr, message.length.toULong(), 0)
-            if (sent == -1L) {
-                perror("send")
-                close(sock)
-                throw Exception("Failed to send start message")
+            // The listener reads until EOF, so the message may span several sends
+            val bytes = message.encodeToByteArray()
+            var offset = 0
+            bytes.usePinned { pinned ->
+                while (offset < bytes.size) {
+                    val sent = send(sock, pinned.addressOf(offset), (bytes.size - offset).toULong(), 0)
+                    if (sent == -1L && errno == EINTR) continue
+                    if (sent == -1L) {
+                        perror("send")
+                        close(sock)
+                        throw Exception("Failed to send notify message")
+                    }
+                    offset += sent.toInt()
+                }
             }
 
-            Logger.debug("NotifySocket: sent start signal")
             close(sock)
         }
     }
@@ -1,16 +1,15 @@
 package channel
 
 import kotlinx.cinterop.*
-import platform.linux.*
 import platform.posix.*
-import utils.JsonCodec
 
 /**
  * Socket-backed implementations of the channel interfaces.
  *
- * Each sender/receiver wraps a Unix domain socket FD. Senders serialize a
- * [Message] to JSON and write it via send/sendmsg. Receivers do the inverse
- * with recv/recvmsg. SCM_RIGHTS is used to pass the seccomp notify FD.
+ * Each sender/receiver wraps one end of a SOCK_SEQPACKET socketpair and
+ * every [Message] is one frame (see Frame.kt): a type, the error text for
+ * the two error messages, and the fd for the messages that carry one
+ * (seccomp notify fd, detached mount trees) via SCM_RIGHTS.
  */
 
 @OptIn(ExperimentalForeignApi::class)
@@ -23,137 +22,61 @@ private fun createSocketPair(): Pair<Int, Int> {
     return Pair(sv[0], sv[1])
 }
 
-@OptIn(ExperimentalForeignApi::class)
 private fun sendMessage(
     socket: Int,
     message: Message,
-) {
-    val json = JsonCodec.encode(message)
-    val bytes = json.encodeToByteArray()
-
-    memScoped {
-        val sent = send(socket, bytes.refTo(0), bytes.size.toULong(), 0)
-        if (sent == -1L) {
-            perror("send")
-            throw Exception("Failed to send message")
-        }
-    }
-}
+    fd: Int = -1,
+) = sendFrame(socket, message.frameType(), message.framePayload(), fd)
 
+/**
+ * Receive one message into [buffer]. An fd that comes with a message not
+ * expecting one is closed.
+ */
 @OptIn(ExperimentalForeignApi::class)
-private fun receiveMessage(socket: Int): Message {
-    memScoped {
-        val buffer = allocArray<ByteVar>(4096)
-        val received = recv(socket, buffer, 4095.toULong(), 0)
-
-        if (received == -1L) {
-            perror("recv")
-            throw Exception("Failed to receive message")
-        }
-        if (received == 0L) {
-            throw Exception("Connection closed")
-        }
-
-        buffer[received.toInt()] = 0
-        val json = buffer.toKString()
-        return JsonCodec.decode<Message>(json)
-    }
+private fun receiveMessage(
+    socket: Int,
+    buffer: ByteArray,
+): Message {
+    val frame = receiveFrame(socket, buffer)
+    if (frame.fd >= 0) close(frame.fd)
+    return messageOf(frame.type, buffer, frame.length)
 }
 
 @OptIn(ExperimentalForeignApi::class)
-private fun sendMessageWithFd(
+private fun receiveMessageWithFd(
     socket: Int,
-    message: Message,
-    fd: Int,
-) {
-    val json = JsonCodec.encode(message)
-    val bytes = json.encodeToByteArray()
-
-    memScoped {
-        val iov = alloc<iovec>()
-        iov.iov_base = bytes.refTo(0).getPointer(this)
-        iov.iov_len = bytes.size.toULong()
-
-        val cmsgSpace = _CMSG_SPACE(sizeOf<IntVar>().toULong())
-        val cmsgBuf = allocArray<ByteVar>(cmsgSpace.toInt())
-
-        val msg = alloc<msghdr>()
-        msg.msg_name = null
-        msg.msg_namelen = 0u
-        msg.msg_iov = iov.ptr
-        msg.msg_iovlen = 1u
-        msg.msg_control = cmsgBuf
-        msg.msg_controllen = cmsgSpace
-        msg.msg_flags = 0
-
-        val cmsg = _CMSG_FIRSTHDR(msg.ptr)
-        if (cmsg != null) {
-            cmsg.pointed.cmsg_level = SOL_SOCKET
-            cmsg.pointed.cmsg_type = SCM_RIGHTS
-            cmsg.pointed.cmsg_len = _CMSG_LEN(sizeOf<IntVar>().toULong())
-
-            val dataPtr = _CMSG_DATA(cmsg)
-            if (dataPtr != null) {
-                dataPtr.reinterpret<IntVar>().pointed.value = fd
-            }
-        }
-
-        val sent = sendmsg(socket, msg.ptr, 0)
-        if (sent == -1L) {
-            perror("sendmsg")
-            throw Exception("Failed to send message with FD")
+    buffer: ByteArray,
+    fdRequired: Boolean = true,
+): Pair<Message, Int> {
+    val frame = receiveFrame(socket, buffer)
+    val message =
+        try {
+            messageOf(frame.type, buffer, frame.length)
+        } catch (e: Exception) {
+            if (frame.fd >= 0) close(frame.fd)
+            throw e
         }
+    if (frame.fd == -1 && fdRequired && message !is Message.ExecFailed && message !is Message.OtherError) {
+        throw Exception("Failed to extract FD from control message")
     }
+    return Pair(message, frame.fd)
 }
 
+/**
+ * Reject [msg], received by [receiveMessageWithFd] in place of [expected]:
+ * close the fd that came with it, if any, and throw
+ */
 @OptIn(ExperimentalForeignApi::class)
-private fun receiveMessageWithFd(socket: Int): Pair<Message, Int> {
-    memScoped {
-        val buffer = allocArray<ByteVar>(4096)
-        val iov = alloc<iovec>()
-        iov.iov_base = buffer
-        iov.iov_len = 4095u
-
-        val cmsgSpace = _CMSG_SPACE(sizeOf<IntVar>().toULong())
-        val cmsgBuf = allocArray<ByteVar>(cmsgSpace.toInt())
-
-        val msg = alloc<msghdr>()
-        msg.msg_name = null
-        msg.msg_namelen = 0u
-        msg.msg_iov = iov.ptr
-        msg.msg_iovlen = 1u
-        msg.msg_control = cmsgBuf
-        msg.msg_controllen = cmsgSpace
-        msg.msg_flags = 0
-
-        val received = recvmsg(socket, msg.ptr, 0)
-        if (received == -1L) {
-            perror("recvmsg")
-            throw Exception("Failed to receive message with FD")
-        }
-        if (received == 0L) {
-            throw Exception("Connection closed")
-        }
-
-        buffer[received.toInt()] = 0
-        val json = buffer.toKString()
-        val message = JsonCodec.decode<Message>(json)
-
-        var receivedFd = -1
-        val cmsg = _CMSG_FIRSTHDR(msg.ptr)
-
-        if (cmsg != null && cmsg.pointed.cmsg_level == SOL_SOCKET && cmsg.pointed.cmsg_type == SCM_RIGHTS) {
-            val dataPtr = _CMSG_DATA(cmsg)
-            if (dataPtr != null) {
-                receivedFd = dataPtr.reinterpret<IntVar>().pointed.value
-            }
-        }
-
-        if (receivedFd == -1) {
-            throw Exception("Failed to extract FD from control message")
-        }
-
-        return Pair(message, receivedFd)
+private fun unexpectedFdMessage(
+    msg: Message,
+    fd: Int,
+    expected: String,
+): Nothing {
+    if (fd >= 0) close(fd)
+    when (msg) {
+        is Message.ExecFailed -> throw Exception("Exec failed: ${msg.error}")
+        is Message.OtherError -> throw Exception("Error: ${msg.error}")
+        else -> throw Exception("Unexpected message: $msg, expected $expected")
     }
 }
 
@@ -172,7 +95,7 @@ class SocketMainSender(
     }
 
     override fun seccompNotifyRequest(fd: Int) {
-        sendMessageWithFd(socket, Message.SeccompNotify, fd)
+        sendMessage(socket, Message.SeccompNotify, fd)
     }
 
     override fun execFailed(error: String) {
@@ -192,10 +115,12 @@ class SocketMainSender(
 class SocketMainReceiver(
     private val socket: Int,
 ) : MainReceiver {
+    private val buffer = ByteArray(CHANNEL_MAX_PAYLOAD)
+
     override fun fd(): Int = socket
 
     override fun waitForMappingRequest(): Message.WriteMapping =
-        when (val msg = receiveMessage(socket)) {
+        when (val msg = receiveMessage(socket, buffer)) {
             is Message.WriteMapping -> msg
             is Message.ExecFailed -> throw Exception("Exec failed: ${msg.error}")
             is Message.OtherError -> throw Exception("Error: ${msg.error}")
@@ -203,7 +128,7 @@ class SocketMainReceiver(
         }
 
     override fun waitForInitReady() {
-        when (val msg = receiveMessage(socket)) {
+        when (val msg = receiveMessage(socket, buffer)) {
             is Message.InitReady -> return
             is Message.ExecFailed -> throw Exception("Exec failed: ${msg.error}")
             is Message.OtherError -> throw Exception("Error: ${msg.error}")
@@ -212,12 +137,10 @@ class SocketMainReceiver(
     }
 
     override fun waitForSeccompRequest(): Int {
-        val (msg, fd) = receiveMessageWithFd(socket)
+        val (msg, fd) = receiveMessageWithFd(socket, buffer)
         return when (msg) {
             is Message.SeccompNotify -> fd
-            is Message.ExecFailed -> throw Exception("Exec failed: ${msg.error}")
-            is Message.OtherError -> throw Exception("Error: ${msg.error}")
-            else -> throw Exception("Unexpected message: $msg, expected SeccompNotify")
+            else -> unexpectedFdMessage(msg, fd, "SeccompNotify")
         }
     }
 
@@ -240,6 +163,14 @@ class SocketInitSender(
         sendMessage(socket, Message.SeccompNotifyDone)
     }
 
+    override fun idmappedMount(fd: Int) {
+        sendMessage(socket, Message.IdmappedMount, fd)
+    }
+
+    override fun devTemplate(fd: Int) {
+        sendMessage(socket, if (fd >= 0) Message.DevTemplate else Message.NoDevTemplate, fd)
+    }
+
     override fun close() {
         close(socket)
     }
@@ -249,22 +180,44 @@ class SocketInitSender(
 class SocketInitReceiver(
     private val socket: Int,
 ) : InitReceiver {
+    private val buffer = ByteArray(CHANNEL_MAX_PAYLOAD)
+
     override fun fd(): Int = socket
 
     override fun waitForMappingAck() {
-        when (val msg = receiveMessage(socket)) {
+        when (val msg = receiveMessage(socket, buffer)) {
             is Message.MappingWritten -> return
             else -> throw Exception("Unexpected message: $msg, expected MappingWritten")
         }
     }
 
     override fun waitForSeccompRequestDone() {
-        when (val msg = receiveMessage(socket)) {
+        when (val msg = receiveMessage(socket, buffer)) {
             is Message.SeccompNotifyDone -> return
             else -> throw Exception("Unexpected message: $msg, expected SeccompNotifyDone")
         }
     }
 
+    override fun waitForIdmappedMount(): Int {
+        val (msg, fd) = receiveMessageWithFd(socket, buffer)
+        return when (msg) {
+            is Message.IdmappedMount -> fd
+            else -> unexpectedFdMessage(msg, fd, "IdmappedMount")
+        }
+    }
+
+    override fun waitForDevTemplate(): Int {
+        val (msg, fd) = receiveMessageWithFd(socket, buffer, fdRequired = false)
+        return when (msg) {
+            is Message.DevTemplate -> fd
+            is Message.NoDevTemplate -> {
+                if (fd >= 0) close(fd)
+                -1
+            }
+            else -> unexpectedFdMessage(msg, fd, "DevTemplate")
+        }
+    }
+
     override fun close() {
         close(socket)
     }
@@ -1,18 +1,33 @@
 package command
 
 import cgroup.Cgroup
+import cgroup.CgroupV2
+import cgroup.autoPinCpuset
 import channel.SocketNotifyListener
 import channel.initChannel
 import channel.mainChannel
+import bootstrap.kontainer_send_config
+import bootstrap.kontainer_spawner_fd
+import bootstrap.kontainer_spawner_pid
+import bootstrap.kontainer_spawner_start
 import kotlinx.cinterop.*
 import logger.Logger
 import namespace.calculateCloneFlags
+import namespace.namespaceJoinPaths
 import platform.linux.SYS_clone
 import platform.posix.*
+import pool.claimPooledContainer
+import process.BootstrapConfig
+import process.BootstrapRlimit
 import process.runMainProcess
-import spec.loadSpec
+import rootfs.overlayRootfsOf
+import seccomp.compileSeccompBpf
+import spec.loadSpecCached
 import state.containerExists
 import syscall.Syscall
+import syscall.rlimitTypeToResource
+import trace.Tracer
+import utils.CborCodec
 import utils.FileSystem
 
 /**
@@ -56,18 +71,31 @@ fun create(
         val configPath = "$bundlePath/config.json"
 
         Logger.info("creating container: $containerId")
-        Logger.debug("loading spec from $configPath")
 
-        val spec =
+        // Open the trace file first so every later phase, including the ones
+        // in stage-1/stage-2, can append to it. The fd travels in the bootstrap
+        // config like the channel FDs.
+        if (Tracer.enabled) {
+            fs.createDirectories("$rootPath/$containerId")
+            Tracer.open("$rootPath/$containerId/${Tracer.TRACE_FILE}")
+        }
+        val createStartNs = Tracer.now()
+
+        Logger.debug { "loading spec from $configPath" }
+
+        // create-batch parses each bundle's config.json once and hands the
+        // spec down (see CreateBatch.kt); otherwise the spec cache saves the
+        // JSON parse when the bundle was created before
+        var spec =
             try {
-                loadSpec(fs, configPath)
+                Tracer.span("spec.load") { takeInheritedSpec() ?: loadSpecCached(rootPath, configPath) }
             } catch (e: Exception) {
                 Logger.error("failed to load spec: ${e.message ?: "unknown error"}")
                 exit(1)
                 return
             }
 
-        Logger.debug("loaded spec version ${spec.ociVersion}")
+        Logger.debug { "loaded spec version ${spec.ociVersion}" }
 
         // Get absolute path of rootfs
         val rootfsPath =
@@ -77,8 +105,61 @@ fun create(
                 "$bundlePath/${spec.root.path}"
             }
 
-        Logger.debug("rootfs path: $rootfsPath")
-        Logger.debug("main: pid=${getpid()}")
+        Logger.debug { "rootfs path: $rootfsPath" }
+
+        // An overlay rootfs is mounted by Stage-2; spec.root.path is only its
+        // mountpoint and may not exist yet
+        val overlay =
+            try {
+                overlayRootfsOf(spec, bundlePath)
+            } catch (e: Exception) {
+                Logger.error("invalid overlay rootfs: ${e.message ?: "unknown error"}")
+                exit(1)
+                return
+            }
+        if (overlay != null) {
+            if (!spec.hasNamespace("mount")) {
+                Logger.error("an overlay rootfs needs a mount namespace")
+                exit(1)
+            }
+            if (!fs.fileExists(rootfsPath)) fs.createDirectories(rootfsPath)
+            Logger.debug { "overlay rootfs with ${overlay.lower.size} lower layers" }
+        }
+        Logger.debug { "main: pid=${getpid()}" }
+
+        // A matching pooled container turns create into a rename. Not with
+        // tracing on: the trace describes a full create.
+        if (!Tracer.enabled) {
+            val pooledPid =
+                claimPooledContainer(syscall, fs, cgroup, rootPath, containerId, bundlePath, spec, rootfsPath)
+            if (pooledPid != null) {
+                pidFile?.let { fs.writeTextFile(it, "$pooledPid") }
+                Logger.info("container $containerId created with init PID $pooledPid (from pool)")
+                return@memScoped
+            }
+        }
+
+        // Resolve the OCI spec cgroupsPath (absolute → literal; relative or
+        // unspecified → nested under our runtime's subtree). See
+        // CgroupV2.resolveCgroupPath() for the rules.
+        val cgroupPath = CgroupV2.resolveCgroupPath(spec.linux?.cgroupsPath, containerId)
+
+        // Opt-in NUMA placement; must precede the cgroup setup and the spec
+        // handed to the init, which both apply cpus/mems
+        spec = autoPinCpuset(fs, spec, cgroupPath)
+
+        // Create and configure the cgroup before anything is forked, so the
+        // container process can be cloned straight into it instead of being
+        // migrated while it runs
+        val cgroupFd =
+            try {
+                Tracer.span("cgroup.setup") { cgroup.prepare(cgroupPath, spec.linux?.resources) }
+                cgroup.openDirectoryFd(cgroupPath)
+            } catch (e: Exception) {
+                Logger.error("failed to set up cgroup: ${e.message ?: "unknown error"}")
+                exit(1)
+                return
+            }
 
         // Create 2 channels for inter-process communication
         // Main ↔ Stage-2 (init / PID 1)
@@ -98,7 +179,89 @@ fun create(
                 return
             }
 
-        // Fork and exec to trigger bootstrap constructor
+        // Calculate clone flags from OCI spec namespaces
+        // These flags will be passed to bootstrap.c in the bootstrap config
+        val cloneFlags = calculateCloneFlags(spec.linux?.namespaces)
+        Logger.debug { "calculated clone_flags: 0x${cloneFlags.toString(16)}" }
+
+        // Bootstrap config consumed by bootstrap.c (stage-1) and Main.kt
+        // (stage-2). The parsed spec travels along as CBOR, so init never
+        // re-reads or re-parses config.json.
+        val specCbor = Tracer.span("spec.encode") { CborCodec.encode(spec) }
+        // Compile (or fetch from the cache) the seccomp filter here, so init
+        // only has to install it
+        val seccompBpf =
+            spec.linux?.seccomp?.let { seccomp ->
+                Tracer.span("seccomp.compile") { compileSeccompBpf(seccomp, rootPath) }
+            }
+        val bootstrapConfig =
+            BootstrapConfig(
+                cloneFlags = cloneFlags,
+                nsPaths = namespaceJoinPaths(spec.linux?.namespaces),
+                bundlePath = bundlePath,
+                rootfsPath = rootfsPath,
+                containerId = containerId,
+                notifySocketPath = notifySocketPath,
+                mainSenderFd = mainSender.fd(),
+                initReceiverFd = initReceiver.fd(),
+                notifyListenerFd = notifyListener.fd(),
+                traceFd = Tracer.fd(),
+                cgroupFd = cgroupFd,
+                traceStartNs = if (Tracer.fd() >= 0) Tracer.now() else 0L,
+                specCbor = specCbor,
+                seccompBpf = seccompBpf ?: ByteArray(0),
+                // Set by stage-1 on itself before it clones stage-2, which
+                // inherits them; main applying them from outside would race
+                // with that clone
+                rlimits =
+                    spec.process.rlimits.orEmpty().mapNotNull { rlimit ->
+                        rlimitTypeToResource(rlimit.type)?.let { BootstrapRlimit(it, rlimit.soft, rlimit.hard) }
+                    },
+            )
+
+        Tracer.record("create.prepare", createStartNs)
+
+        // Fast path: bootstrap.c pre-forked a single-threaded spawner before the
+        // Kotlin runtime started (see start_spawner()). Hand it the bootstrap
+        // config and FDs (via SCM_RIGHTS) and it runs stage-1 in place, so no
+        // second copy of this binary is exec'd and initialized. Its control
+        // socket then carries the usual sync protocol.
+        val spawnerFd = kontainer_spawner_fd()
+        if (spawnerFd >= 0) {
+            val stage1Pid = kontainer_spawner_pid()
+            if (handOffToSpawner(bootstrapConfig) != 0) {
+                perror("sendmsg")
+                Logger.error("failed to hand bootstrap config to spawner (errno=$errno)")
+                notifyListener.close()
+                exit(1)
+            }
+            Logger.debug { "handed bootstrap config to spawner, stage-1 PID=$stage1Pid" }
+            if (cgroupFd >= 0) close(cgroupFd)
+
+            runMainProcess(
+                syscall = syscall,
+                fs = fs,
+                cgroup = cgroup,
+                stage1Pid = stage1Pid,
+                syncFd = spawnerFd,
+                spec = spec,
+                containerId = containerId,
+                bundlePath = bundlePath,
+                rootfsPath = rootfsPath,
+                rootPath = rootPath,
+                cgroupPath = cgroupPath,
+                pidFile = pidFile,
+                notifyListener = notifyListener,
+                mainSender = mainSender,
+                mainReceiver = mainReceiver,
+                initSender = initSender,
+                initReceiver = initReceiver,
+            )
+            return@memScoped
+        }
+
+        // Fallback: fork and exec to trigger bootstrap constructor (spawner
+        // disabled with KONTAINER_SPAWNER=0, or CLONE_PARENT unavailable).
         // The bootstrap constructor (in C) will:
         //   - Unshare namespaces (Stage-1)
         //   - Fork Stage-2 (init process / PID 1)
@@ -108,19 +271,14 @@ fun create(
         // Create sync socketpair for parent-child synchronization
         val syncFds = IntArray(2)
         syncFds.usePinned { pinned ->
-            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pinned.addressOf(0)) < 0) {
+            if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pinned.addressOf(0)) < 0) {
                 perror("socketpair")
                 Logger.error("Failed to create sync socketpair")
                 notifyListener.close()
                 exit(1)
             }
         }
-        Logger.debug("created sync socketpair: parent_fd=${syncFds[0]}, child_fd=${syncFds[1]}")
-
-        // Calculate clone flags from OCI spec namespaces
-        // These flags will be passed to bootstrap.c via environment variable
-        val cloneFlags = calculateCloneFlags(spec.linux?.namespaces)
-        Logger.debug("calculated clone_flags: 0x${cloneFlags.toString(16)}")
+        Logger.debug { "created sync socketpair: parent_fd=${syncFds[0]}, child_fd=${syncFds[1]}" }
 
         // Get current executable path (in parent process, before fork)
         val exePathBuf = allocArray<ByteVar>(4096)
@@ -134,10 +292,11 @@ fun create(
             exit(1)
         }
         exePathBuf[exePathLen.toInt()] = 0.toByte() // null terminate
-        Logger.debug("executable path: ${exePathBuf.toKString()}")
+        Logger.debug { "executable path: ${exePathBuf.toKString()}" }
 
         // Clone with CLONE_PARENT and exec to trigger bootstrap constructor
-        when (val stage1Pid = cloneWithParent()) {
+        val cloneStartNs = Tracer.now()
+        when (val stage1Pid = cloneWithParent(cgroupFd)) {
             -1 -> {
                 perror("clone")
                 Logger.error("Failed to clone with CLONE_PARENT")
@@ -154,50 +313,13 @@ fun create(
                 // Close parent side of sync socketpair
                 close(syncFds[0])
 
-                // Set environment variables
-                val syncPipeStr = syncFds[1].toString()
-
-                // Pass channel FDs to init process (Stage-2)
-                val mainSenderFd = mainSender.fd().toString()
-                val initReceiverFd = initReceiver.fd().toString()
-                val notifyListenerFd = notifyListener.fd().toString()
-
-                // Set clone flags as hex string (e.g., "10000000" for CLONE_NEWUSER)
-                val cloneFlagsHex = cloneFlags.toUInt().toString(16)
-                setenv("_KONTAINER_CLONE_FLAGS", cloneFlagsHex, 1)
-                // Enable bootstrap mode
+                // Enable bootstrap mode; the config follows on the sync socket
+                // and the FDs it names are inherited by number
                 setenv("_KONTAINER_IS_BOOTSTRAP", "1", 1)
-                setenv("_KONTAINER_SYNCPIPE", syncPipeStr, 1)
-                setenv("_KONTAINER_MAIN_SENDER_FD", mainSenderFd, 1)
-                setenv("_KONTAINER_INIT_RECEIVER_FD", initReceiverFd, 1)
-                setenv("_KONTAINER_NOTIFY_LISTENER_FD", notifyListenerFd, 1)
-                setenv("_KONTAINER_BUNDLE_PATH", bundlePath, 1)
-                setenv("_KONTAINER_ROOTFS_PATH", rootfsPath, 1)
-                setenv("_KONTAINER_NOTIFY_SOCKET", notifySocketPath, 1)
-                setenv("_KONTAINER_CONTAINER_ID", containerId, 1)
-
-                // Pass any spec.linux.namespaces[].path entries to bootstrap.c
-                // so it can setns(2) into existing namespaces before the
-                // stage-2 fork. Doing this in the Kotlin runtime is unreliable
-                // because the runtime is multi-threaded (the kernel rejects
-                // setns into a mount namespace from such a process) and PID
-                // namespace join must happen pre-fork. The env var key matches
-                // ENV_NS_PATH_PREFIX in bootstrap.c.
-                spec.linux?.namespaces?.forEach { ns ->
-                    val path = ns.path ?: return@forEach
-                    val envKey =
-                        when (ns.type) {
-                            "mount" -> "_KONTAINER_NS_PATH_MOUNT"
-                            "network" -> "_KONTAINER_NS_PATH_NETWORK"
-                            "uts" -> "_KONTAINER_NS_PATH_UTS"
-                            "ipc" -> "_KONTAINER_NS_PATH_IPC"
-                            "user" -> "_KONTAINER_NS_PATH_USER"
-                            "cgroup" -> "_KONTAINER_NS_PATH_CGROUP"
-                            "pid" -> "_KONTAINER_NS_PATH_PID"
-                            else -> return@forEach
-                        }
-                    setenv(envKey, path, 1)
-                }
+                setenv("_KONTAINER_SYNCPIPE", syncFds[1].toString(), 1)
+
+                // The trace fd is close-on-exec; only this exec may inherit it
+                Tracer.fd().let { if (it >= 0) fcntl(it, F_SETFD, 0) }
 
                 // Prepare arguments
                 val argv = allocArray<CPointerVar<ByteVar>>(3)
@@ -220,8 +342,21 @@ fun create(
 
                 // Close child side of sync socketpair
                 close(syncFds[1])
+                // Stage-1 inherited the cgroup fd
+                if (cgroupFd >= 0) close(cgroupFd)
+                Tracer.record("clone.stage1", cloneStartNs)
+
+                // Stage-1 reads the config right after exec
+                val encoded = bootstrapConfig.encode()
+                if (kontainer_send_config(syncFds[0], encoded.refTo(0), encoded.size, null, 0) != 0) {
+                    perror("sendmsg")
+                    Logger.error("Failed to send bootstrap config to Stage-1")
+                    close(syncFds[0])
+                    notifyListener.close()
+                    exit(1)
+                }
 
-                Logger.debug("forked Stage-1, PID=$stage1Pid, waiting for bootstrap to complete")
+                Logger.debug { "forked Stage-1, PID=$stage1Pid, waiting for bootstrap to complete" }
 
                 runMainProcess(
                     syscall = syscall,
@@ -232,7 +367,9 @@ fun create(
                     spec = spec,
                     containerId = containerId,
                     bundlePath = bundlePath,
+                    rootfsPath = rootfsPath,
                     rootPath = rootPath,
+                    cgroupPath = cgroupPath,
                     pidFile = pidFile,
                     notifyListener = notifyListener,
                     mainSender = mainSender,
@@ -244,6 +381,18 @@ fun create(
         }
     }
 
+/**
+ * Send the bootstrap config and the FDs it names to the pre-forked spawner
+ *
+ * @return 0 on success, -1 on error (errno set)
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun handOffToSpawner(config: BootstrapConfig): Int {
+    val encoded = config.encode()
+    val fds = config.fdList().map { it.second }.toIntArray()
+    return kontainer_spawner_start(encoded.refTo(0), encoded.size, fds.refTo(0), fds.size)
+}
+
 /**
  * Clone with CLONE_PARENT flag using raw syscall
  * Makes the child process a sibling of the caller (same parent)
@@ -251,12 +400,33 @@ fun create(
  * This ensures Stage-1 becomes a sibling of Create.kt (both children of containerd-shim)
  * When Stage-1 exits, it won't become a zombie waiting for Create.kt to reap it
  *
+ * If [cgroupFd] is valid, the child is spawned directly in that cgroup with
+ * clone3(CLONE_INTO_CGROUP). On kernels without it (< 5.7) or if the clone3
+ * call is refused, this falls back to plain clone and Stage-1 starts in our
+ * cgroup; Stage-1 still clones Stage-2 into the container cgroup.
+ *
  * @return PID of cloned child on success, -1 on error
  */
 @OptIn(ExperimentalForeignApi::class)
-private fun cloneWithParent(): Int {
-    // CLONE_PARENT = 0x00008000
+private fun cloneWithParent(cgroupFd: Int): Int {
+    if (cgroupFd >= 0) {
+        // struct clone_args up to CLONE_ARGS_SIZE_VER2: flags, pidfd,
+        // child_tid, parent_tid, exit_signal, stack, stack_size, tls,
+        // set_tid, set_tid_size, cgroup
+        val args = LongArray(11)
+        args[0] = CLONE_PARENT or CLONE_INTO_CGROUP
+        // exit_signal stays 0: clone3 rejects one with CLONE_PARENT, the child
+        // gets ours instead
+        args[10] = cgroupFd.toLong()
+        val pid = args.usePinned { pinned -> syscall(SYS_CLONE3, pinned.addressOf(0), (args.size * 8).toLong()) }
+        if (pid >= 0L) return pid.toInt()
+        Logger.debug { "clone3(CLONE_INTO_CGROUP) failed (errno=$errno), falling back to clone" }
+    }
     // syscall(SYS_clone, flags, child_stack, parent_tid, child_tid, tls)
-    val pid = syscall(SYS_clone.toLong(), SIGCHLD.toLong() or 0x00008000L, 0L, 0L, 0L, 0L)
+    val pid = syscall(SYS_clone.toLong(), SIGCHLD.toLong() or CLONE_PARENT, 0L, 0L, 0L, 0L)
     return pid.toInt()
 }
+
+private const val SYS_CLONE3 = 435L
+private const val CLONE_PARENT = 0x00008000L
+private const val CLONE_INTO_CGROUP = 0x200000000L
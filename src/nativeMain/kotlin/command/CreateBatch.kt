@@ -0,0 +1,358 @@
+package command
+
+import kotlinx.cinterop.*
+import kotlinx.serialization.Serializable
+import logger.Logger
+import platform.posix.*
+import seccomp.compileSeccompBpf
+import spec.Spec
+import spec.loadSpecCached
+import state.loadState
+import utils.CborCodec
+import utils.FileSystem
+import utils.JsonCodec
+
+/**
+ * One container of a `create-batch` request
+ *
+ * @property id Container ID
+ * @property bundle Path to the OCI bundle directory
+ * @property pidFile Optional path to write the init process PID
+ */
+@Serializable
+data class BatchEntry(
+    val id: String,
+    val bundle: String = ".",
+    val pidFile: String? = null,
+)
+
+/**
+ * Outcome of one container of a `create-batch` request
+ *
+ * @property status "created" or "failed"
+ * @property pid Init process PID if created
+ * @property error Reason if failed
+ */
+@Serializable
+data class BatchResult(
+    val id: String,
+    val status: String,
+    val pid: Int? = null,
+    val error: String? = null,
+)
+
+/**
+ * Environment variable naming an inherited fd that holds the CBOR-encoded
+ * spec for the bundle `create` was given, so it skips reading and parsing
+ * config.json. Set by `create-batch` only.
+ */
+internal const val SPEC_FD_ENV = "_KONTAINER_SPEC_FD"
+
+/**
+ * Parse and validate a `create-batch` request: a JSON array of [BatchEntry]
+ *
+ * @throws Exception if the JSON is invalid, an id is empty or appears twice
+ */
+fun parseBatchEntries(text: String): List<BatchEntry> {
+    val entries =
+        try {
+            JsonCodec.decode<List<BatchEntry>>(text)
+        } catch (e: Exception) {
+            throw Exception("invalid batch request: ${e.message}")
+        }
+    val seen = mutableSetOf<String>()
+    for (entry in entries) {
+        if (entry.id.isEmpty()) throw Exception("invalid batch request: empty container id")
+        if (!seen.add(entry.id)) throw Exception("invalid batch request: duplicate container id ${entry.id}")
+    }
+    return entries
+}
+
+/**
+ * Create-batch command - Create many containers from one runtime invocation
+ *
+ * Every container is still a separate `create` of this binary: create ends
+ * in exit() and the Kotlin runtime must not be forked without exec (see
+ * bootstrap.c), so each child keeps its own pre-forked spawner. What the
+ * batch shares is everything that depends only on the bundle: the path is
+ * resolved and config.json parsed once per distinct bundle, the spec is handed
+ * to each child as CBOR in an inherited fd ([SPEC_FD_ENV]), and the seccomp
+ * profile is compiled once so every child hits the BPF cache.
+ *
+ * At most [jobs] creates run at a time. The per-container results are
+ * printed to stdout as a JSON array of [BatchResult] in request order.
+ *
+ * @param rootPath Root directory for container state
+ * @param requestPath File with the JSON request, or "-" for stdin
+ * @param jobs Maximum number of concurrent creates
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun createBatch(
+    fs: FileSystem,
+    rootPath: String,
+    requestPath: String,
+    jobs: Int,
+): Unit =
+    memScoped {
+        val entries =
+            try {
+                parseBatchEntries(if (requestPath == "-") readStdin() else fs.readTextFile(requestPath))
+            } catch (e: Exception) {
+                Logger.error("failed to read batch request: ${e.message ?: "unknown error"}")
+                exit(1)
+                return@memScoped
+            }
+        if (jobs < 1) {
+            Logger.error("--jobs must be at least 1")
+            exit(1)
+        }
+        Logger.info("creating ${entries.size} containers, up to $jobs at a time")
+
+        val exePath =
+            allocArray<ByteVar>(4096).let { buf ->
+                val len = readlink("/proc/self/exe", buf, 4095u)
+                if (len < 0) {
+                    Logger.error("failed to read executable path (errno=$errno)")
+                    exit(1)
+                }
+                buf[len.toInt()] = 0
+                buf.toKString()
+            }
+
+        val results = arrayOfNulls<BatchResult>(entries.size)
+        // Keyed by the bundle path as given; realpath and parse once per bundle
+        val bundles = mutableMapOf<String, PreparedBundle>()
+        for ((i, entry) in entries.withIndex()) {
+            val prepared = bundles.getOrPut(entry.bundle) { prepareBundle(rootPath, entry.bundle, bundles.size) }
+            prepared.error?.let { results[i] = BatchResult(entry.id, "failed", error = it) }
+        }
+
+        // create pid -> index of its entry
+        val running = mutableMapOf<Int, Int>()
+        val pending = ArrayDeque(entries.indices.filter { results[it] == null })
+        val status = alloc<IntVar>()
+        while (pending.isNotEmpty() || running.isNotEmpty()) {
+            while (pending.isNotEmpty() && running.size < jobs) {
+                val i = pending.removeFirst()
+                val entry = entries[i]
+                val prepared = bundles.getValue(entry.bundle)
+                val pid = spawnCreate(exePath, rootPath, entry, prepared)
+                if (pid < 0) {
+                    results[i] = BatchResult(entry.id, "failed", error = "fork failed (errno=$errno)")
+                } else {
+                    running[pid] = i
+                }
+            }
+            if (running.isEmpty()) continue
+
+            // Each create clones its stage-1 (the spawner, or the exec'd
+            // fallback) with CLONE_PARENT, and stage-1 clones init the same
+            // way, so both are children of this process, not of the create.
+            // Only the create processes are tracked; the others are reaped
+            // here as they exit (stage-1 as soon as init is running)
+            val pid = waitpid(-1, status.ptr, 0)
+            if (pid < 0) {
+                if (errno == EINTR) continue
+                Logger.error("waitpid failed (errno=$errno)")
+                break
+            }
+            val i = running.remove(pid) ?: continue
+            results[i] = collectResult(fs, rootPath, entries[i], status.value)
+        }
+
+        bundles.values.forEach { it.specFd.takeIf { fd -> fd >= 0 }?.let { fd -> close(fd) } }
+
+        val report = entries.indices.map { results[it] ?: BatchResult(entries[it].id, "failed", error = "not run") }
+        println(JsonCodec.encode(report, prettyPrint = true))
+
+        val failed = report.count { it.status != "created" }
+        Logger.info("created ${report.size - failed} of ${report.size} containers")
+        if (failed > 0) exit(1)
+    }
+
+/**
+ * Per-bundle work shared by all containers of a batch
+ *
+ * @property absPath Canonical bundle path
+ * @property specFd Memfd holding the CBOR spec, inherited
+ *   by each create (-1 if the bundle could not be prepared)
+ * @property error Reason why containers of this bundle cannot be created
+ */
+private data class PreparedBundle(
+    val absPath: String,
+    val specFd: Int,
+    val error: String? = null,
+)
+
+@OptIn(ExperimentalForeignApi::class)
+private fun prepareBundle(
+    rootPath: String,
+    bundlePath: String,
+    index: Int,
+): PreparedBundle =
+    memScoped {
+        val absPath =
+            allocArray<ByteVar>(4096).let { buf ->
+                if (realpath(bundlePath, buf) == null) {
+                    return@memScoped PreparedBundle(bundlePath, -1, "failed to resolve bundle path (errno=$errno)")
+                }
+                buf.toKString()
+            }
+
+        val spec =
+            try {
+                loadSpecCached(rootPath, "$absPath/config.json")
+            } catch (e: Exception) {
+                return@memScoped PreparedBundle(absPath, -1, "failed to load spec: ${e.message ?: "unknown error"}")
+            }
+
+        // Warm the BPF cache; every create of this bundle then gets a hit
+        spec.linux?.seccomp?.let { compileSeccompBpf(it, rootPath) }
+
+        PreparedBundle(absPath, writeSpecFd(spec, index))
+    }
+
+// glibc has no memfd_create wrapper in the version we build against
+private const val SYS_MEMFD_CREATE = 319L // x86_64
+private const val MFD_CLOEXEC = 1L
+
+/**
+ * Store [spec] as CBOR in an anonymous memfd and return its fd, read by each
+ * child with pread so it needs no rewinding. A memfd has no path another
+ * user could create first or open. The fd is close-on-exec: [spawnCreate]
+ * clears the flag only in the children of its bundle. -1 if it cannot be
+ * written; the children then parse config.json themselves.
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun writeSpecFd(
+    spec: Spec,
+    index: Int,
+): Int {
+    val bytes = CborCodec.encode(spec)
+    val fd = memScoped { syscall(SYS_MEMFD_CREATE, "kontainer-spec-$index".cstr.ptr, MFD_CLOEXEC).toInt() }
+    if (fd < 0) {
+        Logger.warn("failed to create the shared spec memfd (errno=$errno), creates will parse config.json")
+        return -1
+    }
+    var offset = 0
+    bytes.usePinned { pinned ->
+        while (offset < bytes.size) {
+            val n = write(fd, pinned.addressOf(offset), (bytes.size - offset).convert())
+            if (n < 0 && errno == EINTR) continue
+            if (n <= 0) break
+            offset += n.toInt()
+        }
+    }
+    if (offset < bytes.size) {
+        Logger.warn("failed to write shared spec (errno=$errno), creates will parse config.json")
+        close(fd)
+        return -1
+    }
+    return fd
+}
+
+/**
+ * Fork and exec `<exe> --root <root> create --bundle <bundle> [--pid-file <f>] <id>`
+ *
+ * argv and envp are built before the fork: the child of this multi-threaded
+ * process only clears FD_CLOEXEC on its bundle's spec fd and calls execve.
+ *
+ * @return PID of the create process, or -1 if fork failed
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun spawnCreate(
+    exePath: String,
+    rootPath: String,
+    entry: BatchEntry,
+    bundle: PreparedBundle,
+): Int =
+    memScoped {
+        val args =
+            listOf(exePath, "--root", rootPath, "create", "--bundle", bundle.absPath) +
+                (entry.pidFile?.let { listOf("--pid-file", it) } ?: emptyList()) +
+                entry.id
+        val argv = allocArray<CPointerVar<ByteVar>>(args.size + 1)
+        args.forEachIndexed { i, a -> argv[i] = a.cstr.ptr }
+        argv[args.size] = null
+
+        val env = mutableListOf<String>()
+        __environ?.let { environ ->
+            var i = 0
+            while (true) {
+                val entry = environ[i++]?.toKString() ?: break
+                if (!entry.startsWith("$SPEC_FD_ENV=")) env.add(entry)
+            }
+        }
+        if (bundle.specFd >= 0) env.add("$SPEC_FD_ENV=${bundle.specFd}")
+        val envp = allocArray<CPointerVar<ByteVar>>(env.size + 1)
+        env.forEachIndexed { i, e -> envp[i] = e.cstr.ptr }
+        envp[env.size] = null
+
+        val pid = fork()
+        if (pid == 0) {
+            if (bundle.specFd >= 0) fcntl(bundle.specFd, F_SETFD, 0)
+            execve(exePath, argv, envp)
+            _exit(127)
+        }
+        pid
+    }
+
+private fun collectResult(
+    fs: FileSystem,
+    rootPath: String,
+    entry: BatchEntry,
+    status: Int,
+): BatchResult {
+    // WIFEXITED && WEXITSTATUS == 0
+    if ((status and 0x7f) != 0) return BatchResult(entry.id, "failed", error = "create killed by signal ${status and 0x7f}")
+    val code = (status shr 8) and 0xff
+    if (code != 0) return BatchResult(entry.id, "failed", error = "create exited with status $code")
+    return try {
+        BatchResult(entry.id, "created", pid = loadState(fs, rootPath, entry.id).pid)
+    } catch (e: Exception) {
+        BatchResult(entry.id, "failed", error = "no state after create: ${e.message ?: "unknown"}")
+    }
+}
+
+private fun readStdin(): String {
+    val builder = StringBuilder()
+    while (true) {
+        val line = readlnOrNull() ?: break
+        builder.append(line).append('\n')
+    }
+    return builder.toString()
+}
+
+/**
+ * Decode the spec handed over by `create-batch` through [SPEC_FD_ENV]
+ *
+ * The fd is closed and the variable cleared, so neither reaches the
+ * container. Any problem yields null and create falls back to config.json.
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun takeInheritedSpec(): Spec? =
+    memScoped {
+        val value = getenv(SPEC_FD_ENV)?.toKString() ?: return null
+        unsetenv(SPEC_FD_ENV)
+        val fd = value.toIntOrNull() ?: return null
+        try {
+            val st = alloc<stat>()
+            if (fstat(fd, st.ptr) != 0 || st.st_size <= 0) return null
+            val bytes = ByteArray(st.st_size.toInt())
+            var done = 0
+            bytes.usePinned { pinned ->
+                while (done < bytes.size) {
+                    val n = pread(fd, pinned.addressOf(done), (bytes.size - done).convert(), done.toLong())
+                    if (n < 0 && errno == EINTR) continue
+                    if (n <= 0) return null
+                    done += n.toInt()
+                }
+            }
+            CborCodec.decode<Spec>(bytes)
+        } catch (e: Exception) {
+            Logger.debug { "ignoring inherited spec: ${e.message}" }
+            null
+        } finally {
+            close(fd)
+        }
+    }
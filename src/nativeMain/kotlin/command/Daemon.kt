@@ -0,0 +1,59 @@
+package command
+
+import cgroup.Cgroup
+import daemon.Daemon
+import daemon.DaemonRequest
+import daemon.forwardToDaemon
+import kotlinx.cinterop.ExperimentalForeignApi
+import logger.Logger
+import platform.posix.exit
+import syscall.Syscall
+import trace.Tracer
+import utils.FileSystem
+
+/**
+ * Daemon command - Serve container commands over `<root>/kontainer.sock`
+ * until killed (see daemon/Daemon.kt)
+ *
+ * @param rootPath Root directory for container state
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun daemon(
+    syscall: Syscall,
+    fs: FileSystem,
+    cgroup: Cgroup,
+    rootPath: String,
+) {
+    Logger.setContext("daemon")
+    try {
+        Daemon(syscall, fs, cgroup, rootPath).run()
+    } catch (e: Exception) {
+        Logger.error("daemon failed: ${e.message ?: "unknown"}")
+        exit(1)
+    }
+}
+
+/**
+ * Run [request] through the daemon if one is running
+ *
+ * Prints the command's output, or logs its error and exits with status 1.
+ * Nothing is forwarded with tracing enabled, since spans are recorded by the
+ * process that runs the command.
+ *
+ * @return true if the daemon handled the request, false if the caller should
+ *   run the command itself
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun runViaDaemon(
+    rootPath: String,
+    request: DaemonRequest,
+): Boolean {
+    if (Tracer.enabled) return false
+    val response = forwardToDaemon(rootPath, request) ?: return false
+    if (!response.ok) {
+        Logger.error("${request.op} ${request.id}: ${response.error ?: "unknown error"}")
+        exit(1)
+    }
+    response.output?.let { println(it) }
+    return true
+}
@@ -7,7 +7,8 @@ import kotlinx.cinterop.ExperimentalForeignApi
 import logger.Logger
 import platform.posix.SIGKILL
 import platform.posix.exit
-import spec.loadSpec
+import spec.loadSpecHooks
+import spec.removeSpecCacheEntry
 import state.*
 import syscall.Syscall
 import utils.FileSystem
@@ -34,7 +35,7 @@ fun delete(
     if (!containerExists(fs, rootPath, containerId)) {
         if (force) {
             // With force flag, non-existent container is not an error
-            Logger.debug("container $containerId does not exist, but force flag is set")
+            Logger.debug { "container $containerId does not exist, but force flag is set" }
             Logger.info("container $containerId deleted successfully")
             exit(0)
         }
@@ -43,7 +44,7 @@ fun delete(
     }
 
     // Load container state and refresh to get actual status
-    var state =
+    val state =
         try {
             loadState(fs, rootPath, containerId)
         } catch (e: Exception) {
@@ -52,27 +53,56 @@ fun delete(
             return
         }
 
+    try {
+        deleteContainer(syscall, fs, cgroup, rootPath, state, force)
+    } catch (e: Exception) {
+        Logger.error("failed to delete container: ${e.message ?: "unknown"}")
+        exit(1)
+    }
+}
+
+/**
+ * Tear down the container described by [state]: its process (with [force]),
+ * cgroup, notify socket and state directory
+ *
+ * Shared by the delete command and the daemon (see daemon/Daemon.kt).
+ *
+ * @param rootPath Root directory for container state
+ * @param force If true, kill the container first if it is not stopped
+ * @throws Exception if the container is not stopped and [force] is false, or
+ *   its directory cannot be removed
+ */
+fun deleteContainer(
+    syscall: Syscall,
+    fs: FileSystem,
+    cgroup: Cgroup,
+    rootPath: String,
+    state: State,
+    force: Boolean,
+) {
+    val containerId = state.id
+
     // Refresh status to check actual process state
-    state = state.refreshStatus()
-    Logger.debug("container status: ${state.status.value}")
+    val current = state.refreshStatus()
+    Logger.debug { "container status: ${current.status.value}" }
 
     // Check if container can be deleted
     // Allow deletion of 'stopped' state without force
     // With force flag, allow deletion of any state
     when {
-        state.status.canDelete() -> {
+        current.status.canDelete() -> {
             // STOPPED status: can delete without killing process
             Logger.debug("container is stopped, proceeding with deletion")
         }
 
         force -> {
             // Force flag set: kill process before deletion
-            Logger.debug("container is in '${state.status.value}' state, but force flag is set")
+            Logger.debug { "container is in '${current.status.value}' state, but force flag is set" }
             Logger.debug("killing process before deletion")
-            state.pid?.let { pid ->
+            current.pid?.let { pid ->
                 try {
-                    syscall.killProcess(pid, SIGKILL)
-                    Logger.debug("killed process $pid")
+                    syscall.killProcess(pid, SIGKILL, current.pidStartTime)
+                    Logger.debug { "killed process $pid" }
                 } catch (e: Exception) {
                     Logger.warn("failed to kill process $pid: ${e.message ?: "unknown"}")
                     // Continue with deletion even if kill fails
@@ -82,9 +112,10 @@ fun delete(
 
         else -> {
             // Cannot delete without force flag
-            Logger.error("cannot delete container in '${state.status.value}' state")
-            Logger.error("use --force flag to force deletion, or stop the container first")
-            exit(1)
+            throw Exception(
+                "cannot delete container in '${current.status.value}' state " +
+                    "(use --force flag to force deletion, or stop the container first)",
+            )
         }
     }
 
@@ -112,14 +143,14 @@ fun delete(
     // Run poststop hooks BEFORE we tear down the notify socket / container dir so
     // the hook can still read state.json and the runtime layout. State at this
     // point shows status="stopped". Hook failures are logged but non-fatal.
-    val poststopSpec =
+    val poststop =
         try {
-            loadSpec(fs, "${state.bundle}/config.json")
+            loadSpecHooks(rootPath, "${current.bundle}/config.json")?.poststop
         } catch (e: Exception) {
             null
         }
-    if (poststopSpec?.hooks?.poststop != null) {
-        runHooks(poststopSpec.hooks.poststop, state.withStatus(ContainerStatus.STOPPED))
+    if (poststop != null) {
+        runHooks(poststop, current.withStatus(ContainerStatus.STOPPED))
     }
 
     // Delete notify socket
@@ -130,12 +161,12 @@ fun delete(
         // Continue with deletion
     }
 
+    // Bundles are usually per container, so the spec cache entry would
+    // otherwise outlive it; another container of the same bundle only misses
+    removeSpecCacheEntry(rootPath, "${current.bundle}/config.json")
+
     // Delete container directory
-    try {
-        deleteContainerDir(rootPath, containerId)
-        Logger.info("container $containerId deleted successfully")
-    } catch (e: Exception) {
-        Logger.error("failed to delete container directory: ${e.message ?: "unknown"}")
-        exit(1)
-    }
+    deleteContainerDir(rootPath, containerId)
+    removeFromIndex(fs, rootPath, containerId)
+    Logger.info("container $containerId deleted successfully")
 }
@@ -0,0 +1,297 @@
+package command
+
+import cgroup.Cgroup
+import cgroup.CgroupV2
+import config.loadKontainerConfig
+import kotlinx.cinterop.*
+import kotlinx.serialization.Serializable
+import logger.Logger
+import platform.linux.*
+import platform.posix.*
+import state.ContainerStatus
+import state.loadState
+import state.refreshStatus
+import syscall.openVerifiedPidfd
+import utils.FileSystem
+import utils.JsonCodec
+
+/**
+ * One event of the `events` stream
+ *
+ * @property type "exit", "oom", "pids.limit" or "memory.pressure"
+ * @property id Container ID
+ * @property data Counters that triggered the event (memory.events /
+ *   pids.events values, or the stall totals of memory.pressure), if any
+ */
+@Serializable
+data class ContainerEvent(
+    val type: String,
+    val id: String,
+    val data: Map<String, Long>? = null,
+)
+
+/**
+ * Events for the change of a counter file from [old] to [new]
+ *
+ * - memory.events: "oom" when oom_kill (or, without kills, oom) grew
+ * - pids.events: "pids.limit" when max grew (a fork hit pids.max)
+ */
+internal fun counterEvents(
+    containerId: String,
+    file: String,
+    old: Map<String, Long>,
+    new: Map<String, Long>,
+): List<ContainerEvent> {
+    fun grew(key: String) = (new[key] ?: 0) > (old[key] ?: 0)
+    return when (file) {
+        MEMORY_EVENTS ->
+            if (grew("oom_kill") || grew("oom")) {
+                listOf(ContainerEvent("oom", containerId, new.filterKeys { it == "oom" || it == "oom_kill" }))
+            } else {
+                emptyList()
+            }
+
+        PIDS_EVENTS ->
+            if (grew("max")) listOf(ContainerEvent("pids.limit", containerId, new)) else emptyList()
+
+        else -> emptyList()
+    }
+}
+
+/**
+ * Check a PSI trigger ("some|full <stall us> <window us>") before handing it
+ * to the kernel, which only answers EINVAL
+ *
+ * The window bounds are the kernel's; unprivileged users are further limited
+ * to windows that are a multiple of 2 s.
+ *
+ * @throws Exception if [trigger] is malformed or out of range
+ */
+internal fun validatePsiTrigger(trigger: String) {
+    val parts = trigger.trim().split(' ').filter { it.isNotEmpty() }
+    val stall = parts.getOrNull(1)?.toLongOrNull()
+    val window = parts.getOrNull(2)?.toLongOrNull()
+    if (parts.size != 3 || parts[0] !in setOf("some", "full") || stall == null || window == null) {
+        throw Exception("Invalid PSI trigger \"$trigger\": expected \"some|full <stall us> <window us>\"")
+    }
+    if (window !in PSI_MIN_WINDOW_US..PSI_MAX_WINDOW_US || stall <= 0 || stall > window) {
+        throw Exception("Invalid PSI trigger \"$trigger\": window must be 500000-10000000 us and stall within it")
+    }
+}
+
+/**
+ * Stall totals of a pressure file
+ * ("some avg10=1.00 avg60=0.50 avg300=0.10 total=12345\nfull ...")
+ *
+ * @return "some.total" and "full.total" in microseconds
+ */
+internal fun parsePressureTotals(content: String): Map<String, Long> =
+    content
+        .lines()
+        .mapNotNull { line ->
+            val kind = line.substringBefore(' ')
+            val total = line.split(' ').firstOrNull { it.startsWith("total=") }?.removePrefix("total=")?.toLongOrNull()
+            if (kind.isEmpty() || total == null) null else "$kind.total" to total
+        }.toMap()
+
+private const val PSI_MIN_WINDOW_US = 500_000L
+private const val PSI_MAX_WINDOW_US = 10_000_000L
+
+private const val CGROUP_EVENTS = "cgroup.events"
+private const val MEMORY_EVENTS = "memory.events"
+private const val PIDS_EVENTS = "pids.events"
+
+/** epoll tag of the init pidfd; counter files use their index in the watch list */
+private const val PIDFD_TAG = 1000UL
+
+/** epoll tag of the memory.pressure trigger fd */
+private const val PRESSURE_TAG = 1001UL
+
+/**
+ * Events command - Stream exit, OOM and pids-limit events of a container
+ *
+ * Prints one JSON [ContainerEvent] per line as it happens and returns once
+ * the container has stopped. Nothing is polled: the init pidfd becomes
+ * readable when it exits, and cgroupfs signals EPOLLPRI on cgroup.events,
+ * memory.events and pids.events when they change, so one epoll_wait covers
+ * everything. The stream ends when cgroup.events reports "populated 0" (or,
+ * without a cgroup, when the init exits).
+ *
+ * With [memoryPressure], a PSI trigger is registered on the cgroup's
+ * memory.pressure and every firing is reported as a "memory.pressure" event,
+ * so a controller can shed load while the container is stalling on
+ * reclaim, before memory.max makes the kernel OOM-kill it.
+ *
+ * @param rootPath Root directory for container state
+ * @param containerId Container ID
+ * @param memoryPressure PSI trigger, e.g. "some 150000 1000000" (150 ms of
+ *   stall within 1 s); see [validatePsiTrigger]
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun events(
+    fs: FileSystem,
+    cgroup: Cgroup,
+    rootPath: String,
+    containerId: String,
+    memoryPressure: String? = null,
+): Unit =
+    memScoped {
+        try {
+            memoryPressure?.let { validatePsiTrigger(it) }
+        } catch (e: Exception) {
+            Logger.error(e.message ?: "invalid PSI trigger")
+            exit(1)
+        }
+
+        val state =
+            try {
+                loadState(fs, rootPath, containerId).refreshStatus()
+            } catch (e: Exception) {
+                Logger.error("failed to load container state: ${e.message ?: "unknown"}")
+                exit(1)
+                return@memScoped
+            }
+
+        val pid = state.pid
+        if (state.status == ContainerStatus.STOPPED || pid == null) {
+            emit(ContainerEvent("exit", containerId))
+            return@memScoped
+        }
+        // -1 with ENOSYS: no pidfds, the cgroup alone tells when it is over
+        val pidfd = openVerifiedPidfd(pid, state.pidStartTime)
+        if (pidfd < 0 && errno != ENOSYS) {
+            emit(ContainerEvent("exit", containerId))
+            return@memScoped
+        }
+
+        val cgroupPath =
+            try {
+                loadKontainerConfig(fs, rootPath, containerId).cgroupPath
+            } catch (e: Exception) {
+                Logger.warn("no kontainer config, watching the init process only: ${e.message ?: "unknown"}")
+                null
+            }
+
+        val epfd = epoll_create1(EPOLL_CLOEXEC)
+        if (epfd < 0) {
+            Logger.error("epoll_create1 failed (errno=$errno)")
+            exit(1)
+        }
+
+        fun watch(
+            fd: Int,
+            events: Int,
+            tag: ULong,
+        ) {
+            val ev = alloc<epoll_event>()
+            ev.events = events.toUInt()
+            ev.data.u64 = tag
+            if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, ev.ptr) != 0) {
+                Logger.warn("epoll_ctl failed for fd $fd (errno=$errno)")
+            }
+        }
+
+        if (pidfd >= 0) watch(pidfd, EPOLLIN, PIDFD_TAG)
+
+        // Counter files and their last values; cgroup.events goes first
+        val files = listOf(CGROUP_EVENTS, MEMORY_EVENTS, PIDS_EVENTS)
+        val fds = IntArray(files.size) { -1 }
+        val counters = Array(files.size) { emptyMap<String, Long>() }
+        if (cgroupPath != null) {
+            for ((i, name) in files.withIndex()) {
+                val fd = cgroup.openInterfaceFile(cgroupPath, name)
+                if (fd < 0) continue
+                fds[i] = fd
+                counters[i] = readCounters(fd)
+                watch(fd, EPOLLPRI or EPOLLERR, i.toULong())
+            }
+        }
+        var pressureFd = -1
+        if (memoryPressure != null) {
+            if (cgroupPath != null) pressureFd = cgroup.openPressureTrigger(cgroupPath, "memory", memoryPressure)
+            if (pressureFd >= 0) {
+                watch(pressureFd, EPOLLPRI or EPOLLERR, PRESSURE_TAG)
+            } else {
+                Logger.warn("no memory.pressure trigger for $containerId, streaming without pressure events")
+            }
+        }
+        if (pidfd < 0 && fds[0] < 0) {
+            Logger.error("container $containerId has neither a pidfd nor cgroup.events to watch")
+            exit(1)
+        }
+
+        var exited = false
+        var done = fds[0] >= 0 && counters[0]["populated"] == 0L
+        val ready = allocArray<epoll_event>(8)
+        while (!done) {
+            val n = epoll_wait(epfd, ready, 8, -1)
+            if (n < 0) {
+                if (errno == EINTR) continue
+                Logger.error("epoll_wait failed (errno=$errno)")
+                break
+            }
+            for (k in 0 until n) {
+                val tag = ready[k].data.u64
+                if (tag == PIDFD_TAG) {
+                    if (!exited) emit(ContainerEvent("exit", containerId))
+                    exited = true
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, pidfd, null)
+                    // Without cgroup.events the stream ends with the init
+                    if (fds[0] < 0) done = true
+                    continue
+                }
+                if (tag == PRESSURE_TAG) {
+                    if ((ready[k].events.toInt() and EPOLLERR) != 0) {
+                        // The cgroup is going away; cgroup.events ends the stream
+                        epoll_ctl(epfd, EPOLL_CTL_DEL, pressureFd, null)
+                    } else {
+                        emit(ContainerEvent("memory.pressure", containerId, readPressureTotals(pressureFd)))
+                    }
+                    continue
+                }
+
+                val i = tag.toInt()
+                val current = readCounters(fds[i])
+                if (i == 0) {
+                    if (current["populated"] == 0L) done = true
+                } else {
+                    counterEvents(containerId, files[i], counters[i], current).forEach { emit(it) }
+                }
+                counters[i] = current
+            }
+        }
+        if (!exited) emit(ContainerEvent("exit", containerId))
+
+        fds.filter { it >= 0 }.forEach { close(it) }
+        if (pressureFd >= 0) close(pressureFd)
+        if (pidfd >= 0) close(pidfd)
+        close(epfd)
+    }
+
+@OptIn(ExperimentalForeignApi::class)
+private fun emit(event: ContainerEvent) {
+    println(JsonCodec.encode(event))
+    fflush(stdout)
+}
+
+@OptIn(ExperimentalForeignApi::class)
+private fun readPressureTotals(fd: Int): Map<String, Long> =
+    memScoped {
+        val buffer = allocArray<ByteVar>(4096)
+        val n = pread(fd, buffer, 4095u, 0)
+        if (n <= 0) return emptyMap()
+        parsePressureTotals(buffer.readBytes(n.toInt()).decodeToString())
+    }
+
+/**
+ * Re-read a cgroup counter file from the start; cgroupfs regenerates the
+ * content on every read
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun readCounters(fd: Int): Map<String, Long> =
+    memScoped {
+        val buffer = allocArray<ByteVar>(4096)
+        val n = pread(fd, buffer, 4095u, 0)
+        if (n <= 0) return emptyMap()
+        CgroupV2.parseKeyedCounters(buffer.readBytes(n.toInt()).decodeToString())
+    }
@@ -1,12 +1,26 @@
 package command
 
+import bootstrap.kontainer_exec
 import kotlinx.cinterop.*
 import logger.Logger
-import platform.linux.setns_wrapper
+import namespace.namespaceCloneFlag
 import platform.posix.*
 import state.loadState
+import syscall.openVerifiedPidfd
 import utils.FileSystem
 
+/** /proc/<pid>/ns entry -> OCI namespace type, for the namespaces exec joins */
+private val execNamespaces =
+    listOf(
+        "user" to "user",
+        "ipc" to "ipc",
+        "uts" to "uts",
+        "net" to "network",
+        "mnt" to "mount",
+        "cgroup" to "cgroup",
+        "pid" to "pid",
+    )
+
 /**
  * Exec command — run an additional process inside a running container by joining
  * its namespaces via setns(2) and then execve(2)'ing the user's command.
@@ -15,9 +29,11 @@ import utils.FileSystem
  * no TTY, no --user / --cwd / --env overrides (those use the container's
  * existing setup). Enough for `kontainer-runtime exec <id> sh -c '...'`.
  *
- * setns into mount/pid/etc requires a single-threaded process. fork() returns
- * a single-threaded child even if the parent runtime has worker threads, so
- * we do the namespace joining in a forked child before execve.
+ * setns into mount/pid/etc requires a single-threaded process, so the
+ * joining happens in a child, see kontainer_exec in bootstrap.c: one clone
+ * straight into the container's cgroup, one setns(pidfd, ...) for all
+ * namespaces, and a vfork for the command itself (setns(CLONE_NEWPID) only
+ * applies to children).
  */
 @OptIn(ExperimentalForeignApi::class)
 fun exec(
@@ -44,66 +60,32 @@ fun exec(
         return
     }
 
-    // Open every namespace file under /proc/<initPid>/ns/. user must be first
-    // (transition affects capability checks), pid last among the post-fork ones.
-    val nsOrder = listOf("user", "ipc", "uts", "net", "mnt", "cgroup", "pid")
-    val nsFds = mutableMapOf<String, Int>()
-    for (ns in nsOrder) {
-        val path = "/proc/$initPid/ns/$ns"
-        if (access(path, F_OK) != 0) continue
-        val fd = open(path, O_RDONLY)
-        if (fd < 0) {
-            Logger.warn("exec: failed to open $path (errno=$errno)")
-            continue
-        }
-        nsFds[ns] = fd
+    // Verified against the recorded start time: a reused PID must not be joined
+    val pidfd = openVerifiedPidfd(initPid, state.pidStartTime)
+    if (pidfd < 0 && errno != ENOSYS) {
+        Logger.error("exec: container init $initPid is not running")
+        exit(1)
     }
+    val nstypes = namespacesToJoin(initPid)
+    // Without a cgroup fd the command stays in the runtime's cgroup
+    val cgroupFd =
+        state.cgroupPath?.let { open("/sys/fs/cgroup/${it.removePrefix("/")}", O_RDONLY or O_DIRECTORY or O_CLOEXEC) } ?: -1
+    Logger.debug { "exec: joining namespaces 0x${nstypes.toString(16)} of $initPid (pidfd=$pidfd, cgroup fd=$cgroupFd)" }
 
-    val pid = fork()
+    val pid = memScoped {
+        val argv = allocArray<CPointerVar<ByteVar>>(args.size + 1)
+        args.forEachIndexed { i, a -> argv[i] = a.cstr.ptr }
+        argv[args.size] = null
+        kontainer_exec(initPid, pidfd, nstypes, cgroupFd, argv)
+    }
+    val cloneErrno = errno
+    if (pidfd >= 0) close(pidfd)
+    if (cgroupFd >= 0) close(cgroupFd)
     if (pid < 0) {
-        Logger.error("exec: fork() failed (errno=$errno)")
+        Logger.error("exec: clone failed (errno=$cloneErrno)")
         exit(1)
     }
-    if (pid == 0) {
-        // Child (single-threaded). Join the container's namespaces.
-        // PID join takes effect on the NEXT fork — execve in this same
-        // process still operates in the new pid ns since the kernel
-        // applies the change at fork/clone boundaries... wait, the spec
-        // is subtler: setns(pidfd, CLONE_NEWPID) puts CHILDREN of the
-        // caller in the new pid ns, not the caller itself. To inherit
-        // pid ns for the user's command we therefore fork once more.
-        for (ns in nsOrder) {
-            val fd = nsFds[ns] ?: continue
-            if (setns_wrapper(fd, 0) != 0) {
-                fprintf(stderr, "exec: setns(%s) failed: %s\n", ns, strerror(errno))
-                _exit(1)
-            }
-        }
-        chdir("/")
-        val grandchild = fork()
-        if (grandchild < 0) _exit(1)
-        if (grandchild == 0) {
-            // Grandchild — now inside the container's pid ns. Exec the command.
-            memScoped {
-                val argv = allocArray<CPointerVar<ByteVar>>(args.size + 1)
-                args.forEachIndexed { i, a -> argv[i] = a.cstr.ptr }
-                argv[args.size] = null
-                execvp(args[0], argv)
-                fprintf(stderr, "exec: execvp(%s) failed: %s\n", args[0], strerror(errno))
-                _exit(127)
-            }
-        }
-        // Child waits for grandchild and propagates exit code.
-        memScoped {
-            val status = alloc<IntVar>()
-            waitpid(grandchild, status.ptr, 0)
-            val code = if ((status.value and 0x7f) == 0) (status.value shr 8) and 0xff else 1
-            _exit(code)
-        }
-    }
 
-    // Parent: wait for child.
-    nsFds.values.forEach { close(it) }
     memScoped {
         val status = alloc<IntVar>()
         waitpid(pid, status.ptr, 0)
@@ -111,3 +93,28 @@ fun exec(
         exit(code)
     }
 }
+
+/**
+ * CLONE_NEW* flags of the namespaces of [initPid] that differ from ours
+ *
+ * setns() into the namespace one is already in fails for a user namespace
+ * and is wasted work for the others, so those are left out. Compared by
+ * inode, without opening anything.
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun namespacesToJoin(initPid: Int): Int =
+    memScoped {
+        val theirs = alloc<stat>()
+        val ours = alloc<stat>()
+        var flags = 0u
+        for ((procName, type) in execNamespaces) {
+            if (stat("/proc/$initPid/ns/$procName", theirs.ptr) != 0) continue
+            if (stat("/proc/self/ns/$procName", ours.ptr) == 0 &&
+                ours.st_ino == theirs.st_ino && ours.st_dev == theirs.st_dev
+            ) {
+                continue
+            }
+            flags = flags or namespaceCloneFlag(type)
+        }
+        flags.toInt()
+    }
@@ -3,6 +3,7 @@ package command
 import kotlinx.cinterop.ExperimentalForeignApi
 import logger.Logger
 import platform.posix.*
+import state.State
 import state.loadState
 import state.refreshStatus
 import syscall.Syscall
@@ -29,7 +30,7 @@ fun kill(
     Logger.info("killing container: $containerId with signal: $signalStr")
 
     // Load container state
-    var state =
+    val state =
         try {
             loadState(fs, rootPath, containerId)
         } catch (e: Exception) {
@@ -39,49 +40,60 @@ fun kill(
             return
         }
 
+    try {
+        killContainer(syscall, state, signalStr)
+    } catch (e: Exception) {
+        Logger.error("failed to kill container: ${e.message ?: "unknown"}")
+        exit(1)
+    }
+}
+
+/**
+ * Send a signal to the init process of the container described by [state]
+ *
+ * Shared by the kill command and the daemon (see daemon/Daemon.kt).
+ *
+ * @param signalStr Signal to send (name like "SIGTERM" or number like "15")
+ * @throws Exception if the container is not created/running, the signal is
+ *   unknown or delivery fails
+ */
+fun killContainer(
+    syscall: Syscall,
+    state: State,
+    signalStr: String,
+) {
     // Refresh status to check actual process state
-    state = state.refreshStatus()
-    Logger.debug("container status: ${state.status.value}")
+    val current = state.refreshStatus()
+    Logger.debug { "container status: ${current.status.value}" }
 
     // Validate status - only created or running containers can be killed
-    if (!state.status.canKill()) {
-        Logger.error("cannot kill container in '${state.status.value}' state")
-        Logger.error("kill can only be used on containers in 'created' or 'running' states")
-        exit(1)
+    if (!current.status.canKill()) {
+        throw Exception(
+            "cannot kill container in '${current.status.value}' state " +
+                "(kill can only be used on containers in 'created' or 'running' states)",
+        )
     }
 
-    Logger.debug("container is in valid state for kill: ${state.status.value}")
+    Logger.debug { "container is in valid state for kill: ${current.status.value}" }
 
     // Parse signal
     val signal =
         try {
             parseSignal(signalStr)
         } catch (e: IllegalArgumentException) {
-            Logger.error("invalid signal: ${e.message ?: "unknown"}")
-            exit(1)
-            return
+            throw Exception("invalid signal: ${e.message ?: "unknown"}")
         }
 
-    Logger.debug("parsed signal: $signalStr -> $signal")
+    Logger.debug { "parsed signal: $signalStr -> $signal" }
 
     // Get PID from state
-    val pid = state.pid
-    if (pid == null) {
-        Logger.error("container has no PID in state")
-        exit(1)
-        return
-    }
+    val pid = current.pid ?: throw Exception("container has no PID in state")
 
-    Logger.debug("sending signal $signal to PID $pid")
+    Logger.debug { "sending signal $signal to PID $pid" }
 
     // Send signal to init process
-    try {
-        syscall.killProcess(pid, signal)
-        Logger.info("successfully sent signal $signalStr to container $containerId (PID $pid)")
-    } catch (e: Exception) {
-        Logger.error("failed to kill container: ${e.message ?: "unknown"}")
-        exit(1)
-    }
+    syscall.killProcess(pid, signal, current.pidStartTime)
+    Logger.info("successfully sent signal $signalStr to container ${current.id} (PID $pid)")
 }
 
 /**
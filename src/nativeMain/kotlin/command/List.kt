@@ -0,0 +1,98 @@
+package command
+
+import kotlinx.cinterop.ExperimentalForeignApi
+import kotlinx.serialization.SerialName
+import kotlinx.serialization.Serializable
+import logger.Logger
+import platform.posix.exit
+import state.ContainerStatus
+import state.IndexEntry
+import state.liveStatus
+import state.readIndex
+import utils.FileSystem
+import utils.JsonCodec
+
+/**
+ * One container of `list --format json`, with the fields of `runc list`
+ * that the index holds
+ */
+@Serializable
+internal data class ListItem(
+    @SerialName("id")
+    val id: String,
+    @SerialName("pid")
+    val pid: Int,
+    @SerialName("status")
+    val status: String,
+    @SerialName("bundle")
+    val bundle: String,
+    @SerialName("created")
+    val created: String,
+)
+
+/**
+ * List command - Show every container under the root
+ *
+ * Reads the per-root index (see [readIndex]) instead of each container's
+ * state.json, so the cost is one mapped file plus one liveness check per
+ * container. Statuses are refreshed like `state` does, but not written back.
+ *
+ * @param rootPath Root directory for container state
+ * @param format Output format ("table" or "json", default: "table")
+ * @param quiet Print container IDs only
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun list(
+    fs: FileSystem,
+    rootPath: String,
+    format: String = "table",
+    quiet: Boolean = false,
+) {
+    if (format != "json" && format != "table") {
+        Logger.error("invalid format: $format (must be 'json' or 'table')")
+        exit(1)
+    }
+
+    val entries =
+        try {
+            readIndex(fs, rootPath).sortedBy { it.id }
+        } catch (e: Exception) {
+            Logger.error("failed to read container index: ${e.message ?: "unknown"}")
+            exit(1)
+            return
+        }
+
+    if (quiet) {
+        entries.forEach { println(it.id) }
+        return
+    }
+
+    val items = entries.map { it.toListItem() }
+    when (format) {
+        "json" -> println(JsonCodec.encode(items))
+        "table" -> formatListTable(items).forEach { println(it) }
+    }
+}
+
+private fun IndexEntry.toListItem(): ListItem {
+    val current = liveStatus(id, pid, pidStartTime, status)
+    return ListItem(
+        id = id,
+        // runc reports 0 for a container without a live process
+        pid = if (current == ContainerStatus.STOPPED) 0 else pid ?: 0,
+        status = current.value,
+        bundle = bundle,
+        created = created ?: "",
+    )
+}
+
+/** `runc list` style table: a header and one line per container */
+internal fun formatListTable(items: List<ListItem>): List<String> {
+    val rows =
+        listOf(listOf("ID", "PID", "STATUS", "BUNDLE", "CREATED")) +
+            items.map { listOf(it.id, it.pid.toString(), it.status, it.bundle, it.created) }
+    val widths = (0 until 4).map { col -> rows.maxOf { it[col].length } }
+    return rows.map { row ->
+        row.mapIndexed { col, cell -> if (col < 4) cell.padEnd(widths[col] + 3) else cell }.joinToString("")
+    }
+}
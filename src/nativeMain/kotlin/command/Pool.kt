@@ -0,0 +1,128 @@
+package command
+
+import kotlinx.cinterop.*
+import logger.Logger
+import platform.posix.*
+import pool.NO_POOL_ENV
+import pool.POOL_MEMBER_PREFIX
+import pool.isPoolEligible
+import pool.listPoolMembers
+import pool.poolTemplateDir
+import pool.poolTemplateKey
+import spec.loadSpecCached
+import utils.FileSystem
+
+/**
+ * Pool command - Fill the warm pool for a bundle (see pool/Pool.kt)
+ *
+ * Creates containers from [bundlePath] until [size] members are registered
+ * for its template. Each member is a regular `create` of this binary, run
+ * with pool claiming disabled so it cannot consume an existing member.
+ *
+ * @param rootPath Root directory for container state
+ * @param bundlePath Path to the OCI bundle used as template
+ * @param size Number of members to keep
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun pool(
+    fs: FileSystem,
+    rootPath: String,
+    bundlePath: String,
+    size: Int,
+): Unit =
+    memScoped {
+        val absBundle =
+            allocArray<ByteVar>(4096).let { buf ->
+                if (realpath(bundlePath, buf) == null) {
+                    Logger.error("failed to resolve bundle path '$bundlePath' (errno=$errno)")
+                    exit(1)
+                    return@memScoped
+                }
+                buf.toKString()
+            }
+
+        val spec =
+            try {
+                loadSpecCached(rootPath, "$absBundle/config.json")
+            } catch (e: Exception) {
+                Logger.error("failed to load spec: ${e.message ?: "unknown error"}")
+                exit(1)
+                return@memScoped
+            }
+        if (!isPoolEligible(spec)) {
+            Logger.error("bundle $absBundle cannot be pooled (spec has hooks, a cgroupsPath or an overlay upper layer)")
+            exit(1)
+        }
+
+        val rootfsPath = if (spec.root.path.startsWith("/")) spec.root.path else "$absBundle/${spec.root.path}"
+        val key = poolTemplateKey(spec, rootfsPath, absBundle)
+        val templateDir = poolTemplateDir(rootPath, key)
+        fs.createDirectories(templateDir)
+
+        val existing = listPoolMembers(rootPath, key).size
+        Logger.info("pool $key has $existing of $size members")
+
+        val exePath =
+            allocArray<ByteVar>(4096).let { buf ->
+                val len = readlink("/proc/self/exe", buf, 4095u)
+                if (len < 0) {
+                    Logger.error("failed to read executable path (errno=$errno)")
+                    exit(1)
+                }
+                buf[len.toInt()] = 0
+                buf.toKString()
+            }
+
+        var failed = 0
+        for (i in existing until size) {
+            val memberId = "$POOL_MEMBER_PREFIX$key-${getpid()}-$i"
+            if (!createMember(exePath, rootPath, absBundle, memberId)) {
+                Logger.error("failed to create pool member $memberId")
+                failed++
+                continue
+            }
+            // Registered only once it is fully created
+            fs.writeTextFile("$templateDir/$memberId", "")
+            Logger.debug { "registered pool member $memberId" }
+        }
+
+        if (failed > 0) exit(1)
+        Logger.info("pool $key filled to $size members")
+    }
+
+/**
+ * Run `<exe> --root <root> create --bundle <bundle> <id>` and wait for it
+ *
+ * @return true if create exited with status 0
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun createMember(
+    exePath: String,
+    rootPath: String,
+    bundlePath: String,
+    memberId: String,
+): Boolean =
+    memScoped {
+        val args = listOf(exePath, "--root", rootPath, "create", "--bundle", bundlePath, memberId)
+        val argv = allocArray<CPointerVar<ByteVar>>(args.size + 1)
+        args.forEachIndexed { i, a -> argv[i] = a.cstr.ptr }
+        argv[args.size] = null
+
+        val pid = fork()
+        if (pid < 0) {
+            Logger.warn("fork() failed (errno=$errno)")
+            return@memScoped false
+        }
+        if (pid == 0) {
+            setenv(NO_POOL_ENV, "1", 1)
+            execv(exePath, argv)
+            _exit(127)
+        }
+
+        val status = alloc<IntVar>()
+        while (waitpid(pid, status.ptr, 0) < 0) {
+            if (errno != EINTR) return@memScoped false
+        }
+        // WIFEXITED && WEXITSTATUS == 0
+        (status.value and 0x7f) == 0 && ((status.value shr 8) and 0xff) == 0
+    }
@@ -6,6 +6,7 @@ import kotlinx.cinterop.*
 import logger.Logger
 import platform.posix.*
 import state.loadState
+import syscall.readProcessStat
 import utils.FileSystem
 import utils.JsonCodec
 
@@ -45,7 +46,7 @@ fun ps(
             return
         }
 
-    Logger.debug("container status: ${state.status.value}")
+    Logger.debug { "container status: ${state.status.value}" }
 
     // Load kontainer config to get cgroup path
     val config =
@@ -65,7 +66,7 @@ fun ps(
         return
     }
 
-    Logger.debug("cgroup path: $cgroupPath")
+    Logger.debug { "cgroup path: $cgroupPath" }
 
     // Get PIDs from cgroup
     val pids =
@@ -96,14 +97,32 @@ fun ps(
 private fun outputJson(pids: List<Int>) {
     val jsonString = JsonCodec.encode(pids)
     println(jsonString)
-    Logger.debug("output JSON: $jsonString")
+    Logger.debug { "output JSON: $jsonString" }
 }
 
+/**
+ * One row of the table output, with the columns of `ps -ef`
+ */
+internal data class PsRow(
+    val user: String,
+    val pid: Int,
+    val ppid: Int,
+    val cpu: Int,
+    val startTime: String,
+    val tty: String,
+    val time: String,
+    val command: String,
+)
+
+internal const val PS_TABLE_HEADER = "UID          PID    PPID  C STIME TTY          TIME CMD"
+
 /**
  * Output PIDs in table format
  *
- * Executes 'ps -ef' and filters output to show only processes with matching PIDs.
- * This provides a human-readable table with process information.
+ * Builds the `ps -ef` columns from /proc/<pid>/stat, status and cmdline of
+ * the container's PIDs only, so the cost follows the container size rather
+ * than the host process table. PIDs that exit after cgroup.procs was read
+ * are skipped.
  */
 @OptIn(ExperimentalForeignApi::class)
 private fun outputTable(pids: List<Int>) {
@@ -112,141 +131,215 @@ private fun outputTable(pids: List<Int>) {
         return
     }
 
-    // Execute 'ps -ef' to get all processes
-    Logger.debug("executing 'ps -ef' to get process information")
-
-    memScoped {
-        // Create pipe for reading ps output
-        val pipeFds = allocArray<IntVar>(2)
-        if (pipe(pipeFds) != 0) {
-            perror("pipe")
-            Logger.error("failed to create pipe for ps command")
-            exit(1)
-        }
-
-        val readFd = pipeFds[0]
-        val writeFd = pipeFds[1]
-
-        // Fork to execute ps command
-        when (val pid = fork()) {
-            -1 -> {
-                perror("fork")
-                Logger.error("failed to fork for ps command")
-                close(readFd)
-                close(writeFd)
-                exit(1)
-            }
-
-            0 -> {
-                // Child process: execute ps -ef
-                close(readFd)
-
-                // Redirect stdout to pipe
-                if (dup2(writeFd, STDOUT_FILENO) == -1) {
-                    perror("dup2")
-                    _exit(1)
-                }
-                close(writeFd)
-
-                // Execute ps -ef
-                val argv = allocArray<CPointerVar<ByteVar>>(3)
-                argv[0] = "ps".cstr.ptr
-                argv[1] = "-ef".cstr.ptr
-                argv[2] = null
-
-                execvp("ps", argv)
+    val clock = PsClock.now()
+    val users = mutableMapOf<Int, String>()
+    println(PS_TABLE_HEADER)
+    var shown = 0
+    for (pid in pids) {
+        val row = readPsRow(pid, clock, users) ?: continue
+        println(formatPsRow(row))
+        shown++
+    }
+    Logger.debug { "table output: $shown of ${pids.size} processes" }
+}
 
-                // If we reach here, execvp failed
-                perror("execvp")
-                _exit(1)
+/**
+ * Time references shared by all rows
+ *
+ * @property now Wall clock in seconds since the epoch
+ * @property uptime Seconds since boot (CLOCK_BOOTTIME), the base of the
+ *   start times in /proc/<pid>/stat
+ * @property hz Clock ticks per second
+ */
+private data class PsClock(
+    val now: Long,
+    val uptime: Double,
+    val hz: Long,
+) {
+    companion object {
+        @OptIn(ExperimentalForeignApi::class)
+        fun now(): PsClock =
+            memScoped {
+                val ts = alloc<timespec>()
+                clock_gettime(CLOCK_BOOTTIME, ts.ptr)
+                val hz = sysconf(_SC_CLK_TCK).takeIf { it > 0 } ?: 100L
+                PsClock(time(null), ts.tv_sec + ts.tv_nsec / 1e9, hz)
             }
+    }
+}
 
-            else -> {
-                // Parent process: read ps output and filter
-                close(writeFd)
-
-                // Read all output from ps
-                val buffer = allocArray<ByteVar>(65536) // 64KB buffer
-                val bytesRead = read(readFd, buffer, 65535u)
-                close(readFd)
+@OptIn(ExperimentalForeignApi::class)
+private fun readPsRow(
+    pid: Int,
+    clock: PsClock,
+    users: MutableMap<Int, String>,
+): PsRow? {
+    val stat = readProcessStat(pid) ?: return null
+    val uid = readProcBytes("/proc/$pid/status")?.decodeToString()?.let { parseEffectiveUid(it) } ?: return null
+    val cmdline = readProcBytes("/proc/$pid/cmdline") ?: return null
+
+    val cpuTicks = stat.utime + stat.stime
+    val elapsed = (clock.uptime - stat.startTime.toDouble() / clock.hz).coerceAtLeast(0.0)
+    return PsRow(
+        user = users.getOrPut(uid) { userName(uid) },
+        pid = pid,
+        ppid = stat.ppid,
+        cpu = cpuPercent(cpuTicks, clock.hz, elapsed),
+        startTime = formatStartTime(clock.now - elapsed.toLong(), clock.now),
+        tty = ttyName(stat.ttyNr),
+        time = formatCpuTime(cpuTicks, clock.hz),
+        command = formatCommand(cmdline, stat.comm),
+    )
+}
 
-                if (bytesRead < 0) {
-                    perror("read")
-                    Logger.error("failed to read ps output")
-                    exit(1)
-                }
+/**
+ * Format [row] in the column layout of [PS_TABLE_HEADER]
+ */
+internal fun formatPsRow(row: PsRow): String =
+    row.user.padEnd(8) + " " +
+        row.pid.toString().padStart(7) + " " +
+        row.ppid.toString().padStart(7) + " " +
+        row.cpu.toString().padStart(2) + " " +
+        row.startTime.padEnd(5) + " " +
+        row.tty.padEnd(8) + " " +
+        row.time.padStart(8) + " " +
+        row.command
 
-                buffer[bytesRead.toInt()] = 0 // Null terminate
-                val psOutput = buffer.toKString()
+/**
+ * Effective UID from the "Uid:" line of /proc/<pid>/status (real, effective,
+ * saved, filesystem)
+ */
+internal fun parseEffectiveUid(status: String): Int? =
+    status
+        .lineSequence()
+        .firstOrNull { it.startsWith("Uid:") }
+        ?.substringAfter(':')
+        ?.trim()
+        ?.split(Regex("\\s+"))
+        ?.getOrNull(1)
+        ?.toIntOrNull()
 
-                // Wait for child process
-                val statusVar = alloc<IntVar>()
-                waitpid(pid, statusVar.ptr, 0)
+/**
+ * Lifetime CPU usage in percent, as the C column of `ps -ef` (capped at 99)
+ */
+internal fun cpuPercent(
+    cpuTicks: Long,
+    hz: Long,
+    elapsedSeconds: Double,
+): Int {
+    if (elapsedSeconds <= 0.0) return 0
+    val percent = (cpuTicks.toDouble() / hz * 100 / elapsedSeconds).toInt()
+    return percent.coerceIn(0, 99)
+}
 
-                // Parse and filter ps output
-                filterPsOutput(psOutput, pids)
-            }
-        }
-    }
+/**
+ * CPU time as `[DD-]HH:MM:SS`
+ */
+internal fun formatCpuTime(
+    cpuTicks: Long,
+    hz: Long,
+): String {
+    val total = cpuTicks / hz
+    val days = total / 86400
+    val hms =
+        (total % 86400 / 3600).toString().padStart(2, '0') + ":" +
+            (total % 3600 / 60).toString().padStart(2, '0') + ":" +
+            (total % 60).toString().padStart(2, '0')
+    return if (days > 0) "$days-$hms" else hms
 }
 
 /**
- * Filter ps output to show only processes with matching PIDs
+ * Terminal name for the tty_nr field of /proc/<pid>/stat, "?" if none
  *
- * @param psOutput Full output from 'ps -ef'
- * @param pids List of PIDs to include
+ * Only the devices a container can have are named: pseudo-terminals
+ * (majors 136-143) and virtual consoles / serial ports (major 4).
  */
-private fun filterPsOutput(
-    psOutput: String,
-    pids: List<Int>,
-) {
-    val lines = psOutput.split('\n')
-
-    if (lines.isEmpty()) {
-        println("No output from ps command")
-        return
-    }
-
-    // Print header (first line)
-    val header = lines[0]
-    println(header)
-
-    // Find PID column index
-    val pidIndex = findPidColumn(header)
-    if (pidIndex == -1) {
-        Logger.warn("could not find PID column in ps output")
-        // Print all lines as fallback
-        lines.drop(1).forEach { println(it) }
-        return
+internal fun ttyName(ttyNr: Int): String {
+    if (ttyNr == 0) return "?"
+    val major = (ttyNr shr 8) and 0xfff
+    val minor = (ttyNr and 0xff) or ((ttyNr shr 12) and 0xfff00)
+    return when {
+        major in 136..143 -> "pts/${(major - 136) * 256 + minor}"
+        major == 4 && minor < 64 -> "tty$minor"
+        major == 4 -> "ttyS${minor - 64}"
+        else -> "?"
     }
+}
 
-    Logger.debug("PID column index: $pidIndex")
-
-    // Filter and print matching lines
-    var matchCount = 0
-    for (line in lines.drop(1)) {
-        if (line.isBlank()) continue
+/**
+ * Command line from /proc/<pid>/cmdline (NUL-separated arguments), or
+ * `[comm]` for kernel threads and zombies, which have none
+ */
+internal fun formatCommand(
+    cmdline: ByteArray,
+    comm: String,
+): String {
+    var end = cmdline.size
+    while (end > 0 && cmdline[end - 1] == 0.toByte()) end--
+    if (end == 0) return "[$comm]"
+    return cmdline.copyOf(end).decodeToString().replace('\u0000', ' ')
+}
 
-        val fields = line.trim().split(Regex("\\s+"))
-        if (pidIndex < fields.size) {
-            val pid = fields[pidIndex].toIntOrNull()
-            if (pid != null && pids.contains(pid)) {
-                println(line)
-                matchCount++
-            }
+/**
+ * STIME column: HH:MM within the last day, MonDD within the year, else the year
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun formatStartTime(
+    startEpoch: Long,
+    nowEpoch: Long,
+): String =
+    memScoped {
+        val start = alloc<tm>()
+        val now = alloc<tm>()
+        val t = alloc<time_tVar>()
+        t.value = startEpoch
+        localtime_r(t.ptr, start.ptr)
+        t.value = nowEpoch
+        localtime_r(t.ptr, now.ptr)
+        when {
+            nowEpoch - startEpoch < 86400 ->
+                start.tm_hour.toString().padStart(2, '0') + ":" + start.tm_min.toString().padStart(2, '0')
+
+            start.tm_year == now.tm_year ->
+                MONTHS[start.tm_mon] + start.tm_mday.toString().padStart(2, '0')
+
+            else -> (start.tm_year + 1900).toString()
         }
     }
 
-    Logger.debug("filtered ps output: $matchCount matching processes")
-}
+private val MONTHS = listOf("Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec")
 
 /**
- * Find the column index of the PID field in ps output header
- *
- * @param header Header line from ps output (e.g., "UID PID PPID C STIME TTY TIME CMD")
- * @return Column index of PID field, or -1 if not found
+ * User name for the UID column; numeric when unknown or longer than the
+ * column, as ps does
  */
-private fun findPidColumn(header: String): Int {
-    val fields = header.trim().split(Regex("\\s+"))
-    return fields.indexOfFirst { it == "PID" }
+@OptIn(ExperimentalForeignApi::class)
+private fun userName(uid: Int): String {
+    val name = getpwuid(uid.toUInt())?.pointed?.pw_name?.toKString()
+    return if (name == null || name.length > 8) uid.toString() else name
 }
+
+/**
+ * Read a small /proc file whole; null if the process is gone
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun readProcBytes(path: String): ByteArray? =
+    memScoped {
+        val fd = open(path, O_RDONLY or O_CLOEXEC)
+        if (fd < 0) return null
+        try {
+            val size = 4096
+            val buffer = allocArray<ByteVar>(size)
+            var total = 0
+            while (total < size) {
+                val n = read(fd, buffer + total, (size - total).convert())
+                if (n < 0 && errno == EINTR) continue
+                if (n < 0) return null
+                if (n == 0L) break
+                total += n.toInt()
+            }
+            buffer.readBytes(total)
+        } finally {
+            close(fd)
+        }
+    }
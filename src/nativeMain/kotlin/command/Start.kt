@@ -5,8 +5,9 @@ import hook.runHooks
 import kotlinx.cinterop.ExperimentalForeignApi
 import logger.Logger
 import platform.posix.exit
-import spec.loadSpec
+import spec.loadSpecHooks
 import state.*
+import trace.Tracer
 import utils.FileSystem
 
 /**
@@ -23,8 +24,12 @@ fun start(
 ) {
     Logger.info("starting container: $containerId")
 
+    // Append to the trace written at create time (if any)
+    Tracer.setStage("start")
+    Tracer.open("$rootPath/$containerId/${Tracer.TRACE_FILE}", truncate = false)
+
     // Load container state to verify it exists
-    var state =
+    val state =
         try {
             loadState(fs, rootPath, containerId)
         } catch (e: Exception) {
@@ -34,47 +39,68 @@ fun start(
             return
         }
 
+    try {
+        startContainer(fs, rootPath, state)
+        Tracer.close()
+    } catch (e: Exception) {
+        Logger.error("failed to start container: ${e.message ?: "unknown"}")
+        exit(1)
+    }
+}
+
+/**
+ * Release the init process of the created container described by [state]
+ * and record it as running
+ *
+ * Shared by the start command and the daemon (see daemon/Daemon.kt).
+ *
+ * @param rootPath Root directory for container state
+ * @return The saved "running" state
+ * @throws Exception if the container is not in the created state or the
+ *   start signal cannot be delivered
+ */
+fun startContainer(
+    fs: FileSystem,
+    rootPath: String,
+    state: State,
+): State {
     // Refresh status to check actual process state
-    state = state.refreshStatus()
+    val current = state.refreshStatus()
 
     // Verify container is in 'created' state
-    if (!state.status.canStart()) {
-        Logger.error("container is in '${state.status.value}' state, expected 'created'")
-        exit(1)
+    if (!current.status.canStart()) {
+        throw Exception("container is in '${current.status.value}' state, expected 'created'")
     }
 
-    Logger.debug("container ${state.id} has init PID ${state.pid}")
+    Logger.debug { "container ${current.id} has init PID ${current.pid}" }
 
-    val notifySocketPath = "/tmp/kontainer-$containerId.sock"
+    val notifySocketPath = "/tmp/kontainer-${current.id}.sock"
 
     // Send start signal to notify socket
     val notifySocket = SocketNotifySocket(notifySocketPath)
-    try {
-        notifySocket.notifyContainerStart()
-        Logger.debug("sent start signal to container")
+    Tracer.span("start.notify") { notifySocket.notifyContainerStart() }
+    Logger.debug("sent start signal to container")
 
-        // Update state to "running" and save
-        val updatedState = state.withStatus(ContainerStatus.RUNNING)
-        updatedState.save(fs, rootPath)
-        Logger.debug("updated container state to 'running'")
+    // Update state to "running" and save
+    val updatedState = current.withStatus(ContainerStatus.RUNNING)
+    updatedState.save(fs, rootPath)
+    Logger.debug("updated container state to 'running'")
 
-        Logger.info("container $containerId started successfully")
+    Logger.info("container ${current.id} started successfully")
 
-        // Run poststart hooks AFTER the container is running. The hook stdin sees
-        // the State JSON with status="running". A failing hook here is logged but
-        // not fatal — the container is already up and tearing it down would be
-        // worse than the hook's intent.
-        val spec =
-            try {
-                loadSpec(fs, "${state.bundle}/config.json")
-            } catch (e: Exception) {
-                null
-            }
-        if (spec?.hooks?.poststart != null) {
-            runHooks(spec.hooks.poststart, updatedState)
+    // Run poststart hooks AFTER the container is running. The hook stdin sees
+    // the State JSON with status="running". A failing hook here is logged but
+    // not fatal — the container is already up and tearing it down would be
+    // worse than the hook's intent. Only the hooks are decoded, from the spec
+    // cache entry create left behind.
+    val poststart =
+        try {
+            loadSpecHooks(rootPath, "${current.bundle}/config.json")?.poststart
+        } catch (e: Exception) {
+            null
         }
-    } catch (e: Exception) {
-        Logger.error("failed to start container: ${e.message ?: "unknown"}")
-        exit(1)
+    if (poststart != null) {
+        Tracer.span("hooks.poststart") { runHooks(poststart, updatedState) }
     }
+    return updatedState
 }
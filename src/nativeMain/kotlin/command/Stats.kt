@@ -0,0 +1,50 @@
+package command
+
+import cgroup.Cgroup
+import cgroup.StatsEvent
+import config.loadKontainerConfig
+import kotlinx.cinterop.ExperimentalForeignApi
+import logger.Logger
+import platform.posix.exit
+import state.listContainerIds
+import utils.FileSystem
+import utils.JsonCodec
+
+/**
+ * Stats command - Print resource statistics of containers
+ *
+ * Prints one `runc events --stats` compatible JSON object per container and
+ * line. With no IDs, covers every container under [rootPath]. All containers
+ * are read through the same [Cgroup], so the read buffer is shared.
+ *
+ * @param rootPath Root directory for container state
+ * @param containerIds Containers to report; empty for all
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun stats(
+    fs: FileSystem,
+    cgroup: Cgroup,
+    rootPath: String,
+    containerIds: List<String>,
+) {
+    val all = containerIds.isEmpty()
+    val ids = if (all) listContainerIds(fs, rootPath) else containerIds
+    var failed = 0
+    for (id in ids) {
+        try {
+            val cgroupPath =
+                loadKontainerConfig(fs, rootPath, id).cgroupPath
+                    ?: throw Exception("container has no cgroup")
+            println(JsonCodec.encode(StatsEvent(type = "stats", id = id, data = cgroup.readStats(cgroupPath))))
+        } catch (e: Exception) {
+            // When listing everything, containers deleted meanwhile are not errors
+            if (all) {
+                Logger.debug { "skipping stats of $id: ${e.message ?: "unknown"}" }
+            } else {
+                Logger.error("failed to read stats of $id: ${e.message ?: "unknown"}")
+                failed++
+            }
+        }
+    }
+    if (failed > 0) exit(1)
+}
@@ -4,6 +4,7 @@ import kotlinx.cinterop.*
 import kotlinx.serialization.SerialName
 import kotlinx.serialization.Serializable
 import logger.Logger
+import state.loadState
 import utils.FileSystem
 import utils.JsonCodec
 
@@ -13,6 +14,10 @@ import utils.JsonCodec
  * This stores runtime-specific configuration
  * that is independent of the OCI bundle. This allows operations like delete
  * to work even if the bundle has been moved or deleted.
+ *
+ * The fields are saved as part of state.json (see state.State.cgroupPath),
+ * so a create writes one record. Containers created by older versions have
+ * them in a separate kontainer_config.json, which is still read.
  */
 
 private const val KONTAINER_CONFIG_NAME = "kontainer_config.json"
@@ -22,31 +27,6 @@ data class KontainerConfig(
     @SerialName("cgroup_path") val cgroupPath: String?,
 )
 
-/**
- * Save configuration to the container directory
- *
- * @param config Configuration to save
- * @param rootPath Root directory for container state
- * @param containerId Container ID
- * @throws Exception if save fails
- */
-@OptIn(ExperimentalForeignApi::class)
-fun saveKontainerConfig(
-    fs: FileSystem,
-    config: KontainerConfig,
-    rootPath: String,
-    containerId: String,
-) {
-    val containerDir = "$rootPath/$containerId"
-    val configPath = "$containerDir/$KONTAINER_CONFIG_NAME"
-
-    Logger.debug("saving kontainer config to $configPath")
-
-    JsonCodec.writeToFile(fs, configPath, config, prettyPrint = true)
-
-    Logger.debug("saved kontainer config")
-}
-
 /**
  * Load configuration from the container directory
  *
@@ -61,10 +41,11 @@ fun loadKontainerConfig(
     rootPath: String,
     containerId: String,
 ): KontainerConfig {
-    val containerDir = "$rootPath/$containerId"
-    val configPath = "$containerDir/$KONTAINER_CONFIG_NAME"
-
-    Logger.debug("loading kontainer config from $configPath")
+    val state = loadState(fs, rootPath, containerId)
+    if (state.cgroupPath != null) return KontainerConfig(cgroupPath = state.cgroupPath)
 
-    return JsonCodec.loadFromFile<KontainerConfig>(fs, configPath)
+    val legacyPath = "$rootPath/$containerId/$KONTAINER_CONFIG_NAME"
+    if (!fs.fileExists(legacyPath)) return KontainerConfig(cgroupPath = null)
+    Logger.debug { "loading kontainer config from $legacyPath" }
+    return JsonCodec.loadFromFile<KontainerConfig>(fs, legacyPath)
 }
@@ -0,0 +1,275 @@
+package daemon
+
+import cgroup.Cgroup
+import command.deleteContainer
+import command.killContainer
+import command.startContainer
+import kotlinx.cinterop.*
+import logger.Logger
+import platform.linux.sockaddr_un
+import platform.posix.*
+import state.State
+import state.containerExists
+import state.getStatePath
+import state.loadState
+import state.refreshStatus
+import syscall.Syscall
+import syscall.openVerifiedPidfd
+import utils.FileSystem
+import utils.JsonCodec
+
+/**
+ * Long-running control daemon
+ *
+ * Serves `state`, `kill`, `start` and `delete` for every container under
+ * [rootPath] from one process, so frequent polling (containerd calls `state`
+ * constantly) does not pay process start-up, runtime init, flock and JSON
+ * parsing each time. The CLI forwards those commands here whenever the
+ * socket accepts connections (see [forwardToDaemon]).
+ *
+ * For every cached container the daemon holds a pidfd of its init, so a
+ * liveness check is a single poll and cannot be fooled by PID reuse.
+ *
+ * States are kept in memory and validated against the state.json inode,
+ * size and mtime on every request, so containers created or changed by other
+ * runtime processes are picked up without re-reading unchanged files. The
+ * daemon writes state.json only on transitions (start); status derived from
+ * /proc is recomputed per request and not persisted, as in the CLI.
+ *
+ * Requests are handled one at a time, in the order they arrive, one
+ * request per connection.
+ */
+@OptIn(ExperimentalForeignApi::class)
+class Daemon(
+    private val syscall: Syscall,
+    private val fs: FileSystem,
+    private val cgroup: Cgroup,
+    private val rootPath: String,
+) {
+    /** Identity of a state.json version: inode, size and mtime */
+    private data class FileStamp(
+        val inode: ULong,
+        val size: Long,
+        val mtimeSec: Long,
+        val mtimeNsec: Long,
+    )
+
+    /**
+     * @property pidfd pidfd of the init, opened when the state was loaded and
+     *   checked against its recorded start time; -1 if unavailable
+     */
+    private data class CachedState(
+        val state: State,
+        val stamp: FileStamp,
+        val pidfd: Int,
+    )
+
+    private val cache = mutableMapOf<String, CachedState>()
+
+    /**
+     * Bind the control socket and serve requests until the process is killed
+     *
+     * @throws Exception if the socket cannot be set up
+     */
+    fun run(): Unit =
+        memScoped {
+            val socketPath = daemonSocketPath(rootPath)
+            fs.createDirectories(rootPath)
+
+            val sock = socket(AF_UNIX, SOCK_SEQPACKET, 0)
+            if (sock == -1) throw Exception("Failed to create daemon socket (errno=$errno)")
+            fcntl(sock, F_SETFD, FD_CLOEXEC)
+
+            val addr = alloc<sockaddr_un>()
+            fillUnixAddress(addr, socketPath)
+            // A stale socket from a previous daemon would make bind fail
+            unlink(socketPath)
+            // bind creates the socket file with 0777 & ~umask, so narrow the
+            // umask around it: the socket is never reachable by other users
+            val oldMask = umask(0x3Fu) // 0x3F = 0o077
+            val bound = bind(sock, addr.ptr.reinterpret(), sizeOf<sockaddr_un>().toUInt())
+            val bindErrno = errno
+            umask(oldMask)
+            if (bound == -1) {
+                close(sock)
+                throw Exception("Failed to bind daemon socket $socketPath (errno=$bindErrno)")
+            }
+            if (listen(sock, 128) == -1) {
+                close(sock)
+                throw Exception("Failed to listen on daemon socket (errno=$errno)")
+            }
+            Logger.info("daemon listening on $socketPath")
+
+            while (true) {
+                val client = accept(sock, null, null)
+                if (client == -1) {
+                    if (errno == EINTR || errno == ECONNABORTED) continue
+                    close(sock)
+                    throw Exception("Failed to accept daemon connection (errno=$errno)")
+                }
+                fcntl(client, F_SETFD, FD_CLOEXEC)
+                setReceiveTimeout(client, CLIENT_TIMEOUT_SEC)
+                try {
+                    serveConnection(client)
+                } catch (e: Exception) {
+                    Logger.warn("daemon connection failed: ${e.message ?: "unknown"}")
+                } finally {
+                    close(client)
+                }
+            }
+        }
+
+    /**
+     * Serve the one request of [client] (see [forwardToDaemon]). Connections
+     * are served in turn, so a client that kept its connection open for more
+     * requests would hold up every other one.
+     */
+    private fun serveConnection(client: Int) {
+        val packet = receivePacket(client) ?: return
+        val response =
+            try {
+                handle(decodeDaemonRequest(packet))
+            } catch (e: Exception) {
+                DaemonResponse(ok = false, error = "invalid request: ${e.message ?: "unknown"}")
+            }
+        sendPacket(client, encodeDaemonResponse(response))
+    }
+
+    /**
+     * Execute [request] and describe the outcome; never throws
+     */
+    internal fun handle(request: DaemonRequest): DaemonResponse {
+        Logger.debug { "daemon: ${request.op} ${request.id}" }
+        return try {
+            when (request.op) {
+                DaemonOp.STATE -> {
+                    val cached = load(request.id)
+                    val state = cached.state.refreshStatus(cached.pidfd)
+                    DaemonResponse(ok = true, output = JsonCodec.encode(state, prettyPrint = true))
+                }
+
+                DaemonOp.KILL -> {
+                    val signal = request.signal ?: throw Exception("kill needs a signal")
+                    killContainer(syscall, load(request.id).state, signal)
+                    DaemonResponse(ok = true)
+                }
+
+                DaemonOp.START -> {
+                    startContainer(fs, rootPath, load(request.id).state)
+                    // Re-stamp from disk, the state was just rewritten
+                    evict(request.id)
+                    DaemonResponse(ok = true)
+                }
+
+                DaemonOp.DELETE -> {
+                    if (!containerExists(fs, rootPath, request.id)) {
+                        evict(request.id)
+                        // With force, a missing container is not an error
+                        if (request.force) return DaemonResponse(ok = true)
+                        throw Exception("container ${request.id} does not exist")
+                    }
+                    deleteContainer(syscall, fs, cgroup, rootPath, load(request.id).state, request.force)
+                    evict(request.id)
+                    DaemonResponse(ok = true)
+                }
+
+                else -> throw Exception("unknown operation '${request.op}'")
+            }
+        } catch (e: Exception) {
+            DaemonResponse(ok = false, error = e.message ?: "unknown error")
+        }
+    }
+
+    /**
+     * State of [containerId], re-read from disk only if state.json changed
+     *
+     * @throws Exception if the container does not exist
+     */
+    private fun load(containerId: String): CachedState {
+        val stamp =
+            stampOf(getStatePath(rootPath, containerId)) ?: run {
+                evict(containerId)
+                throw Exception("container $containerId does not exist")
+            }
+        cache[containerId]?.takeIf { it.stamp == stamp }?.let { return it }
+        evict(containerId)
+
+        // Stamped before reading: a write in between only causes another reload
+        val state = loadState(fs, rootPath, containerId)
+        val pidfd = state.pid?.let { openVerifiedPidfd(it, state.pidStartTime) } ?: -1
+        return CachedState(state, stamp, pidfd).also { cache[containerId] = it }
+    }
+
+    private fun evict(containerId: String) {
+        cache.remove(containerId)?.pidfd?.let { if (it >= 0) close(it) }
+    }
+
+    private fun stampOf(path: String): FileStamp? =
+        memScoped {
+            val st = alloc<stat>()
+            if (stat(path, st.ptr) != 0) return null
+            FileStamp(st.st_ino, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec)
+        }
+
+    private fun setReceiveTimeout(
+        fd: Int,
+        seconds: Long,
+    ) {
+        memScoped {
+            val tv = alloc<timeval>()
+            tv.tv_sec = seconds
+            tv.tv_usec = 0
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, tv.ptr, sizeOf<timeval>().toUInt())
+        }
+    }
+
+    private companion object {
+        /**
+         * A client that connects but stalls before sending its request must
+         * not block the daemon for long; forwardToDaemon sends right away
+         */
+        const val CLIENT_TIMEOUT_SEC = 1L
+    }
+}
+
+/**
+ * Send [request] to the daemon for [rootPath], if one is running
+ *
+ * @return The daemon's response, or null if no daemon accepts connections
+ *   (the caller then runs the command itself)
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun forwardToDaemon(
+    rootPath: String,
+    request: DaemonRequest,
+): DaemonResponse? =
+    memScoped {
+        if (getenv(NO_DAEMON_ENV)?.toKString() == "1") return null
+        val socketPath = daemonSocketPath(rootPath)
+        if (access(socketPath, F_OK) != 0) return null
+
+        val sock = socket(AF_UNIX, SOCK_SEQPACKET, 0)
+        if (sock == -1) return null
+        try {
+            val addr = alloc<sockaddr_un>()
+            fillUnixAddress(addr, socketPath)
+            if (connect(sock, addr.ptr.reinterpret(), sizeOf<sockaddr_un>().toUInt()) == -1) {
+                // Stale socket of a daemon that is gone
+                Logger.debug { "no daemon on $socketPath (errno=$errno), running locally" }
+                return null
+            }
+            Logger.debug { "forwarding ${request.op} ${request.id} to daemon" }
+
+            // Once connected the request may have been executed, so failures
+            // from here on are reported rather than retried locally
+            try {
+                sendPacket(sock, encodeDaemonRequest(request))
+                val reply = receivePacket(sock) ?: throw Exception("daemon closed the connection")
+                decodeDaemonResponse(reply)
+            } catch (e: Exception) {
+                DaemonResponse(ok = false, error = "daemon request failed: ${e.message ?: "unknown"}")
+            }
+        } finally {
+            close(sock)
+        }
+    }
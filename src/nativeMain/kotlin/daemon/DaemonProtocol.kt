@@ -0,0 +1,130 @@
+package daemon
+
+import kotlinx.cinterop.*
+import kotlinx.serialization.Serializable
+import platform.linux.sockaddr_un
+import platform.posix.*
+import utils.CborCodec
+
+/**
+ * Control protocol between the CLI and `kontainer-runtime daemon`
+ *
+ * The daemon listens on a SOCK_SEQPACKET Unix socket at
+ * `<root>/kontainer.sock`, so every message is one packet and needs no
+ * framing. A client connects, sends one CBOR-encoded [DaemonRequest] and
+ * reads back one CBOR-encoded [DaemonResponse]; the daemon then closes the
+ * connection, so each request needs its own.
+ */
+const val DAEMON_SOCKET_FILE = "kontainer.sock"
+
+/** Set to "1" to make the CLI handle every command itself even if a daemon runs */
+const val NO_DAEMON_ENV = "KONTAINER_NO_DAEMON"
+
+/** Largest request or response packet */
+internal const val MAX_DAEMON_MESSAGE = 65536
+
+/** Operations served by the daemon; each matches the CLI command of the same name */
+object DaemonOp {
+    const val STATE = "state"
+    const val KILL = "kill"
+    const val START = "start"
+    const val DELETE = "delete"
+}
+
+/**
+ * One command forwarded to the daemon
+ *
+ * @property op One of [DaemonOp]
+ * @property id Container ID
+ * @property signal Signal for [DaemonOp.KILL]
+ * @property force Force flag for [DaemonOp.DELETE]
+ */
+@Serializable
+data class DaemonRequest(
+    val op: String,
+    val id: String,
+    val signal: String? = null,
+    val force: Boolean = false,
+)
+
+/**
+ * Result of a [DaemonRequest]
+ *
+ * @property output Text the CLI prints to stdout (the state JSON for `state`)
+ * @property error Failure reason when [ok] is false
+ */
+@Serializable
+data class DaemonResponse(
+    val ok: Boolean,
+    val output: String? = null,
+    val error: String? = null,
+)
+
+fun daemonSocketPath(rootPath: String): String = "$rootPath/$DAEMON_SOCKET_FILE"
+
+fun encodeDaemonRequest(request: DaemonRequest): ByteArray = CborCodec.encode(request)
+
+fun decodeDaemonRequest(bytes: ByteArray): DaemonRequest = CborCodec.decode(bytes)
+
+fun encodeDaemonResponse(response: DaemonResponse): ByteArray = CborCodec.encode(response)
+
+fun decodeDaemonResponse(bytes: ByteArray): DaemonResponse = CborCodec.decode(bytes)
+
+/**
+ * Fill [addr] with [socketPath]
+ *
+ * @throws Exception if the path does not fit in sun_path
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun fillUnixAddress(
+    addr: sockaddr_un,
+    socketPath: String,
+) {
+    addr.sun_family = AF_UNIX.toUShort()
+    // sun_path is limited to 108 bytes on Linux
+    val pathBytes = socketPath.encodeToByteArray()
+    if (pathBytes.size >= 108) {
+        throw Exception("Socket path too long (max 108 bytes): $socketPath")
+    }
+    for (i in pathBytes.indices) {
+        addr.sun_path[i] = pathBytes[i]
+    }
+    addr.sun_path[pathBytes.size] = 0
+}
+
+/**
+ * Send one packet
+ *
+ * MSG_NOSIGNAL: a peer that went away must not kill the daemon with SIGPIPE.
+ *
+ * @throws Exception if the packet cannot be sent
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun sendPacket(
+    fd: Int,
+    bytes: ByteArray,
+) {
+    var sent: Long
+    do {
+        sent = bytes.usePinned { pinned -> send(fd, pinned.addressOf(0), bytes.size.convert(), MSG_NOSIGNAL) }
+    } while (sent == -1L && errno == EINTR)
+    if (sent != bytes.size.toLong()) throw Exception("Failed to send daemon message (errno=$errno)")
+}
+
+/**
+ * Receive one packet
+ *
+ * @return The packet, or null if the peer closed the connection
+ * @throws Exception if the receive fails or times out
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun receivePacket(fd: Int): ByteArray? =
+    memScoped {
+        val buffer = allocArray<ByteVar>(MAX_DAEMON_MESSAGE)
+        var n: Long
+        do {
+            n = recv(fd, buffer, MAX_DAEMON_MESSAGE.convert(), 0)
+        } while (n == -1L && errno == EINTR)
+        if (n < 0L) throw Exception("Failed to receive daemon message (errno=$errno)")
+        if (n == 0L) null else buffer.readBytes(n.toInt())
+    }
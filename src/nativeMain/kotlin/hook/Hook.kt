@@ -1,12 +1,34 @@
 package hook
 
+import bootstrap.kontainer_spawn
 import kotlinx.cinterop.*
-import kotlinx.serialization.encodeToString
 import kotlinx.serialization.json.Json
 import logger.Logger
 import platform.posix.*
+import spec.ANNOTATION_HOOKS_PARALLEL
 import spec.Hook
 import state.State
+import syscall.pidfdOpen
+
+// fcntl commands for the pipe capacity (F_LINUX_SPECIFIC_BASE + 7, + 8)
+private const val F_SETPIPE_SZ = 1031
+private const val F_GETPIPE_SZ = 1032
+
+/** Poll interval for hooks without a pidfd (kernels before 5.3) */
+private const val NO_PIDFD_POLL_MS = 50L
+
+/**
+ * One started hook
+ *
+ * @property pidfd -1 without pidfd support; the process is then polled
+ * @property deadline CLOCK_MONOTONIC ms after which it is killed, 0 for none
+ */
+private class RunningHook(
+    val hook: Hook,
+    val pid: Int,
+    val pidfd: Int,
+    val deadline: Long,
+)
 
 /**
  * Execute one OCI hook program. Standard input is the container State JSON;
@@ -15,101 +37,224 @@ import state.State
  * Returns true on success (hook exited 0), false if the hook failed, errored
  * out, or didn't finish within its timeout.
  */
-@OptIn(ExperimentalForeignApi::class)
 fun execHook(
     hook: Hook,
     state: State,
+): Boolean = runHookSet(listOf(hook), encodeState(state))
+
+/**
+ * Run every hook in [hooks], stopping at the first failure. Returns true if all
+ * hooks ran cleanly.
+ *
+ * The state JSON is encoded once for all of them. With
+ * [ANNOTATION_HOOKS_PARALLEL] in the state's annotations, all hooks are
+ * started at once and waited for together; every hook runs to completion
+ * (or its timeout) even if another one failed.
+ */
+fun runHooks(
+    hooks: List<Hook>?,
+    state: State,
 ): Boolean {
-    val stateJson = Json.encodeToString(State.serializer(), state)
-    Logger.debug("running hook ${hook.path} args=${hook.args}")
+    if (hooks.isNullOrEmpty()) return true
+    val input = encodeState(state)
+    if (state.annotations?.get(ANNOTATION_HOOKS_PARALLEL) == "true" && hooks.size > 1) {
+        Logger.debug { "running ${hooks.size} hooks in parallel" }
+        return runHookSet(hooks, input)
+    }
+    for (hook in hooks) {
+        if (!runHookSet(listOf(hook), input)) return false
+    }
+    return true
+}
+
+private fun encodeState(state: State): ByteArray = Json.encodeToString(State.serializer(), state).encodeToByteArray()
+
+/**
+ * Start all of [hooks] with [input] on their stdin, then wait for them in
+ * one poll loop over their pidfds that also enforces each hook's timeout
+ *
+ * @return true if every hook exited 0
+ */
+private fun runHookSet(
+    hooks: List<Hook>,
+    input: ByteArray,
+): Boolean {
+    var ok = true
+    val running = mutableListOf<RunningHook>()
+    for (hook in hooks) {
+        val started = startHook(hook, input)
+        if (started == null) ok = false else running += started
+    }
+    return awaitHooks(running) && ok
+}
 
-    return memScoped {
+/**
+ * Spawn [hook] with posix_spawn, its stdin a pipe already holding [input]
+ *
+ * The whole state JSON is written (and the write end closed) before the
+ * hook starts, so there is no writer to wait for, and no SIGPIPE if the
+ * hook exits without reading. Only an input larger than the pipe can grow
+ * to is written after the spawn.
+ *
+ * @return null if the hook could not be started (logged)
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun startHook(
+    hook: Hook,
+    input: ByteArray,
+): RunningHook? =
+    memScoped {
+        Logger.debug { "running hook ${hook.path} args=${hook.args}" }
         val pipeFds = allocArray<IntVar>(2)
         if (pipe(pipeFds) != 0) {
             Logger.warn("hook ${hook.path}: pipe() failed (errno=$errno)")
-            return@memScoped false
+            return@memScoped null
         }
         val readEnd = pipeFds[0]
         val writeEnd = pipeFds[1]
+        // Other hooks spawned meanwhile must not inherit either end; the
+        // spawn's dup2 onto stdin clears the flag on the hook's copy
+        fcntl(readEnd, F_SETFD, FD_CLOEXEC)
+        fcntl(writeEnd, F_SETFD, FD_CLOEXEC)
+
+        val fits = fcntl(writeEnd, F_GETPIPE_SZ) >= input.size || fcntl(writeEnd, F_SETPIPE_SZ, input.size) >= input.size
+        val prewritten = if (fits) input.size else 0
+        if (prewritten > 0) writeAll(writeEnd, input, 0, prewritten, hook)
+
+        // Per the OCI spec, hook.args is the FULL argv (including argv[0]).
+        // Fall back to [hook.path] when args is omitted.
+        val args = hook.args ?: listOf(hook.path)
+        val argv = allocArray<CPointerVar<ByteVar>>(args.size + 1)
+        args.forEachIndexed { i, a -> argv[i] = a.cstr.ptr }
+        argv[args.size] = null
+        val envp =
+            hook.env?.let { envList ->
+                allocArray<CPointerVar<ByteVar>>(envList.size + 1).also { envp ->
+                    envList.forEachIndexed { i, e -> envp[i] = e.cstr.ptr }
+                    envp[envList.size] = null
+                }
+            }
 
-        val pid = fork()
+        val pid = kontainer_spawn(hook.path, argv, envp, readEnd)
+        val spawnErrno = errno
+        close(readEnd)
         if (pid < 0) {
-            close(readEnd); close(writeEnd)
-            Logger.warn("hook ${hook.path}: fork() failed (errno=$errno)")
-            return@memScoped false
-        }
-        if (pid == 0) {
-            // Child: wire stdin to read end of pipe and exec.
             close(writeEnd)
-            dup2(readEnd, STDIN_FILENO)
-            close(readEnd)
-
-            // Per the OCI spec, hook.args is the FULL argv (including argv[0]).
-            // Fall back to [hook.path] when args is omitted.
-            val args = hook.args ?: listOf(hook.path)
-            val argv = allocArray<CPointerVar<ByteVar>>(args.size + 1)
-            args.forEachIndexed { i, a -> argv[i] = a.cstr.ptr }
-            argv[args.size] = null
-
-            val envList = hook.env
-            if (envList != null) {
-                val envp = allocArray<CPointerVar<ByteVar>>(envList.size + 1)
-                envList.forEachIndexed { i, e -> envp[i] = e.cstr.ptr }
-                envp[envList.size] = null
-                execve(hook.path, argv, envp)
-            } else {
-                execv(hook.path, argv)
-            }
-            // execve only returns on failure.
-            Logger.error("hook ${hook.path}: execve failed (errno=$errno)")
-            _exit(127)
+            Logger.warn("hook ${hook.path}: spawn failed (errno=$spawnErrno)")
+            return@memScoped null
         }
+        if (prewritten < input.size) writeAll(writeEnd, input, prewritten, input.size, hook)
+        close(writeEnd)
 
-        // Parent: write state JSON to pipe.
-        close(readEnd)
-        val bytes = stateJson.encodeToByteArray()
-        bytes.usePinned { pinned ->
-            val w = write(writeEnd, pinned.addressOf(0), bytes.size.toULong())
-            if (w.toInt() != bytes.size) {
-                Logger.warn("hook ${hook.path}: short write of state JSON ($w / ${bytes.size})")
+        // Our own unreaped child: the PID cannot have been reused
+        val pidfd = pidfdOpen(pid)
+        val timeoutMs = (hook.timeout ?: 0) * 1000L
+        RunningHook(hook, pid, pidfd, if (timeoutMs > 0) monotonicMillis() + timeoutMs else 0L)
+    }
+
+@OptIn(ExperimentalForeignApi::class)
+private fun writeAll(
+    fd: Int,
+    bytes: ByteArray,
+    from: Int,
+    to: Int,
+    hook: Hook,
+) {
+    bytes.usePinned { pinned ->
+        var offset = from
+        while (offset < to) {
+            val w = write(fd, pinned.addressOf(offset), (to - offset).toULong())
+            if (w < 0 && errno == EINTR) continue
+            if (w <= 0) {
+                Logger.warn("hook ${hook.path}: short write of state JSON (${offset - from} / ${to - from})")
+                return
             }
+            offset += w.toInt()
         }
-        close(writeEnd)
+    }
+}
 
-        // Wait for the hook with a private timeout: WNOHANG-poll + sleep loop.
-        // alarm(2) would work but is process-wide — a future caller running two
-        // hooks concurrently, or with an unrelated SIGALRM handler, would see
-        // bogus interruptions. The 50ms poll cadence keeps CPU cost negligible
-        // while still firing the timeout within ~50ms of its budget.
+/**
+ * Wait for every hook of [running]: poll their pidfds until the next
+ * deadline, reap whichever exited, and SIGKILL those past their timeout.
+ * Deadlines use CLOCK_MONOTONIC, so wall-clock changes cannot stretch them.
+ *
+ * @return true if all exited 0
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun awaitHooks(running: List<RunningHook>): Boolean =
+    memScoped {
+        var ok = true
+        val pending = running.toMutableList()
+        val pfds = allocArray<pollfd>(running.size.coerceAtLeast(1))
         val status = alloc<IntVar>()
-        val timeoutMs = (hook.timeout ?: 0) * 1000L
-        val pollSleepMicros = 50_000u // 50ms
-        val deadline = if (timeoutMs > 0) monotonicMillis() + timeoutMs else 0L
-        while (true) {
-            val rc = waitpid(pid, status.ptr, WNOHANG)
-            if (rc == pid) break // hook finished
-            if (rc < 0) {
-                Logger.warn("hook ${hook.path}: waitpid failed (errno=$errno)")
-                return@memScoped false
+        while (pending.isNotEmpty()) {
+            var nfds = 0
+            var timeout = -1L
+            val now = monotonicMillis()
+            for (r in pending) {
+                if (r.pidfd >= 0) {
+                    pfds[nfds].fd = r.pidfd
+                    pfds[nfds].events = POLLIN.toShort()
+                    pfds[nfds].revents = 0
+                    nfds++
+                } else {
+                    timeout = if (timeout < 0) NO_PIDFD_POLL_MS else minOf(timeout, NO_PIDFD_POLL_MS)
+                }
+                if (r.deadline != 0L) {
+                    val left = (r.deadline - now).coerceAtLeast(0)
+                    timeout = if (timeout < 0) left else minOf(timeout, left)
+                }
             }
-            // rc == 0: still running
-            if (deadline != 0L && monotonicMillis() >= deadline) {
-                Logger.warn("hook ${hook.path}: timed out after ${hook.timeout}s; killing")
-                kill(pid, SIGKILL)
-                waitpid(pid, status.ptr, 0)
-                return@memScoped false
+            if (poll(pfds, nfds.toULong(), timeout.toInt()) < 0 && errno != EINTR) {
+                Logger.warn("hooks: poll failed (errno=$errno)")
+            }
+
+            val iter = pending.iterator()
+            while (iter.hasNext()) {
+                val r = iter.next()
+                val rc = waitpid(r.pid, status.ptr, WNOHANG)
+                val finished =
+                    when {
+                        rc == r.pid -> {
+                            if (!exitedCleanly(r.hook, status.value)) ok = false
+                            true
+                        }
+                        rc < 0 -> {
+                            Logger.warn("hook ${r.hook.path}: waitpid failed (errno=$errno)")
+                            ok = false
+                            true
+                        }
+                        r.deadline != 0L && monotonicMillis() >= r.deadline -> {
+                            Logger.warn("hook ${r.hook.path}: timed out after ${r.hook.timeout}s; killing")
+                            kill(r.pid, SIGKILL)
+                            waitpid(r.pid, status.ptr, 0)
+                            ok = false
+                            true
+                        }
+                        else -> false
+                    }
+                if (finished) {
+                    if (r.pidfd >= 0) close(r.pidfd)
+                    iter.remove()
+                }
             }
-            usleep(pollSleepMicros)
-        }
-        val exited = (status.value and 0x7f) == 0
-        val code = (status.value shr 8) and 0xff
-        if (!exited || code != 0) {
-            Logger.warn("hook ${hook.path}: exited with status ${status.value} (code=$code)")
-            return@memScoped false
         }
-        Logger.debug("hook ${hook.path}: completed successfully")
-        true
+        ok
+    }
+
+private fun exitedCleanly(
+    hook: Hook,
+    status: Int,
+): Boolean {
+    val exited = (status and 0x7f) == 0
+    val code = (status shr 8) and 0xff
+    if (!exited || code != 0) {
+        Logger.warn("hook ${hook.path}: exited with status $status (code=$code)")
+        return false
     }
+    Logger.debug { "hook ${hook.path}: completed successfully" }
+    return true
 }
 
 /**
@@ -124,18 +269,3 @@ private fun monotonicMillis(): Long =
         clock_gettime(CLOCK_MONOTONIC.toInt(), ts.ptr)
         ts.tv_sec * 1000L + ts.tv_nsec / 1_000_000L
     }
-
-/**
- * Run every hook in [hooks], stopping at the first failure. Returns true if all
- * hooks ran cleanly.
- */
-fun runHooks(
-    hooks: List<Hook>?,
-    state: State,
-): Boolean {
-    if (hooks.isNullOrEmpty()) return true
-    for (hook in hooks) {
-        if (!execHook(hook, state)) return false
-    }
-    return true
-}
@@ -11,11 +11,14 @@ import platform.posix.*
  * - Log levels: TRACE, DEBUG, INFO, WARN, ERROR
  * - Environment variable control: KONTAINER_LOG_LEVEL
  * - Process context tracking (main/intermediate/init)
- * - Timestamp formatting
+ * - Timestamp formatting (cached per second)
+ * - One writev(2) per record and sink, no stdio buffering
+ * - Lazy messages: `Logger.debug { "..." }` builds the string only when
+ *   the level is enabled
  *
  * Usage:
  *   Logger.setContext("init")
- *   Logger.debug("started, pid=${getpid()}")
+ *   Logger.debug { "started, pid=${getpid()}" }
  *   Logger.error("Failed to initialize seccomp")
  */
 @OptIn(ExperimentalForeignApi::class)
@@ -61,14 +64,18 @@ object Logger {
     // Process context (main/intermediate/init)
     private var processContext: String = "main"
 
-    // Log file handle (null means stderr only)
-    private var logFile: CPointer<FILE>? = null
+    // Log file fd (-1 means stderr only)
+    private var logFd: Int = -1
 
     // Log format (text or json)
     private var logFormat: Format = Format.TEXT
 
-    // Debug log file handle (always writes to /tmp for troubleshooting)
-    private var debugLogFile: CPointer<FILE>? = null
+    // Debug log file fd (always writes to /tmp for troubleshooting)
+    private var debugLogFd: Int = -1
+
+    // Formatted timestamp of the second in cachedSecond
+    private var cachedSecond: Long = -1
+    private var cachedTimestamp: String = ""
 
     init {
         // Open debug log file in /tmp for persistent logging
@@ -78,27 +85,20 @@ object Logger {
         // This allows both root and regular users to write to the file
         // Note: fchmod() fails with EPERM in user namespaces, so we use umask instead
         val oldUmask = umask(0u)
-        debugLogFile = fopen("/tmp/kontainer-runtime-debug.log", "a")
+        debugLogFd = open(DEBUG_LOG_PATH, O_WRONLY or O_APPEND or O_CREAT or O_CLOEXEC, 0x1B6u) // 0o666
         umask(oldUmask) // Restore original umask
 
-        if (debugLogFile != null) {
+        if (debugLogFd >= 0) {
             // Write a separator to mark new execution
-            val timestamp = getCurrentTimestamp()
-            fprintf(debugLogFile, "\n=== New execution at %s ===\n", timestamp)
-            fflush(debugLogFile)
+            writeRecord(debugLogFd, "\n=== New execution at ${getCurrentTimestamp()} ===\n".encodeToByteArray())
         } else {
-            // Log fopen() failure to stderr for debugging
+            // Log open() failure to stderr for debugging
             val errNum = errno
-            val uid = getuid()
-            val gid = getgid()
-            fprintf(
-                stderr,
-                "WARNING: Failed to open /tmp/kontainer-runtime-debug.log for appending (errno=%d, uid=%u, gid=%u)\n",
-                errNum,
-                uid,
-                gid,
+            writeRecord(
+                STDERR_FILENO,
+                ("WARNING: Failed to open $DEBUG_LOG_PATH for appending " +
+                    "(errno=$errNum, uid=${getuid()}, gid=${getgid()})\n").encodeToByteArray(),
             )
-            fflush(stderr)
         }
     }
 
@@ -135,9 +135,9 @@ object Logger {
      */
     fun setLogFile(path: String) {
         // Close existing log file if open
-        logFile?.let {
-            fclose(it)
-            logFile = null
+        if (logFd >= 0) {
+            close(logFd)
+            logFd = -1
         }
 
         // Extract parent directory from log file path and create it if needed
@@ -155,26 +155,19 @@ object Logger {
 
                 currentPath += if (currentPath == "/") component else "/$component"
 
-                if (mkdir(currentPath, 0x1EDu) != 0) { // 0x1ED = 0755 octal
-                    val errNum = errno
-                    if (errNum != EEXIST) {
-                        // Directory creation failed (but not because it exists)
-                        // Don't use Logger here to avoid circular dependency
-                        // Continue anyway, fopen will fail if directory doesn't exist
-                    }
-                }
+                // Failures other than EEXIST surface when the open below fails
+                mkdir(currentPath, 0x1EDu) // 0x1ED = 0755 octal
             }
         }
 
         // Open new log file in append mode
-        val file = fopen(path, "a")
-        if (file == null) {
-            fprintf(stderr, "[ERROR] Failed to open log file: %s\n", path)
-            perror("fopen")
+        val fd = open(path, O_WRONLY or O_APPEND or O_CREAT or O_CLOEXEC, 0x1B6u) // 0o666, trimmed by umask
+        if (fd < 0) {
+            writeRecord(STDERR_FILENO, "[ERROR] Failed to open log file: $path (errno=$errno)\n".encodeToByteArray())
             return
         }
 
-        logFile = file
+        logFd = fd
         // Don't log to stderr - it pollutes stdout when used with containerd
     }
 
@@ -189,7 +182,7 @@ object Logger {
                 "json" -> Format.JSON
                 "text" -> Format.TEXT
                 else -> {
-                    fprintf(stderr, "[WARN] Unknown log format '%s', using 'text'\n", format)
+                    writeRecord(STDERR_FILENO, "[WARN] Unknown log format '$format', using 'text'\n".encodeToByteArray())
                     Format.TEXT
                 }
             }
@@ -204,103 +197,125 @@ object Logger {
         currentLevel = level
     }
 
+    /** The current log level, e.g. to restore it after [setLogLevel] */
+    fun getLogLevel(): Level = currentLevel
+
+    /**
+     * Whether messages at [level] are written; lets callers skip work that
+     * only feeds a log line
+     */
+    fun isEnabled(level: Level): Boolean = level.value >= currentLevel.value
+
     /**
      * Get current timestamp in a readable format
      * Format: YYYY-MM-DD HH:MM:SS
+     *
+     * CLOCK_REALTIME_COARSE is read from the vDSO without a syscall, and the
+     * formatted string is reused for every record within the same second.
      */
-    private fun getCurrentTimestamp(): String {
-        return memScoped {
-            val now = alloc<time_tVar>()
-            time(now.ptr)
+    private fun getCurrentTimestamp(): String =
+        memScoped {
+            val ts = alloc<timespec>()
+            clock_gettime(CLOCK_REALTIME_COARSE, ts.ptr)
+            val second = ts.tv_sec.toLong()
+            if (second == cachedSecond) return cachedTimestamp
 
-            val timeinfo = localtime(now.ptr) ?: return "0000-00-00 00:00:00"
+            val now = alloc<time_tVar>()
+            now.value = ts.tv_sec
+            val timeinfo = alloc<tm>()
+            if (localtime_r(now.ptr, timeinfo.ptr) == null) return "0000-00-00 00:00:00"
 
             val buffer = allocArray<ByteVar>(32)
-            strftime(buffer, 32.convert(), "%Y-%m-%d %H:%M:%S", timeinfo)
+            strftime(buffer, 32.convert(), "%Y-%m-%d %H:%M:%S", timeinfo.ptr)
 
-            buffer.toKString()
+            cachedSecond = second
+            cachedTimestamp = buffer.toKString()
+            cachedTimestamp
         }
-    }
 
     /**
      * Internal log function
+     *
+     * The record is split into a header, the message and a trailer, and goes
+     * to each sink with one writev(2): no stdio buffer to flush and no copy
+     * of the message into a joined line.
      */
     private fun log(
         level: Level,
         message: String,
     ) {
-        if (level.value >= currentLevel.value) {
-            val timestamp = getCurrentTimestamp()
-
-            when (logFormat) {
-                Format.TEXT -> {
-                    val formattedMessage = "[%s] [%s] [%s] %s\n"
-
-                    // Log to stderr only if no log file is configured
-                    // This prevents polluting stdout when used with containerd (--log option)
-                    if (logFile == null) {
-                        fprintf(
-                            stderr,
-                            formattedMessage,
-                            timestamp,
-                            level.label,
-                            processContext,
-                            message,
-                        )
-                    }
-
-                    // Log to file if configured
-                    logFile?.let { file ->
-                        fprintf(
-                            file,
-                            formattedMessage,
-                            timestamp,
-                            level.label,
-                            processContext,
-                            message,
-                        )
-                        fflush(file) // Ensure immediate write
-                    }
-
-                    // Always log to debug file for troubleshooting
-                    debugLogFile?.let { file ->
-                        fprintf(
-                            file,
-                            formattedMessage,
-                            timestamp,
-                            level.label,
-                            processContext,
-                            message,
-                        )
-                        fflush(file) // Ensure immediate write
-                    }
-                }
+        if (!isEnabled(level)) return
+        val timestamp = getCurrentTimestamp()
+
+        val header: String
+        val body: String
+        val trailer: String
+        when (logFormat) {
+            Format.TEXT -> {
+                header = "[$timestamp] [${level.label}] [$processContext] "
+                body = message
+                trailer = "\n"
+            }
+
+            Format.JSON -> {
+                header = "{\"timestamp\":\"$timestamp\",\"level\":\"${level.label}\"," +
+                    "\"context\":\"${escapeJson(processContext)}\",\"message\":\""
+                body = escapeJson(message)
+                trailer = "\"}\n"
+            }
+        }
+        val parts = arrayOf(header.encodeToByteArray(), body.encodeToByteArray(), trailer.encodeToByteArray())
+
+        // Log to stderr only if no log file is configured
+        // This prevents polluting stdout when used with containerd (--log option)
+        writeRecord(if (logFd >= 0) logFd else STDERR_FILENO, *parts)
+
+        // Always log to debug file for troubleshooting
+        if (debugLogFd >= 0) writeRecord(debugLogFd, *parts)
+    }
 
-                Format.JSON -> {
-                    // Escape quotes in message for JSON
-                    val escapedMessage = message.replace("\"", "\\\"").replace("\n", "\\n")
-                    val jsonMessage =
-                        "{\"timestamp\":\"$timestamp\",\"level\":\"${level.label}\"," +
-                            "\"context\":\"$processContext\",\"message\":\"$escapedMessage\"}\n"
-
-                    // Log to stderr only if no log file is configured
-                    // This prevents polluting stdout when used with containerd (--log option)
-                    if (logFile == null) {
-                        fprintf(stderr, "%s", jsonMessage)
-                    }
-
-                    // Log to file if configured
-                    logFile?.let { file ->
-                        fprintf(file, "%s", jsonMessage)
-                        fflush(file)
-                    }
-
-                    // Always log to debug file for troubleshooting
-                    debugLogFile?.let { file ->
-                        fprintf(file, "%s", jsonMessage)
-                        fflush(file)
-                    }
+    /**
+     * [message] as the inside of a JSON string, in one pass; the message
+     * itself when nothing needs escaping
+     */
+    internal fun escapeJson(message: String): String {
+        if (message.none { it == '"' || it == '\\' || it < ' ' }) return message
+        val sb = StringBuilder(message.length + 16)
+        for (c in message) {
+            when {
+                c == '"' -> sb.append("\\\"")
+                c == '\\' -> sb.append("\\\\")
+                c == '\n' -> sb.append("\\n")
+                c == '\r' -> sb.append("\\r")
+                c == '\t' -> sb.append("\\t")
+                c < ' ' -> sb.append("\\u00").append(HEX_DIGITS[c.code shr 4]).append(HEX_DIGITS[c.code and 0xf])
+                else -> sb.append(c)
+            }
+        }
+        return sb.toString()
+    }
+
+    /** Write [parts] to [fd] as one record; logging is best effort, errors are dropped */
+    private fun writeRecord(
+        fd: Int,
+        vararg parts: ByteArray,
+    ) {
+        memScoped {
+            val iov = allocArray<iovec>(parts.size)
+            val pinned = parts.map { it.pin() }
+            try {
+                var count = 0
+                for (p in pinned) {
+                    if (p.get().isEmpty()) continue
+                    iov[count].iov_base = p.addressOf(0)
+                    iov[count].iov_len = p.get().size.convert()
+                    count++
+                }
+                while (writev(fd, iov, count) < 0 && errno == EINTR) {
+                    // retry
                 }
+            } finally {
+                pinned.forEach { it.unpin() }
             }
         }
     }
@@ -312,6 +327,14 @@ object Logger {
         log(Level.TRACE, message)
     }
 
+    /**
+     * Log at TRACE level; [message] is only built if the level is enabled,
+     * and not at all in builds whose BuildConfig.MIN_LOG_LEVEL is above TRACE
+     */
+    inline fun trace(message: () -> String) {
+        if (BuildConfig.MIN_LOG_LEVEL <= 0 && isEnabled(Level.TRACE)) trace(message())
+    }
+
     /**
      * Log at DEBUG level
      * Use for detailed diagnostic information
@@ -320,6 +343,15 @@ object Logger {
         log(Level.DEBUG, message)
     }
 
+    /**
+     * Log at DEBUG level; [message] is only built if the level is enabled,
+     * and not at all in builds whose BuildConfig.MIN_LOG_LEVEL is above DEBUG.
+     * Prefer this form for messages with interpolated values.
+     */
+    inline fun debug(message: () -> String) {
+        if (BuildConfig.MIN_LOG_LEVEL <= 1 && isEnabled(Level.DEBUG)) debug(message())
+    }
+
     /**
      * Log at INFO level
      * Use for general informational messages
@@ -344,3 +376,10 @@ object Logger {
         log(Level.ERROR, message)
     }
 }
+
+private const val DEBUG_LOG_PATH = "/tmp/kontainer-runtime-debug.log"
+
+// From linux/time.h; the coarse clock is updated once per tick
+private const val CLOCK_REALTIME_COARSE = 5
+
+private const val HEX_DIGITS = "0123456789abcdef"
@@ -13,7 +13,6 @@ import spec.Namespace
  * @param namespaces List of namespace specifications from OCI config
  * @return Combined clone flags as UInt (bitwise OR of all CLONE_NEW* flags)
  */
-@OptIn(ExperimentalForeignApi::class)
 fun calculateCloneFlags(namespaces: List<Namespace>?): UInt {
     if (namespaces == null) {
         return 0u
@@ -25,22 +24,44 @@ fun calculateCloneFlags(namespaces: List<Namespace>?): UInt {
         // A namespace entry with a non-null `path` means "join an existing namespace
         // at this path", not "create a new one" — don't add it to the unshare set.
         if (ns.path != null) continue
-        val flag: UInt =
-            when (ns.type) {
-                "mount" -> _CLONE_NEWNS().toUInt()
-                "network" -> _CLONE_NEWNET().toUInt()
-                "uts" -> _CLONE_NEWUTS().toUInt()
-                "ipc" -> _CLONE_NEWIPC().toUInt()
-                "pid" -> _CLONE_NEWPID().toUInt()
-                "user" -> _CLONE_NEWUSER().toUInt()
-                "cgroup" -> 0x02000000u // CLONE_NEWCGROUP (not yet in K/N's platform.linux on older sysroots)
-                else -> {
-                    // Skip unknown namespace types (for forward compatibility)
-                    0u
-                }
-            }
-        flags = flags or flag
+        flags = flags or namespaceCloneFlag(ns.type)
     }
 
     return flags
 }
+
+/**
+ * CLONE_NEW* flag for an OCI namespace type
+ *
+ * @return The flag, or 0 for unknown types (skipped for forward compatibility)
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun namespaceCloneFlag(type: String): UInt =
+    when (type) {
+        "mount" -> _CLONE_NEWNS().toUInt()
+        "network" -> _CLONE_NEWNET().toUInt()
+        "uts" -> _CLONE_NEWUTS().toUInt()
+        "ipc" -> _CLONE_NEWIPC().toUInt()
+        "pid" -> _CLONE_NEWPID().toUInt()
+        "user" -> _CLONE_NEWUSER().toUInt()
+        "cgroup" -> 0x02000000u // CLONE_NEWCGROUP (not yet in K/N's platform.linux on older sysroots)
+        else -> 0u
+    }
+
+/**
+ * Namespaces to join rather than create
+ *
+ * bootstrap.c setns(2)s into these before the stage-2 fork. Doing this in
+ * the Kotlin runtime is unreliable because the runtime is multi-threaded
+ * (the kernel rejects setns into a mount namespace from such a process) and
+ * PID namespace join must happen pre-fork.
+ *
+ * @param namespaces List of namespace specifications from OCI config
+ * @return (CLONE_NEW* flag, path) for every entry with a path and known type
+ */
+fun namespaceJoinPaths(namespaces: List<Namespace>?): List<Pair<UInt, String>> =
+    namespaces.orEmpty().mapNotNull { ns ->
+        val path = ns.path ?: return@mapNotNull null
+        val flag = namespaceCloneFlag(ns.type)
+        if (flag == 0u) null else flag to path
+    }
@@ -0,0 +1,247 @@
+package pool
+
+import cgroup.Cgroup
+import channel.ProcessUpdate
+import channel.SocketNotifySocket
+import config.loadKontainerConfig
+import kotlinx.cinterop.*
+import logger.Logger
+import namespace.namespaceCloneFlag
+import platform.posix.*
+import spec.ANNOTATION_OVERLAY_LOWER
+import spec.ANNOTATION_OVERLAY_UPPER
+import spec.ANNOTATION_OVERLAY_WORK
+import spec.RUNTIME_ANNOTATION_PREFIX
+import spec.Spec
+import state.*
+import syscall.Syscall
+import utils.FileSystem
+import utils.JsonCodec
+import utils.fnv1a64Hex
+
+/**
+ * Warm container pool
+ *
+ * `kontainer-runtime pool --bundle <b> --size N` keeps N containers of a
+ * bundle in the created state: namespaces unshared, rootfs pivoted, cgroup
+ * populated and the init process parked in waitForContainerStart(). A later
+ * `create` whose spec matches the template claims one of them instead of
+ * building a new container: it renames the member's state directory and
+ * notify socket to the new id, sends the per-instance process args/env as a
+ * [ProcessUpdate] and, with a UTS namespace, sets the hostname from outside.
+ *
+ * Members are registered as empty files `<root>/.pool/<template key>/<member
+ * id>`; a claim unlinks the file first, so exactly one create gets a member.
+ * The member keeps its cgroup (the cgroup path is carried over into the new
+ * state), so delete cleans it up as usual.
+ *
+ * Specs with hooks, an explicit cgroupsPath or an overlay upper layer are
+ * never pooled: hooks would have run for the member's id, the cgroup is
+ * already created, and the upper/work dirs would be shared by all members.
+ */
+const val POOL_DIR = ".pool"
+
+/** Prefix of pool member container ids */
+const val POOL_MEMBER_PREFIX = "pool-"
+
+/** Set to "1" to make `create` build a new container even if a pooled one matches */
+const val NO_POOL_ENV = "KONTAINER_NO_POOL"
+
+/**
+ * Whether containers for [spec] can be served from a pool
+ *
+ * An overlay rootfs with an upper layer is not: the upper and work dirs
+ * come from the annotations, so every member would share them.
+ */
+fun isPoolEligible(spec: Spec): Boolean =
+    spec.hooks == null &&
+        spec.linux?.cgroupsPath == null &&
+        spec.annotations?.get(ANNOTATION_OVERLAY_UPPER) == null &&
+        spec.annotations?.get(ANNOTATION_OVERLAY_WORK) == null
+
+/**
+ * Template key for [spec]: everything a claim cannot change afterwards
+ *
+ * Process args and env and the annotations are per-instance, and so is the
+ * hostname when the container has its own UTS namespace; all other fields
+ * must match exactly. The runtime's own annotations ([RUNTIME_ANNOTATION_PREFIX])
+ * are the exception: they change how the member was built, so they stay in
+ * the key. The root path is replaced by the resolved rootfs, and relative
+ * overlay layers by their paths under [bundlePath].
+ */
+fun poolTemplateKey(
+    spec: Spec,
+    rootfsPath: String,
+    bundlePath: String,
+): String {
+    val runtimeAnnotations =
+        spec.annotations
+            ?.filterKeys { it.startsWith(RUNTIME_ANNOTATION_PREFIX) }
+            ?.mapValues { (name, value) ->
+                if (name != ANNOTATION_OVERLAY_LOWER) return@mapValues value
+                value.split(':').joinToString(":") { if (it.isEmpty() || it.startsWith("/")) it else "$bundlePath/$it" }
+            }?.ifEmpty { null }
+    val template =
+        spec.copy(
+            root = spec.root.copy(path = rootfsPath),
+            process = spec.process.copy(args = emptyList(), env = null),
+            hostname = if (spec.hasNamespace("uts")) null else spec.hostname,
+            annotations = runtimeAnnotations,
+        )
+    return fnv1a64Hex(JsonCodec.encode(template))
+}
+
+/**
+ * Directory holding the member registrations for [key]
+ */
+fun poolTemplateDir(
+    rootPath: String,
+    key: String,
+): String = "$rootPath/$POOL_DIR/$key"
+
+/**
+ * Ids of the members currently registered for [key]
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun listPoolMembers(
+    rootPath: String,
+    key: String,
+): List<String> {
+    val dir = opendir(poolTemplateDir(rootPath, key)) ?: return emptyList()
+    val members = mutableListOf<String>()
+    try {
+        while (true) {
+            val entry = readdir(dir) ?: break
+            val name = entry.pointed.d_name.toKString()
+            if (name.startsWith(POOL_MEMBER_PREFIX)) members.add(name)
+        }
+    } finally {
+        closedir(dir)
+    }
+    return members
+}
+
+/**
+ * Try to serve `create` for [containerId] from the pool
+ *
+ * @return The init PID of the claimed container, or null if no live member
+ *   matches (the caller then creates the container normally)
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun claimPooledContainer(
+    syscall: Syscall,
+    fs: FileSystem,
+    cgroup: Cgroup,
+    rootPath: String,
+    containerId: String,
+    bundlePath: String,
+    spec: Spec,
+    rootfsPath: String,
+): Int? {
+    if (getenv(NO_POOL_ENV)?.toKString() == "1" || !isPoolEligible(spec)) return null
+
+    val key = poolTemplateKey(spec, rootfsPath, bundlePath)
+    for (member in listPoolMembers(rootPath, key)) {
+        // Whoever unlinks the registration owns the member
+        if (unlink("${poolTemplateDir(rootPath, key)}/$member") != 0) continue
+
+        try {
+            val pid = adoptMember(syscall, fs, rootPath, member, containerId, bundlePath, spec)
+            Logger.info("claimed pooled container $member as $containerId (init pid=$pid)")
+            return pid
+        } catch (e: Exception) {
+            Logger.warn("discarding pool member $member: ${e.message ?: "unknown"}")
+            discardMember(syscall, fs, cgroup, rootPath, member)
+        }
+    }
+    Logger.debug { "no pooled container for template $key" }
+    return null
+}
+
+@OptIn(ExperimentalForeignApi::class)
+private fun adoptMember(
+    syscall: Syscall,
+    fs: FileSystem,
+    rootPath: String,
+    member: String,
+    containerId: String,
+    bundlePath: String,
+    spec: Spec,
+): Int {
+    val memberState = loadState(fs, rootPath, member).refreshStatus()
+    val pid = memberState.pid
+    if (memberState.status != ContainerStatus.CREATED || pid == null) {
+        throw Exception("member is ${memberState.status.value}, expected created")
+    }
+
+    // The init has dropped its capabilities already, so set the hostname
+    // from here: setns only moves this thread, and create exits right after
+    if (spec.hasNamespace("uts") && spec.hostname != null) {
+        val nsPath = "/proc/$pid/ns/uts"
+        val fd = open(nsPath, O_RDONLY or O_CLOEXEC)
+        if (fd < 0) throw Exception("failed to open $nsPath (errno=$errno)")
+        try {
+            if (syscall.setns(fd, namespaceCloneFlag("uts").toInt()) != 0) {
+                throw Exception("setns($nsPath) failed (errno=$errno)")
+            }
+        } finally {
+            close(fd)
+        }
+        if (syscall.sethostname(spec.hostname) != 0) throw Exception("sethostname failed (errno=$errno)")
+    }
+
+    SocketNotifySocket("/tmp/kontainer-$member.sock")
+        .sendProcessUpdate(ProcessUpdate(args = spec.process.args, env = spec.process.env))
+
+    // A bound socket can be renamed; the listener keeps working
+    if (rename("/tmp/kontainer-$member.sock", "/tmp/kontainer-$containerId.sock") != 0) {
+        throw Exception("failed to rename notify socket (errno=$errno)")
+    }
+    if (rename("$rootPath/$member", "$rootPath/$containerId") != 0) {
+        throw Exception("failed to rename state directory (errno=$errno)")
+    }
+    removeFromIndex(fs, rootPath, member)
+
+    createState(
+        ociVersion = spec.ociVersion,
+        containerId = containerId,
+        status = ContainerStatus.CREATED,
+        pid = pid,
+        bundle = bundlePath,
+        annotations = spec.annotations,
+        pidStartTime = memberState.pidStartTime,
+        cgroupPath = memberState.cgroupPath,
+    ).save(fs, rootPath)
+    return pid
+}
+
+/**
+ * Best-effort teardown of a member that could not be adopted. Its state may
+ * already be partly renamed; whatever is left under the member id goes.
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun discardMember(
+    syscall: Syscall,
+    fs: FileSystem,
+    cgroup: Cgroup,
+    rootPath: String,
+    member: String,
+) {
+    try {
+        loadState(fs, rootPath, member).let { s -> s.pid?.let { syscall.killProcess(it, SIGKILL, s.pidStartTime) } }
+    } catch (e: Exception) {
+        Logger.debug { "no live process for pool member $member: ${e.message}" }
+    }
+    try {
+        loadKontainerConfig(fs, rootPath, member).cgroupPath?.let { cgroup.cleanup(it) }
+    } catch (e: Exception) {
+        Logger.debug { "no cgroup to clean up for pool member $member: ${e.message}" }
+    }
+    deleteNotifySocket(member)
+    try {
+        deleteContainerDir(rootPath, member)
+        removeFromIndex(fs, rootPath, member)
+    } catch (e: Exception) {
+        Logger.warn("failed to delete pool member $member: ${e.message ?: "unknown"}")
+    }
+}
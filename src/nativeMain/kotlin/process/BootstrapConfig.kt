@@ -0,0 +1,318 @@
+package process
+
+/**
+ * Bootstrap configuration message (main → stage-1 → stage-2)
+ *
+ * A compact, versioned, netlink-style binary message, similar to runc's
+ * nsexec bootstrap data. Create.kt writes it once over the sync socket;
+ * bootstrap.c reads the attributes it needs (clone flags, namespace paths,
+ * fds) without any string parsing, and stage-2 inherits the buffer and decodes
+ * the rest here. The spec travels pre-encoded as CBOR so the init process
+ * never re-reads or re-parses config.json.
+ *
+ * Layout (host byte order, little-endian on every supported target):
+ *
+ *   header:    u32 magic, u16 version, u16 reserved, u32 total length
+ *   attribute: u32 length (header + payload, unpadded), u32 type, payload,
+ *              padded to a 4-byte boundary
+ *
+ * Constants must match KONTAINER_BOOTSTRAP_* in bootstrap.h.
+ */
+class BootstrapConfig(
+    val cloneFlags: UInt,
+    val nsPaths: List<Pair<UInt, String>>,
+    val bundlePath: String,
+    val rootfsPath: String,
+    val containerId: String,
+    val notifySocketPath: String,
+    val mainSenderFd: Int,
+    val initReceiverFd: Int,
+    val notifyListenerFd: Int,
+    val traceFd: Int = -1,
+    val cgroupFd: Int = -1,
+    val traceStartNs: Long = 0L,
+    val specCbor: ByteArray = ByteArray(0),
+    val seccompBpf: ByteArray = ByteArray(0),
+    val rlimits: List<BootstrapRlimit> = emptyList(),
+) {
+    /**
+     * Encode to the wire format
+     */
+    fun encode(): ByteArray {
+        val out = Writer()
+        out.u32(MAGIC)
+        out.u16(VERSION)
+        out.u16(0)
+        out.u32(0) // total length, patched below
+
+        out.attr(ATTR_CLONE_FLAGS) { u32(cloneFlags.toInt()) }
+        nsPaths.forEach { (type, path) ->
+            out.attr(ATTR_NS_PATH) {
+                u32(type.toInt())
+                cstring(path)
+            }
+        }
+        out.attr(ATTR_BUNDLE_PATH) { cstring(bundlePath) }
+        out.attr(ATTR_ROOTFS_PATH) { cstring(rootfsPath) }
+        out.attr(ATTR_CONTAINER_ID) { cstring(containerId) }
+        out.attr(ATTR_NOTIFY_SOCKET) { cstring(notifySocketPath) }
+        // FD attributes stay in this order: the spawner maps them onto the
+        // SCM_RIGHTS array positionally.
+        fdList().forEach { (role, fd) ->
+            out.attr(ATTR_FD) {
+                u32(role)
+                u32(fd)
+            }
+        }
+        if (traceStartNs > 0L) out.attr(ATTR_TRACE_START_NS) { u64(traceStartNs) }
+        if (specCbor.isNotEmpty()) out.attr(ATTR_SPEC) { bytes(specCbor) }
+        if (seccompBpf.isNotEmpty()) out.attr(ATTR_SECCOMP_BPF) { bytes(seccompBpf) }
+        rlimits.forEach { rlimit ->
+            out.attr(ATTR_RLIMIT) {
+                u32(rlimit.resource)
+                u64(rlimit.soft.toLong())
+                u64(rlimit.hard.toLong())
+            }
+        }
+
+        val encoded = out.toByteArray()
+        putU32(encoded, 8, encoded.size)
+        return encoded
+    }
+
+    /**
+     * FDs carried by this config as (role, fd), in wire order
+     */
+    fun fdList(): List<Pair<Int, Int>> =
+        buildList {
+            add(FD_MAIN_SENDER to mainSenderFd)
+            add(FD_INIT_RECEIVER to initReceiverFd)
+            add(FD_NOTIFY_LISTENER to notifyListenerFd)
+            if (traceFd >= 0) add(FD_TRACE to traceFd)
+            if (cgroupFd >= 0) add(FD_CGROUP to cgroupFd)
+        }
+
+    companion object {
+        const val MAGIC = 0x4b425354 // "KBST"
+        const val VERSION = 1
+        const val HEADER_SIZE = 12
+        const val ATTR_HEADER_SIZE = 8
+
+        const val ATTR_CLONE_FLAGS = 1
+        const val ATTR_NS_PATH = 2
+        const val ATTR_BUNDLE_PATH = 3
+        const val ATTR_ROOTFS_PATH = 4
+        const val ATTR_CONTAINER_ID = 5
+        const val ATTR_NOTIFY_SOCKET = 6
+        const val ATTR_FD = 7
+        const val ATTR_TRACE_START_NS = 8
+        const val ATTR_SPEC = 9
+        const val ATTR_SECCOMP_BPF = 10
+        const val ATTR_RLIMIT = 11
+
+        const val FD_MAIN_SENDER = 1
+        const val FD_INIT_RECEIVER = 2
+        const val FD_NOTIFY_LISTENER = 3
+        const val FD_TRACE = 4
+        const val FD_CGROUP = 5
+
+        /**
+         * Decode a message produced by [encode]
+         *
+         * Unknown attribute types are skipped so newer writers stay readable.
+         *
+         * @throws Exception if the header or an attribute is malformed
+         */
+        fun decode(data: ByteArray): BootstrapConfig {
+            if (data.size < HEADER_SIZE || getU32(data, 0) != MAGIC) {
+                throw Exception("invalid bootstrap config header")
+            }
+            val version = getU16(data, 4)
+            if (version != VERSION) {
+                throw Exception("unsupported bootstrap config version $version")
+            }
+            val total = getU32(data, 8)
+            if (total < HEADER_SIZE || total > data.size) {
+                throw Exception("invalid bootstrap config length $total")
+            }
+
+            var cloneFlags = 0u
+            val nsPaths = mutableListOf<Pair<UInt, String>>()
+            var bundlePath = ""
+            var rootfsPath = ""
+            var containerId = ""
+            var notifySocketPath = ""
+            val fds = mutableMapOf<Int, Int>()
+            var traceStartNs = 0L
+            var specCbor = ByteArray(0)
+            var seccompBpf = ByteArray(0)
+            val rlimits = mutableListOf<BootstrapRlimit>()
+
+            var offset = HEADER_SIZE
+            while (offset + ATTR_HEADER_SIZE <= total) {
+                val len = getU32(data, offset)
+                val type = getU32(data, offset + 4)
+                if (len < ATTR_HEADER_SIZE || offset + len > total) {
+                    throw Exception("invalid bootstrap config attribute at offset $offset")
+                }
+                val start = offset + ATTR_HEADER_SIZE
+                val end = offset + len
+                when (type) {
+                    ATTR_CLONE_FLAGS -> cloneFlags = getU32(data, start).toUInt()
+                    ATTR_NS_PATH -> nsPaths.add(getU32(data, start).toUInt() to getCString(data, start + 4, end))
+                    ATTR_BUNDLE_PATH -> bundlePath = getCString(data, start, end)
+                    ATTR_ROOTFS_PATH -> rootfsPath = getCString(data, start, end)
+                    ATTR_CONTAINER_ID -> containerId = getCString(data, start, end)
+                    ATTR_NOTIFY_SOCKET -> notifySocketPath = getCString(data, start, end)
+                    ATTR_FD -> fds[getU32(data, start)] = getU32(data, start + 4)
+                    ATTR_TRACE_START_NS -> traceStartNs = getU64(data, start)
+                    ATTR_SPEC -> specCbor = data.copyOfRange(start, end)
+                    ATTR_SECCOMP_BPF -> seccompBpf = data.copyOfRange(start, end)
+                    ATTR_RLIMIT ->
+                        rlimits.add(
+                            BootstrapRlimit(
+                                getU32(data, start),
+                                getU64(data, start + 4).toULong(),
+                                getU64(data, start + 12).toULong(),
+                            ),
+                        )
+                }
+                offset += align4(len)
+            }
+
+            return BootstrapConfig(
+                cloneFlags = cloneFlags,
+                nsPaths = nsPaths,
+                bundlePath = bundlePath,
+                rootfsPath = rootfsPath,
+                containerId = containerId,
+                notifySocketPath = notifySocketPath,
+                mainSenderFd = fds[FD_MAIN_SENDER] ?: -1,
+                initReceiverFd = fds[FD_INIT_RECEIVER] ?: -1,
+                notifyListenerFd = fds[FD_NOTIFY_LISTENER] ?: -1,
+                traceFd = fds[FD_TRACE] ?: -1,
+                cgroupFd = fds[FD_CGROUP] ?: -1,
+                traceStartNs = traceStartNs,
+                specCbor = specCbor,
+                seccompBpf = seccompBpf,
+                rlimits = rlimits,
+            )
+        }
+
+        private fun align4(n: Int): Int = (n + 3) and 3.inv()
+
+        private fun getU16(
+            data: ByteArray,
+            at: Int,
+        ): Int = (data[at].toInt() and 0xFF) or ((data[at + 1].toInt() and 0xFF) shl 8)
+
+        private fun getU32(
+            data: ByteArray,
+            at: Int,
+        ): Int =
+            (data[at].toInt() and 0xFF) or
+                ((data[at + 1].toInt() and 0xFF) shl 8) or
+                ((data[at + 2].toInt() and 0xFF) shl 16) or
+                ((data[at + 3].toInt() and 0xFF) shl 24)
+
+        private fun getU64(
+            data: ByteArray,
+            at: Int,
+        ): Long = (getU32(data, at).toLong() and 0xFFFFFFFFL) or (getU32(data, at + 4).toLong() shl 32)
+
+        private fun putU32(
+            data: ByteArray,
+            at: Int,
+            value: Int,
+        ) {
+            data[at] = (value and 0xFF).toByte()
+            data[at + 1] = ((value shr 8) and 0xFF).toByte()
+            data[at + 2] = ((value shr 16) and 0xFF).toByte()
+            data[at + 3] = ((value shr 24) and 0xFF).toByte()
+        }
+
+        private fun getCString(
+            data: ByteArray,
+            start: Int,
+            end: Int,
+        ): String {
+            var nul = start
+            while (nul < end && data[nul] != 0.toByte()) nul++
+            return data.decodeToString(start, nul)
+        }
+    }
+
+    /**
+     * Growable little-endian byte writer
+     */
+    private class Writer {
+        private var buf = ByteArray(256)
+        private var size = 0
+
+        private fun ensure(extra: Int) {
+            if (size + extra > buf.size) {
+                buf = buf.copyOf(maxOf(buf.size * 2, size + extra))
+            }
+        }
+
+        fun u16(value: Int) {
+            ensure(2)
+            buf[size++] = (value and 0xFF).toByte()
+            buf[size++] = ((value shr 8) and 0xFF).toByte()
+        }
+
+        fun u32(value: Int) {
+            ensure(4)
+            putU32(buf, size, value)
+            size += 4
+        }
+
+        fun u64(value: Long) {
+            u32((value and 0xFFFFFFFFL).toInt())
+            u32((value ushr 32).toInt())
+        }
+
+        fun bytes(value: ByteArray) {
+            ensure(value.size)
+            value.copyInto(buf, size)
+            size += value.size
+        }
+
+        fun cstring(value: String) {
+            bytes(value.encodeToByteArray())
+            ensure(1)
+            buf[size++] = 0
+        }
+
+        /**
+         * Write one attribute: header, payload from [body], padding
+         */
+        fun attr(
+            type: Int,
+            body: Writer.() -> Unit,
+        ) {
+            val start = size
+            u32(0)
+            u32(type)
+            body()
+            putU32(buf, start, size - start)
+            val padding = align4(size) - size
+            ensure(padding)
+            repeat(padding) { buf[size++] = 0 }
+        }
+
+        fun toByteArray(): ByteArray = buf.copyOf(size)
+    }
+}
+
+/**
+ * One resource limit that stage-1 sets on itself with setrlimit(2) before it
+ * unshares anything, so stage-2 and the container process inherit it
+ *
+ * @property resource RLIMIT_* number
+ */
+data class BootstrapRlimit(
+    val resource: Int,
+    val soft: ULong,
+    val hard: ULong,
+)
@@ -0,0 +1,115 @@
+package process
+
+import bootstrap.kontainer_userns_holder
+import kotlinx.cinterop.*
+import logger.Logger
+import platform.posix.*
+import rootfs.AT_EMPTY_PATH_MOUNT
+import rootfs.AT_FDCWD_MOUNT
+import rootfs.AT_RECURSIVE
+import rootfs.IdmapTarget
+import rootfs.MOUNT_ATTR_IDMAP
+import rootfs.OPEN_TREE_CLONE
+import spec.LinuxIdMapping
+import spec.Spec
+import syscall.Syscall
+import utils.FileSystem
+
+/**
+ * Clone and idmap every tree of [targets] for the init to attach
+ *
+ * Runs in the main process, which holds CAP_SYS_ADMIN over the host
+ * filesystems. Targets using the container's mappings are idmapped with the
+ * user namespace of [initPid]. Mount-specific mappings get a namespace of
+ * their own from a short-lived holder process, one per set of mappings.
+ *
+ * @return Detached tree fds, in the order of [targets]
+ * @throws Exception if a tree cannot be created; nothing is left open
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun createIdmappedTrees(
+    syscall: Syscall,
+    fs: FileSystem,
+    spec: Spec,
+    targets: List<IdmapTarget>,
+    initPid: Int,
+): List<Int> {
+    val containerUid = spec.linux?.uidMappings
+    val containerGid = spec.linux?.gidMappings
+    // (uid mappings, gid mappings) -> user namespace fd
+    val userns = mutableMapOf<Pair<List<LinuxIdMapping>?, List<LinuxIdMapping>?>, Int>()
+    val trees = mutableListOf<Int>()
+    try {
+        for (target in targets) {
+            val key = (target.uidMappings ?: containerUid) to (target.gidMappings ?: containerGid)
+            val usernsFd =
+                userns.getOrPut(key) {
+                    if (key == containerUid to containerGid) {
+                        openNamespaceFd("/proc/$initPid/ns/user")
+                    } else {
+                        openUsernsWithMappings(syscall, fs, key.first, key.second)
+                    }
+                }
+            trees += createIdmappedTree(syscall, target, usernsFd)
+        }
+        Logger.debug { "created ${trees.size} idmapped trees" }
+        return trees
+    } catch (e: Exception) {
+        trees.forEach { close(it) }
+        throw e
+    } finally {
+        userns.values.forEach { close(it) }
+    }
+}
+
+@OptIn(ExperimentalForeignApi::class)
+private fun createIdmappedTree(
+    syscall: Syscall,
+    target: IdmapTarget,
+    usernsFd: Int,
+): Int {
+    val treeFlags = OPEN_TREE_CLONE or O_CLOEXEC.toUInt() or (if (target.recursive) AT_RECURSIVE else 0u)
+    val tree = syscall.openTree(AT_FDCWD_MOUNT, target.source, treeFlags)
+    if (tree < 0) {
+        throw Exception("Failed to clone ${target.source} for idmapping (errno=$errno)")
+    }
+    val attr = target.attr.copy(attrSet = target.attr.attrSet or MOUNT_ATTR_IDMAP, usernsFd = usernsFd.toULong())
+    val flags = AT_EMPTY_PATH_MOUNT or (if (target.recursiveIdmap) AT_RECURSIVE else 0u)
+    if (syscall.mountSetattr(tree, "", flags, attr) != 0) {
+        val errNum = errno
+        close(tree)
+        // EINVAL: the filesystem does not support idmapped mounts
+        throw Exception("Failed to idmap ${target.source} (errno=$errNum)")
+    }
+    return tree
+}
+
+@OptIn(ExperimentalForeignApi::class)
+private fun openNamespaceFd(path: String): Int {
+    val fd = open(path, O_RDONLY or O_CLOEXEC)
+    if (fd < 0) throw Exception("Failed to open $path (errno=$errno)")
+    return fd
+}
+
+/**
+ * A user namespace with the given mappings, held open by fd only: the holder
+ * process is killed as soon as the namespace fd is open
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun openUsernsWithMappings(
+    syscall: Syscall,
+    fs: FileSystem,
+    uidMappings: List<LinuxIdMapping>?,
+    gidMappings: List<LinuxIdMapping>?,
+): Int {
+    val pid = kontainer_userns_holder()
+    if (pid < 0) throw Exception("Failed to create user namespace for idmapped mount (errno=$errno)")
+    try {
+        fs.writeTextFile("/proc/$pid/uid_map", buildIdMapping(uidMappings, syscall.geteuid()))
+        fs.writeTextFile("/proc/$pid/gid_map", buildIdMapping(gidMappings, syscall.getegid()))
+        return openNamespaceFd("/proc/$pid/ns/user")
+    } finally {
+        kill(pid, SIGKILL)
+        waitpid(pid, null, 0)
+    }
+}
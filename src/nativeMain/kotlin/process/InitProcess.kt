@@ -1,23 +1,29 @@
 package process
 
+import cgroup.applyCpuPlacement
 import channel.InitReceiver
 import channel.MainSender
 import channel.NotifyListener
 import kotlinx.cinterop.*
 import logger.Logger
 import platform.posix.*
+import rootfs.ROOTFS_IDMAP_INDEX
 import rootfs.applyLinuxDevices
 import rootfs.applyMaskedPaths
 import rootfs.applyReadonlyPaths
 import rootfs.applyRootfsPropagation
 import rootfs.applySpecMounts
 import rootfs.applySysctls
+import rootfs.idmapTargets
+import rootfs.overlayRootfsOf
 import rootfs.pivotRoot
 import rootfs.prepareRootfs
 import rootfs.setRootfsReadonly
+import rootfs.usesDevTemplate
 import seccomp.initializeSeccomp
 import spec.Spec
 import syscall.Syscall
+import trace.Tracer
 
 /**
  * Init process (Stage-2 / PID 1 in container)
@@ -36,20 +42,23 @@ private fun initProcessInternal(
     syscall: Syscall,
     spec: Spec,
     rootfsPath: String,
+    bundlePath: String,
+    containerId: String,
+    seccompBpf: ByteArray,
     mainSender: MainSender,
     initReceiver: InitReceiver,
     notifyListener: NotifyListener,
 ): Unit =
     memScoped {
         Logger.setContext("init")
-        Logger.debug("started, pid=${getpid()} ppid=${getppid()}")
+        Logger.debug { "started, pid=${getpid()} ppid=${getppid()}" }
 
         // All namespaces (user, mount, network, uts, ipc, pid) are unshared by bootstrap.c Stage-1
         // before the Kotlin runtime starts. UID/GID mapping was also completed by Stage-1.
         // See bootstrap.c for the full 2-stage protocol.
         Logger.debug("all namespaces already unshared by Stage-1, UID/GID mapping already done")
         Logger.debug("user namespace mapping already done by Stage-1, we are root in user NS")
-        Logger.debug("session already created by bootstrap.c (sid=${getsid(0)})")
+        Logger.debug { "session already created by bootstrap.c (sid=${getsid(0)})" }
 
         // Bring up the loopback interface inside the container's network
         // namespace (when one is configured). Without this, the container has
@@ -67,8 +76,6 @@ private fun initProcessInternal(
         // container's namespaces but haven't pivoted root or execve'd yet, so
         // status is still "created" for createContainer and "running" for
         // startContainer (set right before exec).
-        val bundlePath = getenv("_KONTAINER_BUNDLE_PATH")?.toKString() ?: ""
-        val containerId = getenv("_KONTAINER_CONTAINER_ID")?.toKString() ?: ""
         val createdState =
             state.State(
                 ociVersion = spec.ociVersion,
@@ -79,23 +86,33 @@ private fun initProcessInternal(
                 annotations = spec.annotations,
             )
 
+        // Idmapped trees made by main, in idmapTargets order (none without a
+        // user and mount namespace)
+        val idmappedTrees =
+            idmapTargets(spec, rootfsPath).associate { it.specIndex to initReceiver.waitForIdmappedMount() }
+        val devTree = if (usesDevTemplate(spec)) initReceiver.waitForDevTemplate() else -1
+
         // Prepare rootfs
         if (spec.hasNamespace("mount")) {
-            prepareRootfs(syscall, rootfsPath, spec.linux?.rootfsPropagation)
+            Tracer.span("rootfs.prepare") {
+                val rootfsTree = idmappedTrees[ROOTFS_IDMAP_INDEX] ?: -1
+                val overlay = overlayRootfsOf(spec, bundlePath)
+                prepareRootfs(syscall, rootfsPath, spec.linux?.rootfsPropagation, rootfsTree, overlay, devTree)
+            }
             // Process spec.mounts BEFORE pivot_root so bind-mount source paths from
             // the host are still reachable. Targets are inside rootfsPath.
-            applySpecMounts(syscall, spec.mounts, rootfsPath)
+            Tracer.span("mounts.apply") { applySpecMounts(syscall, spec.mounts, rootfsPath, idmappedTrees) }
             // createContainer hooks run after the container's mount namespace
             // is established but BEFORE pivot_root — they can still see the
             // host paths via the new rootfs's parent. This is the standard
             // spec timing (post-1.0.2).
             if (spec.hooks?.createContainer != null) {
-                if (!hook.runHooks(spec.hooks.createContainer, createdState)) {
+                if (!Tracer.span("hooks.createContainer") { hook.runHooks(spec.hooks.createContainer, createdState) }) {
                     Logger.error("createContainer hook failed; aborting")
                     _exit(1)
                 }
             }
-            pivotRoot(syscall, rootfsPath)
+            Tracer.span("pivot_root") { pivotRoot(syscall, rootfsPath) }
             // Apply rootfsPropagation only AFTER pivot_root; the kernel forbids
             // pivot_root into a MS_SHARED subtree.
             applyRootfsPropagation(syscall, spec.linux?.rootfsPropagation)
@@ -109,7 +126,7 @@ private fun initProcessInternal(
             perror("chdir")
             Logger.warn("failed to chdir to $cwd")
         } else {
-            Logger.debug("changed directory to $cwd")
+            Logger.debug { "changed directory to $cwd" }
         }
 
         // Set hostname (within UTS namespace).
@@ -121,12 +138,12 @@ private fun initProcessInternal(
                 perror("sethostname")
                 Logger.warn("failed to set hostname to $hostname")
             } else {
-                Logger.debug("set hostname to $hostname")
+                Logger.debug { "set hostname to $hostname" }
             }
         }
 
         // Create spec.linux.devices[] device nodes inside the container's /dev.
-        applyLinuxDevices(syscall, spec.linux?.devices)
+        Tracer.span("devices.apply") { applyLinuxDevices(syscall, spec.linux?.devices) }
 
         // Apply spec.linux.sysctl entries via /proc/sys/*. /proc is mounted by
         // prepareRootfs; we must do this while still root (writing /proc/sys
@@ -136,8 +153,10 @@ private fun initProcessInternal(
         // Mask and remount-readonly paths inside the container. Done after
         // prepareRootfs+pivotRoot (so the target paths exist inside the new
         // root) and before dropping caps (mount/remount need CAP_SYS_ADMIN).
-        applyMaskedPaths(syscall, spec.linux?.maskedPaths)
-        applyReadonlyPaths(syscall, spec.linux?.readonlyPaths)
+        Tracer.span("paths.mask_readonly") {
+            applyMaskedPaths(syscall, spec.linux?.maskedPaths)
+            applyReadonlyPaths(syscall, spec.linux?.readonlyPaths)
+        }
 
         // Finalize rootfs (set readonly, umask).
         // Must be done BEFORE dropping privileges (setuid/setgid) because remounting
@@ -146,17 +165,19 @@ private fun initProcessInternal(
         finalizeRootfs(syscall, spec)
 
         // Prepare environment and FD handling
-        val processArgs = spec.process.args
-        val processEnv = spec.process.env?.toMutableList() ?: mutableListOf()
+        // Both can still be replaced by a ProcessUpdate while parked (pool claims)
+        var processArgs = spec.process.args
+        var processEnv = spec.process.env ?: emptyList()
+        val listenEnv = mutableListOf<String>()
 
         // Handle LISTEN_FDS for systemd socket activation.
         // See https://www.freedesktop.org/software/systemd/man/sd_listen_fds.html
         val listenFds = getenv("LISTEN_FDS")?.toKString()?.toIntOrNull() ?: 0
         val preserveFds =
             if (listenFds > 0) {
-                processEnv.add("LISTEN_FDS=$listenFds")
-                processEnv.add("LISTEN_PID=1")
-                Logger.debug("preserving $listenFds FDs for systemd socket activation")
+                listenEnv.add("LISTEN_FDS=$listenFds")
+                listenEnv.add("LISTEN_PID=1")
+                Logger.debug { "preserving $listenFds FDs for systemd socket activation" }
                 listenFds
             } else {
                 0
@@ -176,6 +197,10 @@ private fun initProcessInternal(
             syscall.setNoNewPrivileges()
         }
 
+        // Pin to linux.resources.cpu.cpus/mems. Before seccomp, which may deny
+        // sched_setaffinity or set_mempolicy to the container
+        applyCpuPlacement(syscall, spec.linux?.resources?.cpu)
+
         // Load seccomp filter BEFORE dropping capabilities. seccomp(2) needs
         // CAP_SYS_ADMIN unless PR_SET_NO_NEW_PRIVS is set, and an OCI default
         // spec specifies seccomp without noNewPrivileges (so we cannot rely on
@@ -183,7 +208,9 @@ private fun initProcessInternal(
         // avoids the EPERM. The filter is inherited across the later capset /
         // setuid / execve, so the container process runs under it.
         spec.linux?.seccomp?.let { seccomp ->
-            val notifyFd = initializeSeccomp(seccomp)
+            // Main pre-compiles the filter when it can (see SeccompCache.kt);
+            // an empty program means build it here with libseccomp
+            val notifyFd = Tracer.span("seccomp.load") { initializeSeccomp(seccomp, seccompBpf) }
             syncSeccompNotifyFd(notifyFd, mainSender, initReceiver)
         }
 
@@ -193,6 +220,7 @@ private fun initProcessInternal(
         // 3. setgroups/setgid/setuid
         // 4. Clear PR_SET_KEEPCAPS
         // 5. Apply effective/permitted/inheritable/ambient capabilities (as non-root user)
+        val capDropStartNs = Tracer.now()
         spec.process.capabilities?.let { capabilities ->
             capability.applyBoundingSet(syscall, capabilities)
             capability.setKeepCaps(syscall)
@@ -202,7 +230,7 @@ private fun initProcessInternal(
         // Note: /proc/self/setgroups may be "deny" in unprivileged user namespaces (Linux 3.19+).
         spec.process.user.additionalGids?.let { additionalGids ->
             if (additionalGids.isNotEmpty()) {
-                Logger.debug("setting ${additionalGids.size} additional groups")
+                Logger.debug { "setting ${additionalGids.size} additional groups" }
                 syscall.setAdditionalGroups(additionalGids)
             }
         }
@@ -221,13 +249,14 @@ private fun initProcessInternal(
             Logger.error("Failed to set UID to $targetUid")
             throw Exception("Failed to set UID to $targetUid")
         }
-        Logger.debug("set UID=$targetUid GID=$targetGid for container process")
+        Logger.debug { "set UID=$targetUid GID=$targetGid for container process" }
 
         // Apply remaining capabilities after setuid
         spec.process.capabilities?.let { capabilities ->
             capability.clearKeepCaps(syscall)
             capability.applyCapabilities(syscall, capabilities)
         }
+        Tracer.record("capabilities.drop", capDropStartNs)
 
         // Apply AppArmor profile / SELinux exec context. Both are written to
         // /proc/self/attr/* files and take effect on the next execve.
@@ -256,7 +285,7 @@ private fun initProcessInternal(
                 }
             }
             if (!written) Logger.warn("failed to set apparmor profile '$profile'")
-            else Logger.debug("staged apparmor exec profile: $profile")
+            else Logger.debug { "staged apparmor exec profile: $profile" }
         }
         spec.process.selinuxLabel?.let { label ->
             try {
@@ -271,13 +300,15 @@ private fun initProcessInternal(
                         }
                     }
                     close(fd)
-                    Logger.debug("staged SELinux exec label: $label")
+                    Logger.debug { "staged SELinux exec label: $label" }
                 }
             } catch (e: Throwable) {
                 Logger.warn("failed to set SELinux label: ${e.message}")
             }
         }
 
+        // Flush before parking: everything up to init-ready is the create path
+        Tracer.flush()
         mainSender.initReady()
         Logger.debug("sent init ready signal")
 
@@ -301,8 +332,18 @@ private fun initProcessInternal(
             )
         }
 
+        val startWaitNs = Tracer.now()
+        if (canParkInit(spec, containerId)) {
+            parkInit(notifyListener.fd(), startWaitNs, processArgs, execEnvironment(processEnv + listenEnv))
+        }
+
         Logger.debug("waiting for start signal...")
-        notifyListener.waitForContainerStart()
+        notifyListener.waitForContainerStart { update ->
+            update.args?.let { processArgs = it }
+            update.env?.let { processEnv = it }
+            Logger.debug { "applied process update (args=${update.args != null}, env=${update.env != null})" }
+        }
+        Tracer.record("wait.start", startWaitNs)
         Logger.debug("received start signal, executing container process")
 
         notifyListener.close()
@@ -311,7 +352,7 @@ private fun initProcessInternal(
         // execve. Status is "running" at this point.
         if (spec.hooks?.startContainer != null) {
             val runningState = createdState.copy(status = state.ContainerStatus.RUNNING)
-            if (!hook.runHooks(spec.hooks.startContainer, runningState)) {
+            if (!Tracer.span("hooks.startContainer") { hook.runHooks(spec.hooks.startContainer, runningState) }) {
                 Logger.error("startContainer hook failed; aborting exec")
                 _exit(1)
             }
@@ -331,20 +372,15 @@ private fun initProcessInternal(
         clearenv()
         Logger.debug("cleared all host environment variables")
 
-        processEnv.forEach { envEntry ->
-            val parts = envEntry.split("=", limit = 2)
-            if (parts.size == 2) {
-                val key = parts[0]
-                val value = parts[1]
-                if (setenv(key, value, 1) != 0) {
-                    perror("setenv")
-                    Logger.warn("failed to set environment variable: $key=$value")
-                }
-            } else {
-                Logger.warn("invalid environment variable format: $envEntry")
+        val execEnv = execEnvironment(processEnv + listenEnv)
+        execEnv.forEach { envEntry ->
+            val (key, value) = envEntry.split("=", limit = 2)
+            if (setenv(key, value, 1) != 0) {
+                perror("setenv")
+                Logger.warn("failed to set environment variable: $key=$value")
             }
         }
-        Logger.debug("set ${processEnv.size} environment variables")
+        Logger.debug { "set ${execEnv.size} environment variables" }
 
         val argv = allocArray<CPointerVar<ByteVar>>(processArgs.size + 1)
         processArgs.forEachIndexed { i, arg ->
@@ -352,6 +388,13 @@ private fun initProcessInternal(
         }
         argv[processArgs.size] = null
 
+        // execve itself is recorded as an instant: nothing of ours runs after
+        // it succeeds. Close the trace fd explicitly; it could sit inside the
+        // LISTEN_FDS range that closeRange() preserves.
+        val execNs = Tracer.now()
+        Tracer.record("execve", execNs, execNs)
+        Tracer.close()
+
         // execvp uses PATH lookup and the environment we set above
         execvp(processArgs[0], argv)
 
@@ -369,12 +412,25 @@ fun runInitProcess(
     syscall: Syscall,
     spec: Spec,
     rootfsPath: String,
+    bundlePath: String,
+    containerId: String,
+    seccompBpf: ByteArray,
     mainSender: MainSender,
     initReceiver: InitReceiver,
     notifyListener: NotifyListener,
 ) {
     try {
-        initProcessInternal(syscall, spec, rootfsPath, mainSender, initReceiver, notifyListener)
+        initProcessInternal(
+            syscall,
+            spec,
+            rootfsPath,
+            bundlePath,
+            containerId,
+            seccompBpf,
+            mainSender,
+            initReceiver,
+            notifyListener,
+        )
     } catch (e: Exception) {
         Logger.error("init process failed: ${e.message ?: "unknown"}")
 
@@ -427,5 +483,5 @@ private fun finalizeRootfs(
     // Set umask (default 0o022)
     val umaskValue = spec.process.umask ?: 0x12u // 0x12 = 0o022 (octal)
     syscall.umask(umaskValue)
-    Logger.debug("set umask to ${umaskValue.toString(8)}")
+    Logger.debug { "set umask to ${umaskValue.toString(8)}" }
 }
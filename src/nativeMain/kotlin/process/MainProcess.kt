@@ -1,15 +1,13 @@
 package process
 
 import cgroup.Cgroup
-import cgroup.CgroupV2
 import channel.*
-import config.KontainerConfig
-import config.saveKontainerConfig
 import hook.runHooks
+import rootfs.idmapTargets
+import rootfs.openDevTemplate
+import rootfs.usesDevTemplate
 import kotlinx.cinterop.ExperimentalForeignApi
-import kotlinx.cinterop.addressOf
 import kotlinx.cinterop.memScoped
-import kotlinx.cinterop.usePinned
 import logger.Logger
 import platform.posix.*
 import seccomp.sendToSeccompListener
@@ -20,6 +18,8 @@ import state.State
 import state.createState
 import state.save
 import syscall.Syscall
+import syscall.readProcessStartTime
+import trace.Tracer
 import utils.FileSystem
 
 /**
@@ -28,8 +28,7 @@ import utils.FileSystem
  * This process manages the init process (Stage-2/PID 1).
  *
  * Responsibilities:
- * - Setup cgroup for Stage-1 (inherited by Stage-2)
- * - Apply rlimits to Stage-1 (inherited by Stage-2)
+ * - Move Stage-2 into its cgroup if it could not be cloned into it
  * - Handle UID/GID mapping protocol with Stage-1
  * - Receive Stage-2 PID from bootstrap
  * - Handle seccomp notify FD if configured
@@ -47,7 +46,9 @@ private fun runMainProcessInternal(
     spec: Spec,
     containerId: String,
     bundlePath: String,
+    rootfsPath: String,
     rootPath: String,
+    cgroupPath: String,
     pidFile: String?,
     notifyListener: NotifyListener,
     mainSender: MainSender,
@@ -57,21 +58,13 @@ private fun runMainProcessInternal(
 ): Unit =
     memScoped {
         Logger.setContext("main")
-        Logger.debug("started, stage-1 pid=$stage1Pid")
+        Logger.debug { "started, stage-1 pid=$stage1Pid" }
 
-        // Resolve the OCI spec cgroupsPath (absolute → literal; relative or
-        // unspecified → nested under our runtime's subtree) and stash the
-        // resolved path so Delete can use it later. See
-        // CgroupV2.resolveCgroupPath() for the rules.
-        val resolvedCgroupPath = CgroupV2.resolveCgroupPath(spec.linux?.cgroupsPath, containerId)
+        // The cgroup at cgroupPath was created and configured by Create.kt
+        // before anything was forked; Stage-1 clones Stage-2 straight into it.
 
-        // Setup cgroup for Stage-1 BEFORE syncing with child
-        // Stage-1 → Stage-2 are both included in the cgroup (inherited through fork)
-        cgroup.setup(stage1Pid, resolvedCgroupPath, spec.linux?.resources)
-
-        // Apply rlimits to Stage-1 BEFORE entering user namespace
-        // Rlimits are inherited: Stage-1 → Stage-2
-        syscall.applyRlimits(stage1Pid, spec.process.rlimits)
+        // Rlimits travel in the bootstrap config; stage-1 sets them on itself
+        // before it unshares the user namespace and clones Stage-2.
 
         // Handle UID/GID mapping if user namespace is configured
         // This must be done BEFORE receiving Stage-2 PID, as Stage-1 waits for mapping completion
@@ -80,62 +73,65 @@ private fun runMainProcessInternal(
         if (hasUserNamespace) {
             Logger.debug("user namespace configured, handling UID/GID mapping")
 
-            // Wait for mapping request from Stage-1
-            // Note: enum sync_t is 4 bytes (int) in C
-            val requestValue = readInt32(syncFd, "Failed to read mapping request from Stage-1")
-            if (requestValue != 0x40) { // SYNC_USERMAP_PLS = 0x40
-                throw Exception("Invalid mapping request: expected 0x40, got 0x${requestValue.toString(16)}")
-            }
-            Logger.debug("received mapping request from Stage-1")
-
-            // UID/GID mapping protocol:
-            // 1. Stage-1 sends SYNC_USERMAP_PLS (mapping request)
-            // 2. Stage-1 sends its own PID (4 bytes, int32)
-            // 3. Main Process writes to /proc/<stage1_pid>/uid_map and gid_map
-            // 4. Main Process sends SYNC_USERMAP_ACK (mapping acknowledgment)
-            // (see bootstrap.c:141-167 for the Stage-1 side)
-
-            // Read Stage-1 PID from bootstrap
-            val bootstrapPid = readInt32(syncFd, "Failed to read bootstrap PID from Stage-1")
-            Logger.debug("received bootstrap PID from Stage-1: $bootstrapPid")
+            // UID/GID mapping protocol (see run_stage1 in bootstrap.c):
+            // 1. Stage-1 sends a USERMAP_PLS frame carrying its own PID
+            // 2. Main Process writes to /proc/<stage1_pid>/uid_map and gid_map
+            // 3. Main Process sends a USERMAP_ACK frame
+            val bootstrapPid =
+                receiveSyncFrame(syncFd, FRAME_USERMAP_PLS, 1, "Failed to read mapping request from Stage-1")[0]
+            Logger.debug { "received mapping request from Stage-1, pid $bootstrapPid" }
+            val usermapStartNs = Tracer.now()
 
             // Build uid_map and gid_map content
             val uidMap = buildIdMapping(spec.linux?.uidMappings, syscall.geteuid())
             val gidMap = buildIdMapping(spec.linux?.gidMappings, syscall.getegid())
 
-            Logger.debug("constructed uidMap: ${uidMap.trim()}")
-            Logger.debug("constructed gidMap: ${gidMap.trim()}")
+            Logger.debug { "constructed uidMap: ${uidMap.trim()}" }
+            Logger.debug { "constructed gidMap: ${gidMap.trim()}" }
 
             // Determine if we need to write to setgroups
             val isPrivileged = syscall.geteuid() == 0u
-            Logger.debug("privileged mode: $isPrivileged (euid=${syscall.geteuid()})")
+            Logger.debug { "privileged mode: $isPrivileged (euid=${syscall.geteuid()})" }
 
             if (!isPrivileged) {
                 // Disable setgroups for unprivileged user namespaces (CVE-2014-8989)
-                Logger.debug("disabling setgroups for pid $bootstrapPid")
+                Logger.debug { "disabling setgroups for pid $bootstrapPid" }
                 fs.writeTextFile("/proc/$bootstrapPid/setgroups", "deny\n")
             } else {
                 Logger.debug("skipping setgroups write (running as root)")
             }
 
-            Logger.debug("writing uid_map for pid $bootstrapPid")
+            Logger.debug { "writing uid_map for pid $bootstrapPid" }
             fs.writeTextFile("/proc/$bootstrapPid/uid_map", uidMap)
 
-            Logger.debug("writing gid_map for pid $bootstrapPid")
+            Logger.debug { "writing gid_map for pid $bootstrapPid" }
             fs.writeTextFile("/proc/$bootstrapPid/gid_map", gidMap)
 
             Logger.debug("successfully wrote UID/GID mappings")
 
-            // Send mapping ack to Stage-1
-            // Note: enum sync_t is 4 bytes (int) in C
-            val ackValue = 0x41 // SYNC_USERMAP_ACK = 0x41
-            writeInt32(syncFd, ackValue, "Failed to send mapping ack to Stage-1")
+            sendSyncFrame(syncFd, FRAME_USERMAP_ACK, "Failed to send mapping ack to Stage-1")
+            Tracer.record("usermap.write", usermapStartNs)
             Logger.debug("sent mapping ack to Stage-1")
         }
 
-        // Wait for Stage-2 PID from bootstrap
-        val stage2Pid = readInt32(syncFd, "Failed to read Stage-2 PID from sync pipe")
-        Logger.debug("received Stage-2 PID from bootstrap: $stage2Pid")
+        // Wait for Stage-2 PID from bootstrap, and whether clone3(CLONE_INTO_CGROUP)
+        // placed Stage-2 in its cgroup
+        val (stage2Pid, placed) =
+            Tracer.span("wait.stage2_pid") {
+                receiveSyncFrame(syncFd, FRAME_STAGE2_PID, 2, "Failed to read Stage-2 PID from Stage-1")
+            }
+        Logger.debug { "received Stage-2 PID from bootstrap: $stage2Pid" }
+
+        // Recorded with the PID so later commands can tell a reused PID apart
+        val stage2StartTime = readProcessStartTime(stage2Pid)
+
+        // If Stage-2 was not cloned into its cgroup (older kernel, or no
+        // permission), move it here; Stage-1 holds Stage-2 until the ack.
+        if (placed == 0) {
+            Logger.debug("stage-2 was not cloned into its cgroup, moving it")
+            Tracer.span("cgroup.attach") { cgroup.addProcess(stage2Pid, cgroupPath) }
+            sendSyncFrame(syncFd, FRAME_CGROUP_ACK, "Failed to send cgroup ack to Stage-1")
+        }
 
         close(syncFd)
 
@@ -147,6 +143,26 @@ private fun runMainProcessInternal(
         // Close notify listener in main process (only used by Stage-2)
         notifyListener.close()
 
+        // Idmapped mounts need CAP_SYS_ADMIN over the host filesystems, so the
+        // trees are made here and attached by Stage-2, which waits for them
+        // before preparing the rootfs
+        val idmapTargets = idmapTargets(spec, rootfsPath)
+        if (idmapTargets.isNotEmpty()) {
+            Tracer.span("idmap.prepare") {
+                createIdmappedTrees(syscall, fs, spec, idmapTargets, stage2Pid).forEach { tree ->
+                    initSender.idmappedMount(tree)
+                    close(tree)
+                }
+            }
+        }
+        if (usesDevTemplate(spec)) {
+            Tracer.span("dev.template") {
+                val tree = openDevTemplate(syscall, rootPath)
+                initSender.devTemplate(tree)
+                if (tree >= 0) close(tree)
+            }
+        }
+
         // Check if seccomp notify is used in the spec
         val hasSeccompNotify =
             spec.linux
@@ -155,12 +171,13 @@ private fun runMainProcessInternal(
                 ?.any { it.action == "SCMP_ACT_NOTIFY" } ?: false
         if (hasSeccompNotify) {
             Logger.debug("seccomp notify is enabled, waiting for notify FD")
+            val notifyStartNs = Tracer.now()
             val notifyFd = mainReceiver.waitForSeccompRequest()
-            Logger.debug("received seccomp notify FD: $notifyFd")
+            Logger.debug { "received seccomp notify FD: $notifyFd" }
 
             // If listenerPath is specified, forward the FD to the listener
             spec.linux.seccomp.listenerPath?.let { listenerPath ->
-                Logger.debug("forwarding seccomp notify FD to listener: $listenerPath")
+                Logger.debug { "forwarding seccomp notify FD to listener: $listenerPath" }
                 val containerState =
                     State(
                         ociVersion = spec.ociVersion,
@@ -178,10 +195,11 @@ private fun runMainProcessInternal(
             }
 
             initSender.seccompNotifyDone()
+            Tracer.record("seccomp.notify_handoff", notifyStartNs)
             Logger.debug("sent seccomp notify done signal")
         }
 
-        mainReceiver.waitForInitReady()
+        Tracer.span("wait.init_ready") { mainReceiver.waitForInitReady() }
         Logger.debug("init process is ready")
 
         mainReceiver.close()
@@ -191,6 +209,11 @@ private fun runMainProcessInternal(
 
         // Save container state for start command
         Logger.debug("saving container state")
+        // The state carries the internal configuration (independent of the
+        // bundle): the *resolved* cgroup path (relative to /sys/fs/cgroup,
+        // no leading slash) so Delete.cleanup() removes the directory we
+        // actually created, not whatever spec.linux.cgroupsPath was.
+        val stateSaveStartNs = Tracer.now()
         val state =
             createState(
                 ociVersion = spec.ociVersion,
@@ -199,25 +222,17 @@ private fun runMainProcessInternal(
                 pid = stage2Pid,
                 bundle = bundlePath,
                 annotations = spec.annotations,
+                pidStartTime = stage2StartTime,
+                cgroupPath = cgroupPath,
             )
         state.save(fs, rootPath)
-
-        // Save internal configuration (independent of bundle). Store the
-        // *resolved* cgroup path (relative to /sys/fs/cgroup, no leading
-        // slash) so Delete.cleanup() removes the directory we actually
-        // created, not whatever spec.linux.cgroupsPath was.
-        Logger.debug("saving kontainer config")
-        val kontainerConfig =
-            KontainerConfig(
-                cgroupPath = resolvedCgroupPath,
-            )
-        saveKontainerConfig(fs, kontainerConfig, rootPath, containerId)
+        Tracer.record("state.save", stateSaveStartNs)
 
         // Write PID to file if --pid-file was specified
         if (pidFile != null) {
-            Logger.debug("writing PID to file: $pidFile")
+            Logger.debug { "writing PID to file: $pidFile" }
             fs.writeTextFile(pidFile, "$stage2Pid")
-            Logger.debug("successfully wrote PID $stage2Pid to $pidFile")
+            Logger.debug { "successfully wrote PID $stage2Pid to $pidFile" }
         }
 
         Logger.info("container $containerId created with init PID $stage2Pid")
@@ -228,7 +243,7 @@ private fun runMainProcessInternal(
         // with status="created". Older runtime-tools tests still use this hook
         // point; createRuntime/createContainer are the modern equivalents.
         if (spec.hooks?.prestart != null) {
-            if (!runHooks(spec.hooks.prestart, state)) {
+            if (!Tracer.span("hooks.prestart") { runHooks(spec.hooks.prestart, state) }) {
                 Logger.error("prestart hook failed; aborting container creation")
                 exit(1)
             }
@@ -238,12 +253,13 @@ private fun runMainProcessInternal(
         // runtime's namespace. Many specs include both pointing at different
         // programs, so we run both lists in order.
         if (spec.hooks?.createRuntime != null) {
-            if (!runHooks(spec.hooks.createRuntime, state)) {
+            if (!Tracer.span("hooks.createRuntime") { runHooks(spec.hooks.createRuntime, state) }) {
                 Logger.error("createRuntime hook failed; aborting container creation")
                 exit(1)
             }
         }
 
+        Tracer.close()
         exit(0)
     }
 
@@ -261,7 +277,9 @@ fun runMainProcess(
     spec: Spec,
     containerId: String,
     bundlePath: String,
+    rootfsPath: String,
     rootPath: String,
+    cgroupPath: String,
     pidFile: String?,
     notifyListener: NotifyListener,
     mainSender: MainSender,
@@ -279,7 +297,9 @@ fun runMainProcess(
             spec,
             containerId,
             bundlePath,
+            rootfsPath,
             rootPath,
+            cgroupPath,
             pidFile,
             notifyListener,
             mainSender,
@@ -289,70 +309,13 @@ fun runMainProcess(
         )
     } catch (e: Exception) {
         Logger.error("main process failed: ${e.message ?: "unknown"}")
+        Tracer.close()
         close(syncFd)
         notifyListener.close()
         _exit(1)
     }
 }
 
-/**
- * Read a 4-byte integer from a file descriptor (little-endian)
- * @param fd File descriptor to read from
- * @param errorMessage Error message prefix
- * @return Decoded Int32 value
- * @throws Exception if read fails or doesn't return 4 bytes
- */
-@OptIn(ExperimentalForeignApi::class)
-fun readInt32(
-    fd: Int,
-    errorMessage: String,
-): Int {
-    val bytes = ByteArray(4)
-    bytes.usePinned { pinned ->
-        val n = read(fd, pinned.addressOf(0), 4u)
-        if (n != 4L) {
-            perror("read")
-            Logger.error("$errorMessage (received $n bytes)")
-            throw Exception("$errorMessage (received $n bytes)")
-        }
-    }
-    // Decode little-endian
-    return (bytes[0].toInt() and 0xFF) or
-        ((bytes[1].toInt() and 0xFF) shl 8) or
-        ((bytes[2].toInt() and 0xFF) shl 16) or
-        ((bytes[3].toInt() and 0xFF) shl 24)
-}
-
-/**
- * Write a 4-byte integer to a file descriptor (little-endian)
- * @param fd File descriptor to write to
- * @param value Integer value to write
- * @param errorMessage Error message prefix
- * @throws Exception if write fails or doesn't write 4 bytes
- */
-@OptIn(ExperimentalForeignApi::class)
-fun writeInt32(
-    fd: Int,
-    value: Int,
-    errorMessage: String,
-) {
-    val bytes =
-        byteArrayOf(
-            (value and 0xFF).toByte(),
-            ((value shr 8) and 0xFF).toByte(),
-            ((value shr 16) and 0xFF).toByte(),
-            ((value shr 24) and 0xFF).toByte(),
-        )
-    bytes.usePinned { pinned ->
-        val n = write(fd, pinned.addressOf(0), 4u)
-        if (n != 4L) {
-            perror("write")
-            Logger.error(errorMessage)
-            throw Exception(errorMessage)
-        }
-    }
-}
-
 /**
  * Build ID mapping string from OCI spec mappings
  * @param mappings List of ID mappings from OCI spec (can be null)
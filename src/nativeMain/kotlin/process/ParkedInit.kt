@@ -0,0 +1,95 @@
+package process
+
+import bootstrap.kontainer_park
+import kotlinx.cinterop.*
+import logger.Logger
+import platform.posix.*
+import pool.POOL_MEMBER_PREFIX
+import spec.ANNOTATION_INIT_PARK
+import spec.Spec
+import spec.annotationEnabled
+import trace.Tracer
+
+/*
+ * Parked init ([ANNOTATION_INIT_PARK])
+ *
+ * Once setup is done, everything the init still needs is the container
+ * process's argv and environment and the notify socket. A parked init execs
+ * a freestanding waiter of a few KB through kontainer_park(), which waits
+ * for the start signal and execs the process (see parkwait.c). Its RSS is
+ * a few pages of code and stack; the Kotlin runtime's heap and threads go
+ * away at that exec.
+ *
+ * The waiter is embedded in the runtime and run from a sealed memfd, so it
+ * needs nothing from the container image or /proc after pivot_root, and
+ * holds no handle on a host binary.
+ */
+
+/**
+ * Whether the init of [spec] may park: requested by annotation, and nothing
+ * after the start signal needs the Kotlin runtime
+ *
+ * - startContainer hooks run between the start signal and execve
+ * - Pool members get their args/env as a ProcessUpdate, which the waiter
+ *   cannot decode
+ * - An empty process.args means init exits instead of exec'ing
+ * - An SELinux or AppArmor exec label would be applied by the exec of the
+ *   waiter instead of the container process's exec
+ */
+fun canParkInit(
+    spec: Spec,
+    containerId: String,
+): Boolean =
+    spec.annotationEnabled(ANNOTATION_INIT_PARK) &&
+        spec.hooks?.startContainer == null &&
+        !containerId.startsWith(POOL_MEMBER_PREFIX) &&
+        spec.process.args.isNotEmpty() &&
+        spec.process.selinuxLabel == null &&
+        spec.process.apparmorProfile == null
+
+/**
+ * The container process's environment from spec and update entries
+ * ("KEY=value"): as clearenv() followed by setenv() for each, a later entry
+ * replaces the value of an earlier one with the same key in place. Entries
+ * without '=' are skipped with a warning.
+ */
+fun execEnvironment(entries: List<String>): List<String> {
+    val env = LinkedHashMap<String, String>()
+    for (entry in entries) {
+        val parts = entry.split("=", limit = 2)
+        if (parts.size == 2) {
+            env[parts[0]] = parts[1]
+        } else {
+            Logger.warn("invalid environment variable format: $entry")
+        }
+    }
+    return env.map { (key, value) -> "$key=$value" }
+}
+
+/**
+ * Exec the C waiter; returns only if that failed, in which case the caller
+ * waits in-process as usual
+ *
+ * @param waitStartNs Start of the wait.start span
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun parkInit(
+    notifyFd: Int,
+    waitStartNs: Long,
+    args: List<String>,
+    env: List<String>,
+) {
+    memScoped {
+        val argv = allocArray<CPointerVar<ByteVar>>(args.size + 1)
+        args.forEachIndexed { i, arg -> argv[i] = arg.cstr.ptr }
+        argv[args.size] = null
+        val envp = allocArray<CPointerVar<ByteVar>>(env.size + 1)
+        env.forEachIndexed { i, entry -> envp[i] = entry.cstr.ptr }
+        envp[env.size] = null
+
+        Logger.info("parking until start, then executing: ${args.joinToString(" ")}")
+        Tracer.flush()
+        kontainer_park(notifyFd, Tracer.fd(), waitStartNs.toULong(), argv, envp)
+        Logger.warn("failed to park init (errno=$errno), waiting in the runtime")
+    }
+}
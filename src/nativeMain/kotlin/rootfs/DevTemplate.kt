@@ -0,0 +1,185 @@
+package rootfs
+
+import kotlinx.cinterop.*
+import logger.Logger
+import platform.posix.*
+import spec.ANNOTATION_DEV_TEMPLATE
+import spec.Spec
+import spec.annotationEnabled
+import syscall.MountAttr
+import syscall.Syscall
+
+/** A default character device: /dev/[name] is [major]:[minor] */
+internal data class DefaultDevice(
+    val name: String,
+    val major: Long,
+    val minor: Long,
+)
+
+/** The nodes the OCI runtime-spec requires in every container's /dev */
+internal val defaultDevices =
+    listOf(
+        DefaultDevice("null", 1, 3),
+        DefaultDevice("zero", 1, 5),
+        DefaultDevice("full", 1, 7),
+        DefaultDevice("random", 1, 8),
+        DefaultDevice("urandom", 1, 9),
+        DefaultDevice("tty", 5, 0),
+    )
+
+/** The default /dev symlinks (link name to target) */
+internal val defaultDevSymlinks =
+    listOf(
+        "stdin" to "/proc/self/fd/0",
+        "stdout" to "/proc/self/fd/1",
+        "stderr" to "/proc/self/fd/2",
+        "fd" to "/proc/self/fd",
+        "ptmx" to "pts/ptmx",
+        "core" to "/proc/kcore",
+    )
+
+/** Linux dev_t encoding of [major]:[minor] (gnu_dev_makedev) */
+internal fun makeDev(
+    major: Long,
+    minor: Long,
+): ULong =
+    (((major and 0xfff) shl 8) or (minor and 0xff) or
+        ((minor and 0xfff00) shl 12) or ((major and 0xfffff000) shl 32)).toULong()
+
+/**
+ * Whether the container's /dev comes from the template of its runtime root
+ *
+ * The clone is shared by every container of the root, so it is mounted
+ * read-only; specs that add to /dev get a tmpfs of their own.
+ */
+fun usesDevTemplate(spec: Spec): Boolean =
+    spec.annotationEnabled(ANNOTATION_DEV_TEMPLATE) &&
+        spec.hasNamespace("mount") &&
+        spec.linux?.devices.isNullOrEmpty() &&
+        spec.mounts?.none { it.destination == "/dev" } != false
+
+/**
+ * A detached, read-only clone of the /dev template under [rootPath], built
+ * on first use. Runs in the main process, in the host mount namespace.
+ *
+ * The template is a tmpfs with the default nodes made by mknod, the default
+ * symlinks and the pts, shm and mqueue mountpoints. Its nodes are usable
+ * from a user namespace because the tmpfs belongs to the host.
+ *
+ * @return The tree fd for the init to attach, or -1 if the template cannot
+ *   be used (the init then populates a tmpfs as usual)
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun openDevTemplate(
+    syscall: Syscall,
+    rootPath: String,
+): Int {
+    val template = "$rootPath/dev-template"
+    if (!ensureDevTemplate(syscall, rootPath, template)) return -1
+
+    val tree = syscall.openTree(AT_FDCWD_MOUNT, template, OPEN_TREE_CLONE or O_CLOEXEC.toUInt())
+    if (tree < 0) {
+        Logger.warn("failed to clone /dev template (errno=$errno)")
+        return -1
+    }
+    val attr = MountAttr(attrSet = MOUNT_ATTR_RDONLY or MOUNT_ATTR_NOSUID or MOUNT_ATTR_NOEXEC)
+    if (syscall.mountSetattr(tree, "", AT_EMPTY_PATH_MOUNT, attr) != 0) {
+        Logger.warn("failed to make /dev template clone read-only (errno=$errno)")
+        close(tree)
+        return -1
+    }
+    return tree
+}
+
+/**
+ * Build [template] unless it is already complete. Concurrent creates are
+ * serialized with a lock file; the ready marker is written last, so a
+ * template left half-built by a crash is detached and built again.
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun ensureDevTemplate(
+    syscall: Syscall,
+    rootPath: String,
+    template: String,
+): Boolean {
+    val marker = "$template.ready"
+    if (access(marker, F_OK) == 0 && isMountPoint(template)) return true
+
+    val lockFd = open("$template.lock", O_RDWR or O_CREAT or O_CLOEXEC, 0x180u) // 0x180 = 0o600
+    if (lockFd < 0) {
+        Logger.warn("failed to open /dev template lock (errno=$errno)")
+        return false
+    }
+    try {
+        // The bare name `flock` resolves to the `struct flock` cinterop type
+        // (see withContainerLock in State.kt), so call the syscall directly; qualified
+        // because the `syscall` parameter shadows the libc function
+        if (platform.posix.syscall(platform.linux.__NR_flock.toLong(), lockFd.toLong(), LOCK_EX.toLong()) != 0L) {
+            Logger.warn("failed to lock /dev template (errno=$errno)")
+            return false
+        }
+        if (access(marker, F_OK) == 0 && isMountPoint(template)) return true
+
+        unlink(marker)
+        if (isMountPoint(template)) syscall.umount2(template, MNT_DETACH)
+        mkdir(rootPath, 0x1EDu) // 0x1ED = 0o755
+        mkdir(template, 0x1EDu)
+        if (syscall.mount("tmpfs", template, "tmpfs", (MS_NOSUID or MS_NOEXEC).toULong(), "mode=755,size=64k") != 0) {
+            Logger.warn("failed to mount /dev template (errno=$errno)")
+            return false
+        }
+        // Private, so the template never shows up in peer mount namespaces
+        syscall.mount(null, template, null, MS_PRIVATE.toULong())
+
+        if (!populateDevTemplate(template)) {
+            syscall.umount2(template, MNT_DETACH)
+            return false
+        }
+        val fd = open(marker, O_WRONLY or O_CREAT or O_CLOEXEC, 0x1A4u) // 0x1A4 = 0o644
+        if (fd < 0) {
+            Logger.warn("failed to mark /dev template ready (errno=$errno)")
+            return false
+        }
+        close(fd)
+        Logger.debug { "built /dev template at $template" }
+        return true
+    } finally {
+        close(lockFd)
+    }
+}
+
+@OptIn(ExperimentalForeignApi::class)
+private fun populateDevTemplate(template: String): Boolean {
+    // Clear umask so the nodes get exactly 0666
+    val savedUmask = umask(0u)
+    try {
+        for (d in defaultDevices) {
+            if (mknod("$template/${d.name}", (S_IFCHR or 0x1B6).toUInt(), makeDev(d.major, d.minor)) != 0) { // 0o666
+                Logger.warn("mknod /dev template ${d.name} failed (errno=$errno)")
+                return false
+            }
+        }
+        mkdir("$template/pts", 0x1EDu) // 0o755
+        mkdir("$template/shm", 0x3FFu) // 0o1777
+        mkdir("$template/mqueue", 0x1EDu)
+    } finally {
+        umask(savedUmask)
+    }
+    for ((name, target) in defaultDevSymlinks) {
+        if (symlink(target, "$template/$name") != 0) {
+            Logger.warn("symlink /dev template $name failed (errno=$errno)")
+            return false
+        }
+    }
+    return true
+}
+
+/** Whether [path] is the root of a mount (its device differs from its parent's) */
+@OptIn(ExperimentalForeignApi::class)
+private fun isMountPoint(path: String): Boolean =
+    memScoped {
+        val st = alloc<stat>()
+        val parent = alloc<stat>()
+        if (stat(path, st.ptr) != 0 || stat("$path/..", parent.ptr) != 0) return false
+        st.st_dev != parent.st_dev
+    }
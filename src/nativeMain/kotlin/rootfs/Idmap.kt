@@ -0,0 +1,124 @@
+package rootfs
+
+import kotlinx.cinterop.*
+import logger.Logger
+import platform.posix.*
+import spec.ANNOTATION_OVERLAY_LOWER
+import spec.ANNOTATION_ROOTFS_IDMAP
+import spec.LinuxIdMapping
+import spec.Spec
+import spec.annotationEnabled
+import syscall.MountAttr
+import syscall.Syscall
+
+const val MOUNT_ATTR_IDMAP = 0x100000uL
+
+/** [IdmapTarget.specIndex] of the rootfs */
+const val ROOTFS_IDMAP_INDEX = -1
+
+/**
+ * A bind mount to be created as an idmapped mount
+ *
+ * Idmapping needs CAP_SYS_ADMIN over the filesystem, which the init inside
+ * its user namespace does not have. So the main process clones and idmaps
+ * each tree (process.createIdmappedTrees) and sends the detached tree to the
+ * init, which only attaches it with move_mount. Both sides derive the same
+ * list from the spec with [idmapTargets].
+ *
+ * @property specIndex Index in spec.mounts, or [ROOTFS_IDMAP_INDEX]
+ * @property source Host path of the tree
+ * @property recursive Clone submounts too (rbind, rootfs)
+ * @property recursiveIdmap Idmap submounts too ("ridmap", rootfs)
+ * @property uidMappings Mount-specific mappings; null for the container's
+ * @property gidMappings Mount-specific mappings; null for the container's
+ * @property attr Attributes applied together with the idmap
+ */
+data class IdmapTarget(
+    val specIndex: Int,
+    val source: String,
+    val recursive: Boolean,
+    val recursiveIdmap: Boolean,
+    val uidMappings: List<LinuxIdMapping>? = null,
+    val gidMappings: List<LinuxIdMapping>? = null,
+    val attr: MountAttr = MountAttr(),
+)
+
+/**
+ * The idmapped mounts [spec] asks for: the rootfs with
+ * [ANNOTATION_ROOTFS_IDMAP], then every bind mount with "idmap"/"ridmap" or
+ * its own uidMappings/gidMappings, in spec order
+ *
+ * Idmapped mounts are only made for containers with both a user and a
+ * mount namespace; other requests are ignored with a warning.
+ */
+fun idmapTargets(
+    spec: Spec,
+    rootfsPath: String,
+): List<IdmapTarget> {
+    val targets = mutableListOf<IdmapTarget>()
+    if (spec.annotationEnabled(ANNOTATION_ROOTFS_IDMAP)) {
+        if (spec.annotations?.containsKey(ANNOTATION_OVERLAY_LOWER) == true) {
+            Logger.warn("$ANNOTATION_ROOTFS_IDMAP does not apply to an overlay rootfs, ignoring")
+        } else {
+            targets += IdmapTarget(ROOTFS_IDMAP_INDEX, rootfsPath, recursive = true, recursiveIdmap = true)
+        }
+    }
+    spec.mounts?.forEachIndexed { i, m ->
+        val options = m.options ?: emptyList()
+        val wanted = "idmap" in options || "ridmap" in options || m.uidMappings != null || m.gidMappings != null
+        if (!wanted) return@forEachIndexed
+        val parsed = parseMountOptions(options)
+        if ((parsed.flags and MS_BIND.toULong()) == 0uL || m.source == null) {
+            Logger.warn("idmap requested for non-bind mount ${m.destination}, ignoring")
+            return@forEachIndexed
+        }
+        targets +=
+            IdmapTarget(
+                specIndex = i,
+                source = m.source,
+                recursive = (parsed.flags and MS_REC.toULong()) != 0uL,
+                recursiveIdmap = "ridmap" in options,
+                uidMappings = m.uidMappings,
+                gidMappings = m.gidMappings,
+                attr = mountAttrOf(parsed).copy(propagation = 0uL),
+            )
+    }
+    if (targets.isEmpty()) return targets
+    if (!spec.hasNamespace("user") || !spec.hasNamespace("mount")) {
+        Logger.warn("idmapped mounts need user and mount namespaces, mounting ${targets.size} without idmap")
+        return emptyList()
+    }
+    return targets
+}
+
+/**
+ * Attach the idmapped [tree] received from main at [target] and close it
+ *
+ * @param propagation MS_* propagation type to set once attached, or 0
+ * @return false if move_mount failed (errno is logged)
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun attachIdmappedTree(
+    syscall: Syscall,
+    tree: Int,
+    target: String,
+    propagation: ULong = 0uL,
+    recursivePropagation: Boolean = false,
+): Boolean {
+    try {
+        if (syscall.moveMount(tree, "", AT_FDCWD_MOUNT, target, MOVE_MOUNT_F_EMPTY_PATH) != 0) {
+            Logger.warn("failed to attach idmapped mount at $target (errno=$errno)")
+            return false
+        }
+    } finally {
+        close(tree)
+    }
+    if (propagation != 0uL) {
+        val flags = if (recursivePropagation) AT_RECURSIVE else 0u
+        if (syscall.mountSetattr(AT_FDCWD_MOUNT, target, flags, MountAttr(propagation = propagation)) != 0) {
+            Logger.warn("failed to set propagation on $target (errno=$errno)")
+        }
+    }
+    Logger.debug { "attached idmapped mount at $target" }
+    return true
+}
@@ -0,0 +1,211 @@
+package rootfs
+
+import kotlinx.cinterop.*
+import logger.Logger
+import platform.posix.*
+import syscall.MountAttr
+import syscall.Syscall
+
+// open_tree / move_mount / mount_setattr flags (from linux/mount.h, linux/fcntl.h)
+const val OPEN_TREE_CLONE = 1u
+const val AT_FDCWD_MOUNT = -100 // AT_FDCWD
+const val AT_EMPTY_PATH_MOUNT = 0x1000u // AT_EMPTY_PATH
+const val AT_RECURSIVE = 0x8000u
+const val MOVE_MOUNT_F_EMPTY_PATH = 4u
+
+const val MOUNT_ATTR_RDONLY = 0x1uL
+const val MOUNT_ATTR_NOSUID = 0x2uL
+const val MOUNT_ATTR_NODEV = 0x4uL
+const val MOUNT_ATTR_NOEXEC = 0x8uL
+const val MOUNT_ATTR__ATIME = 0x70uL
+const val MOUNT_ATTR_RELATIME = 0x0uL
+const val MOUNT_ATTR_NOATIME = 0x10uL
+const val MOUNT_ATTR_STRICTATIME = 0x20uL
+const val MOUNT_ATTR_NODIRATIME = 0x80uL
+
+/**
+ * Whether open_tree/move_mount/mount_setattr work on this kernel; cleared on
+ * the first ENOSYS so later mounts go straight to the legacy path
+ */
+internal var mountApiAvailable = true
+
+/**
+ * One spec.mounts entry, ready to be mounted
+ *
+ * @property destination Path inside the container
+ * @property source Host path for bind mounts, label for the others
+ * @property fsType Filesystem type (ignored for bind mounts)
+ * @property specIndex Position in spec.mounts
+ */
+internal data class PlannedMount(
+    val destination: String,
+    val source: String?,
+    val fsType: String?,
+    val options: ParsedMountOptions,
+    val specIndex: Int,
+) {
+    val isBind: Boolean get() = (options.flags and MS_BIND.toULong()) != 0uL
+    val isRecursive: Boolean get() = (options.flags and MS_REC.toULong()) != 0uL
+}
+
+/** Destinations prepareRootfs() already establishes */
+private val handledByPrepareRootfs = setOf("/proc", "/dev", "/sys", "/sys/fs/cgroup")
+
+/**
+ * Order spec.mounts so that every mount comes after the mounts of its parent
+ * directories: sorted by destination depth, spec order kept within a depth
+ * (so of two mounts on the same destination the later still wins)
+ */
+internal fun planMounts(mounts: List<spec.Mount>): List<PlannedMount> =
+    mounts
+        .mapIndexed { i, m -> PlannedMount(m.destination, m.source ?: m.type, m.type, parseMountOptions(m.options), i) }
+        .filter { m ->
+            (m.destination !in handledByPrepareRootfs).also {
+                if (!it) Logger.debug { "skipping spec.mount ${m.destination} (already handled by prepareRootfs)" }
+            }
+        }.sortedBy { m -> m.destination.split('/').count { it.isNotEmpty() } }
+
+/**
+ * MOUNT_ATTR_* equivalent of the per-mount flags in [options]. Only flags the
+ * options name are touched, so attributes locked by a user namespace are
+ * left alone instead of failing the whole mount.
+ */
+internal fun mountAttrOf(options: ParsedMountOptions): MountAttr {
+    val ms = options.flags
+    fun has(flag: Int) = (ms and flag.toULong()) != 0uL
+    fun cleared(flag: Int) = (options.cleared and flag.toULong()) != 0uL
+
+    var set = 0uL
+    var clr = 0uL
+    if (has(MS_RDONLY)) set = set or MOUNT_ATTR_RDONLY else if (cleared(MS_RDONLY)) clr = clr or MOUNT_ATTR_RDONLY
+    if (has(MS_NOSUID)) set = set or MOUNT_ATTR_NOSUID else if (cleared(MS_NOSUID)) clr = clr or MOUNT_ATTR_NOSUID
+    if (has(MS_NODEV)) set = set or MOUNT_ATTR_NODEV else if (cleared(MS_NODEV)) clr = clr or MOUNT_ATTR_NODEV
+    if (has(MS_NOEXEC)) set = set or MOUNT_ATTR_NOEXEC else if (cleared(MS_NOEXEC)) clr = clr or MOUNT_ATTR_NOEXEC
+    if (has(MS_NODIRATIME)) set = set or MOUNT_ATTR_NODIRATIME
+
+    // The atime mode is a 3-bit field: clear it whenever one is chosen
+    val atime =
+        when {
+            has(MS_NOATIME) -> MOUNT_ATTR_NOATIME
+            has(MS_STRICTATIME) -> MOUNT_ATTR_STRICTATIME
+            has(MS_RELATIME) -> MOUNT_ATTR_RELATIME
+            else -> null
+        }
+    if (atime != null) {
+        set = set or atime
+        clr = clr or MOUNT_ATTR__ATIME
+    }
+
+    // mount_attr.propagation takes the type alone; recursion comes from AT_RECURSIVE
+    return MountAttr(set, clr, options.propagation and MS_REC.toULong().inv())
+}
+
+internal enum class MountApiResult { DONE, FAILED, UNSUPPORTED }
+
+/**
+ * Bind [source] onto [target] with the new mount API: clone the tree with
+ * open_tree, apply [attr] with mount_setattr while it is still detached,
+ * then attach it with move_mount. The mount never appears with the wrong
+ * flags, and there is no MS_REMOUNT or separate propagation call.
+ *
+ * Attributes apply to the top mount only unless [recursiveAttrs], as the
+ * legacy bind-remount did; propagation goes down the tree when
+ * [recursivePropagation].
+ *
+ * @return [MountApiResult.UNSUPPORTED] (nothing changed) if the kernel lacks
+ *   the API and the caller should use mount(2)
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun bindMountDetached(
+    syscall: Syscall,
+    source: String,
+    target: String,
+    recursive: Boolean,
+    attr: MountAttr,
+    recursiveAttrs: Boolean = false,
+    recursivePropagation: Boolean = false,
+): MountApiResult {
+    if (!mountApiAvailable) return MountApiResult.UNSUPPORTED
+
+    val treeFlags = OPEN_TREE_CLONE or O_CLOEXEC.toUInt() or (if (recursive) AT_RECURSIVE else 0u)
+    val tree = syscall.openTree(AT_FDCWD_MOUNT, source, treeFlags)
+    if (tree < 0) {
+        if (errno == ENOSYS) return unsupported()
+        Logger.warn("open_tree $source failed (errno=$errno)")
+        return MountApiResult.FAILED
+    }
+    try {
+        val attrs = attr.copy(propagation = 0uL)
+        val propagationOnly = MountAttr(propagation = attr.propagation)
+        val hasAttrs = attrs.attrSet != 0uL || attrs.attrClr != 0uL
+        // One call covers both, unless only one of them may recurse into the
+        // submounts of the tree
+        val steps =
+            when {
+                attr.propagation == 0uL -> if (hasAttrs) listOf(attrs to recursiveAttrs) else emptyList()
+                !hasAttrs -> listOf(propagationOnly to recursivePropagation)
+                recursive && recursiveAttrs != recursivePropagation ->
+                    listOf(attrs to recursiveAttrs, propagationOnly to recursivePropagation)
+                else -> listOf(attr to recursiveAttrs)
+            }
+        var propagationPending = false
+        for ((step, recursiveStep) in steps) {
+            val err = setattr(syscall, tree, step, recursiveStep)
+            when {
+                err == 0 -> {}
+                err == ENOSYS -> return unsupported()
+                // Older kernels refuse propagation changes on detached trees;
+                // it is then set once the tree is attached
+                err == EINVAL && step.propagation != 0uL -> {
+                    propagationPending = true
+                    val rest = step.copy(propagation = 0uL)
+                    if ((rest.attrSet != 0uL || rest.attrClr != 0uL) && setattr(syscall, tree, rest, recursiveAttrs) != 0) {
+                        return failed("mount_setattr", target)
+                    }
+                }
+                else -> return failed("mount_setattr", target)
+            }
+        }
+
+        if (syscall.moveMount(tree, "", AT_FDCWD_MOUNT, target, MOVE_MOUNT_F_EMPTY_PATH) != 0) {
+            if (errno == ENOSYS) return unsupported()
+            return failed("move_mount", target)
+        }
+        if (propagationPending) {
+            val flags = if (recursivePropagation) AT_RECURSIVE else 0u
+            if (syscall.mountSetattr(AT_FDCWD_MOUNT, target, flags, MountAttr(propagation = attr.propagation)) != 0) {
+                Logger.warn("failed to set propagation on $target (errno=$errno)")
+            }
+        }
+        return MountApiResult.DONE
+    } finally {
+        close(tree)
+    }
+}
+
+/** mount_setattr on a detached tree; 0 or the errno */
+@OptIn(ExperimentalForeignApi::class)
+private fun setattr(
+    syscall: Syscall,
+    tree: Int,
+    attr: MountAttr,
+    recursive: Boolean,
+): Int {
+    val flags = AT_EMPTY_PATH_MOUNT or (if (recursive) AT_RECURSIVE else 0u)
+    return if (syscall.mountSetattr(tree, "", flags, attr) == 0) 0 else errno
+}
+
+private fun unsupported(): MountApiResult {
+    Logger.debug("new mount API unavailable, using mount(2)")
+    mountApiAvailable = false
+    return MountApiResult.UNSUPPORTED
+}
+
+@OptIn(ExperimentalForeignApi::class)
+private fun failed(
+    call: String,
+    target: String,
+): MountApiResult {
+    Logger.warn("$call for $target failed (errno=$errno)")
+    return MountApiResult.FAILED
+}
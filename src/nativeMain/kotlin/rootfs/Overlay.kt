@@ -0,0 +1,77 @@
+package rootfs
+
+import spec.ANNOTATION_OVERLAY_LOWER
+import spec.ANNOTATION_OVERLAY_OPTIONS
+import spec.ANNOTATION_OVERLAY_UPPER
+import spec.ANNOTATION_OVERLAY_WORK
+import spec.Spec
+
+/** mount(2) data is copied in as a single page */
+private const val MOUNT_DATA_MAX = 4095
+
+/**
+ * Overlayfs rootfs assembled by the init from layer directories
+ *
+ * @property lower Lower layers, uppermost first; absolute paths
+ * @property upper Upper directory, or null for a read-only overlay
+ * @property work Work directory (set exactly when [upper] is)
+ * @property options Extra overlayfs options (volatile, index=off, ...)
+ */
+data class OverlayRootfs(
+    val lower: List<String>,
+    val upper: String? = null,
+    val work: String? = null,
+    val options: List<String> = emptyList(),
+) {
+    /**
+     * The mount(2) data string
+     * @throws Exception if it does not fit in one page
+     */
+    fun mountData(): String {
+        val parts = mutableListOf("lowerdir=" + lower.joinToString(":"))
+        upper?.let { parts += "upperdir=$it" }
+        work?.let { parts += "workdir=$it" }
+        parts += options
+        val data = parts.joinToString(",")
+        if (data.length > MOUNT_DATA_MAX) {
+            throw Exception("overlay options are ${data.length} bytes, more than mount(2) accepts ($MOUNT_DATA_MAX)")
+        }
+        return data
+    }
+}
+
+/**
+ * The overlay rootfs described by the `org.kontainer.rootfs.overlay.*`
+ * annotations of [spec], or null if the rootfs is a plain directory
+ *
+ * @param bundlePath Base for relative layer paths
+ * @throws Exception if the annotations are inconsistent
+ */
+fun overlayRootfsOf(
+    spec: Spec,
+    bundlePath: String,
+): OverlayRootfs? {
+    val annotations = spec.annotations ?: return null
+    val lowerList = annotations[ANNOTATION_OVERLAY_LOWER] ?: return null
+
+    fun resolve(path: String) = if (path.startsWith("/")) path else "$bundlePath/$path"
+
+    val lower = lowerList.split(':').filter { it.isNotEmpty() }.map(::resolve)
+    if (lower.isEmpty()) throw Exception("$ANNOTATION_OVERLAY_LOWER lists no layers")
+    val upper = annotations[ANNOTATION_OVERLAY_UPPER]?.takeIf { it.isNotEmpty() }?.let(::resolve)
+    val work = annotations[ANNOTATION_OVERLAY_WORK]?.takeIf { it.isNotEmpty() }?.let(::resolve)
+    if ((upper == null) != (work == null)) {
+        throw Exception("$ANNOTATION_OVERLAY_UPPER and $ANNOTATION_OVERLAY_WORK must be set together")
+    }
+    val options =
+        annotations[ANNOTATION_OVERLAY_OPTIONS]
+            ?.split(',')
+            ?.map { it.trim() }
+            ?.filter { it.isNotEmpty() }
+            ?: emptyList()
+    // Layer paths are ours to set; an option must not redefine them
+    options.firstOrNull { it.substringBefore('=') in setOf("lowerdir", "upperdir", "workdir") }?.let {
+        throw Exception("$ANNOTATION_OVERLAY_OPTIONS must not set $it")
+    }
+    return OverlayRootfs(lower, upper, work, options)
+}
@@ -3,6 +3,7 @@ package rootfs
 import kotlinx.cinterop.*
 import logger.Logger
 import platform.posix.*
+import syscall.MountAttr
 import syscall.Syscall
 
 // Mount flags (from linux/mount.h)
@@ -27,14 +28,23 @@ const val MNT_DETACH = 2
 
 /**
  * Prepare rootfs with basic mounts
+ *
+ * @param rootfsTree Idmapped clone of the rootfs sent by main (see
+ *   [idmapTargets]), attached in place of the plain self-bind; -1 if none
+ * @param overlay Overlayfs mounted on [rootfsPath] in place of the self-bind
+ * @param devTree Detached /dev template clone sent by main (see
+ *   [openDevTemplate]), attached in place of the per-container tmpfs; -1 if none
  */
 @OptIn(ExperimentalForeignApi::class)
 fun prepareRootfs(
     syscall: Syscall,
     rootfsPath: String,
     rootfsPropagation: String? = null,
+    rootfsTree: Int = -1,
+    overlay: OverlayRootfs? = null,
+    devTree: Int = -1,
 ) {
-    Logger.debug("preparing rootfs at $rootfsPath")
+    Logger.debug { "preparing rootfs at $rootfsPath" }
 
     if (access(rootfsPath, F_OK) != 0) {
         throw Exception("Rootfs path does not exist: $rootfsPath")
@@ -59,9 +69,28 @@ fun prepareRootfs(
         // Continue anyway - this is best effort
     }
 
-    // Bind mount rootfs to itself to make it a mount point (required for pivot_root)
-    Logger.debug("bind mounting rootfs to itself")
-    if (syscall.mount(
+    // Bind mount rootfs to itself to make it a mount point (required for pivot_root).
+    // An idmapped clone is already a bind of the rootfs and only needs attaching;
+    // an overlay is a mount point of its own. Mounted here, in the container's
+    // mount namespace, it goes away with the namespace.
+    if (overlay != null) {
+        if (syscall.mount(
+                source = "overlay",
+                target = rootfsPath,
+                fstype = "overlay",
+                flags = 0uL,
+                data = overlay.mountData(),
+            ) != 0
+        ) {
+            val errNum = errno
+            Logger.error("failed to mount overlay rootfs (errno=$errNum)")
+            throw Exception("Failed to mount overlay rootfs (errno=$errNum)")
+        }
+    } else if (rootfsTree >= 0) {
+        if (!attachIdmappedTree(syscall, rootfsTree, rootfsPath)) {
+            throw Exception("Failed to attach idmapped rootfs")
+        }
+    } else if (syscall.mount(
             source = rootfsPath,
             target = rootfsPath,
             fstype = null,
@@ -73,7 +102,7 @@ fun prepareRootfs(
         Logger.error("failed to bind mount rootfs to itself (errno=$errNum)")
         throw Exception("Failed to bind mount rootfs (errno=$errNum)")
     }
-    Logger.debug("rootfs bind mounted successfully")
+    Logger.debug("rootfs mounted successfully")
 
     // Mount /proc if it exists in rootfs
     val procPath = "$rootfsPath/proc"
@@ -93,9 +122,14 @@ fun prepareRootfs(
         Logger.debug("mounted /proc")
     }
 
-    // Mount /dev if it exists in rootfs
+    // Mount /dev if it exists in rootfs: the template clone from main when
+    // there is one, else a tmpfs populated here
     val devPath = "$rootfsPath/dev"
-    if (access(devPath, F_OK) == 0) {
+    if (access(devPath, F_OK) != 0) {
+        if (devTree >= 0) close(devTree)
+    } else if (devTree >= 0 && attachDevTemplate(syscall, devTree, devPath)) {
+        mountDevFilesystems(syscall, devPath)
+    } else {
         if (syscall.mount(
                 source = "tmpfs",
                 target = devPath,
@@ -142,7 +176,7 @@ fun prepareRootfs(
             val containerCgroupPath = getContainerCgroupPath()
             if (containerCgroupPath != null) {
                 val cgroupSourcePath = "/sys/fs/cgroup$containerCgroupPath"
-                Logger.debug("container cgroup source path: $cgroupSourcePath")
+                Logger.debug { "container cgroup source path: $cgroupSourcePath" }
 
                 if (access(cgroupSourcePath, F_OK) != 0) {
                     Logger.warn("container cgroup path does not exist: $cgroupSourcePath")
@@ -155,33 +189,41 @@ fun prepareRootfs(
                     }
 
                     // Bind mount the container's cgroup path to /sys/fs/cgroup so the
-                    // container sees its own cgroup as the root of the hierarchy.
-                    if (syscall.mount(
-                            source = cgroupSourcePath,
-                            target = cgroupMountPath,
-                            fstype = null,
-                            flags = (MS_BIND or MS_REC).toULong(),
-                        ) != 0
-                    ) {
-                        val errNum = errno
-                        perror("bind mount $cgroupSourcePath")
-                        Logger.warn("failed to bind mount container cgroup (errno=$errNum)")
-                    } else {
-                        Logger.debug("bind mounted container cgroup to /sys/fs/cgroup")
-
-                        // Remount as readonly
+                    // container sees its own cgroup as the root of the hierarchy,
+                    // read-only from the moment it appears when the new mount API is there.
+                    val cgroupAttr =
+                        MountAttr(attrSet = MOUNT_ATTR_RDONLY or MOUNT_ATTR_NOSUID or MOUNT_ATTR_NODEV or MOUNT_ATTR_NOEXEC)
+                    val result = bindMountDetached(syscall, cgroupSourcePath, cgroupMountPath, recursive = true, attr = cgroupAttr)
+                    if (result == MountApiResult.DONE) {
+                        Logger.debug("bind mounted container cgroup to /sys/fs/cgroup (readonly)")
+                    } else if (result == MountApiResult.UNSUPPORTED) {
                         if (syscall.mount(
-                                source = null,
+                                source = cgroupSourcePath,
                                 target = cgroupMountPath,
                                 fstype = null,
-                                flags = (MS_BIND or MS_REMOUNT or MS_RDONLY or MS_NOSUID or MS_NODEV or MS_NOEXEC).toULong(),
+                                flags = (MS_BIND or MS_REC).toULong(),
                             ) != 0
                         ) {
                             val errNum = errno
-                            perror("remount /sys/fs/cgroup readonly")
-                            Logger.warn("failed to remount /sys/fs/cgroup readonly (errno=$errNum)")
+                            perror("bind mount $cgroupSourcePath")
+                            Logger.warn("failed to bind mount container cgroup (errno=$errNum)")
                         } else {
-                            Logger.debug("remounted /sys/fs/cgroup as readonly")
+                            Logger.debug("bind mounted container cgroup to /sys/fs/cgroup")
+
+                            // Remount as readonly
+                            if (syscall.mount(
+                                    source = null,
+                                    target = cgroupMountPath,
+                                    fstype = null,
+                                    flags = (MS_BIND or MS_REMOUNT or MS_RDONLY or MS_NOSUID or MS_NODEV or MS_NOEXEC).toULong(),
+                                ) != 0
+                            ) {
+                                val errNum = errno
+                                perror("remount /sys/fs/cgroup readonly")
+                                Logger.warn("failed to remount /sys/fs/cgroup readonly (errno=$errNum)")
+                            } else {
+                                Logger.debug("remounted /sys/fs/cgroup as readonly")
+                            }
                         }
                     }
                 }
@@ -194,6 +236,25 @@ fun prepareRootfs(
     }
 }
 
+/** Attach the /dev template clone [tree] at [devPath] and close it */
+@OptIn(ExperimentalForeignApi::class)
+private fun attachDevTemplate(
+    syscall: Syscall,
+    tree: Int,
+    devPath: String,
+): Boolean {
+    try {
+        if (syscall.moveMount(tree, "", AT_FDCWD_MOUNT, devPath, MOVE_MOUNT_F_EMPTY_PATH) != 0) {
+            Logger.warn("failed to attach /dev template (errno=$errno), populating /dev")
+            return false
+        }
+    } finally {
+        close(tree)
+    }
+    Logger.debug("attached /dev template")
+    return true
+}
+
 /**
  * Create a single device node using bind mount.
  *
@@ -212,7 +273,7 @@ private fun createDeviceNode(
     if (fd == -1) {
         val errNum = errno
         if (errNum == EEXIST) {
-            Logger.debug("file for device $name already exists at $path")
+            Logger.debug { "file for device $name already exists at $path" }
         } else {
             perror("open $name")
             Logger.error("failed to create file for device $name at $path (errno=$errNum)")
@@ -220,7 +281,7 @@ private fun createDeviceNode(
         }
     } else {
         close(fd)
-        Logger.debug("created file for device $name at $path")
+        Logger.debug { "created file for device $name at $path" }
     }
 
     val hostDevPath = "/dev/$name"
@@ -233,14 +294,14 @@ private fun createDeviceNode(
     ) {
         val errNum = errno
         if (errNum == EBUSY) {
-            Logger.debug("device $name already mounted at $path")
+            Logger.debug { "device $name already mounted at $path" }
         } else {
             perror("bind mount $name")
             Logger.error("failed to bind mount $hostDevPath to $path (errno=$errNum)")
             throw Exception("Failed to bind mount device: $name")
         }
     } else {
-        Logger.debug("bind mounted $hostDevPath to $path")
+        Logger.debug { "bind mounted $hostDevPath to $path" }
     }
 }
 
@@ -256,12 +317,12 @@ private fun createDevSymlink(
     if (symlink(target, linkPath) != 0) {
         val errNum = errno
         if (errNum == EEXIST) {
-            Logger.debug("symlink $linkPath -> $target already exists")
+            Logger.debug { "symlink $linkPath -> $target already exists" }
         } else {
             Logger.warn("failed to symlink $linkPath -> $target (errno=$errNum)")
         }
     } else {
-        Logger.debug("created symlink $linkPath -> $target")
+        Logger.debug { "created symlink $linkPath -> $target" }
     }
 }
 
@@ -277,14 +338,24 @@ private fun createDeviceNodes(
     syscall: Syscall,
     devPath: String,
 ) {
-    createDeviceNode(syscall, "$devPath/null", "null")
-    createDeviceNode(syscall, "$devPath/zero", "zero")
-    createDeviceNode(syscall, "$devPath/full", "full")
-    createDeviceNode(syscall, "$devPath/random", "random")
-    createDeviceNode(syscall, "$devPath/urandom", "urandom")
-    createDeviceNode(syscall, "$devPath/tty", "tty")
-    Logger.debug("finished creating device nodes in $devPath")
+    for (d in defaultDevices) createDeviceNode(syscall, "$devPath/${d.name}", d.name)
+    Logger.debug { "finished creating device nodes in $devPath" }
+
+    mountDevFilesystems(syscall, devPath)
+
+    // Default symlinks required by the OCI spec (and used by util-linux, GNU coreutils, ...).
+    for ((name, target) in defaultDevSymlinks) createDevSymlink("$devPath/$name", target)
+}
 
+/**
+ * Mount the per-container filesystems under /dev: a new devpts instance,
+ * /dev/shm and /dev/mqueue
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun mountDevFilesystems(
+    syscall: Syscall,
+    devPath: String,
+) {
     // Mount /dev/pts (devpts) so /dev/ptmx -> pts/ptmx and pseudoterminal allocation work.
     val ptsPath = "$devPath/pts"
     if (access(ptsPath, F_OK) != 0) {
@@ -348,14 +419,6 @@ private fun createDeviceNodes(
     } else {
         Logger.debug("mounted /dev/mqueue")
     }
-
-    // Default symlinks required by the OCI spec (and used by util-linux, GNU coreutils, ...).
-    createDevSymlink("$devPath/stdin", "/proc/self/fd/0")
-    createDevSymlink("$devPath/stdout", "/proc/self/fd/1")
-    createDevSymlink("$devPath/stderr", "/proc/self/fd/2")
-    createDevSymlink("$devPath/fd", "/proc/self/fd")
-    createDevSymlink("$devPath/ptmx", "pts/ptmx")
-    createDevSymlink("$devPath/core", "/proc/kcore")
 }
 
 /**
@@ -366,7 +429,7 @@ fun pivotRoot(
     syscall: Syscall,
     newRoot: String,
 ) {
-    Logger.debug("pivoting root to $newRoot")
+    Logger.debug { "pivoting root to $newRoot" }
 
     // Open newroot directory before pivot_root so we can fchdir back to it after.
     val newrootFd = open(newRoot, O_DIRECTORY or O_RDONLY, 0u)
@@ -513,11 +576,7 @@ fun applyLinuxDevices(
         val perms = (d.fileMode ?: 0x1B6u).toInt() // 0666
         val major = d.major ?: 0L
         val minor = d.minor ?: 0L
-        // Linux gnu_dev_makedev encoding handles the common (major<256, minor<256)
-        // path with the simple (major<<8|minor) layout; full encoding is below.
-        val devNum =
-            (((major and 0xfff) shl 8) or (minor and 0xff) or
-                ((minor and 0xfff00) shl 12) or ((major and 0xfffff000) shl 32)).toULong()
+        val devNum = makeDev(major, minor)
 
         // Ensure parent directory exists. For /dev/test1, parent is /dev (already mounted).
         val parent = d.path.substringBeforeLast('/', missingDelimiterValue = "")
@@ -557,7 +616,7 @@ fun applyLinuxDevices(
                 Logger.warn("chown ${d.path} (uid=${d.uid}, gid=${d.gid}) failed (errno=$errno)")
             }
         }
-        Logger.debug("created device ${d.path} (type=${d.type}, major=$major, minor=$minor, perms=${perms.toString(8)})")
+        Logger.debug { "created device ${d.path} (type=${d.type}, major=$major, minor=$minor, perms=${perms.toString(8)})" }
     }
 }
 
@@ -585,7 +644,7 @@ fun applyRootfsPropagation(
                 return
             }
         }
-    Logger.debug("setting rootfs propagation to $label (post-pivot)")
+    Logger.debug { "setting rootfs propagation to $label (post-pivot)" }
     if (syscall.mount(
             source = null,
             target = "/",
@@ -609,7 +668,7 @@ fun applyMaskedPaths(
     if (paths.isNullOrEmpty()) return
     for (path in paths) {
         if (access(path, F_OK) != 0) {
-            Logger.debug("masked path $path does not exist, skipping")
+            Logger.debug { "masked path $path does not exist, skipping" }
             continue
         }
         memScoped {
@@ -639,7 +698,7 @@ fun applyMaskedPaths(
             if (rc != 0) {
                 Logger.warn("failed to mask path $path (errno=$errno)")
             } else {
-                Logger.debug("masked path $path (dir=$isDir)")
+                Logger.debug { "masked path $path (dir=$isDir)" }
             }
         }
     }
@@ -648,6 +707,11 @@ fun applyMaskedPaths(
 /**
  * Remount a list of paths as read-only by bind-remounting them with MS_RDONLY.
  * Used to implement spec.linux.readonlyPaths.
+ *
+ * With the new mount API each path is cloned recursively, made read-only
+ * with one mount_setattr(AT_RECURSIVE) while detached and attached over
+ * itself, so submounts become read-only too and the path is never writable
+ * in between.
  */
 @OptIn(ExperimentalForeignApi::class)
 fun applyReadonlyPaths(
@@ -657,9 +721,19 @@ fun applyReadonlyPaths(
     if (paths.isNullOrEmpty()) return
     for (path in paths) {
         if (access(path, F_OK) != 0) {
-            Logger.debug("readonly path $path does not exist, skipping")
+            Logger.debug { "readonly path $path does not exist, skipping" }
             continue
         }
+        val attr = MountAttr(attrSet = MOUNT_ATTR_RDONLY)
+        when (bindMountDetached(syscall, path, path, recursive = true, attr = attr, recursiveAttrs = true)) {
+            MountApiResult.DONE -> {
+                Logger.debug { "remounted $path as readonly" }
+                continue
+            }
+
+            MountApiResult.FAILED -> continue
+            MountApiResult.UNSUPPORTED -> {}
+        }
         // Bind the path to itself first so MS_REMOUNT below operates on a mount we own,
         // not on whatever filesystem the path happens to live in.
         if (syscall.mount(
@@ -681,7 +755,7 @@ fun applyReadonlyPaths(
         ) {
             Logger.warn("failed to remount $path as readonly (errno=$errno)")
         } else {
-            Logger.debug("remounted $path as readonly")
+            Logger.debug { "remounted $path as readonly" }
         }
     }
 }
@@ -704,7 +778,7 @@ fun applySysctls(sysctls: Map<String, String>?) {
             if (fputs(value, fd) < 0) {
                 Logger.warn("failed to write sysctl $key=$value to $sysctlPath (errno=$errno)")
             } else {
-                Logger.debug("set sysctl $key=$value")
+                Logger.debug { "set sysctl $key=$value" }
             }
         } finally {
             fclose(fd)
@@ -718,30 +792,49 @@ fun applySysctls(sysctls: Map<String, String>?) {
  * - data: kept for fs-specific options like "size=64k" passed via mount() data
  * - propagationFlag: applied with a SECOND mount() call (the kernel only honours
  *   propagation flags when used alone)
+ * - cleared: flags explicitly negated ("rw", "suid", ...), which mount_setattr
+ *   has to clear rather than just not set
  */
-private data class ParsedMountOptions(
+internal data class ParsedMountOptions(
     val flags: ULong,
     val propagation: ULong,
     val data: String?,
+    val cleared: ULong = 0uL,
 )
 
-private fun parseMountOptions(options: List<String>?): ParsedMountOptions {
+internal fun parseMountOptions(options: List<String>?): ParsedMountOptions {
     if (options.isNullOrEmpty()) return ParsedMountOptions(0uL, 0uL, null)
     var flags = 0uL
     var propagation = 0uL
+    var cleared = 0uL
     val dataParts = mutableListOf<String>()
     for (opt in options) {
         when (opt) {
             "ro" -> flags = flags or MS_RDONLY.toULong()
-            "rw" -> flags = flags and MS_RDONLY.toULong().inv()
+            "rw" -> {
+                flags = flags and MS_RDONLY.toULong().inv()
+                cleared = cleared or MS_RDONLY.toULong()
+            }
             "nosuid" -> flags = flags or MS_NOSUID.toULong()
-            "suid" -> flags = flags and MS_NOSUID.toULong().inv()
+            "suid" -> {
+                flags = flags and MS_NOSUID.toULong().inv()
+                cleared = cleared or MS_NOSUID.toULong()
+            }
             "nodev" -> flags = flags or MS_NODEV.toULong()
-            "dev" -> flags = flags and MS_NODEV.toULong().inv()
+            "dev" -> {
+                flags = flags and MS_NODEV.toULong().inv()
+                cleared = cleared or MS_NODEV.toULong()
+            }
             "noexec" -> flags = flags or MS_NOEXEC.toULong()
-            "exec" -> flags = flags and MS_NOEXEC.toULong().inv()
+            "exec" -> {
+                flags = flags and MS_NOEXEC.toULong().inv()
+                cleared = cleared or MS_NOEXEC.toULong()
+            }
             "noatime" -> flags = flags or MS_NOATIME.toULong()
-            "atime" -> flags = flags and MS_NOATIME.toULong().inv()
+            "atime" -> {
+                flags = flags and MS_NOATIME.toULong().inv()
+                cleared = cleared or MS_NOATIME.toULong()
+            }
             "nodiratime" -> flags = flags or MS_NODIRATIME.toULong()
             "relatime" -> flags = flags or MS_RELATIME.toULong()
             "strictatime" -> flags = flags or MS_STRICTATIME.toULong()
@@ -757,11 +850,13 @@ private fun parseMountOptions(options: List<String>?): ParsedMountOptions {
             "unbindable" -> propagation = propagation or MS_UNBINDABLE.toULong()
             "runbindable" -> propagation = propagation or MS_UNBINDABLE.toULong() or MS_REC.toULong()
             "defaults" -> { /* no-op */ }
+            // Handled by idmapTargets: the tree arrives already idmapped
+            "idmap", "ridmap" -> {}
             else -> dataParts.add(opt)
         }
     }
     val data = if (dataParts.isEmpty()) null else dataParts.joinToString(",")
-    return ParsedMountOptions(flags, propagation, data)
+    return ParsedMountOptions(flags, propagation, data, cleared and flags.inv())
 }
 
 /**
@@ -777,7 +872,7 @@ private fun mkdirP(path: String) {
     if (parent.isNotEmpty()) mkdirP(parent)
     if (access(path, F_OK) == 0) return
     if (mkdir(path, 0x1EDu) != 0 && errno != EEXIST) {
-        Logger.debug("mkdir $path failed (errno=$errno)")
+        Logger.debug { "mkdir $path failed (errno=$errno)" }
     }
 }
 
@@ -787,77 +882,119 @@ private fun mkdirP(path: String) {
  * but processes everything else (user bind mounts, /dev/pts, /dev/shm, /dev/mqueue,
  * /sys/fs/cgroup with their spec-defined options).
  *
- * Called after pivot_root, while the process is still root with CAP_SYS_ADMIN.
+ * Mounts are ordered by [planMounts] so parents are mounted before their
+ * children. Bind mounts use [bindMountDetached], which applies flags and
+ * propagation before the mount is attached; other filesystems, and bind
+ * mounts on kernels without the new mount API, go through mount(2).
+ *
+ * Called before pivot_root, while the process is still root with CAP_SYS_ADMIN.
+ *
+ * @param idmappedTrees Idmapped trees sent by main, keyed by spec.mounts index
  */
 @OptIn(ExperimentalForeignApi::class)
 fun applySpecMounts(
     syscall: Syscall,
     mounts: List<spec.Mount>?,
     rootfsPath: String,
+    idmappedTrees: Map<Int, Int> = emptyMap(),
 ) {
     if (mounts.isNullOrEmpty()) return
-    // prepareRootfs() already establishes these defaults; skip to avoid double-mount.
-    val handledByPrepareRootfs = setOf("/proc", "/dev", "/sys", "/sys/fs/cgroup")
-    for (m in mounts) {
-        if (m.destination in handledByPrepareRootfs) {
-            Logger.debug("skipping spec.mount ${m.destination} (already handled by prepareRootfs)")
-            continue
-        }
-        val parsed = parseMountOptions(m.options)
-        val fsType = m.type
-        // Choose source: for bind mounts the source must exist on the host; for fs
-        // mounts the value is mainly a label (e.g. "shm").
-        val source = m.source ?: fsType
+    for (m in planMounts(mounts)) {
         // The target is relative to the future container root; the actual filesystem
         // path before pivot_root is rootfsPath + destination.
         val target = rootfsPath + m.destination
         mkdirP(target)
-        val rc =
-            syscall.mount(
-                source = source,
-                target = target,
-                fstype = if ((parsed.flags and MS_BIND.toULong()) != 0uL) null else fsType,
-                flags = parsed.flags,
-                data = parsed.data,
-            )
-        if (rc != 0) {
-            if (errno == EBUSY) {
-                Logger.debug("spec.mount ${m.destination}: already mounted, skipping")
-            } else {
-                Logger.warn("failed to mount ${m.destination} (type=$fsType, errno=$errno)")
-            }
+        val recursivePropagation = (m.options.propagation and MS_REC.toULong()) != 0uL
+        val idmappedTree = idmappedTrees[m.specIndex]
+        if (idmappedTree != null) {
+            val propagation = m.options.propagation and MS_REC.toULong().inv()
+            attachIdmappedTree(syscall, idmappedTree, target, propagation, recursivePropagation)
             continue
         }
-        Logger.debug("mounted ${m.destination} (type=$fsType, flags=${parsed.flags})")
+        if (m.isBind && m.source != null) {
+            val result =
+                bindMountDetached(
+                    syscall,
+                    m.source,
+                    target,
+                    m.isRecursive,
+                    mountAttrOf(m.options),
+                    recursivePropagation = recursivePropagation,
+                )
+            when (result) {
+                MountApiResult.DONE -> {
+                    Logger.debug { "mounted ${m.destination} (bind, flags=${m.options.flags})" }
+                    continue
+                }
 
-        // Bind-remount once more with the requested flags. The kernel ignores flag
-        // bits other than MS_BIND/MS_REC on the initial bind mount; MS_RDONLY etc.
-        // only take effect via a subsequent MS_REMOUNT.
-        if ((parsed.flags and MS_BIND.toULong()) != 0uL && parsed.flags != MS_BIND.toULong() && parsed.flags != (MS_BIND or MS_REC).toULong()) {
-            val remountFlags = parsed.flags or MS_REMOUNT.toULong()
-            if (syscall.mount(
-                    source = source,
-                    target = target,
-                    fstype = null,
-                    flags = remountFlags,
-                    data = parsed.data,
-                ) != 0
-            ) {
-                Logger.warn("bind-remount of ${m.destination} failed (errno=$errno)")
+                MountApiResult.FAILED -> continue
+                MountApiResult.UNSUPPORTED -> {}
             }
         }
+        legacyMount(syscall, m, target)
+    }
+}
 
-        // Apply propagation flag in a separate mount() call (kernel requirement).
-        if (parsed.propagation != 0uL) {
-            if (syscall.mount(
-                    source = null,
-                    target = target,
-                    fstype = null,
-                    flags = parsed.propagation,
-                ) != 0
-            ) {
-                Logger.warn("failed to set propagation on ${m.destination} (errno=$errno)")
-            }
+/**
+ * mount(2) path of [applySpecMounts]: mount, then a bind-remount for the
+ * flags and a separate call for propagation
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun legacyMount(
+    syscall: Syscall,
+    m: PlannedMount,
+    target: String,
+) {
+    val parsed = m.options
+    val fsType = m.fsType
+    // Choose source: for bind mounts the source must exist on the host; for fs
+    // mounts the value is mainly a label (e.g. "shm").
+    val source = m.source
+    val rc =
+        syscall.mount(
+            source = source,
+            target = target,
+            fstype = if (m.isBind) null else fsType,
+            flags = parsed.flags,
+            data = parsed.data,
+        )
+    if (rc != 0) {
+        if (errno == EBUSY) {
+            Logger.debug { "spec.mount ${m.destination}: already mounted, skipping" }
+        } else {
+            Logger.warn("failed to mount ${m.destination} (type=$fsType, errno=$errno)")
+        }
+        return
+    }
+    Logger.debug { "mounted ${m.destination} (type=$fsType, flags=${parsed.flags})" }
+
+    // Bind-remount once more with the requested flags. The kernel ignores flag
+    // bits other than MS_BIND/MS_REC on the initial bind mount; MS_RDONLY etc.
+    // only take effect via a subsequent MS_REMOUNT.
+    if (m.isBind && parsed.flags != MS_BIND.toULong() && parsed.flags != (MS_BIND or MS_REC).toULong()) {
+        val remountFlags = parsed.flags or MS_REMOUNT.toULong()
+        if (syscall.mount(
+                source = source,
+                target = target,
+                fstype = null,
+                flags = remountFlags,
+                data = parsed.data,
+            ) != 0
+        ) {
+            Logger.warn("bind-remount of ${m.destination} failed (errno=$errno)")
+        }
+    }
+
+    // Apply propagation flag in a separate mount() call (kernel requirement).
+    if (parsed.propagation != 0uL) {
+        if (syscall.mount(
+                source = null,
+                target = target,
+                fstype = null,
+                flags = parsed.propagation,
+            ) != 0
+        ) {
+            Logger.warn("failed to set propagation on ${m.destination} (errno=$errno)")
         }
     }
 }
@@ -885,7 +1022,7 @@ fun getContainerCgroupPath(): String? {
                 if (line.startsWith("0::")) {
                     val cgroupPath = line.substring(3)
                     if (cgroupPath.isNotEmpty()) {
-                        Logger.debug("found container cgroup path: $cgroupPath")
+                        Logger.debug { "found container cgroup path: $cgroupPath" }
                         return cgroupPath
                     }
                 }
@@ -0,0 +1,195 @@
+package seccomp
+
+import kotlinx.cinterop.*
+import libseccomp.*
+import logger.Logger
+import platform.posix.*
+import spec.LinuxSeccomp
+import utils.JsonCodec
+import utils.fnv1a64Hex
+import utils.plusU32
+import utils.readAll
+import utils.readFileBytes
+import utils.u32At
+import utils.writeAll
+
+/**
+ * Content-addressed cache of compiled seccomp BPF programs
+ *
+ * Building a libseccomp context for a profile with hundreds of rules costs
+ * milliseconds of CPU, and almost every container uses the same profile. The
+ * main process therefore compiles the profile once, exports the BPF program
+ * with seccomp_export_bpf() and stores it under
+ * `<root>/.seccomp-cache/<hash>.bpf`; later creates read it back, and the init
+ * process installs it directly with seccomp(SECCOMP_SET_MODE_FILTER).
+ *
+ * The key is the normalized profile (re-encoded JSON, so formatting in
+ * config.json does not matter) plus everything else that changes the
+ * generated program: the filter builder's version, libseccomp version, its
+ * API level and the machine. The full key is stored in the entry and
+ * compared on every hit, so a hash collision degrades to a miss.
+ *
+ * Profiles using SCMP_ACT_NOTIFY are never cached: the listener fd comes from
+ * the libseccomp context at load time, so init builds those itself.
+ *
+ * Entry layout: "KBPF", u32 key length (little-endian), key bytes, BPF program.
+ */
+const val SECCOMP_CACHE_DIR = ".seccomp-cache"
+
+private val CACHE_MAGIC = byteArrayOf(0x4b, 0x42, 0x50, 0x46) // "KBPF"
+
+/**
+ * Bumped whenever [buildSeccompFilter] changes the program it generates for
+ * the same profile, so stale entries are not reused
+ */
+private const val COMPILER_VERSION = 2
+
+/**
+ * Cache key for [seccomp] compiled under [environment]
+ */
+fun seccompCacheKey(
+    seccomp: LinuxSeccomp,
+    environment: String,
+): String = "$environment\n${JsonCodec.encode(seccomp)}"
+
+/**
+ * Cache file name for [key]: 64-bit FNV-1a of the key in hex
+ */
+fun seccompCacheFileName(key: String): String = fnv1a64Hex(key) + ".bpf"
+
+/**
+ * Serialize a cache entry
+ */
+fun encodeSeccompCacheEntry(
+    key: String,
+    bpf: ByteArray,
+): ByteArray {
+    val keyBytes = key.encodeToByteArray()
+    return CACHE_MAGIC.plusU32(keyBytes.size) + keyBytes + bpf
+}
+
+/**
+ * Extract the BPF program from a cache entry
+ *
+ * @return The program, or null if the entry is malformed or was written for
+ *   a different key
+ */
+fun decodeSeccompCacheEntry(
+    entry: ByteArray,
+    key: String,
+): ByteArray? {
+    if (entry.size < 8 || !entry.copyOfRange(0, 4).contentEquals(CACHE_MAGIC)) return null
+    val keyLen = entry.u32At(4)
+    if (keyLen < 0 || 8 + keyLen > entry.size) return null
+    if (!entry.copyOfRange(8, 8 + keyLen).contentEquals(key.encodeToByteArray())) return null
+    val bpf = entry.copyOfRange(8 + keyLen, entry.size)
+    // Programs are arrays of 8-byte struct sock_filter
+    if (bpf.isEmpty() || bpf.size % 8 != 0) return null
+    return bpf
+}
+
+/**
+ * Describe the host properties that affect the generated BPF
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun seccompEnvironment(): String =
+    memScoped {
+        val version = seccomp_version()?.pointed
+        val uts = alloc<utsname>()
+        val machine = if (uname(uts.ptr) == 0) uts.machine.toKString() else "unknown"
+        "compiler=$COMPILER_VERSION libseccomp=${version?.major}.${version?.minor}.${version?.micro} " +
+            "api=${seccomp_api_get()} machine=$machine"
+    }
+
+/**
+ * Get the compiled BPF program for [seccomp], from the cache or by compiling it
+ *
+ * Runs in the main process. Any failure is logged and reported as null, in
+ * which case init builds and loads the filter with libseccomp as before (and
+ * reports real profile errors from there).
+ *
+ * @param rootPath Runtime root; the cache lives in `<root>/.seccomp-cache`
+ * @return The BPF program, or null if the profile cannot be pre-compiled
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun compileSeccompBpf(
+    seccomp: LinuxSeccomp,
+    rootPath: String,
+): ByteArray? {
+    if (seccomp.defaultAction == "SCMP_ACT_NOTIFY" || hasNotifyAction(seccomp)) {
+        Logger.debug("seccomp profile uses SCMP_ACT_NOTIFY, not pre-compiling")
+        return null
+    }
+
+    return try {
+        val key = seccompCacheKey(seccomp, seccompEnvironment())
+        val cacheDir = "$rootPath/$SECCOMP_CACHE_DIR"
+        val path = "$cacheDir/${seccompCacheFileName(key)}"
+
+        readFileBytes(path)?.let { entry ->
+            decodeSeccompCacheEntry(entry, key)?.let { bpf ->
+                Logger.debug { "seccomp cache hit: $path (${bpf.size / 8} BPF instructions)" }
+                return bpf
+            }
+            Logger.debug { "seccomp cache entry $path does not match, recompiling" }
+        }
+
+        Logger.debug("seccomp cache miss, compiling profile")
+        compileAndStore(seccomp, key, cacheDir, path)
+    } catch (e: Exception) {
+        Logger.warn("failed to pre-compile seccomp profile: ${e.message ?: "unknown"}")
+        null
+    }
+}
+
+/**
+ * Build the filter, export its BPF program into a new cache entry and return
+ * the program
+ *
+ * seccomp_export_bpf() only writes to an fd, so the program is exported
+ * straight into a temporary file in [cacheDir] after the entry header and
+ * read back from there. The file is then renamed into place, so concurrent
+ * creates never see a partial entry.
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun compileAndStore(
+    seccomp: LinuxSeccomp,
+    key: String,
+    cacheDir: String,
+    path: String,
+): ByteArray {
+    mkdir(cacheDir, 0x1C0u) // 0x1C0 = 0o700
+    val tmpPath = "$path.tmp.${getpid()}"
+    val fd = open(tmpPath, O_RDWR or O_CREAT or O_TRUNC or O_CLOEXEC, 0x180u) // 0x180 = 0o600
+    if (fd < 0) throw Exception("Failed to create $tmpPath: errno=$errno")
+
+    val bpf =
+        try {
+            val header = encodeSeccompCacheEntry(key, ByteArray(0))
+            writeAll(fd, header)
+            val ctx = buildSeccompFilter(seccomp)
+            try {
+                val rc = seccomp_export_bpf(ctx, fd)
+                if (rc < 0) throw Exception("seccomp_export_bpf failed: errno=${-rc}")
+            } finally {
+                seccomp_release(ctx)
+            }
+            val end = lseek(fd, 0L, SEEK_CUR)
+            readAll(fd, end - header.size, offset = header.size.toLong())
+        } catch (e: Exception) {
+            close(fd)
+            unlink(tmpPath)
+            throw e
+        }
+    close(fd)
+    Logger.debug { "compiled seccomp filter: ${bpf.size / 8} BPF instructions" }
+
+    if (rename(tmpPath, path) != 0) {
+        // The program is still good; only the cache write failed
+        Logger.warn("failed to store seccomp cache entry $path (errno=$errno)")
+        unlink(tmpPath)
+    } else {
+        Logger.debug { "stored seccomp cache entry $path" }
+    }
+    return bpf
+}
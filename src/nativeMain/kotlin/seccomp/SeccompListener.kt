@@ -33,7 +33,7 @@ fun sendToSeccompListener(
     state: State,
     notifyFd: Int,
 ) {
-    Logger.debug("sending seccomp notify FD to listener: $listenerPath")
+    Logger.debug { "sending seccomp notify FD to listener: $listenerPath" }
 
     // Create Unix socket
     val sock = socket(AF_UNIX, SOCK_STREAM, 0)
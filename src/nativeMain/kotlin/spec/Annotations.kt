@@ -0,0 +1,69 @@
+package spec
+
+/*
+ * Annotations (spec.annotations) that switch on runtime-specific behaviour.
+ * Values are compared as strings; "true" enables a flag.
+ */
+
+/** Prefix of every annotation the runtime interprets */
+const val RUNTIME_ANNOTATION_PREFIX = "org.kontainer."
+
+/**
+ * "true": with a user namespace, bind the rootfs as an idmapped mount using
+ * the container's uid/gid mappings, so an image owned by host root can be
+ * shared by containers with different ID ranges without chown-ing it
+ */
+const val ANNOTATION_ROOTFS_IDMAP = "org.kontainer.rootfs.idmap"
+
+/**
+ * Colon-separated overlayfs lower layers for the rootfs, uppermost first
+ * (the lowerdir= order). When set, the init mounts overlayfs on
+ * spec.root.path itself, inside the container's mount namespace. Relative
+ * paths are resolved against the bundle, like spec.root.path.
+ */
+const val ANNOTATION_OVERLAY_LOWER = "org.kontainer.rootfs.overlay.lower"
+
+/** Overlay upper directory; without it the overlay is read-only */
+const val ANNOTATION_OVERLAY_UPPER = "org.kontainer.rootfs.overlay.upper"
+
+/** Overlay work directory, required with an upper directory */
+const val ANNOTATION_OVERLAY_WORK = "org.kontainer.rootfs.overlay.work"
+
+/**
+ * Extra comma-separated overlayfs options, e.g. "volatile,index=off" for
+ * ephemeral containers
+ */
+const val ANNOTATION_OVERLAY_OPTIONS = "org.kontainer.rootfs.overlay.options"
+
+/**
+ * When "true", /dev is a read-only clone of a tmpfs with the default device
+ * nodes, built once per runtime root, instead of a tmpfs populated for each
+ * container. Ignored for specs with linux.devices or their own /dev mount.
+ */
+const val ANNOTATION_DEV_TEMPLATE = "org.kontainer.dev.template"
+
+/**
+ * When "true", the hooks of one hook point (prestart, createRuntime, ...)
+ * run concurrently instead of one after the other; the point fails if any
+ * of them fails. Only for hooks that do not depend on each other.
+ */
+const val ANNOTATION_HOOKS_PARALLEL = "org.kontainer.hooks.parallel"
+
+/**
+ * When "true", the init waits for `start` in a freestanding C waiter it
+ * execs instead of in the Kotlin runtime, so an idle created container is
+ * charged a few pages instead of the runtime's heap. Ignored when the init
+ * must still run Kotlin code after the start signal (see
+ * process.canParkInit).
+ */
+const val ANNOTATION_INIT_PARK = "org.kontainer.init.park"
+
+/**
+ * When "true" and the spec sets neither linux.resources.cpu.cpus nor mems,
+ * create pins the container to the NUMA node used by the fewest sibling
+ * cgroups (see cgroup.autoPinCpuset). Ignored on single-node hosts.
+ */
+const val ANNOTATION_CPUSET_AUTOPIN = "org.kontainer.cpuset.autopin"
+
+/** Whether annotation [key] of this spec is set to "true" */
+fun Spec.annotationEnabled(key: String): Boolean = annotations?.get(key) == "true"
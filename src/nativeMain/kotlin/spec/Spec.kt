@@ -56,6 +56,9 @@ data class Hooks(
 /**
  * Mount entry from the OCI runtime-spec `mounts[]` array.
  * https://github.com/opencontainers/runtime-spec/blob/main/config.md#mounts
+ *
+ * [uidMappings]/[gidMappings] make a bind mount idmapped (also requested by
+ * the "idmap"/"ridmap" options, which default to the container's mappings).
  */
 @Serializable
 data class Mount(
@@ -63,6 +66,8 @@ data class Mount(
     val type: String? = null,
     val source: String? = null,
     val options: List<String>? = null,
+    val uidMappings: List<LinuxIdMapping>? = null,
+    val gidMappings: List<LinuxIdMapping>? = null,
 )
 
 @Serializable
@@ -150,6 +155,9 @@ data class LinuxCpu(
     val shares: Long? = null,
     val quota: Long? = null,
     val period: Long? = null,
+    // cpuset list format, e.g. "0-3,8"
+    val cpus: String? = null,
+    val mems: String? = null,
 )
 
 @Serializable
@@ -172,6 +180,9 @@ data class LinuxResources(
     val hugepageLimits: List<LinuxHugepageLimit>? = null,
     val memory: LinuxMemory? = null,
     val cpu: LinuxCpu? = null,
+    // cgroup v2 interface files by name, e.g. "memory.high" to "1G"; applied
+    // after the typed fields, so they win where both set a file
+    val unified: Map<String, String>? = null,
 )
 
 /**
@@ -266,6 +277,8 @@ data class LinuxDevice(
 
 /**
  * Load OCI spec from config.json file
+ *
+ * Commands with a runtime root load through [loadSpecCached] instead.
  */
 @OptIn(ExperimentalForeignApi::class)
 fun loadSpec(
@@ -274,7 +287,16 @@ fun loadSpec(
 ): Spec {
     // Read and parse JSON file
     val spec = JsonCodec.loadFromFile<Spec>(fs, configPath)
+    validateSpec(spec)
+    return spec
+}
 
+/**
+ * Reject specs the runtime must not run
+ *
+ * @throws Exception naming the invalid field
+ */
+fun validateSpec(spec: Spec) {
     // process.args may legitimately be empty: the spec allows omitting
     // spec.process entirely, in which case create/start should still succeed
     // (the container infrastructure is set up but the init process exec's
@@ -289,6 +311,4 @@ fun loadSpec(
     if (!versionRegex.matches(spec.ociVersion)) {
         throw Exception("Spec validation failed: ociVersion '${spec.ociVersion}' is not a valid semver")
     }
-
-    return spec
 }
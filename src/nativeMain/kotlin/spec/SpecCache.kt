@@ -0,0 +1,252 @@
+package spec
+
+import kotlinx.cinterop.*
+import kotlinx.serialization.Serializable
+import logger.Logger
+import platform.posix.*
+import utils.CborCodec
+import utils.JsonCodec
+import utils.fnv1a64Hex
+import utils.plusU32
+import utils.readAll
+import utils.readFileBytes
+import utils.u32At
+import utils.writeFileBytesAtomic
+
+/**
+ * Cache of parsed and validated specs, one entry per bundle
+ *
+ * A large config.json costs a full JSON parse in every command that reads
+ * it. The first command to load a bundle's spec (normally create) stores it
+ * as CBOR under `<root>/.spec-cache/<hash>.spec`; later loads of the same
+ * config.json decode the binary form instead, and start/delete decode only
+ * the hooks (see [loadSpecHooks]).
+ *
+ * The file name hashes the config path alone, so each bundle has one entry
+ * that is replaced when config.json changes. The key stored in the entry
+ * identifies the file's version: device, inode, size, mtime and ctime of
+ * config.json, plus [FORMAT_VERSION]. It is compared in full on every hit,
+ * so an edited, replaced or touched config.json (or a hash collision) is a
+ * miss.
+ *
+ * Only specs that passed [validateSpec] are stored, so a hit skips
+ * validation as well.
+ *
+ * Entry layout: "KSPC", u32 key length, key bytes, u32 hooks length, the
+ * hooks as CBOR ([SpecHooks]), the whole spec as CBOR. Lengths are
+ * little-endian.
+ */
+const val SPEC_CACHE_DIR = ".spec-cache"
+
+private val CACHE_MAGIC = byteArrayOf(0x4b, 0x53, 0x50, 0x43) // "KSPC"
+
+/**
+ * Bumped whenever the serialized form of [Spec] changes incompatibly, so
+ * entries written by an older runtime are not decoded as the new classes
+ */
+private const val FORMAT_VERSION = 1
+
+/**
+ * The part of a spec that start and delete need
+ *
+ * Decoding config.json into this skips every other field without building
+ * it; the cache stores it as its own section so a hit skips the rest of the
+ * entry too.
+ */
+@Serializable
+data class SpecHooks(
+    val hooks: Hooks? = null,
+)
+
+/**
+ * Cache key for one version of the config.json at [configPath]
+ *
+ * Times are in nanoseconds. ctime is included because mtime can be set
+ * back by a client (touch -d, tar extraction).
+ */
+fun specCacheKey(
+    configPath: String,
+    device: ULong,
+    inode: ULong,
+    size: Long,
+    mtimeNs: Long,
+    ctimeNs: Long,
+): String = "format=$FORMAT_VERSION path=$configPath dev=$device ino=$inode size=$size mtime=$mtimeNs ctime=$ctimeNs"
+
+/**
+ * Cache file name for the bundle whose config.json is [configPath]
+ */
+fun specCacheFileName(configPath: String): String = fnv1a64Hex(configPath) + ".spec"
+
+/**
+ * Serialize a cache entry for [spec]
+ */
+fun encodeSpecCacheEntry(
+    key: String,
+    spec: Spec,
+): ByteArray {
+    val keyBytes = key.encodeToByteArray()
+    val hooks = CborCodec.encode(SpecHooks(spec.hooks))
+    return CACHE_MAGIC.plusU32(keyBytes.size) + keyBytes + ByteArray(0).plusU32(hooks.size) + hooks +
+        CborCodec.encode(spec)
+}
+
+/**
+ * Decode the whole spec from a cache entry
+ *
+ * @return The spec, or null if the entry is malformed or was written for a
+ *   different key
+ */
+fun decodeSpecCacheEntry(
+    entry: ByteArray,
+    key: String,
+): Spec? {
+    val hooksStart = hooksSectionStart(entry, key)
+    if (hooksStart < 0) return null
+    val specStart = hooksStart + entry.u32At(hooksStart - 4)
+    return runCatching { CborCodec.decode<Spec>(entry.copyOfRange(specStart, entry.size)) }.getOrNull()
+}
+
+/**
+ * Decode only the hooks section of a cache entry
+ *
+ * @return The hooks, or null if the entry is malformed or was written for a
+ *   different key
+ */
+fun decodeSpecCacheHooks(
+    entry: ByteArray,
+    key: String,
+): SpecHooks? {
+    val hooksStart = hooksSectionStart(entry, key)
+    if (hooksStart < 0) return null
+    val hooksEnd = hooksStart + entry.u32At(hooksStart - 4)
+    return runCatching { CborCodec.decode<SpecHooks>(entry.copyOfRange(hooksStart, hooksEnd)) }.getOrNull()
+}
+
+/**
+ * Offset of the hooks section, after checking the magic, the key and that
+ * both sections are present; -1 if any check fails
+ */
+private fun hooksSectionStart(
+    entry: ByteArray,
+    key: String,
+): Int {
+    if (entry.size < 8 || !entry.copyOfRange(0, 4).contentEquals(CACHE_MAGIC)) return -1
+    val keyLen = entry.u32At(4)
+    if (keyLen < 0 || 12 + keyLen > entry.size) return -1
+    if (!entry.copyOfRange(8, 8 + keyLen).contentEquals(key.encodeToByteArray())) return -1
+    val hooksStart = 12 + keyLen
+    val hooksLen = entry.u32At(hooksStart - 4)
+    // The spec section is never empty: root is a required field
+    if (hooksLen < 0 || hooksStart + hooksLen >= entry.size) return -1
+    return hooksStart
+}
+
+/**
+ * Load the spec from [configPath] through the spec cache
+ *
+ * On a miss config.json is parsed and validated as [loadSpec] does, and the
+ * result is stored. Failing to store it is only logged.
+ *
+ * @param rootPath Runtime root; the cache lives in `<root>/.spec-cache`
+ * @param configPath Absolute path of the bundle's config.json
+ * @throws Exception if config.json cannot be read, parsed or validated
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun loadSpecCached(
+    rootPath: String,
+    configPath: String,
+): Spec =
+    withConfig(rootPath, configPath) { fd, size, key, entryPath ->
+        readFileBytes(entryPath)?.let { entry ->
+            decodeSpecCacheEntry(entry, key)?.let {
+                Logger.debug { "spec cache hit: $entryPath" }
+                return@withConfig it
+            }
+        }
+
+        Logger.debug { "spec cache miss for $configPath" }
+        val spec = JsonCodec.decode<Spec>(readAll(fd, size, offset = 0).decodeToString())
+        validateSpec(spec)
+        try {
+            mkdir("$rootPath/$SPEC_CACHE_DIR", 0x1C0u) // 0x1C0 = 0o700
+            writeFileBytesAtomic(entryPath, encodeSpecCacheEntry(key, spec))
+            Logger.debug { "stored spec cache entry $entryPath" }
+        } catch (e: Exception) {
+            Logger.warn("failed to store spec cache entry $entryPath: ${e.message ?: "unknown"}")
+        }
+        spec
+    }
+
+/**
+ * Load only the hooks of the spec at [configPath]
+ *
+ * A hit decodes the entry's hooks section; a miss decodes config.json into
+ * [SpecHooks], skipping the other fields. Nothing is stored on a miss, since
+ * the rest of the spec was never validated.
+ *
+ * @param rootPath Runtime root; the cache lives in `<root>/.spec-cache`
+ * @param configPath Absolute path of the bundle's config.json
+ * @return The spec's hooks, null if it has none
+ * @throws Exception if config.json cannot be read or parsed
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun loadSpecHooks(
+    rootPath: String,
+    configPath: String,
+): Hooks? =
+    withConfig(rootPath, configPath) { fd, size, key, entryPath ->
+        readFileBytes(entryPath)?.let { entry ->
+            decodeSpecCacheHooks(entry, key)?.let {
+                Logger.debug { "spec cache hit (hooks): $entryPath" }
+                return@withConfig it.hooks
+            }
+        }
+
+        Logger.debug { "spec cache miss for $configPath, decoding hooks only" }
+        JsonCodec.decode<SpecHooks>(readAll(fd, size, offset = 0).decodeToString()).hooks
+    }
+
+/**
+ * Drop the cache entry of the bundle whose config.json is [configPath], if any
+ */
+fun removeSpecCacheEntry(
+    rootPath: String,
+    configPath: String,
+) {
+    unlink("$rootPath/$SPEC_CACHE_DIR/${specCacheFileName(configPath)}")
+}
+
+/**
+ * Open and fstat config.json and run [block] with its fd, size, cache key
+ * and cache entry path
+ *
+ * The key comes from the open file, and a miss parses that same file, so a
+ * config.json replaced in between is never stored under the old key.
+ */
+@OptIn(ExperimentalForeignApi::class)
+private inline fun <T> withConfig(
+    rootPath: String,
+    configPath: String,
+    block: (fd: Int, size: Long, key: String, entryPath: String) -> T,
+): T =
+    memScoped {
+        val fd = open(configPath, O_RDONLY or O_CLOEXEC)
+        if (fd < 0) throw Exception("Failed to open $configPath (errno=$errno)")
+        try {
+            val st = alloc<stat>()
+            if (fstat(fd, st.ptr) != 0) throw Exception("Failed to stat $configPath (errno=$errno)")
+            val key =
+                specCacheKey(
+                    configPath,
+                    st.st_dev,
+                    st.st_ino,
+                    st.st_size,
+                    st.st_mtim.tv_sec * 1_000_000_000L + st.st_mtim.tv_nsec,
+                    st.st_ctim.tv_sec * 1_000_000_000L + st.st_ctim.tv_nsec,
+                )
+            block(fd, st.st_size, key, "$rootPath/$SPEC_CACHE_DIR/${specCacheFileName(configPath)}")
+        } finally {
+            close(fd)
+        }
+    }
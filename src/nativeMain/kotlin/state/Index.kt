@@ -0,0 +1,247 @@
+package state
+
+import kotlinx.cinterop.*
+import logger.Logger
+import platform.posix.*
+import utils.FileSystem
+
+/**
+ * Per-root container index
+ *
+ * `<root>/index` lets `list` enumerate containers without opening every
+ * state.json. It is a log of text records, one per line, fields separated
+ * by tabs:
+ *
+ *     S <id> <pid|-> <status> <created|-> <pidStartTime|-> <bundle>
+ *     D <id>
+ *
+ * The last record of an id wins; D means the container was deleted. Every
+ * state.json write appends an S record and every delete a D record, with
+ * one O_APPEND write under the root lock `<root>/.index.lock`. Readers take
+ * no lock: they map the file and ignore a trailing line without its newline
+ * (an append still in flight).
+ *
+ * When the log has grown past twice its size at the last compaction (and at
+ * least [INDEX_COMPACT_MIN_BYTES]), the writer rewrites it with the live
+ * records only, through a temp file and rename. The first line of a
+ * compacted index records its size: `K <bytes>`, tab separated.
+ *
+ * The index mirrors state.json, which stays authoritative; a missing index
+ * is rebuilt from the state directories by the next [readIndex].
+ */
+private const val INDEX_FILE_NAME = "index"
+private const val INDEX_LOCK_NAME = ".index.lock"
+private const val INDEX_COMPACT_MIN_BYTES = 64 * 1024L
+
+/**
+ * What `list` shows of a container, as stored in the index
+ */
+data class IndexEntry(
+    val id: String,
+    val pid: Int?,
+    val status: ContainerStatus,
+    val created: String?,
+    val pidStartTime: Long?,
+    val bundle: String,
+)
+
+private fun indexPath(rootPath: String) = "$rootPath/$INDEX_FILE_NAME"
+
+/** The index entry of this state */
+fun State.toIndexEntry(): IndexEntry = IndexEntry(id, pid, status, created, pidStartTime, bundle)
+
+/** [IndexEntry] as an S record line */
+internal fun encodeIndexRecord(entry: IndexEntry): String =
+    listOf(
+        "S",
+        entry.id,
+        entry.pid?.toString() ?: "-",
+        entry.status.value,
+        entry.created ?: "-",
+        entry.pidStartTime?.toString() ?: "-",
+        escapeField(entry.bundle),
+    ).joinToString("\t", postfix = "\n")
+
+/** The D record line for [id] */
+internal fun encodeIndexRemoval(id: String): String = "D\t$id\n"
+
+/**
+ * Live entries of an index log, in order of first appearance; malformed
+ * lines and an unterminated last line are skipped
+ */
+internal fun parseIndex(content: String): List<IndexEntry> {
+    val entries = LinkedHashMap<String, IndexEntry>()
+    var start = 0
+    while (true) {
+        val end = content.indexOf('\n', start)
+        if (end < 0) break
+        val fields = content.substring(start, end).split('\t')
+        start = end + 1
+        when {
+            fields[0] == "D" && fields.size == 2 -> entries.remove(fields[1])
+            fields[0] == "S" && fields.size == 7 -> {
+                val status = ContainerStatus.entries.find { it.value == fields[3] } ?: continue
+                entries.remove(fields[1])
+                entries[fields[1]] =
+                    IndexEntry(
+                        id = fields[1],
+                        pid = fields[2].toIntOrNull(),
+                        status = status,
+                        created = fields[4].takeIf { it != "-" },
+                        pidStartTime = fields[5].toLongOrNull(),
+                        bundle = unescapeField(fields[6]),
+                    )
+            }
+        }
+    }
+    return entries.values.toList()
+}
+
+/** Size recorded by the last compaction, 0 if none */
+private fun compactedSize(content: String): Long =
+    if (content.startsWith("K\t")) content.substring(2, content.indexOf('\n').coerceAtLeast(2)).toLongOrNull() ?: 0 else 0
+
+/** The index content holding only [entries] */
+internal fun compactIndex(entries: List<IndexEntry>): String {
+    val records = entries.joinToString("") { encodeIndexRecord(it) }
+    // Counted in bytes, like the file size it is compared with. The header
+    // leaves itself out; its length hardly changes the threshold
+    return "K\t${records.encodeToByteArray().size}\n$records"
+}
+
+/** Record the state of a container in the index (see [State.save]) */
+fun updateIndex(
+    fs: FileSystem,
+    rootPath: String,
+    state: State,
+) = appendIndex(fs, rootPath, encodeIndexRecord(state.toIndexEntry()))
+
+/** Record that container [containerId] is gone */
+fun removeFromIndex(
+    fs: FileSystem,
+    rootPath: String,
+    containerId: String,
+) = appendIndex(fs, rootPath, encodeIndexRemoval(containerId))
+
+/**
+ * Live index entries of [rootPath], without locking
+ *
+ * A root without an index (created by an older version) gets one built from
+ * its state directories first.
+ */
+fun readIndex(
+    fs: FileSystem,
+    rootPath: String,
+): List<IndexEntry> {
+    val content = fs.mapTextFile(indexPath(rootPath))
+    if (content != null) return parseIndex(content)
+
+    Logger.debug { "no container index under $rootPath, building it" }
+    val entries = indexEntriesFromStates(fs, rootPath)
+    withRootLock(rootPath) {
+        // Someone else may have built or appended to it meanwhile
+        if (fs.mapTextFile(indexPath(rootPath)) == null) {
+            fs.writeTextFileAtomic(indexPath(rootPath), compactIndex(entries))
+        }
+    }
+    return entries
+}
+
+/** Index entries built from the state directories of [rootPath] */
+private fun indexEntriesFromStates(
+    fs: FileSystem,
+    rootPath: String,
+): List<IndexEntry> =
+    listContainerIds(fs, rootPath).mapNotNull { id ->
+        try {
+            loadState(fs, rootPath, id).toIndexEntry()
+        } catch (e: Exception) {
+            null
+        }
+    }
+
+/**
+ * Append [record] under the root lock, compacting the log when it has
+ * doubled. A missing index is first built from the state directories, as
+ * [readIndex] would: appending to a new file would leave an index that
+ * lists only this record and is never rebuilt. Best effort: the index is a
+ * cache of state.json, so a failure is logged and `list` will show stale
+ * data rather than the command failing.
+ */
+private fun appendIndex(
+    fs: FileSystem,
+    rootPath: String,
+    record: String,
+) {
+    val path = indexPath(rootPath)
+    try {
+        withRootLock(rootPath) {
+            if (fs.mapTextFile(path) == null) {
+                Logger.debug { "no container index under $rootPath, building it" }
+                fs.writeTextFileAtomic(path, compactIndex(indexEntriesFromStates(fs, rootPath)))
+            }
+            val size = fs.appendTextFile(path, record)
+            if (size < INDEX_COMPACT_MIN_BYTES) return@withRootLock
+            val content = fs.mapTextFile(path) ?: return@withRootLock
+            if (size < 2 * compactedSize(content)) return@withRootLock
+            val compacted = compactIndex(parseIndex(content))
+            fs.writeTextFileAtomic(path, compacted)
+            Logger.debug { "compacted container index from $size to ${compacted.encodeToByteArray().size} bytes" }
+        }
+    } catch (e: Exception) {
+        Logger.warn("failed to update container index: ${e.message ?: "unknown"}")
+    }
+}
+
+/**
+ * Run [block] holding the exclusive flock on the root's index lock. If the
+ * lock cannot be taken, [block] runs anyway: appends are atomic by
+ * themselves, only a concurrent compaction could drop a record.
+ */
+@OptIn(ExperimentalForeignApi::class)
+private inline fun withRootLock(
+    rootPath: String,
+    block: () -> Unit,
+) {
+    val fd = open("$rootPath/$INDEX_LOCK_NAME", O_CREAT or O_RDWR or O_CLOEXEC, 0x180u) // 0600
+    if (fd < 0) {
+        Logger.debug { "failed to open index lock under $rootPath (errno=$errno)" }
+        return block()
+    }
+    try {
+        // See withContainerLock for why flock is called by number
+        syscall(platform.linux.__NR_flock.toLong(), fd.toLong(), LOCK_EX.toLong())
+        block()
+    } finally {
+        close(fd)
+    }
+}
+
+/** Escape tab, newline and backslash so a field stays on its line */
+private fun escapeField(value: String): String {
+    if (value.none { it == '\t' || it == '\n' || it == '\\' }) return value
+    return value.replace("\\", "\\\\").replace("\t", "\\t").replace("\n", "\\n")
+}
+
+private fun unescapeField(value: String): String {
+    if ('\\' !in value) return value
+    val sb = StringBuilder(value.length)
+    var i = 0
+    while (i < value.length) {
+        val c = value[i]
+        if (c == '\\' && i + 1 < value.length) {
+            sb.append(
+                when (value[i + 1]) {
+                    't' -> '\t'
+                    'n' -> '\n'
+                    else -> value[i + 1]
+                },
+            )
+            i += 2
+        } else {
+            sb.append(c)
+            i++
+        }
+    }
+    return sb.toString()
+}
@@ -11,6 +11,9 @@ import kotlinx.serialization.encoding.Decoder
 import kotlinx.serialization.encoding.Encoder
 import logger.Logger
 import platform.posix.*
+import syscall.openVerifiedPidfd
+import syscall.pidfdHasExited
+import syscall.readProcessStat
 import utils.FileSystem
 import utils.JsonCodec
 
@@ -111,11 +114,25 @@ data class State(
     val annotations: Map<String, String>? = null,
     @SerialName("created")
     val created: String? = null, // ISO 8601 timestamp (extension, not in OCI spec)
+    @SerialName("pidStartTime")
+    val pidStartTime: Long? = null, // Start time of pid in clock ticks, tells a reused PID apart (extension)
+    @SerialName("cgroupPath")
+    val cgroupPath: String? = null, // Resolved cgroup, relative to /sys/fs/cgroup, for delete/stats/events (extension)
 )
 
 private const val STATE_FILE_NAME = "state.json"
 private const val LOCK_FILE_NAME = ".lock"
 
+/** "1" to always fsync state.json, "0" to never; unset to decide by filesystem */
+private const val STATE_FSYNC_ENV = "KONTAINER_STATE_FSYNC"
+
+// statfs f_type of filesystems that do not survive a reboot anyway
+private const val TMPFS_MAGIC = 0x01021994L
+private const val RAMFS_MAGIC = 0x858458f6L
+
+/** Cached answer of [stateNeedsFsync] per root */
+private val fsyncByRoot = mutableMapOf<String, Boolean>()
+
 private fun getLockPath(
     rootPath: String,
     containerId: String,
@@ -123,9 +140,10 @@ private fun getLockPath(
 
 /**
  * Run [block] while holding an advisory flock on the per-container lock file.
- * Pass [exclusive] = true for write operations (LOCK_EX) and false for reads
- * (LOCK_SH). Without this, parallel `kontainer-runtime state` / `delete` /
- * `kill` invocations on the same container race on state.json.
+ * Pass [exclusive] = true for write operations (LOCK_EX) and false for
+ * shared access (LOCK_SH). Without this, parallel writers of the same
+ * container's state.json race. Plain reads take no lock: state.json is only
+ * ever replaced by rename.
  */
 @OptIn(ExperimentalForeignApi::class)
 private inline fun <T> withContainerLock(
@@ -158,6 +176,27 @@ private inline fun <T> withContainerLock(
     }
 }
 
+/**
+ * Whether state writes under [rootPath] are fsynced: not on tmpfs or ramfs
+ * (the usual /run), where a crash loses the state with the container
+ * anyway; yes when the root is on disk. [STATE_FSYNC_ENV] overrides this.
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun stateNeedsFsync(rootPath: String): Boolean =
+    fsyncByRoot.getOrPut(rootPath) {
+        when (getenv(STATE_FSYNC_ENV)?.toKString()) {
+            "1" -> true
+            "0" -> false
+            else ->
+                memScoped {
+                    val st = alloc<statfs>()
+                    if (statfs(rootPath, st.ptr) != 0) return@memScoped true
+                    val type = st.f_type.toLong() and 0xffffffffL
+                    type != TMPFS_MAGIC && type != RAMFS_MAGIC
+                }
+        }
+    }
+
 /**
  * Get the directory path for a container's state
  *
@@ -177,7 +216,7 @@ private fun getContainerDir(
  * @param containerId Container ID
  * @return Path to state.json file
  */
-private fun getStatePath(
+internal fun getStatePath(
     rootPath: String,
     containerId: String,
 ): String = "${getContainerDir(rootPath, containerId)}/$STATE_FILE_NAME"
@@ -207,7 +246,11 @@ private fun getCurrentTimestamp(): String =
  * Save container state to disk
  *
  * Creates {rootPath}/{container-id}/ directory if it doesn't exist
- * and writes state.json file.
+ * and writes state.json file: one compact record holding the OCI state and
+ * the runtime's own fields, replaced atomically (see
+ * [FileSystem.writeTextFileAtomic]) so readers need no lock. Writers still
+ * take the exclusive container lock, so concurrent updates don't interleave.
+ * The container's record in the root index is updated too (see [readIndex]).
  *
  * @param rootPath Root directory for container state (e.g., /run/kontainer)
  * @throws Exception if directory creation or file write fails
@@ -220,18 +263,19 @@ fun State.save(
     val containerDir = getContainerDir(rootPath, this.id)
     val statePath = getStatePath(rootPath, this.id)
 
-    Logger.debug("saving state to $statePath")
+    Logger.debug { "saving state to $statePath" }
 
     fs.createDirectories(containerDir)
 
     withContainerLock(fs, rootPath, this.id, exclusive = true) {
         try {
-            JsonCodec.writeToFile(fs, statePath, this, prettyPrint = true)
+            fs.writeTextFileAtomic(statePath, JsonCodec.encode(this), durable = stateNeedsFsync(rootPath))
         } catch (e: Exception) {
             Logger.error("failed to save state: ${e.message ?: "unknown"}")
             throw Exception("Failed to save state: ${e.message}")
         }
     }
+    updateIndex(fs, rootPath, this)
 
     Logger.info("saved state for container ${this.id}")
 }
@@ -253,14 +297,40 @@ fun containerExists(
     val exists = fs.fileExists(statePath)
 
     if (exists) {
-        Logger.debug("container $containerId exists at $statePath")
+        Logger.debug { "container $containerId exists at $statePath" }
     } else {
-        Logger.debug("container $containerId does not exist")
+        Logger.debug { "container $containerId does not exist" }
     }
 
     return exists
 }
 
+/**
+ * IDs of all containers under [rootPath] (directories with a state.json)
+ *
+ * Runtime-internal directories such as `.pool` start with a dot and are
+ * skipped.
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun listContainerIds(
+    fs: FileSystem,
+    rootPath: String,
+): List<String> {
+    val dir = opendir(rootPath) ?: return emptyList()
+    val ids = mutableListOf<String>()
+    try {
+        while (true) {
+            val entry = readdir(dir) ?: break
+            val name = entry.pointed.d_name.toKString()
+            if (name.startsWith(".")) continue
+            if (fs.fileExists(getStatePath(rootPath, name))) ids.add(name)
+        }
+    } finally {
+        closedir(dir)
+    }
+    return ids.sorted()
+}
+
 /**
  * Load container state from disk
  *
@@ -279,13 +349,11 @@ fun loadState(
 ): State {
     val statePath = getStatePath(rootPath, containerId)
 
-    Logger.debug("loading state from $statePath")
+    Logger.debug { "loading state from $statePath" }
 
     val state =
         try {
-            withContainerLock(fs, rootPath, containerId, exclusive = false) {
-                JsonCodec.loadFromFile<State>(fs, statePath)
-            }
+            JsonCodec.loadFromFile<State>(fs, statePath)
         } catch (e: Exception) {
             Logger.error("failed to load state: ${e.message ?: "unknown"}")
             throw Exception("Failed to load state file (container may not exist): ${e.message}")
@@ -305,6 +373,8 @@ fun createState(
     pid: Int?,
     bundle: String,
     annotations: Map<String, String>? = null,
+    pidStartTime: Long? = null,
+    cgroupPath: String? = null,
 ): State =
     State(
         ociVersion = ociVersion,
@@ -314,6 +384,8 @@ fun createState(
         bundle = bundle,
         annotations = annotations,
         created = getCurrentTimestamp(),
+        pidStartTime = pidStartTime,
+        cgroupPath = cgroupPath,
     )
 
 /**
@@ -333,7 +405,7 @@ fun State.withStatus(newStatus: ContainerStatus): State = this.copy(status = new
 fun deleteNotifySocket(containerId: String) {
     val notifySocketPath = "/tmp/kontainer-$containerId.sock"
 
-    Logger.debug("deleting notify socket: $notifySocketPath")
+    Logger.debug { "deleting notify socket: $notifySocketPath" }
 
     if (unlink(notifySocketPath) != 0) {
         val errNum = errno
@@ -342,7 +414,7 @@ fun deleteNotifySocket(containerId: String) {
             Logger.warn("failed to delete notify socket $notifySocketPath: errno=$errNum")
         }
     } else {
-        Logger.debug("deleted notify socket: $notifySocketPath")
+        Logger.debug { "deleted notify socket: $notifySocketPath" }
     }
 }
 
@@ -362,7 +434,7 @@ fun deleteContainerDir(
 ) {
     val containerDir = getContainerDir(rootPath, containerId)
 
-    Logger.debug("deleting container directory: $containerDir")
+    Logger.debug { "deleting container directory: $containerDir" }
 
     // Check if directory exists
     val dir = opendir(containerDir)
@@ -370,7 +442,7 @@ fun deleteContainerDir(
         val errNum = errno
         if (errNum == ENOENT) {
             // Directory doesn't exist - already deleted
-            Logger.debug("container directory $containerDir does not exist")
+            Logger.debug { "container directory $containerDir does not exist" }
             return
         }
         perror("opendir")
@@ -391,124 +463,82 @@ fun deleteContainerDir(
 }
 
 /**
- * Check if a process is alive by reading /proc/{pid}/stat
+ * Check if the container process is alive
+ *
+ * Uses a pidfd when the kernel has them: pidfd_open fails with ESRCH for a
+ * missing process, a start time mismatch means the PID was reused, and the
+ * pidfd polls readable once the process has exited (zombie or dead).
+ * Without pidfd support this falls back to the state field of
+ * /proc/{pid}/stat.
  *
  * @param pid Process ID to check
- * @return true if process exists and is not zombie/dead, false otherwise
+ * @param startTime Recorded start time of the process, if known
+ * @return true if the process exists and is not zombie/dead, false otherwise
  */
 @OptIn(ExperimentalForeignApi::class)
-private fun isProcessAlive(pid: Int): Boolean {
-    val statPath = "/proc/$pid/stat"
-
-    // Try to open /proc/{pid}/stat
-    val file = fopen(statPath, "r")
-    if (file == null) {
-        // Process doesn't exist
-        Logger.debug("process $pid does not exist (/proc/$pid/stat not found)")
+private fun isProcessAlive(
+    pid: Int,
+    startTime: Long?,
+): Boolean {
+    val pidfd = openVerifiedPidfd(pid, startTime)
+    if (pidfd >= 0) {
+        try {
+            return !pidfdHasExited(pidfd).also { if (it) Logger.debug { "process $pid has exited" } }
+        } finally {
+            close(pidfd)
+        }
+    }
+    if (errno != ENOSYS) {
+        Logger.debug { "process $pid does not exist or was replaced (errno=$errno)" }
         return false
     }
 
-    try {
-        // Read the stat file
-        // Format: pid (comm) state ppid ...
-        // We need to parse the state field (3rd field)
-        memScoped {
-            val buffer = allocArray<ByteVar>(4096)
-            val bytesRead = fread(buffer, 1u, 4095u, file)
-            if (bytesRead == 0UL) {
-                Logger.warn("failed to read /proc/$pid/stat")
-                return false
-            }
-
-            buffer[bytesRead.toInt()] = 0 // Null terminate
-            val statContent = buffer.toKString()
-
-            // Parse state: skip "pid (comm) " and get the state character
-            // comm can contain spaces and parentheses, so we need to find the last ')'
-            val lastParen = statContent.lastIndexOf(')')
-            if (lastParen == -1 || lastParen + 2 >= statContent.length) {
-                Logger.warn("failed to parse /proc/$pid/stat")
-                return false
-            }
-
-            // State is the character after ") "
-            val state = statContent[lastParen + 2]
+    val stat = readProcessStat(pid)
+    if (stat == null) {
+        Logger.debug { "process $pid does not exist (/proc/$pid/stat not readable)" }
+        return false
+    }
+    if (startTime != null && stat.startTime != startTime) {
+        Logger.debug { "pid $pid was reused by another process" }
+        return false
+    }
 
-            Logger.debug("process $pid state: $state")
+    Logger.debug { "process $pid state: ${stat.state}" }
 
-            // Check if process is zombie (Z) or dead (X)
-            return when (state) {
-                'Z' -> {
-                    Logger.debug("process $pid is zombie")
-                    false
-                }
+    // Check if process is zombie (Z) or dead (X)
+    return when (stat.state) {
+        'Z' -> {
+            Logger.debug { "process $pid is zombie" }
+            false
+        }
 
-                'X' -> {
-                    Logger.debug("process $pid is dead")
-                    false
-                }
+        'X' -> {
+            Logger.debug { "process $pid is dead" }
+            false
+        }
 
-                else -> {
-                    // Process is alive (R, S, D, T, etc.)
-                    true
-                }
-            }
+        else -> {
+            // Process is alive (R, S, D, T, etc.)
+            true
         }
-    } finally {
-        fclose(file)
     }
 }
 
 /**
  * Refresh container status based on actual process state
  *
- * Checks /proc/{pid} to determine if the container process is still running.
- * Updates status to STOPPED if:
+ * Checks the container process (see isProcessAlive) to determine if it is
+ * still running. Updates status to STOPPED if:
  * - PID is null
- * - Process doesn't exist in /proc
+ * - Process doesn't exist, or its PID now belongs to another process
  * - Process is zombie (Z) or dead (X)
  *
+ * @param pidfd Already verified pidfd of the process, e.g. held by the
+ *   daemon; -1 to look the process up by PID
  * @return New State with updated status, or original State if no change needed
  */
-fun State.refreshStatus(): State {
-    val newStatus =
-        when {
-            // No PID means container is stopped
-            this.pid == null -> {
-                Logger.debug("container ${this.id} has no PID, status: stopped")
-                ContainerStatus.STOPPED
-            }
-
-            // Check if process is actually alive
-            !isProcessAlive(this.pid) -> {
-                Logger.debug("container ${this.id} process ${this.pid} is not alive, status: stopped")
-                ContainerStatus.STOPPED
-            }
-
-            // Process exists and is alive
-            else -> {
-                // Keep current status if it's a valid non-running state
-                when (this.status) {
-                    ContainerStatus.CREATING, ContainerStatus.CREATED -> {
-                        Logger.debug("container ${this.id} process ${this.pid} is alive, keeping status: ${this.status.value}")
-                        this.status
-                    }
-
-                    ContainerStatus.STOPPED -> {
-                        // Process is alive but status is stopped - inconsistent state
-                        // This shouldn't happen, but if it does, update to running
-                        Logger.warn("container ${this.id} status is 'stopped' but process ${this.pid} is alive, updating to 'running'")
-                        ContainerStatus.RUNNING
-                    }
-
-                    ContainerStatus.RUNNING -> {
-                        // Process is alive and running
-                        Logger.debug("container ${this.id} process ${this.pid} is alive, status: running")
-                        ContainerStatus.RUNNING
-                    }
-                }
-            }
-        }
+fun State.refreshStatus(pidfd: Int = -1): State {
+    val newStatus = liveStatus(id, pid, pidStartTime, status, pidfd)
 
     // Return updated state if status changed
     return if (newStatus != this.status) {
@@ -518,3 +548,53 @@ fun State.refreshStatus(): State {
         this
     }
 }
+
+/**
+ * Status of a container as recorded ([status]) checked against its process
+ * (see [State.refreshStatus])
+ */
+internal fun liveStatus(
+    id: String,
+    pid: Int?,
+    pidStartTime: Long?,
+    status: ContainerStatus,
+    pidfd: Int = -1,
+): ContainerStatus =
+    when {
+        // No PID means container is stopped
+        pid == null -> {
+            Logger.debug { "container $id has no PID, status: stopped" }
+            ContainerStatus.STOPPED
+        }
+
+        // Check if process is actually alive
+        // A held pidfd needs one poll and no /proc access
+        (if (pidfd >= 0) pidfdHasExited(pidfd) else !isProcessAlive(pid, pidStartTime)) -> {
+            Logger.debug { "container $id process $pid is not alive, status: stopped" }
+            ContainerStatus.STOPPED
+        }
+
+        // Process exists and is alive
+        else -> {
+            // Keep current status if it's a valid non-running state
+            when (status) {
+                ContainerStatus.CREATING, ContainerStatus.CREATED -> {
+                    Logger.debug { "container $id process $pid is alive, keeping status: ${status.value}" }
+                    status
+                }
+
+                ContainerStatus.STOPPED -> {
+                    // Process is alive but status is stopped - inconsistent state
+                    // This shouldn't happen, but if it does, update to running
+                    Logger.warn("container $id status is 'stopped' but process $pid is alive, updating to 'running'")
+                    ContainerStatus.RUNNING
+                }
+
+                ContainerStatus.RUNNING -> {
+                    // Process is alive and running
+                    Logger.debug { "container $id process $pid is alive, status: running" }
+                    ContainerStatus.RUNNING
+                }
+            }
+        }
+    }
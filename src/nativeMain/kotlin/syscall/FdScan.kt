@@ -0,0 +1,97 @@
+package syscall
+
+import kotlinx.cinterop.*
+import platform.linux.SYS_getdents64
+import platform.posix.*
+
+/**
+ * Open-fd enumeration for the close_range(2) fallback
+ *
+ * This runs on the init's exec path, possibly with hundreds of fds inherited
+ * from a shim, so it avoids the Kotlin heap. /proc/self/fd is read with
+ * getdents64 into one native buffer, and fd numbers are parsed from the
+ * d_name bytes in place. Without /proc, every fd below RLIMIT_NOFILE is
+ * probed with fcntl instead.
+ */
+internal const val DIRENT_BUFFER_SIZE = 4096
+
+// struct linux_dirent64 { u64 d_ino; s64 d_off; u16 d_reclen; u8 d_type; char d_name[]; }
+internal const val DIRENT_RECLEN_OFFSET = 16
+internal const val DIRENT_NAME_OFFSET = 19
+
+/**
+ * Call [action] with every fd number in the [length] bytes of linux_dirent64
+ * records at [buffer]; "." and ".." and any other non-numeric name are
+ * skipped
+ */
+internal inline fun forEachDirentFd(
+    buffer: CPointer<ByteVar>,
+    length: Int,
+    action: (Int) -> Unit,
+) {
+    var pos = 0
+    while (pos < length) {
+        val record = (buffer + pos)!!
+        val reclen = (record + DIRENT_RECLEN_OFFSET)!!.reinterpret<UShortVar>().pointed.value.toInt()
+        if (reclen <= 0) return
+        var fd = 0
+        var digits = 0
+        var i = DIRENT_NAME_OFFSET
+        while (i < reclen) {
+            val c = record[i].toInt()
+            if (c == 0) break
+            if (c < '0'.code || c > '9'.code) {
+                digits = 0
+                break
+            }
+            fd = fd * 10 + (c - '0'.code)
+            digits++
+            i++
+        }
+        if (digits > 0) action(fd)
+        pos += reclen
+    }
+}
+
+/**
+ * Call [action] with every open fd of this process, including the one used
+ * to read /proc/self/fd
+ *
+ * @return false if /proc/self/fd could not be read
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal inline fun forEachOpenFd(action: (Int) -> Unit): Boolean {
+    val dirFd = open("/proc/self/fd", O_RDONLY or O_DIRECTORY or O_CLOEXEC)
+    if (dirFd < 0) return false
+    try {
+        memScoped {
+            val buffer = allocArray<ByteVar>(DIRENT_BUFFER_SIZE)
+            var n = syscall(SYS_getdents64.toLong(), dirFd.toLong(), buffer, DIRENT_BUFFER_SIZE.toLong())
+            while (n > 0L) {
+                forEachDirentFd(buffer, n.toInt(), action)
+                n = syscall(SYS_getdents64.toLong(), dirFd.toLong(), buffer, DIRENT_BUFFER_SIZE.toLong())
+            }
+            return n == 0L
+        }
+    } finally {
+        close(dirFd)
+    }
+}
+
+/**
+ * Upper bound for fd numbers, for when /proc is not mounted: the hard
+ * RLIMIT_NOFILE, since the soft limit may have been lowered after
+ * inherited fds above it were opened
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun openFdLimit(): Int =
+    memScoped {
+        val rlim = alloc<rlimit>()
+        if (getrlimit(RLIMIT_NOFILE, rlim.ptr) != 0 || rlim.rlim_max > NR_OPEN_DEFAULT.toULong()) {
+            return NR_OPEN_DEFAULT
+        }
+        rlim.rlim_max.toInt()
+    }
+
+/** fs.nr_open default, the most fds a process can have unless raised */
+private const val NR_OPEN_DEFAULT = 1024 * 1024
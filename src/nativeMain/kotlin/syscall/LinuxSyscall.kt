@@ -6,6 +6,12 @@ import platform.linux.*
 import platform.posix.*
 import spec.POSIXRlimit
 
+// Generic syscall numbers, the same on every architecture since 5.x
+private const val SYS_OPEN_TREE = 428L
+private const val SYS_MOVE_MOUNT = 429L
+private const val SYS_MOUNT_SETATTR = 442L
+private const val MOUNT_ATTR_SIZE_VER0 = 32L
+
 /**
  * Production [Syscall] implementation invoking real kernel and libc routines.
  *
@@ -48,6 +54,43 @@ class LinuxSyscall : Syscall {
             syscall(__NR_pivot_root.toLong(), newRoot.cstr.ptr, putOld.cstr.ptr).toInt()
         }
 
+    override fun openTree(
+        dirfd: Int,
+        path: String,
+        flags: UInt,
+    ): Int =
+        memScoped {
+            syscall(SYS_OPEN_TREE, dirfd.toLong(), path.cstr.ptr, flags.toLong()).toInt()
+        }
+
+    override fun moveMount(
+        fromDirfd: Int,
+        fromPath: String,
+        toDirfd: Int,
+        toPath: String,
+        flags: UInt,
+    ): Int =
+        memScoped {
+            syscall(SYS_MOVE_MOUNT, fromDirfd.toLong(), fromPath.cstr.ptr, toDirfd.toLong(), toPath.cstr.ptr, flags.toLong())
+                .toInt()
+        }
+
+    override fun mountSetattr(
+        dirfd: Int,
+        path: String,
+        flags: UInt,
+        attr: MountAttr,
+    ): Int =
+        memScoped {
+            // struct mount_attr { __u64 attr_set, attr_clr, propagation, userns_fd; }
+            val raw = allocArray<ULongVar>(4)
+            raw[0] = attr.attrSet
+            raw[1] = attr.attrClr
+            raw[2] = attr.propagation
+            raw[3] = attr.usernsFd
+            syscall(SYS_MOUNT_SETATTR, dirfd.toLong(), path.cstr.ptr, flags.toLong(), raw, MOUNT_ATTR_SIZE_VER0).toInt()
+        }
+
     override fun chroot(path: String): Int = platform.posix.chroot(path)
 
     override fun chdir(path: String): Int = platform.posix.chdir(path)
@@ -134,7 +177,7 @@ class LinuxSyscall : Syscall {
             return
         }
 
-        Logger.debug("applying ${rlimits.size} rlimits to PID $pid")
+        Logger.debug { "applying ${rlimits.size} rlimits to PID $pid" }
 
         memScoped {
             for (rlimit in rlimits) {
@@ -153,7 +196,7 @@ class LinuxSyscall : Syscall {
                     Logger.warn("failed to set rlimit ${rlimit.type} (resource=$resource) for PID $pid: $errorMsg")
                     // Continue applying other rlimits instead of failing
                 } else {
-                    Logger.debug("set rlimit ${rlimit.type}: soft=${rlimit.soft}, hard=${rlimit.hard}")
+                    Logger.debug { "set rlimit ${rlimit.type}: soft=${rlimit.soft}, hard=${rlimit.hard}" }
                 }
             }
         }
@@ -189,7 +232,7 @@ class LinuxSyscall : Syscall {
         val minFd = 3 + preserveFds // stdin=0, stdout=1, stderr=2, then preserve_fds
         val maxFd = Int.MAX_VALUE
 
-        Logger.debug("setting CLOEXEC on FDs >= $minFd")
+        Logger.debug { "setting CLOEXEC on FDs >= $minFd" }
 
         val result =
             syscall(
@@ -208,7 +251,7 @@ class LinuxSyscall : Syscall {
             //          The fallback uses /proc/self/fd + fcntl which IS allowed.
             //          This is expected with the OCI default profile, so don't warn.
             if (errNum == ENOSYS || errNum == EINVAL || errNum == EPERM) {
-                Logger.debug("close_range not available (errno=$errNum), using fallback")
+                Logger.debug { "close_range not available (errno=$errNum), using fallback" }
                 emulateCloseRange(preserveFds)
             } else {
                 perror("close_range")
@@ -216,7 +259,7 @@ class LinuxSyscall : Syscall {
                 emulateCloseRange(preserveFds)
             }
         } else {
-            Logger.debug("successfully set CLOEXEC on FDs >= $minFd using close_range")
+            Logger.debug { "successfully set CLOEXEC on FDs >= $minFd using close_range" }
         }
     }
 
@@ -258,7 +301,7 @@ class LinuxSyscall : Syscall {
                 Logger.warn("failed to set additional groups: $errorMsg (errno=$errno)")
                 // Don't throw: this can fail in unprivileged user namespace
             } else {
-                Logger.debug("set ${gids.size} additional groups successfully")
+                Logger.debug { "set ${gids.size} additional groups successfully" }
             }
         }
     }
@@ -266,20 +309,35 @@ class LinuxSyscall : Syscall {
     override fun killProcess(
         pid: Int,
         signal: Int,
+        startTime: Long?,
     ) {
-        Logger.debug("sending signal $signal to process $pid")
+        Logger.debug { "sending signal $signal to process $pid" }
 
-        val result = kill(pid, signal)
+        // Signal through a pidfd, so a PID that was reused since the state was
+        // written is never hit; plain kill() only without pidfd support
+        val pidfd = openVerifiedPidfd(pid, startTime)
+        val result =
+            if (pidfd >= 0) {
+                try {
+                    pidfdSendSignal(pidfd, signal)
+                } finally {
+                    close(pidfd)
+                }
+            } else if (errno == ENOSYS) {
+                kill(pid, signal)
+            } else {
+                -1
+            }
 
         when {
             result == 0 -> {
-                Logger.debug("successfully sent signal $signal to process $pid")
+                Logger.debug { "successfully sent signal $signal to process $pid" }
             }
             result == -1 -> {
                 val errNum = errno
                 if (errNum == ESRCH) {
-                    // Process doesn't exist - this is OK (race condition)
-                    Logger.debug("process $pid does not exist (ESRCH), already terminated")
+                    // Process doesn't exist (or the PID was reused) - this is OK (race condition)
+                    Logger.debug { "process $pid does not exist (ESRCH), already terminated" }
                 } else {
                     perror("kill")
                     Logger.error("failed to send signal $signal to process $pid: errno=$errNum")
@@ -298,93 +356,94 @@ class LinuxSyscall : Syscall {
         nstype: Int,
     ): Int = setns_wrapper(fd, nstype)
 
-    private fun rlimitTypeToResource(type: String): Int? =
-        when (type) {
-            "RLIMIT_AS" -> RLIMIT_AS
-            "RLIMIT_CORE" -> RLIMIT_CORE
-            "RLIMIT_CPU" -> RLIMIT_CPU
-            "RLIMIT_DATA" -> RLIMIT_DATA
-            "RLIMIT_FSIZE" -> RLIMIT_FSIZE
-            "RLIMIT_LOCKS" -> RLIMIT_LOCKS
-            "RLIMIT_MEMLOCK" -> RLIMIT_MEMLOCK
-            "RLIMIT_MSGQUEUE" -> RLIMIT_MSGQUEUE
-            "RLIMIT_NICE" -> RLIMIT_NICE
-            "RLIMIT_NOFILE" -> RLIMIT_NOFILE
-            "RLIMIT_NPROC" -> RLIMIT_NPROC
-            "RLIMIT_RSS" -> RLIMIT_RSS
-            "RLIMIT_RTPRIO" -> RLIMIT_RTPRIO
-            "RLIMIT_RTTIME" -> RLIMIT_RTTIME
-            "RLIMIT_SIGPENDING" -> RLIMIT_SIGPENDING
-            "RLIMIT_STACK" -> RLIMIT_STACK
-            else -> {
-                Logger.warn("unknown rlimit type: $type")
-                null
-            }
-        }
-
-    /**
-     * Read the open file descriptors of this process by listing /proc/self/fd.
-     * Used as a fallback when close_range(2) is unavailable.
-     */
-    private fun getOpenFds(): List<Int> {
-        val procFdPath = "/proc/self/fd"
-        val fds = mutableListOf<Int>()
-
-        val dir = opendir(procFdPath)
-        if (dir == null) {
-            Logger.warn("failed to open $procFdPath for FD enumeration")
-            return emptyList()
+    override fun setCpuAffinity(cpus: List<Int>): Int =
+        memScoped {
+            val mask = idMask(cpus)
+            set_cpu_affinity(mask, idMaskWords(cpus))
         }
 
-        try {
-            while (true) {
-                val entry = readdir(dir) ?: break
-                val name = entry.pointed.d_name.toKString()
-
-                if (name == "." || name == "..") {
-                    continue
-                }
-
-                name.toIntOrNull()?.let { fd ->
-                    fds.add(fd)
-                }
-            }
-        } finally {
-            closedir(dir)
+    override fun bindMemoryPolicy(nodes: List<Int>): Int =
+        memScoped {
+            val mask = idMask(nodes)
+            set_mempolicy_bind(mask, idMaskWords(nodes))
         }
 
-        return fds
+    /** Bitmask with the bits of [ids] set, as the kernel's cpu and node masks */
+    private fun MemScope.idMask(ids: List<Int>): CArrayPointer<ULongVar> {
+        val words = idMaskWords(ids)
+        val mask = allocArray<ULongVar>(words) { value = 0uL }
+        for (id in ids) mask[id / 64] = mask[id / 64] or (1uL shl (id % 64))
+        return mask
     }
 
+    private fun idMaskWords(ids: List<Int>): Int = (ids.maxOrNull() ?: 0) / 64 + 1
+
     /**
      * Emulate close_range by setting FD_CLOEXEC on all open FDs.
      * Fallback for kernels that don't support close_range(2) or CLOSE_RANGE_CLOEXEC.
+     * Open FDs come from /proc/self/fd (see [forEachOpenFd]); without /proc,
+     * every FD up to RLIMIT_NOFILE is tried.
      */
     private fun emulateCloseRange(preserveFds: Int) {
         val minFd = 3 + preserveFds
 
-        Logger.debug("emulating close_range by setting CLOEXEC on FDs >= $minFd")
+        Logger.debug { "emulating close_range by setting CLOEXEC on FDs >= $minFd" }
 
-        val openFds = getOpenFds()
-        if (openFds.isEmpty()) {
-            Logger.error("failed to enumerate open FDs, cannot emulate close_range")
-            throw Exception("Failed to enumerate open FDs for close_range emulation (CVE-2024-21626 mitigation)")
+        var marked = 0
+        val listed =
+            forEachOpenFd { fd ->
+                if (fd >= minFd && setCloexec(fd)) marked++
+            }
+        if (!listed) {
+            val limit = openFdLimit()
+            Logger.debug { "/proc/self/fd unavailable, probing FDs $minFd..${limit - 1}" }
+            for (fd in minFd until limit) {
+                if (setCloexec(fd)) marked++
+            }
         }
 
-        val fdsToClose = openFds.filter { it >= minFd }
-
-        for (fd in fdsToClose) {
-            val currentFlags = fcntl(fd, F_GETFD)
-            if (currentFlags == -1) {
-                // FD might have been closed already (race condition), ignore
-                continue
-            }
+        Logger.debug { "emulated close_range: set CLOEXEC on $marked FDs" }
+    }
 
+    /** @return false if [fd] is not open */
+    private fun setCloexec(fd: Int): Boolean {
+        val currentFlags = fcntl(fd, F_GETFD)
+        if (currentFlags == -1) {
+            // FD might have been closed already (race condition), ignore
+            return false
+        }
+        if ((currentFlags and FD_CLOEXEC) == 0) {
             // Intentionally ignore errors here -- failures here typically mean the
             // FD was already closed by another thread (race condition).
             fcntl(fd, F_SETFD, currentFlags or FD_CLOEXEC)
         }
-
-        Logger.debug("emulated close_range: set CLOEXEC on ${fdsToClose.size} FDs")
+        return true
     }
 }
+
+/**
+ * RLIMIT_* number for an OCI rlimit type ("RLIMIT_NOFILE"), or null if unknown
+ */
+fun rlimitTypeToResource(type: String): Int? =
+    when (type) {
+        "RLIMIT_AS" -> RLIMIT_AS
+        "RLIMIT_CORE" -> RLIMIT_CORE
+        "RLIMIT_CPU" -> RLIMIT_CPU
+        "RLIMIT_DATA" -> RLIMIT_DATA
+        "RLIMIT_FSIZE" -> RLIMIT_FSIZE
+        "RLIMIT_LOCKS" -> RLIMIT_LOCKS
+        "RLIMIT_MEMLOCK" -> RLIMIT_MEMLOCK
+        "RLIMIT_MSGQUEUE" -> RLIMIT_MSGQUEUE
+        "RLIMIT_NICE" -> RLIMIT_NICE
+        "RLIMIT_NOFILE" -> RLIMIT_NOFILE
+        "RLIMIT_NPROC" -> RLIMIT_NPROC
+        "RLIMIT_RSS" -> RLIMIT_RSS
+        "RLIMIT_RTPRIO" -> RLIMIT_RTPRIO
+        "RLIMIT_RTTIME" -> RLIMIT_RTTIME
+        "RLIMIT_SIGPENDING" -> RLIMIT_SIGPENDING
+        "RLIMIT_STACK" -> RLIMIT_STACK
+        else -> {
+            Logger.warn("unknown rlimit type: $type")
+            null
+        }
+    }
@@ -0,0 +1,86 @@
+package syscall
+
+import kotlinx.cinterop.*
+import platform.posix.*
+
+/**
+ * pidfd helpers (Linux >= 5.3)
+ *
+ * A pidfd refers to one process, not to a PID number: once the process is
+ * gone, signals sent through it fail with ESRCH instead of reaching whatever
+ * reused the PID. A pidfd only protects from the moment it is opened, so the
+ * init's start time (field 22 of /proc/<pid>/stat, in clock ticks since
+ * boot) is recorded in the state at create time and compared when a pidfd is
+ * opened for a stored PID; see [openVerifiedPidfd].
+ *
+ * glibc has no wrappers in the versions we build against, so these use raw
+ * syscall numbers (the same on every architecture).
+ */
+private const val SYS_PIDFD_SEND_SIGNAL = 424L
+private const val SYS_PIDFD_OPEN = 434L
+
+/**
+ * pidfd_open(pid, 0)
+ *
+ * @return The pidfd (close-on-exec), or -1 with errno set (ESRCH if no such
+ *   process, ENOSYS on kernels without pidfds)
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun pidfdOpen(pid: Int): Int = syscall(SYS_PIDFD_OPEN, pid.toLong(), 0L).toInt()
+
+/**
+ * pidfd_send_signal(pidfd, signal, NULL, 0)
+ *
+ * @return 0 on success, -1 with errno set (ESRCH if the process has exited)
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun pidfdSendSignal(
+    pidfd: Int,
+    signal: Int,
+): Int = syscall(SYS_PIDFD_SEND_SIGNAL, pidfd.toLong(), signal.toLong(), 0L, 0L).toInt()
+
+/**
+ * Whether the process behind [pidfd] has exited (zombies included)
+ *
+ * A pidfd polls readable once the process exits. This works for processes
+ * that are not our children, unlike waitid(P_PIDFD): the init is a child of
+ * whoever ran `create` (it is cloned with CLONE_PARENT), never of later
+ * runtime invocations.
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun pidfdHasExited(pidfd: Int): Boolean =
+    memScoped {
+        val pfd = alloc<pollfd>()
+        pfd.fd = pidfd
+        pfd.events = POLLIN.toShort()
+        var rc: Int
+        do {
+            rc = poll(pfd.ptr, 1u, 0)
+        } while (rc < 0 && errno == EINTR)
+        rc > 0
+    }
+
+/**
+ * Open a pidfd for [pid] and check that it is still the process that
+ * started at [startTime] (skipped if null, for states written before start
+ * times were recorded)
+ *
+ * @return The pidfd, or -1 with errno set: ESRCH if the process is gone or
+ *   the PID now belongs to another process, ENOSYS without pidfd support
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun openVerifiedPidfd(
+    pid: Int,
+    startTime: Long?,
+): Int {
+    val fd = pidfdOpen(pid)
+    if (fd < 0 || startTime == null) return fd
+    // Checked after opening: if the start time matches now, the pidfd refers
+    // to the original process even if it exits right after
+    if (readProcessStartTime(pid) != startTime) {
+        close(fd)
+        set_posix_errno(ESRCH)
+        return -1
+    }
+    return fd
+}
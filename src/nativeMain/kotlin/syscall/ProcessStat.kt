@@ -0,0 +1,77 @@
+package syscall
+
+import kotlinx.cinterop.*
+import platform.posix.*
+
+/**
+ * Start time of [pid] in clock ticks since boot, or null if it cannot be read
+ */
+fun readProcessStartTime(pid: Int): Long? = readProcessStat(pid)?.startTime
+
+/**
+ * Fields of /proc/<pid>/stat used by the runtime
+ *
+ * @property comm Command name (field 2, without the parentheses)
+ * @property state State character (R, S, D, Z, X, ...)
+ * @property ppid Parent PID (field 4)
+ * @property ttyNr Controlling terminal device number (field 7)
+ * @property utime User CPU time in clock ticks (field 14)
+ * @property stime System CPU time in clock ticks (field 15)
+ * @property startTime Start time in clock ticks since boot (field 22)
+ */
+data class ProcessStat(
+    val comm: String,
+    val state: Char,
+    val ppid: Int,
+    val ttyNr: Int,
+    val utime: Long,
+    val stime: Long,
+    val startTime: Long,
+)
+
+/**
+ * Read and parse /proc/<pid>/stat
+ *
+ * @return The parsed fields, or null if the process does not exist or the
+ *   file cannot be parsed
+ */
+@OptIn(ExperimentalForeignApi::class)
+fun readProcessStat(pid: Int): ProcessStat? =
+    memScoped {
+        val fd = open("/proc/$pid/stat", O_RDONLY or O_CLOEXEC)
+        if (fd < 0) return null
+        val buffer = allocArray<ByteVar>(1024)
+        val n =
+            try {
+                read(fd, buffer, 1023u)
+            } finally {
+                close(fd)
+            }
+        if (n <= 0) return null
+        parseProcessStat(buffer.readBytes(n.toInt()).decodeToString())
+    }
+
+/**
+ * Parse the content of /proc/<pid>/stat
+ *
+ * Format: `pid (comm) state ppid ...`. comm may contain spaces and
+ * parentheses, so fields are counted from the last ')'; the state is then
+ * field 3 and the start time field 22.
+ */
+fun parseProcessStat(content: String): ProcessStat? {
+    val firstParen = content.indexOf('(')
+    val lastParen = content.lastIndexOf(')')
+    if (firstParen == -1 || lastParen < firstParen || lastParen + 2 >= content.length) return null
+    val fields = content.substring(lastParen + 2).trim().split(' ')
+    if (fields.size < 20 || fields[0].length != 1) return null
+    // fields[i] is field i + 3 of the man page
+    return ProcessStat(
+        comm = content.substring(firstParen + 1, lastParen),
+        state = fields[0][0],
+        ppid = fields[1].toIntOrNull() ?: return null,
+        ttyNr = fields[4].toIntOrNull() ?: return null,
+        utime = fields[11].toLongOrNull() ?: return null,
+        stime = fields[12].toLongOrNull() ?: return null,
+        startTime = fields[19].toLongOrNull() ?: return null,
+    )
+}
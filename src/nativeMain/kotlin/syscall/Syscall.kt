@@ -32,6 +32,41 @@ interface Syscall {
         putOld: String,
     ): Int
 
+    /**
+     * open_tree(2): with OPEN_TREE_CLONE, a detached copy of the mount at
+     * [path] that can be configured before it is attached with [moveMount]
+     * @return The tree fd, or -1 with errno set (ENOSYS before Linux 5.2)
+     */
+    fun openTree(
+        dirfd: Int,
+        path: String,
+        flags: UInt,
+    ): Int
+
+    /**
+     * move_mount(2): attach or move the mount at [fromDirfd]/[fromPath] to
+     * [toDirfd]/[toPath]
+     */
+    fun moveMount(
+        fromDirfd: Int,
+        fromPath: String,
+        toDirfd: Int,
+        toPath: String,
+        flags: UInt,
+    ): Int
+
+    /**
+     * mount_setattr(2): change the attributes and propagation of the mount at
+     * [dirfd]/[path] (recursively with AT_RECURSIVE) in one call
+     * @return 0, or -1 with errno set (ENOSYS before Linux 5.12)
+     */
+    fun mountSetattr(
+        dirfd: Int,
+        path: String,
+        flags: UInt,
+        attr: MountAttr,
+    ): Int
+
     fun chroot(path: String): Int
 
     fun chdir(path: String): Int
@@ -76,9 +111,28 @@ interface Syscall {
 
     fun setAdditionalGroups(gids: List<UInt>)
 
+    /**
+     * Restrict the calling thread to [cpus] (sched_setaffinity). Inherited
+     * across execve.
+     * @return 0, or -1 with errno set
+     */
+    fun setCpuAffinity(cpus: List<Int>): Int
+
+    /**
+     * Allocate the calling thread's memory from NUMA [nodes] only
+     * (set_mempolicy MPOL_BIND). Inherited across execve.
+     * @return 0, or -1 with errno set
+     */
+    fun bindMemoryPolicy(nodes: List<Int>): Int
+
+    /**
+     * Send [signal] to [pid]. With [startTime] (see [readProcessStartTime]),
+     * a PID that now belongs to another process is treated as already gone.
+     */
     fun killProcess(
         pid: Int,
         signal: Int,
+        startTime: Long? = null,
     )
 
     /**
@@ -92,6 +146,22 @@ interface Syscall {
     ): Int
 }
 
+/**
+ * struct mount_attr of mount_setattr(2)
+ *
+ * @property attrSet MOUNT_ATTR_* flags to set
+ * @property attrClr MOUNT_ATTR_* flags to clear
+ * @property propagation One of MS_SHARED / MS_SLAVE / MS_PRIVATE /
+ *   MS_UNBINDABLE, or 0 to leave it unchanged
+ * @property usernsFd User namespace fd for MOUNT_ATTR_IDMAP
+ */
+data class MountAttr(
+    val attrSet: ULong = 0uL,
+    val attrClr: ULong = 0uL,
+    val propagation: ULong = 0uL,
+    val usernsFd: ULong = 0uL,
+)
+
 /**
  * The three capability bitmasks read/written together by capget(2)/capset(2).
  * Each bit position corresponds to a [capability.Capability.value].
@@ -0,0 +1,175 @@
+package trace
+
+import kotlinx.cinterop.*
+import platform.posix.*
+
+/**
+ * Per-phase latency tracer for the create/start path
+ *
+ * Records CLOCK_MONOTONIC nanosecond spans and appends them to the
+ * container's trace file (`<root>/<id>/trace.json`). Every stage of the
+ * bootstrap (main, stage-1/stage-2 in bootstrap.c, init, start) writes to the
+ * same file through an inherited O_APPEND fd, one JSON object per line:
+ *
+ *   {"stage":"init","name":"rootfs.prepare","start_ns":...,"end_ns":...,"duration_ns":...}
+ *
+ * Lines are written with a single write(2) each flush, so concurrent stages
+ * never interleave partial records. Timestamps share one monotonic clock
+ * across processes, which lets the spans be laid out on one timeline.
+ *
+ * Tracing is off unless KONTAINER_TRACE=1 is set; when off, [span] runs its
+ * block directly and nothing is allocated.
+ *
+ * Usage:
+ *   Tracer.setStage("init")
+ *   Tracer.span("pivot_root") { pivotRoot(syscall, rootfsPath) }
+ *   Tracer.flush()
+ */
+@OptIn(ExperimentalForeignApi::class)
+object Tracer {
+    /** Environment variable enabling tracing ("1" or "true") */
+    const val TRACE_ENV = "KONTAINER_TRACE"
+
+    /** File name of the per-container trace, next to state.json */
+    const val TRACE_FILE = "trace.json"
+
+    private class Span(
+        val name: String,
+        val startNs: Long,
+        val endNs: Long,
+    )
+
+    val enabled: Boolean =
+        getenv(TRACE_ENV)?.toKString().let { it == "1" || it == "true" }
+
+    private var stage: String = "main"
+    private var traceFd: Int = -1
+    private val spans = ArrayList<Span>()
+
+    /**
+     * Set the stage label written with each span ("main", "init", "start")
+     */
+    fun setStage(stage: String) {
+        this.stage = stage
+    }
+
+    /**
+     * Create (truncate) the trace file and use it for this process
+     *
+     * The fd is close-on-exec, so hooks and the container process never see
+     * it. Stages that need it get it explicitly: the spawner receives it over
+     * SCM_RIGHTS, the fork-and-exec fallback clears the flag in the child
+     * right before the `__init__` exec, and a parked init hands it to
+     * kontainer_park(). Its number travels in the bootstrap config.
+     *
+     * @param path Trace file path, usually `<root>/<id>/trace.json`
+     * @param truncate Start a new trace (create) instead of appending (start)
+     * @return The trace fd, or -1 if tracing is disabled or the open failed
+     */
+    fun open(
+        path: String,
+        truncate: Boolean = true,
+    ): Int {
+        if (!enabled) return -1
+        val flags = O_WRONLY or O_APPEND or O_CLOEXEC or (if (truncate) O_CREAT or O_TRUNC else 0)
+        val fd = platform.posix.open(path, flags, 0x1A4u) // 0x1A4 = 0o644
+        if (fd >= 0) traceFd = fd
+        return fd
+    }
+
+    /**
+     * Use an fd inherited from the parent stage (see process.BootstrapConfig)
+     */
+    fun attach(fd: Int) {
+        if (enabled && fd >= 0) traceFd = fd
+    }
+
+    /**
+     * Current trace fd, or -1 if none
+     */
+    fun fd(): Int = traceFd
+
+    /**
+     * CLOCK_MONOTONIC in nanoseconds
+     */
+    fun now(): Long =
+        memScoped {
+            val ts = alloc<timespec>()
+            clock_gettime(CLOCK_MONOTONIC, ts.ptr)
+            ts.tv_sec * 1_000_000_000L + ts.tv_nsec
+        }
+
+    /**
+     * Record a finished span
+     *
+     * @param name Phase name, dot-separated (e.g. "cgroup.setup")
+     * @param startNs Monotonic start time from [now]
+     * @param endNs Monotonic end time (defaults to now)
+     */
+    fun record(
+        name: String,
+        startNs: Long,
+        endNs: Long = now(),
+    ) {
+        if (!enabled || startNs <= 0L) return
+        spans.add(Span(name, startNs, endNs))
+    }
+
+    /**
+     * Time [block] as a span named [name]
+     */
+    inline fun <T> span(
+        name: String,
+        block: () -> T,
+    ): T {
+        if (!enabled) return block()
+        val start = now()
+        try {
+            return block()
+        } finally {
+            record(name, start)
+        }
+    }
+
+    /**
+     * Append the recorded spans to the trace file in one write and clear them
+     */
+    fun flush() {
+        if (traceFd < 0 || spans.isEmpty()) return
+        val out = StringBuilder()
+        for (span in spans) {
+            out.append(formatSpan(stage, span.name, span.startNs, span.endNs)).append('\n')
+        }
+        spans.clear()
+        val bytes = out.toString().encodeToByteArray()
+        bytes.usePinned { pinned ->
+            write(traceFd, pinned.addressOf(0), bytes.size.convert())
+        }
+    }
+
+    /**
+     * Flush pending spans and close the trace fd
+     */
+    fun close() {
+        flush()
+        if (traceFd >= 0) {
+            platform.posix.close(traceFd)
+            traceFd = -1
+        }
+    }
+}
+
+/**
+ * Format one span as a single-line JSON object
+ *
+ * Names and stages are fixed identifiers chosen by the runtime, so no
+ * escaping is needed.
+ */
+fun formatSpan(
+    stage: String,
+    name: String,
+    startNs: Long,
+    endNs: Long,
+): String =
+    "{\"stage\":\"$stage\",\"name\":\"$name\",\"start_ns\":$startNs," +
+        "\"end_ns\":$endNs,\"duration_ns\":${endNs - startNs}}"
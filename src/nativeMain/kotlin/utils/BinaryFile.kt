@@ -0,0 +1,124 @@
+package utils
+
+import kotlinx.cinterop.*
+import platform.posix.*
+
+// Raw byte I/O for the runtime's binary cache files (seccomp BPF, specs).
+// These bypass FileSystem: cache entries are an optimization owned by the
+// main process, and every caller treats a failed read as a miss.
+
+/**
+ * Write all of [bytes] to [fd], retrying on EINTR and short writes
+ *
+ * @throws Exception if a write fails
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun writeAll(
+    fd: Int,
+    bytes: ByteArray,
+) {
+    if (bytes.isEmpty()) return
+    bytes.usePinned { pinned ->
+        var offset = 0
+        while (offset < bytes.size) {
+            val n = write(fd, pinned.addressOf(offset), (bytes.size - offset).convert())
+            if (n < 0 && errno == EINTR) continue
+            if (n <= 0) throw Exception("Short write: errno=$errno")
+            offset += n.toInt()
+        }
+    }
+}
+
+/**
+ * Read exactly [size] bytes of [fd] starting at [offset] with pread
+ *
+ * @throws Exception if the file ends early or a read fails
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun readAll(
+    fd: Int,
+    size: Long,
+    offset: Long,
+): ByteArray {
+    if (size <= 0) return ByteArray(0)
+    val buf = ByteArray(size.toInt())
+    buf.usePinned { pinned ->
+        var done = 0
+        while (done < buf.size) {
+            val n = pread(fd, pinned.addressOf(done), (buf.size - done).convert(), offset + done)
+            if (n < 0 && errno == EINTR) continue
+            if (n <= 0) throw Exception("Short read: errno=$errno")
+            done += n.toInt()
+        }
+    }
+    return buf
+}
+
+/**
+ * Read a whole regular file, or null if it does not exist or cannot be read
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun readFileBytes(path: String): ByteArray? =
+    memScoped {
+        val fd = open(path, O_RDONLY or O_CLOEXEC)
+        if (fd < 0) return null
+        try {
+            val st = alloc<stat>()
+            if (fstat(fd, st.ptr) != 0) return null
+            readAll(fd, st.st_size, offset = 0)
+        } catch (e: Exception) {
+            null
+        } finally {
+            close(fd)
+        }
+    }
+
+/**
+ * Replace [path] with [bytes] through a temporary file renamed into place,
+ * so concurrent readers never see a partial file
+ *
+ * @throws Exception if the write or rename fails ([path] is unchanged)
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun writeFileBytesAtomic(
+    path: String,
+    bytes: ByteArray,
+) {
+    val tmpPath = "$path.tmp.${getpid()}"
+    val fd = open(tmpPath, O_WRONLY or O_CREAT or O_TRUNC or O_CLOEXEC, 0x180u) // 0x180 = 0o600
+    if (fd < 0) throw Exception("Failed to create $tmpPath: errno=$errno")
+    try {
+        writeAll(fd, bytes)
+    } catch (e: Exception) {
+        close(fd)
+        unlink(tmpPath)
+        throw e
+    }
+    close(fd)
+    if (rename(tmpPath, path) != 0) {
+        val err = errno
+        unlink(tmpPath)
+        throw Exception("Failed to rename $tmpPath to $path: errno=$err")
+    }
+}
+
+/**
+ * Append [value] as a little-endian u32
+ */
+internal fun ByteArray.plusU32(value: Int): ByteArray =
+    this +
+        byteArrayOf(
+            (value and 0xFF).toByte(),
+            ((value shr 8) and 0xFF).toByte(),
+            ((value shr 16) and 0xFF).toByte(),
+            ((value shr 24) and 0xFF).toByte(),
+        )
+
+/**
+ * Little-endian u32 at [offset]; the caller checks the bounds
+ */
+internal fun ByteArray.u32At(offset: Int): Int =
+    (this[offset].toInt() and 0xFF) or
+        ((this[offset + 1].toInt() and 0xFF) shl 8) or
+        ((this[offset + 2].toInt() and 0xFF) shl 16) or
+        ((this[offset + 3].toInt() and 0xFF) shl 24)
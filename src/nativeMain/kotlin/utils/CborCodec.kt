@@ -0,0 +1,36 @@
+package utils
+
+import kotlinx.serialization.ExperimentalSerializationApi
+import kotlinx.serialization.cbor.Cbor
+import kotlinx.serialization.serializer
+
+/**
+ * Binary codec for values passed between runtime processes (not for files
+ * users read or write; those stay JSON via [JsonCodec])
+ *
+ * Used to hand the already-parsed spec from the main process to the init
+ * process inside the bootstrap config, so init decodes a compact binary form
+ * instead of re-reading and re-parsing config.json.
+ */
+@OptIn(ExperimentalSerializationApi::class)
+object CborCodec {
+    /**
+     * - ignoreUnknownKeys: Same forward compatibility as [JsonCodec]
+     */
+    private val cbor =
+        Cbor {
+            ignoreUnknownKeys = true
+        }
+
+    /**
+     * Encode a value to CBOR bytes
+     */
+    internal inline fun <reified T> encode(value: T): ByteArray = cbor.encodeToByteArray(serializer(), value)
+
+    /**
+     * Decode CBOR bytes to typed value
+     *
+     * @throws Exception if the bytes are not a valid encoding of T
+     */
+    internal inline fun <reified T> decode(bytes: ByteArray): T = cbor.decodeFromByteArray(serializer(), bytes)
+}
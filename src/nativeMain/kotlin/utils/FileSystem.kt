@@ -19,12 +19,46 @@ interface FileSystem {
         content: String,
     )
 
+    /**
+     * Append [content] to [path] (created if missing) with one O_APPEND
+     * write, so concurrent appenders never interleave within a record.
+     * @return The size of the file after the append
+     * @throws Exception if the open or write fails
+     */
+    fun appendTextFile(
+        path: String,
+        content: String,
+    ): Long
+
+    /**
+     * Read the whole of [path] through a read-only mmap: one copy and no
+     * stdio buffer. For small files that are read far more often than written.
+     * @return The content, or null if [path] does not exist
+     * @throws Exception if [path] exists but cannot be read
+     */
+    fun mapTextFile(path: String): String?
+
     /**
      * Read the entire contents of [path] as a String.
      * @throws Exception if the read fails for any reason
      */
     fun readTextFile(path: String): String
 
+    /**
+     * Replace [path] with [content] atomically: the content goes to a
+     * temporary file in the same directory, which is then renamed over
+     * [path]. Readers see the old or the new file, never a partial one.
+     *
+     * @param durable fsync the file and the directory, so the new content
+     *   survives a crash; pointless on tmpfs
+     * @throws Exception if the write or rename fails ([path] is unchanged)
+     */
+    fun writeTextFileAtomic(
+        path: String,
+        content: String,
+        durable: Boolean = false,
+    )
+
     /**
      * Read a /proc file. /proc files cannot be seeked and report size as 0,
      * so the read uses a fixed-size buffer until EOF.
@@ -53,4 +87,43 @@ interface FileSystem {
      * warning by the implementation but not thrown.
      */
     fun removeDirectory(path: String): Boolean
+
+    /**
+     * Open the directory at [path] once for file operations relative to it.
+     * Used for cgroupfs, where many small files in one directory are written
+     * back to back. The caller must [DirectoryHandle.close] the handle.
+     * @throws Exception if [path] cannot be opened as a directory
+     */
+    fun openDirectory(path: String): DirectoryHandle
+}
+
+/**
+ * An open directory (O_DIRECTORY fd in the real implementation).
+ *
+ * File names are relative to the directory. Writes are a single unbuffered
+ * write(2), which is what pseudo-filesystems like cgroupfs expect: every write
+ * is parsed as one value.
+ */
+interface DirectoryHandle : AutoCloseable {
+    /** Path the handle was opened with, for messages */
+    val path: String
+
+    /**
+     * Write [content] to the existing file [name] (no create, no truncate
+     * semantics beyond what the filesystem applies).
+     * @throws Exception if the open or write fails
+     */
+    fun writeFile(
+        name: String,
+        content: String,
+    )
+
+    /**
+     * Read the file [name], up to 4 KiB (enough for any cgroup interface file
+     * the runtime reads this way).
+     * @throws Exception if the open or read fails
+     */
+    fun readFile(name: String): String
+
+    override fun close()
 }
@@ -0,0 +1,15 @@
+package utils
+
+/**
+ * 64-bit FNV-1a of [text]'s UTF-8 bytes as 16 hex digits
+ *
+ * Used for content-addressed names (cache files, pool templates), not for
+ * anything security relevant: callers compare the full key on every hit.
+ */
+fun fnv1a64Hex(text: String): String {
+    var hash = 0xcbf29ce484222325uL
+    for (b in text.encodeToByteArray()) {
+        hash = (hash xor (b.toUByte().toULong())) * 0x100000001b3uL
+    }
+    return hash.toString(16).padStart(16, '0')
+}
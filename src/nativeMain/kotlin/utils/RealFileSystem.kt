@@ -51,7 +51,7 @@ class RealFileSystem : FileSystem {
                 throw Exception("Failed to close $path: errno=$errNum")
             }
 
-            Logger.debug("successfully wrote $path")
+            Logger.debug { "successfully wrote $path" }
         } catch (e: Exception) {
             fclose(fp)
             throw e
@@ -107,7 +107,7 @@ class RealFileSystem : FileSystem {
                 throw Exception("Failed to close $path: errno=$errNum")
             }
 
-            Logger.debug("successfully read $path ($fileSize bytes)")
+            Logger.debug { "successfully read $path ($fileSize bytes)" }
             return content
         } catch (e: Exception) {
             fclose(fp)
@@ -149,7 +149,7 @@ class RealFileSystem : FileSystem {
         path: String,
         mode: UInt,
     ) {
-        Logger.debug("creating directories: $path")
+        Logger.debug { "creating directories: $path" }
 
         val components = path.trim('/').split('/')
         var currentPath = if (path.startsWith("/")) "/" else ""
@@ -166,9 +166,110 @@ class RealFileSystem : FileSystem {
                     perror("mkdir($currentPath)")
                     throw Exception("Failed to create directory $currentPath: errno=$errNum")
                 }
-                Logger.debug("directory already exists: $currentPath")
+                Logger.debug { "directory already exists: $currentPath" }
             } else {
-                Logger.debug("created directory: $currentPath")
+                Logger.debug { "created directory: $currentPath" }
+            }
+        }
+    }
+
+    override fun writeTextFileAtomic(
+        path: String,
+        content: String,
+        durable: Boolean,
+    ) {
+        val tmpPath = "$path.tmp.${getpid()}"
+        val fd = open(tmpPath, O_WRONLY or O_CREAT or O_TRUNC or O_CLOEXEC, 0x1A4u) // 0x1A4 = 0o644
+        if (fd < 0) {
+            val errNum = errno
+            Logger.error("failed to create $tmpPath (errno=$errNum)")
+            throw Exception("Failed to create $tmpPath: errno=$errNum")
+        }
+        try {
+            writeFully(fd, content.encodeToByteArray(), tmpPath)
+            if (durable && fsync(fd) != 0) throw Exception("Failed to fsync $tmpPath: errno=$errno")
+        } catch (e: Exception) {
+            close(fd)
+            unlink(tmpPath)
+            Logger.error("failed to write $path: ${e.message}")
+            throw e
+        }
+        close(fd)
+
+        if (rename(tmpPath, path) != 0) {
+            val errNum = errno
+            unlink(tmpPath)
+            Logger.error("failed to rename $tmpPath to $path (errno=$errNum)")
+            throw Exception("Failed to rename $tmpPath to $path: errno=$errNum")
+        }
+        if (durable) {
+            // The rename itself is only durable once the directory is synced
+            val dirFd = open(path.substringBeforeLast('/', "."), O_RDONLY or O_DIRECTORY or O_CLOEXEC)
+            if (dirFd < 0 || fsync(dirFd) != 0) Logger.warn("failed to fsync directory of $path (errno=$errno)")
+            if (dirFd >= 0) close(dirFd)
+        }
+        Logger.debug { "atomically wrote $path (${content.length} chars, durable=$durable)" }
+    }
+
+    override fun appendTextFile(
+        path: String,
+        content: String,
+    ): Long {
+        val fd = open(path, O_WRONLY or O_APPEND or O_CREAT or O_CLOEXEC, 0x1A4u) // 0x1A4 = 0o644
+        if (fd < 0) {
+            val errNum = errno
+            Logger.error("failed to open $path for appending (errno=$errNum)")
+            throw Exception("Failed to open $path for appending: errno=$errNum")
+        }
+        try {
+            writeFully(fd, content.encodeToByteArray(), path)
+            return lseek(fd, 0, SEEK_END)
+        } finally {
+            close(fd)
+        }
+    }
+
+    override fun mapTextFile(path: String): String? {
+        val fd = open(path, O_RDONLY or O_CLOEXEC)
+        if (fd < 0) {
+            val errNum = errno
+            if (errNum == ENOENT) return null
+            throw Exception("Failed to open $path for reading: errno=$errNum")
+        }
+        try {
+            val size =
+                memScoped {
+                    val st = alloc<stat>()
+                    if (fstat(fd, st.ptr) != 0) throw Exception("Failed to stat $path: errno=$errno")
+                    st.st_size
+                }
+            if (size == 0L) return ""
+            val addr = mmap(null, size.convert(), PROT_READ, MAP_PRIVATE, fd, 0)
+            if (addr == MAP_FAILED) throw Exception("Failed to mmap $path: errno=$errno")
+            try {
+                return addr!!.reinterpret<ByteVar>().readBytes(size.toInt()).decodeToString()
+            } finally {
+                munmap(addr, size.convert())
+            }
+        } finally {
+            close(fd)
+        }
+    }
+
+    /** write(2) all of [bytes] to [fd], retrying short writes */
+    private fun writeFully(
+        fd: Int,
+        bytes: ByteArray,
+        path: String,
+    ) {
+        if (bytes.isEmpty()) return
+        bytes.usePinned { pinned ->
+            var offset = 0
+            while (offset < bytes.size) {
+                val n = write(fd, pinned.addressOf(offset), (bytes.size - offset).convert())
+                if (n < 0 && errno == EINTR) continue
+                if (n <= 0) throw Exception("Write error for $path: errno=$errno")
+                offset += n.toInt()
             }
         }
     }
@@ -177,17 +278,17 @@ class RealFileSystem : FileSystem {
         val fp = fopen(path, "r")
         if (fp != null) {
             fclose(fp)
-            Logger.debug("file exists: $path")
+            Logger.debug { "file exists: $path" }
             return true
         }
 
-        Logger.debug("file does not exist: $path")
+        Logger.debug { "file does not exist: $path" }
         return false
     }
 
     override fun removeDirectory(path: String): Boolean {
         if (access(path, F_OK) != 0) {
-            Logger.debug("directory $path does not exist, nothing to remove")
+            Logger.debug { "directory $path does not exist, nothing to remove" }
             return false
         }
 
@@ -199,7 +300,85 @@ class RealFileSystem : FileSystem {
             return false
         }
 
-        Logger.debug("removed directory: $path")
+        Logger.debug { "removed directory: $path" }
         return true
     }
+
+    override fun openDirectory(path: String): DirectoryHandle {
+        val fd = open(path, O_RDONLY or O_DIRECTORY or O_CLOEXEC)
+        if (fd < 0) {
+            val errNum = errno
+            throw Exception("Failed to open directory $path: errno=$errNum")
+        }
+        return RealDirectoryHandle(path, fd)
+    }
+}
+
+/**
+ * [DirectoryHandle] backed by an O_DIRECTORY fd and openat(2)
+ */
+@OptIn(ExperimentalForeignApi::class)
+private class RealDirectoryHandle(
+    override val path: String,
+    private var fd: Int,
+) : DirectoryHandle {
+    override fun writeFile(
+        name: String,
+        content: String,
+    ) {
+        val fileFd = openat(fd, name, O_WRONLY or O_CLOEXEC)
+        if (fileFd < 0) {
+            val errNum = errno
+            throw Exception("Failed to open $path/$name for writing: errno=$errNum")
+        }
+        try {
+            val bytes = content.encodeToByteArray()
+            val written =
+                if (bytes.isEmpty()) {
+                    0L
+                } else {
+                    bytes.usePinned { pinned -> write(fileFd, pinned.addressOf(0), bytes.size.convert()) }
+                }
+            if (written != bytes.size.toLong()) {
+                val errNum = errno
+                throw Exception("Failed to write $path/$name: errno=$errNum")
+            }
+        } finally {
+            platform.posix.close(fileFd)
+        }
+    }
+
+    override fun readFile(name: String): String {
+        val fileFd = openat(fd, name, O_RDONLY or O_CLOEXEC)
+        if (fileFd < 0) {
+            val errNum = errno
+            throw Exception("Failed to open $path/$name for reading: errno=$errNum")
+        }
+        try {
+            val buffer = ByteArray(4096)
+            var total = 0
+            buffer.usePinned { pinned ->
+                while (total < buffer.size) {
+                    val n = read(fileFd, pinned.addressOf(total), (buffer.size - total).convert())
+                    if (n < 0 && errno == EINTR) continue
+                    if (n < 0) {
+                        val errNum = errno
+                        throw Exception("Failed to read $path/$name: errno=$errNum")
+                    }
+                    if (n == 0L) break
+                    total += n.toInt()
+                }
+            }
+            return buffer.decodeToString(0, total)
+        } finally {
+            platform.posix.close(fileFd)
+        }
+    }
+
+    override fun close() {
+        if (fd >= 0) {
+            platform.posix.close(fd)
+            fd = -1
+        }
+    }
 }
@@ -0,0 +1,69 @@
+package cgroup
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.nulls.shouldBeNull
+import io.kotest.matchers.shouldBe
+import utils.JsonCodec
+
+class CgroupStatsTest :
+    FunSpec({
+
+        fun bytes(text: String) = text.encodeToByteArray()
+
+        test("parseSingleValue reads numbers and treats max as unset") {
+            val b = bytes("123456\n")
+            parseSingleValue(b, b.size) shouldBe 123456uL
+            val max = bytes("max\n")
+            parseSingleValue(max, max.size).shouldBeNull()
+        }
+
+        test("parseCpuStat converts microseconds to nanoseconds") {
+            val b =
+                bytes(
+                    "usage_usec 1500\nuser_usec 1000\nsystem_usec 500\n" +
+                        "nr_periods 10\nnr_throttled 2\nthrottled_usec 30\n",
+                )
+            parseCpuStat(b, b.size) shouldBe
+                CpuStats(
+                    usage = CpuUsage(total = 1500000uL, kernel = 500000uL, user = 1000000uL),
+                    throttling = CpuThrottling(periods = 10uL, throttledPeriods = 2uL, throttledTime = 30000uL),
+                )
+        }
+
+        test("parsers only look at the first length bytes of a reused buffer") {
+            val b = bytes("usage_usec 7\nuser_usec 9999\n")
+            parseCpuStat(b, "usage_usec 7\n".length).usage shouldBe CpuUsage(total = 7000uL, kernel = 0uL, user = 0uL)
+        }
+
+        test("parseMemoryStat keeps every key in order") {
+            val b = bytes("anon 4096\nfile 8192\nkernel_stack 16384\n")
+            parseMemoryStat(b, b.size) shouldBe mapOf("anon" to 4096uL, "file" to 8192uL, "kernel_stack" to 16384uL)
+        }
+
+        test("valueOfKey finds a key in a flat keyed file") {
+            val b = bytes("low 0\nhigh 0\nmax 3\noom 1\n")
+            valueOfKey(b, b.size, "max".encodeToByteArray()) shouldBe 3uL
+            valueOfKey(b, b.size, "oom_kill".encodeToByteArray()) shouldBe 0uL
+        }
+
+        test("parseIoStat maps bytes and ios to runc Read/Write entries") {
+            val b = bytes("8:0 rbytes=100 wbytes=200 rios=1 wios=2 dbytes=0 dios=0\n253:1 rbytes=5 wbytes=0 rios=1 wios=0\n")
+            val stats = parseIoStat(b, b.size)
+            stats.ioServiceBytesRecursive shouldBe
+                listOf(
+                    BlkioEntry(8uL, 0uL, "Read", 100uL),
+                    BlkioEntry(8uL, 0uL, "Write", 200uL),
+                    BlkioEntry(253uL, 1uL, "Read", 5uL),
+                    BlkioEntry(253uL, 1uL, "Write", 0uL),
+                )
+            stats.ioServicedRecursive.first() shouldBe BlkioEntry(8uL, 0uL, "Read", 1uL)
+        }
+
+        test("stats use runc's JSON field names") {
+            val json =
+                JsonCodec.encode(
+                    CpuThrottling(periods = 1uL, throttledPeriods = 2uL, throttledTime = 3uL),
+                )
+            json shouldBe """{"periods":1,"throttled_periods":2,"throttled_time":3}"""
+        }
+    })
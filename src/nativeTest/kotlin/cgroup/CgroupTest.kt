@@ -47,12 +47,109 @@ class CgroupTest :
             fs.files["/sys/fs/cgroup/kontainer-42/memory.max"] shouldBe "1024"
         }
 
+        test("setup skips subtree_control writes for controllers already enabled") {
+            val fs = FakeFileSystem()
+            fs.files["/sys/fs/cgroup/cgroup.subtree_control"] = "cpu memory pids\n"
+            CgroupV2(fs).setup(
+                pid = 1,
+                cgroupPath = "default/x",
+                resources = LinuxResources(memory = LinuxMemory(limit = 1024L)),
+            )
+
+            fs.calls shouldNotContain "writeFile(/sys/fs/cgroup/cgroup.subtree_control, +memory)"
+            fs.files["/sys/fs/cgroup/cgroup.subtree_control"] shouldBe "cpu memory pids\n"
+            fs.files["/sys/fs/cgroup/default/cgroup.subtree_control"] shouldBe "+memory"
+        }
+
+        test("setup enables all missing controllers with a single write") {
+            val fs = FakeFileSystem()
+            fs.files["/sys/fs/cgroup/cgroup.subtree_control"] = "pids"
+            CgroupV2(fs).setup(
+                pid = 1,
+                cgroupPath = "x",
+                resources =
+                    LinuxResources(
+                        memory = LinuxMemory(limit = 1024L),
+                        cpu = LinuxCpu(shares = 1024L),
+                    ),
+            )
+
+            fs.calls.filter { it.startsWith("writeFile(/sys/fs/cgroup/cgroup.subtree_control") } shouldBe
+                listOf("writeFile(/sys/fs/cgroup/cgroup.subtree_control, +memory +cpu)")
+        }
+
+        test("setup writes cpuset.cpus/mems and enables only cpuset for a pin-only cpu") {
+            val fs = FakeFileSystem()
+            CgroupV2(fs).setup(
+                pid = 1,
+                cgroupPath = "x",
+                resources = LinuxResources(cpu = LinuxCpu(cpus = "0-3", mems = "0")),
+            )
+
+            fs.files["/sys/fs/cgroup/cgroup.subtree_control"] shouldBe "+cpuset"
+            fs.files["/sys/fs/cgroup/x/cpuset.cpus"] shouldBe "0-3"
+            fs.files["/sys/fs/cgroup/x/cpuset.mems"] shouldBe "0"
+            fs.files.keys shouldNotContain "/sys/fs/cgroup/x/cpu.weight"
+        }
+
+        test("setup writes unified entries after the typed fields and enables their controllers") {
+            val fs = FakeFileSystem()
+            CgroupV2(fs).setup(
+                pid = 1,
+                cgroupPath = "x",
+                resources =
+                    LinuxResources(
+                        memory = LinuxMemory(limit = 1024L),
+                        unified = mapOf("memory.max" to "2048", "memory.high" to "1024", "io.weight" to "200"),
+                    ),
+            )
+
+            fs.files["/sys/fs/cgroup/cgroup.subtree_control"] shouldBe "+memory +io"
+            fs.files["/sys/fs/cgroup/x/memory.max"] shouldBe "2048"
+            fs.files["/sys/fs/cgroup/x/memory.high"] shouldBe "1024"
+            fs.files["/sys/fs/cgroup/x/io.weight"] shouldBe "200"
+        }
+
+        test("unified keys outside controller interface files are refused") {
+            CgroupV2.unifiedController("memory.oom.group") shouldBe "memory"
+            listOf("cgroup.procs", "memory.", "memory", "../memory.max", "foo.bar").forEach {
+                runCatching { CgroupV2.unifiedController(it) }.isFailure shouldBe true
+            }
+        }
+
+        test("parseControllers accepts both listing and write syntax") {
+            CgroupV2.parseControllers("cpu memory\n") shouldBe setOf("cpu", "memory")
+            CgroupV2.parseControllers("+memory +pids") shouldBe setOf("memory", "pids")
+            CgroupV2.parseControllers("") shouldBe emptySet()
+        }
+
         test("setup short-circuits when both cgroupPath and resources are null") {
             val fs = FakeFileSystem()
             CgroupV2(fs).setup(pid = 1, cgroupPath = null, resources = null)
             fs.calls.isEmpty() shouldBe true
         }
 
+        // prepare / addProcess (cgroup created before the process exists)
+
+        test("prepare creates the cgroup and applies limits without adding a process") {
+            val fs = FakeFileSystem()
+            CgroupV2(fs).prepare(
+                cgroupPath = "default/x",
+                resources = LinuxResources(memory = LinuxMemory(limit = 1024L)),
+            )
+
+            fs.directories shouldContain "/sys/fs/cgroup/default/x"
+            fs.files["/sys/fs/cgroup/default/x/memory.max"] shouldBe "1024"
+            fs.files.keys shouldNotContain "/sys/fs/cgroup/default/x/cgroup.procs"
+        }
+
+        test("addProcess writes the pid to cgroup.procs") {
+            val fs = FakeFileSystem()
+            CgroupV2(fs).addProcess(pid = 77, cgroupPath = "/default/x")
+
+            fs.files["/sys/fs/cgroup/default/x/cgroup.procs"] shouldBe "77"
+        }
+
         // Resource value translation
 
         test("setup writes 'max' for limit = -1") {
@@ -0,0 +1,99 @@
+package cgroup
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+import spec.ANNOTATION_CPUSET_AUTOPIN
+import spec.Linux
+import spec.LinuxCpu
+import spec.LinuxResources
+import spec.Process
+import spec.Root
+import spec.Spec
+import syscall.FakeSyscall
+import utils.FakeFileSystem
+
+class CpusetTest :
+    FunSpec({
+
+        val node0 = NumaNode(0, listOf(0, 1, 2, 3))
+        val node1 = NumaNode(1, listOf(4, 5, 6, 7))
+
+        fun twoNodeFs() =
+            FakeFileSystem().apply {
+                files["/sys/devices/system/node/online"] = "0-1\n"
+                files["/sys/devices/system/node/node0/cpulist"] = "0-3\n"
+                files["/sys/devices/system/node/node1/cpulist"] = "4-7\n"
+            }
+
+        val spec =
+            Spec(
+                root = Root(path = "rootfs"),
+                process = Process(args = listOf("/bin/sh")),
+                annotations = mapOf(ANNOTATION_CPUSET_AUTOPIN to "true"),
+            )
+
+        test("parseCpuList expands ranges, sorts and dedupes") {
+            parseCpuList("0-3,8,10-11\n") shouldBe listOf(0, 1, 2, 3, 8, 10, 11)
+            parseCpuList("5,1,1-2") shouldBe listOf(1, 2, 5)
+            parseCpuList("") shouldBe emptyList()
+        }
+
+        test("parseCpuList rejects malformed lists") {
+            listOf("a", "3-1", "1-2-3", "-1").forEach {
+                runCatching { parseCpuList(it) }.isFailure shouldBe true
+            }
+        }
+
+        test("readNumaNodes skips nodes without CPUs") {
+            val fs = twoNodeFs()
+            fs.files["/sys/devices/system/node/online"] = "0-2"
+            fs.files["/sys/devices/system/node/node2/cpulist"] = "\n"
+            readNumaNodes(fs) shouldBe listOf(node0, node1)
+        }
+
+        test("readNumaNodes is empty without sysfs node information") {
+            readNumaNodes(FakeFileSystem()) shouldBe emptyList()
+        }
+
+        test("pickNumaNode picks the node with the fewest pinned siblings") {
+            val onNode0 = CpusetUsage(cpus = emptyList(), mems = listOf(0))
+            pickNumaNode(listOf(node0, node1), listOf(onNode0)) shouldBe node1
+            pickNumaNode(listOf(node0, node1), emptyList()) shouldBe node0
+        }
+
+        test("pickNumaNode counts CPU-only siblings against the nodes they touch") {
+            val spanning = CpusetUsage(cpus = listOf(3, 4), mems = emptyList())
+            val onNode0 = CpusetUsage(cpus = listOf(1), mems = emptyList())
+            val unpinned = CpusetUsage(cpus = emptyList(), mems = emptyList())
+            pickNumaNode(listOf(node0, node1), listOf(spanning, onNode0, unpinned)) shouldBe node1
+        }
+
+        test("autoPinCpuset pins to one node and keeps other cpu settings") {
+            val withShares = spec.copy(linux = Linux(resources = LinuxResources(cpu = LinuxCpu(shares = 512L))))
+            val pinned = autoPinCpuset(twoNodeFs(), withShares, "kontainer/c1", cgroupRoot = "/nonexistent")
+            pinned.linux?.resources?.cpu shouldBe LinuxCpu(shares = 512L, cpus = "0,1,2,3", mems = "0")
+        }
+
+        test("autoPinCpuset leaves specs alone without the annotation, with a placement, or on one node") {
+            val fs = twoNodeFs()
+            autoPinCpuset(fs, spec.copy(annotations = null), "c1", cgroupRoot = "/nonexistent") shouldBe
+                spec.copy(annotations = null)
+            val placed = spec.copy(linux = Linux(resources = LinuxResources(cpu = LinuxCpu(mems = "1"))))
+            autoPinCpuset(fs, placed, "c1", cgroupRoot = "/nonexistent") shouldBe placed
+            fs.files["/sys/devices/system/node/online"] = "0"
+            autoPinCpuset(fs, spec, "c1", cgroupRoot = "/nonexistent") shouldBe spec
+        }
+
+        test("applyCpuPlacement sets affinity and memory policy from the spec lists") {
+            val syscall = FakeSyscall()
+            applyCpuPlacement(syscall, LinuxCpu(cpus = "0-1,4", mems = "1"))
+            syscall.calls shouldBe listOf("setCpuAffinity(cpus=[0, 1, 4])", "bindMemoryPolicy(nodes=[1])")
+        }
+
+        test("applyCpuPlacement does nothing without cpus or mems") {
+            val syscall = FakeSyscall()
+            applyCpuPlacement(syscall, LinuxCpu(shares = 1024L))
+            applyCpuPlacement(syscall, null)
+            syscall.calls shouldBe emptyList()
+        }
+    })
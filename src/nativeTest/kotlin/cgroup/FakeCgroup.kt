@@ -7,10 +7,12 @@ import spec.LinuxResources
  *
  * Records every call as a string. [getPids] returns whatever a test
  * preseeds via [pidsByPath]; missing paths return an empty list.
+ * [readStats] returns [statsByPath] entries and throws for missing paths.
  */
 class FakeCgroup : Cgroup {
     val calls: MutableList<String> = mutableListOf()
     val pidsByPath: MutableMap<String, List<Int>> = mutableMapOf()
+    val statsByPath: MutableMap<String, Stats> = mutableMapOf()
 
     override fun setup(
         pid: Int,
@@ -20,6 +22,44 @@ class FakeCgroup : Cgroup {
         calls += "setup(pid=$pid, cgroupPath=$cgroupPath, hasResources=${resources != null})"
     }
 
+    override fun prepare(
+        cgroupPath: String,
+        resources: LinuxResources?,
+    ) {
+        calls += "prepare(cgroupPath=$cgroupPath, hasResources=${resources != null})"
+    }
+
+    override fun addProcess(
+        pid: Int,
+        cgroupPath: String,
+    ) {
+        calls += "addProcess(pid=$pid, cgroupPath=$cgroupPath)"
+    }
+
+    /** There is no directory to open; callers take the [addProcess] path. */
+    override fun openDirectoryFd(cgroupPath: String): Int {
+        calls += "openDirectoryFd(cgroupPath=$cgroupPath)"
+        return -1
+    }
+
+    /** No cgroupfs to watch; callers go without cgroup notifications. */
+    override fun openInterfaceFile(
+        cgroupPath: String,
+        name: String,
+    ): Int {
+        calls += "openInterfaceFile(cgroupPath=$cgroupPath, name=$name)"
+        return -1
+    }
+
+    override fun openPressureTrigger(
+        cgroupPath: String,
+        resource: String,
+        trigger: String,
+    ): Int {
+        calls += "openPressureTrigger(cgroupPath=$cgroupPath, resource=$resource, trigger=$trigger)"
+        return -1
+    }
+
     override fun cleanup(cgroupPath: String?) {
         calls += "cleanup(cgroupPath=$cgroupPath)"
     }
@@ -28,4 +68,9 @@ class FakeCgroup : Cgroup {
         calls += "getPids(cgroupPath=$cgroupPath)"
         return pidsByPath[cgroupPath] ?: emptyList()
     }
+
+    override fun readStats(cgroupPath: String): Stats {
+        calls += "readStats(cgroupPath=$cgroupPath)"
+        return statsByPath[cgroupPath] ?: throw Exception("no stats for $cgroupPath")
+    }
 }
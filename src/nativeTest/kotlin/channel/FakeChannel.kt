@@ -93,6 +93,14 @@ class FakeInitSender : InitSender {
         calls += "seccompNotifyDone()"
     }
 
+    override fun idmappedMount(fd: Int) {
+        calls += "idmappedMount(fd=$fd)"
+    }
+
+    override fun devTemplate(fd: Int) {
+        calls += "devTemplate(fd=$fd)"
+    }
+
     override fun close() {
         calls += "close()"
     }
@@ -102,6 +110,8 @@ class FakeInitReceiver : InitReceiver {
     val calls: MutableList<String> = mutableListOf()
     val mappingAcks: ArrayDeque<Unit> = ArrayDeque()
     val seccompDoneSignals: ArrayDeque<Unit> = ArrayDeque()
+    val idmappedMountFds: ArrayDeque<Int> = ArrayDeque()
+    var devTemplateFd: Int = -1
 
     override fun fd(): Int {
         calls += "fd()"
@@ -120,6 +130,17 @@ class FakeInitReceiver : InitReceiver {
             ?: error("no seccomp done signal preseeded")
     }
 
+    override fun waitForIdmappedMount(): Int {
+        calls += "waitForIdmappedMount()"
+        return idmappedMountFds.removeFirstOrNull()
+            ?: error("no idmapped mount fd preseeded")
+    }
+
+    override fun waitForDevTemplate(): Int {
+        calls += "waitForDevTemplate()"
+        return devTemplateFd
+    }
+
     override fun close() {
         calls += "close()"
     }
@@ -129,13 +150,17 @@ class FakeNotifyListener : NotifyListener {
     val calls: MutableList<String> = mutableListOf()
     val startSignals: ArrayDeque<Unit> = ArrayDeque()
 
+    /** Delivered to onUpdate, in order, before the start signal */
+    val updates: ArrayDeque<ProcessUpdate> = ArrayDeque()
+
     override fun fd(): Int {
         calls += "fd()"
         return -1
     }
 
-    override fun waitForContainerStart() {
+    override fun waitForContainerStart(onUpdate: (ProcessUpdate) -> Unit) {
         calls += "waitForContainerStart()"
+        while (updates.isNotEmpty()) onUpdate(updates.removeFirst())
         startSignals.removeFirstOrNull()
             ?: error("no start signal preseeded")
     }
@@ -151,4 +176,8 @@ class FakeNotifySocket : NotifySocket {
     override fun notifyContainerStart() {
         calls += "notifyContainerStart()"
     }
+
+    override fun sendProcessUpdate(update: ProcessUpdate) {
+        calls += "sendProcessUpdate($update)"
+    }
 }
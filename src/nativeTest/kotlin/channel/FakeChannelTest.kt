@@ -91,4 +91,15 @@ class FakeChannelTest :
 
             listener.calls shouldBe listOf("waitForContainerStart()")
         }
+
+        test("FakeNotifyListener delivers preseeded updates before the start signal") {
+            val listener = FakeNotifyListener()
+            listener.updates.addLast(ProcessUpdate(args = listOf("/bin/echo", "hi")))
+            listener.startSignals.addLast(Unit)
+
+            val received = mutableListOf<ProcessUpdate>()
+            listener.waitForContainerStart { received += it }
+
+            received shouldBe listOf(ProcessUpdate(args = listOf("/bin/echo", "hi")))
+        }
     })
@@ -0,0 +1,99 @@
+package channel
+
+import io.kotest.assertions.throwables.shouldThrow
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.collections.shouldContainExactly
+import io.kotest.matchers.ints.shouldBeGreaterThanOrEqual
+import io.kotest.matchers.shouldBe
+import io.kotest.matchers.string.shouldContain
+import kotlinx.cinterop.ExperimentalForeignApi
+import kotlinx.cinterop.refTo
+import platform.posix.*
+
+@OptIn(ExperimentalForeignApi::class)
+private fun seqpacketPair(): Pair<Int, Int> {
+    val sv = IntArray(2)
+    socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv.refTo(0)) shouldBe 0
+    return sv[0] to sv[1]
+}
+
+@OptIn(ExperimentalForeignApi::class)
+class FrameTest :
+    FunSpec({
+
+        test("every message maps to a frame type and back") {
+            val messages =
+                listOf(
+                    Message.InitReady,
+                    Message.WriteMapping,
+                    Message.MappingWritten,
+                    Message.SeccompNotify,
+                    Message.SeccompNotifyDone,
+                    Message.IdmappedMount,
+                    Message.DevTemplate,
+                    Message.NoDevTemplate,
+                    Message.ExecFailed("exec: no such file"),
+                    Message.OtherError("boom"),
+                )
+            val decoded =
+                messages.map {
+                    val payload = it.framePayload()
+                    messageOf(it.frameType(), payload, payload.size)
+                }
+            decoded shouldContainExactly messages
+        }
+
+        test("a frame crosses a seqpacket socket with its payload and fd") {
+            val (a, b) = seqpacketPair()
+            val pipeFds = IntArray(2)
+            pipe(pipeFds.refTo(0)) shouldBe 0
+            try {
+                sendFrame(a, FRAME_EXEC_FAILED, "bad".encodeToByteArray(), pipeFds[0])
+                val buffer = ByteArray(CHANNEL_MAX_PAYLOAD)
+                val frame = receiveFrame(b, buffer)
+
+                frame.type shouldBe FRAME_EXEC_FAILED
+                buffer.decodeToString(0, frame.length) shouldBe "bad"
+                frame.fd shouldBeGreaterThanOrEqual 0
+                close(frame.fd)
+            } finally {
+                close(pipeFds[0])
+                close(pipeFds[1])
+                close(a)
+                close(b)
+            }
+        }
+
+        test("a frame larger than the buffer is rejected, not cut") {
+            val (a, b) = seqpacketPair()
+            try {
+                sendFrame(a, FRAME_OTHER_ERROR, ByteArray(64))
+                shouldThrow<Exception> { receiveFrame(b, ByteArray(16)) }.message shouldContain "Malformed frame"
+            } finally {
+                close(a)
+                close(b)
+            }
+        }
+
+        test("sync frames carry int32 values and check type and size") {
+            val (a, b) = seqpacketPair()
+            try {
+                sendSyncFrame(a, FRAME_STAGE2_PID, "send", 4242, 1)
+                receiveSyncFrame(b, FRAME_STAGE2_PID, 2, "recv").toList() shouldContainExactly listOf(4242, 1)
+
+                sendSyncFrame(a, FRAME_CGROUP_ACK, "send")
+                shouldThrow<Exception> { receiveSyncFrame(b, FRAME_USERMAP_ACK, 0, "recv") }.message shouldContain
+                    "expected frame 0x41"
+            } finally {
+                close(a)
+                close(b)
+            }
+        }
+
+        test("a closed peer is reported") {
+            val (a, b) = seqpacketPair()
+            close(a)
+            shouldThrow<Exception> { receiveFrame(b, ByteArray(0)) }.message shouldBe "Connection closed"
+            close(b)
+        }
+    })
@@ -0,0 +1,83 @@
+package command
+
+import io.kotest.assertions.throwables.shouldThrow
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.nulls.shouldBeNull
+import io.kotest.matchers.shouldBe
+import io.kotest.matchers.shouldNotBe
+import io.kotest.matchers.string.shouldContain
+import kotlinx.cinterop.ExperimentalForeignApi
+import kotlinx.cinterop.toKString
+import platform.posix.FD_CLOEXEC
+import platform.posix.F_GETFD
+import platform.posix.fcntl
+import platform.posix.getenv
+import platform.posix.setenv
+import spec.Process
+import spec.Root
+import spec.Spec
+
+class CreateBatchTest :
+    FunSpec({
+
+        test("parseBatchEntries reads ids, bundles and pid files") {
+            val entries =
+                parseBatchEntries(
+                    """[{"id": "a", "bundle": "/b1"}, {"id": "b", "bundle": "/b1", "pidFile": "/run/b.pid"}, {"id": "c"}]""",
+                )
+            entries shouldBe
+                listOf(
+                    BatchEntry("a", "/b1"),
+                    BatchEntry("b", "/b1", "/run/b.pid"),
+                    BatchEntry("c", "."),
+                )
+        }
+
+        test("parseBatchEntries accepts an empty batch") {
+            parseBatchEntries("[]") shouldBe emptyList()
+        }
+
+        test("parseBatchEntries rejects duplicate ids") {
+            val e = shouldThrow<Exception> { parseBatchEntries("""[{"id": "a"}, {"id": "a"}]""") }
+            e.message shouldContain "duplicate container id a"
+        }
+
+        test("parseBatchEntries rejects empty ids") {
+            shouldThrow<Exception> { parseBatchEntries("""[{"id": ""}]""") }
+        }
+
+        test("parseBatchEntries rejects malformed JSON") {
+            val e = shouldThrow<Exception> { parseBatchEntries("{not a list") }
+            e.message shouldContain "invalid batch request"
+        }
+
+        @OptIn(ExperimentalForeignApi::class)
+        test("takeInheritedSpec decodes the spec written by writeSpecFd and closes the fd") {
+            val spec =
+                Spec(
+                    root = Root("rootfs"),
+                    process = Process(args = listOf("/bin/sh", "-c", "true")),
+                    hostname = "batch",
+                    annotations = mapOf("org.kontainer.test" to "1"),
+                )
+            val fd = writeSpecFd(spec, 0)
+            fd shouldNotBe -1
+            (fcntl(fd, F_GETFD) and FD_CLOEXEC) shouldBe FD_CLOEXEC
+
+            setenv(SPEC_FD_ENV, fd.toString(), 1)
+            takeInheritedSpec() shouldBe spec
+            getenv(SPEC_FD_ENV)?.toKString().shouldBeNull()
+            fcntl(fd, F_GETFD) shouldBe -1
+        }
+
+        test("takeInheritedSpec yields null without the variable") {
+            takeInheritedSpec().shouldBeNull()
+        }
+
+        @OptIn(ExperimentalForeignApi::class)
+        test("takeInheritedSpec ignores and clears a malformed variable") {
+            setenv(SPEC_FD_ENV, "not-a-number", 1)
+            takeInheritedSpec().shouldBeNull()
+            getenv(SPEC_FD_ENV)?.toKString().shouldBeNull()
+        }
+    })
@@ -0,0 +1,53 @@
+package command
+
+import cgroup.CgroupV2
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.collections.shouldBeEmpty
+import io.kotest.matchers.shouldBe
+
+class EventsTest :
+    FunSpec({
+
+        test("parseKeyedCounters reads flat keyed cgroup files") {
+            CgroupV2.parseKeyedCounters("low 0\nhigh 3\nmax 1\noom 2\noom_kill 1\n") shouldBe
+                mapOf("low" to 0L, "high" to 3L, "max" to 1L, "oom" to 2L, "oom_kill" to 1L)
+            CgroupV2.parseKeyedCounters("populated 0\nfrozen 0\n")["populated"] shouldBe 0L
+        }
+
+        test("an oom_kill increase is reported as an oom event") {
+            val old = mapOf("oom" to 0L, "oom_kill" to 0L, "high" to 5L)
+            val new = mapOf("oom" to 1L, "oom_kill" to 1L, "high" to 9L)
+            counterEvents("c1", "memory.events", old, new) shouldBe
+                listOf(ContainerEvent("oom", "c1", mapOf("oom" to 1L, "oom_kill" to 1L)))
+        }
+
+        test("memory.high throttling alone is not an oom event") {
+            counterEvents("c1", "memory.events", mapOf("high" to 1L), mapOf("high" to 2L)).shouldBeEmpty()
+        }
+
+        test("a pids.events max increase is reported as pids.limit") {
+            counterEvents("c1", "pids.events", mapOf("max" to 2L), mapOf("max" to 3L)) shouldBe
+                listOf(ContainerEvent("pids.limit", "c1", mapOf("max" to 3L)))
+            counterEvents("c1", "pids.events", mapOf("max" to 3L), mapOf("max" to 3L)).shouldBeEmpty()
+        }
+
+        test("parsePressureTotals reads the stall totals of a pressure file") {
+            val content =
+                "some avg10=1.50 avg60=0.40 avg300=0.10 total=123456\n" +
+                    "full avg10=0.00 avg60=0.00 avg300=0.00 total=789\n"
+            parsePressureTotals(content) shouldBe mapOf("some.total" to 123456L, "full.total" to 789L)
+        }
+
+        test("validatePsiTrigger accepts kernel-sized windows only") {
+            validatePsiTrigger("some 150000 1000000")
+            validatePsiTrigger("full 500000 2000000")
+            listOf(
+                "some 150000",
+                "most 150000 1000000",
+                "some 150000 100000",
+                "some 150000 20000000",
+                "full 3000000 2000000",
+                "some 0 1000000",
+            ).forEach { runCatching { validatePsiTrigger(it) }.isFailure shouldBe true }
+        }
+    })
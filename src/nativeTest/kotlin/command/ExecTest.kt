@@ -0,0 +1,43 @@
+package command
+
+import bootstrap.kontainer_exec
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+import kotlinx.cinterop.*
+import platform.posix.*
+import syscall.pidfdOpen
+
+@OptIn(ExperimentalForeignApi::class)
+class ExecTest :
+    FunSpec({
+
+        fun runExec(
+            pidfd: Int,
+            nstypes: Int,
+            vararg args: String,
+        ): Int =
+            memScoped {
+                val argv = allocArray<CPointerVar<ByteVar>>(args.size + 1)
+                args.forEachIndexed { i, a -> argv[i] = a.cstr.ptr }
+                argv[args.size] = null
+                val pid = kontainer_exec(getpid(), pidfd, nstypes, -1, argv)
+                (pid > 0) shouldBe true
+                val status = alloc<IntVar>()
+                waitpid(pid, status.ptr, 0)
+                (status.value shr 8) and 0xff
+            }
+
+        test("a process shares all namespaces with itself") {
+            namespacesToJoin(getpid()) shouldBe 0
+        }
+
+        test("the exit status of the command is the clone's") {
+            val pidfd = pidfdOpen(getpid())
+            runExec(pidfd, 0, "sh", "-c", "exit 3") shouldBe 3
+            if (pidfd >= 0) close(pidfd)
+        }
+
+        test("a missing command exits 127") {
+            runExec(-1, 0, "/nonexistent/command") shouldBe 127
+        }
+    })
@@ -0,0 +1,51 @@
+package command
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+
+class PsTest :
+    FunSpec({
+
+        test("formatPsRow lines up with the header like ps -ef") {
+            val row = PsRow("root", 1, 0, 0, "10:42", "pts/0", "00:00:01", "/bin/sh -c sleep")
+            val line = formatPsRow(row)
+            line shouldBe "root           1       0  0 10:42 pts/0    00:00:01 /bin/sh -c sleep"
+            line.indexOf("/bin/sh") shouldBe PS_TABLE_HEADER.indexOf("CMD")
+            line.indexOf("00:00:01") + 8 shouldBe PS_TABLE_HEADER.indexOf("TIME") + 4
+        }
+
+        test("formatCpuTime prints HH:MM:SS and a day prefix past 24 hours") {
+            formatCpuTime(0, 100) shouldBe "00:00:00"
+            formatCpuTime(366_100, 100) shouldBe "01:01:01"
+            formatCpuTime((86400L + 3661) * 100, 100) shouldBe "1-01:01:01"
+        }
+
+        test("cpuPercent is lifetime usage capped at 99") {
+            cpuPercent(50, 100, 10.0) shouldBe 5
+            cpuPercent(5000, 100, 10.0) shouldBe 99
+            cpuPercent(10, 100, 0.0) shouldBe 0
+        }
+
+        test("ttyName decodes pseudo-terminals and consoles") {
+            ttyName(0) shouldBe "?"
+            ttyName((136 shl 8) or 3) shouldBe "pts/3"
+            ttyName((137 shl 8) or 1) shouldBe "pts/257"
+            ttyName((4 shl 8) or 1) shouldBe "tty1"
+            ttyName((4 shl 8) or 64) shouldBe "ttyS0"
+            ttyName((5 shl 8) or 1) shouldBe "?"
+        }
+
+        test("formatCommand joins NUL-separated arguments") {
+            formatCommand("sleep\u0000infinity\u0000".encodeToByteArray(), "sleep") shouldBe "sleep infinity"
+        }
+
+        test("formatCommand falls back to the bracketed comm without a cmdline") {
+            formatCommand(ByteArray(0), "kworker/0:1") shouldBe "[kworker/0:1]"
+        }
+
+        test("parseEffectiveUid takes the second Uid field") {
+            val status = "Name:\tsleep\nState:\tS (sleeping)\nUid:\t1000\t0\t0\t0\nGid:\t1000\t1000\t1000\t1000\n"
+            parseEffectiveUid(status) shouldBe 0
+            parseEffectiveUid("Name:\tsleep\n") shouldBe null
+        }
+    })
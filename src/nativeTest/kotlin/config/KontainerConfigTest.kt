@@ -0,0 +1,37 @@
+package config
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+import state.ContainerStatus
+import state.State
+import state.save
+import utils.FakeFileSystem
+
+class KontainerConfigTest :
+    FunSpec({
+
+        fun stateOf(cgroupPath: String?) =
+            State(ociVersion = "1.0.0", id = "c", status = ContainerStatus.CREATED, pid = 1, bundle = "/b", cgroupPath = cgroupPath)
+
+        test("the cgroup path comes from state.json") {
+            val fs = FakeFileSystem()
+            stateOf("kontainer/c").save(fs, "/run/kontainer")
+
+            loadKontainerConfig(fs, "/run/kontainer", "c") shouldBe KontainerConfig(cgroupPath = "kontainer/c")
+        }
+
+        test("containers from older versions still have their kontainer_config.json read") {
+            val fs = FakeFileSystem()
+            stateOf(null).save(fs, "/run/kontainer")
+            fs.files["/run/kontainer/c/kontainer_config.json"] = """{"cgroup_path":"legacy/c"}"""
+
+            loadKontainerConfig(fs, "/run/kontainer", "c").cgroupPath shouldBe "legacy/c"
+        }
+
+        test("no cgroup path anywhere is not an error") {
+            val fs = FakeFileSystem()
+            stateOf(null).save(fs, "/run/kontainer")
+
+            loadKontainerConfig(fs, "/run/kontainer", "c").cgroupPath shouldBe null
+        }
+    })
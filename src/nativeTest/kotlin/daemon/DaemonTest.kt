@@ -0,0 +1,49 @@
+package daemon
+
+import cgroup.FakeCgroup
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+import io.kotest.matchers.string.shouldContain
+import syscall.FakeSyscall
+import utils.FakeFileSystem
+
+class DaemonTest :
+    FunSpec({
+
+        fun daemon() = Daemon(FakeSyscall(), FakeFileSystem(), FakeCgroup(), "/nonexistent/kontainer-daemon-test")
+
+        test("requests and responses survive the wire encoding") {
+            val request = DaemonRequest(DaemonOp.DELETE, "c1", force = true)
+            decodeDaemonRequest(encodeDaemonRequest(request)) shouldBe request
+
+            val response = DaemonResponse(ok = true, output = "{\"id\": \"c1\"}")
+            decodeDaemonResponse(encodeDaemonResponse(response)) shouldBe response
+        }
+
+        test("state of an unknown container fails without throwing") {
+            val response = daemon().handle(DaemonRequest(DaemonOp.STATE, "missing"))
+            response.ok shouldBe false
+            response.error!! shouldContain "does not exist"
+        }
+
+        test("kill without a signal is rejected") {
+            val response = daemon().handle(DaemonRequest(DaemonOp.KILL, "c1"))
+            response.ok shouldBe false
+            response.error!! shouldContain "signal"
+        }
+
+        test("forced delete of an unknown container succeeds") {
+            daemon().handle(DaemonRequest(DaemonOp.DELETE, "missing", force = true)).ok shouldBe true
+            daemon().handle(DaemonRequest(DaemonOp.DELETE, "missing")).ok shouldBe false
+        }
+
+        test("unknown operations are rejected") {
+            val response = daemon().handle(DaemonRequest("pause", "c1"))
+            response.ok shouldBe false
+            response.error!! shouldContain "unknown operation"
+        }
+
+        test("daemon socket lives in the runtime root") {
+            daemonSocketPath("/run/kontainer") shouldBe "/run/kontainer/kontainer.sock"
+        }
+    })
@@ -0,0 +1,67 @@
+package hook
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+import io.kotest.matchers.string.shouldContain
+import platform.posix.getpid
+import spec.ANNOTATION_HOOKS_PARALLEL
+import spec.Hook
+import state.ContainerStatus
+import state.State
+import utils.RealFileSystem
+
+class HookTest :
+    FunSpec({
+
+        val fs = RealFileSystem()
+        val dir = "/tmp/kontainer-hook-test-${getpid()}"
+        fs.createDirectories(dir)
+        val state = State(ociVersion = "1.2.0", id = "hooked", status = ContainerStatus.CREATED, pid = getpid(), bundle = dir)
+        val parallel = state.copy(annotations = mapOf(ANNOTATION_HOOKS_PARALLEL to "true"))
+
+        fun sh(
+            script: String,
+            timeout: Int? = null,
+        ) = Hook(path = "/bin/sh", args = listOf("sh", "-c", script), timeout = timeout)
+
+        test("a hook receives the state JSON on stdin") {
+            execHook(sh("cat > $dir/stdin"), state) shouldBe true
+            fs.readTextFile("$dir/stdin") shouldContain "\"id\":\"hooked\""
+        }
+
+        test("a state larger than the default pipe reaches the hook whole") {
+            val bundle = dir + "/" + "b".repeat(200_000)
+            execHook(sh("wc -c > $dir/size"), state.copy(bundle = bundle)) shouldBe true
+            (fs.readTextFile("$dir/size").trim().toInt() > 200_000) shouldBe true
+        }
+
+        test("a hook that ignores stdin still succeeds") {
+            execHook(sh("exit 0"), state) shouldBe true
+        }
+
+        test("serial hooks stop at the first failure") {
+            runHooks(listOf(sh("exit 1"), sh("touch $dir/serial")), state) shouldBe false
+            fs.fileExists("$dir/serial") shouldBe false
+        }
+
+        test("parallel hooks all run even when one fails") {
+            runHooks(listOf(sh("exit 1"), sh("touch $dir/parallel")), parallel) shouldBe false
+            fs.fileExists("$dir/parallel") shouldBe true
+        }
+
+        test("parallel hooks succeed together") {
+            runHooks(listOf(sh("exit 0"), sh("exit 0"), sh("exit 0")), parallel) shouldBe true
+        }
+
+        test("a hook past its timeout is killed") {
+            execHook(sh("sleep 30", timeout = 1), state) shouldBe false
+        }
+
+        test("a slow hook does not hold back the timeout of a fast one") {
+            runHooks(listOf(sh("sleep 30", timeout = 1), sh("exit 0")), parallel) shouldBe false
+        }
+
+        test("a missing hook binary fails") {
+            execHook(Hook(path = "$dir/missing"), state) shouldBe false
+        }
+    })
@@ -0,0 +1,35 @@
+package logger
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+import io.kotest.matchers.types.shouldBeSameInstanceAs
+
+class LoggerTest :
+    FunSpec({
+
+        test("escapeJson returns a message without special characters as is") {
+            val message = "created cgroup kontainer/abc"
+            Logger.escapeJson(message) shouldBeSameInstanceAs message
+        }
+
+        test("escapeJson escapes quotes, backslashes and control characters") {
+            Logger.escapeJson("say \"hi\"\\n\nnext\tline\u0001") shouldBe
+                "say \\\"hi\\\"\\\\n\\nnext\\tline\\u0001"
+        }
+
+        test("lazy messages are not built when the level is disabled") {
+            val previous = Logger.getLogLevel()
+            Logger.setLogLevel(Logger.Level.INFO)
+            try {
+                var built = false
+                Logger.debug {
+                    built = true
+                    "never"
+                }
+                built shouldBe false
+                Logger.isEnabled(Logger.Level.WARN) shouldBe true
+            } finally {
+                Logger.setLogLevel(previous)
+            }
+        }
+    })
@@ -57,4 +57,20 @@ class NamespaceFlagsTest :
             (all and pidOnly) shouldBe pidOnly
             (all > pidOnly) shouldBe true
         }
+
+        test("namespaceJoinPaths keeps only entries with a path") {
+            val paths =
+                namespaceJoinPaths(
+                    listOf(
+                        Namespace("pid"),
+                        Namespace("network", "/proc/42/ns/net"),
+                        Namespace("bogus", "/proc/42/ns/bogus"),
+                    ),
+                )
+            paths shouldBe listOf(namespaceCloneFlag("network") to "/proc/42/ns/net")
+        }
+
+        test("namespaceJoinPaths returns empty for null") {
+            namespaceJoinPaths(null) shouldBe emptyList()
+        }
     })
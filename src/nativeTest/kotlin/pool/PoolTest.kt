@@ -0,0 +1,87 @@
+package pool
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+import io.kotest.matchers.shouldNotBe
+import spec.ANNOTATION_OVERLAY_LOWER
+import spec.ANNOTATION_OVERLAY_UPPER
+import spec.ANNOTATION_OVERLAY_WORK
+import spec.Hook
+import spec.Hooks
+import spec.Linux
+import spec.LinuxMemory
+import spec.LinuxResources
+import spec.Namespace
+import spec.Process
+import spec.Root
+import spec.Spec
+
+class PoolTest :
+    FunSpec({
+
+        fun template(
+            args: List<String> = listOf("/bin/true"),
+            env: List<String>? = listOf("PATH=/bin"),
+            hostname: String? = "box",
+            namespaces: List<String> = listOf("pid", "mount", "uts"),
+            memoryLimit: Long? = null,
+        ) = Spec(
+            root = Root(path = "rootfs"),
+            process = Process(args = args, env = env),
+            hostname = hostname,
+            annotations = mapOf("request" to "1"),
+            linux =
+                Linux(
+                    namespaces = namespaces.map { Namespace(it) },
+                    resources = memoryLimit?.let { LinuxResources(memory = LinuxMemory(limit = it)) },
+                ),
+        )
+
+        test("poolTemplateKey ignores per-instance args, env and annotations") {
+            val a = template()
+            val b = template(args = listOf("/bin/sh", "-c", "exit 3"), env = listOf("A=1")).copy(annotations = null)
+
+            poolTemplateKey(a, "/b/rootfs", "/b") shouldBe poolTemplateKey(b, "/b/rootfs", "/b")
+        }
+
+        test("poolTemplateKey ignores the hostname only with a UTS namespace") {
+            poolTemplateKey(template(hostname = "a"), "/r", "/b") shouldBe
+                poolTemplateKey(template(hostname = "b"), "/r", "/b")
+
+            val noUts = listOf("pid", "mount")
+            poolTemplateKey(template(hostname = "a", namespaces = noUts), "/r", "/b") shouldNotBe
+                poolTemplateKey(template(hostname = "b", namespaces = noUts), "/r", "/b")
+        }
+
+        test("poolTemplateKey differs for a different rootfs or resources") {
+            poolTemplateKey(template(), "/a/rootfs", "/b") shouldNotBe poolTemplateKey(template(), "/b/rootfs", "/b")
+            poolTemplateKey(template(memoryLimit = 1024L), "/r", "/b") shouldNotBe poolTemplateKey(template(), "/r", "/b")
+        }
+
+        test("poolTemplateKey keeps the runtime's annotations") {
+            val runtime = "org.kontainer.test"
+            val annotated = template().copy(annotations = mapOf("request" to "1", runtime to "true"))
+            poolTemplateKey(annotated, "/r", "/b") shouldNotBe poolTemplateKey(template(), "/r", "/b")
+            poolTemplateKey(annotated, "/r", "/b") shouldBe
+                poolTemplateKey(annotated.copy(annotations = mapOf(runtime to "true")), "/r", "/b")
+        }
+
+        test("poolTemplateKey resolves relative overlay layers against the bundle") {
+            val layered = template().copy(annotations = mapOf(ANNOTATION_OVERLAY_LOWER to "layers/base"))
+            poolTemplateKey(layered, "/r", "/b1") shouldNotBe poolTemplateKey(layered, "/r", "/b2")
+            val absolute = template().copy(annotations = mapOf(ANNOTATION_OVERLAY_LOWER to "/b1/layers/base"))
+            poolTemplateKey(layered, "/r", "/b1") shouldBe poolTemplateKey(absolute, "/r", "/b2")
+        }
+
+        test("isPoolEligible rejects overlays with an upper layer") {
+            val upper = mapOf(ANNOTATION_OVERLAY_LOWER to "/l", ANNOTATION_OVERLAY_UPPER to "/u", ANNOTATION_OVERLAY_WORK to "/w")
+            isPoolEligible(template().copy(annotations = mapOf(ANNOTATION_OVERLAY_LOWER to "/l"))) shouldBe true
+            isPoolEligible(template().copy(annotations = upper)) shouldBe false
+        }
+
+        test("isPoolEligible rejects specs with hooks or a cgroupsPath") {
+            isPoolEligible(template()) shouldBe true
+            isPoolEligible(template().copy(hooks = Hooks(poststart = listOf(Hook(path = "/bin/true"))))) shouldBe false
+            isPoolEligible(template().copy(linux = Linux(cgroupsPath = "/x"))) shouldBe false
+        }
+    })
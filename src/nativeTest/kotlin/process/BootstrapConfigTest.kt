@@ -0,0 +1,129 @@
+package process
+
+import io.kotest.assertions.throwables.shouldThrow
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+import spec.Linux
+import spec.Namespace
+import spec.Process
+import spec.Root
+import spec.Spec
+import utils.CborCodec
+
+class BootstrapConfigTest :
+    FunSpec({
+
+        fun sampleConfig(
+            traceFd: Int = -1,
+            cgroupFd: Int = -1,
+            specCbor: ByteArray = ByteArray(0),
+            seccompBpf: ByteArray = ByteArray(0),
+            rlimits: List<BootstrapRlimit> = emptyList(),
+        ) = BootstrapConfig(
+            cloneFlags = 0x20020000u,
+            nsPaths = listOf(0x40000000u to "/proc/42/ns/net"),
+            bundlePath = "/bundles/abc",
+            rootfsPath = "/bundles/abc/rootfs",
+            containerId = "abc-123",
+            notifySocketPath = "/tmp/kontainer-abc-123.sock",
+            mainSenderFd = 5,
+            initReceiverFd = 8,
+            notifyListenerFd = 9,
+            traceFd = traceFd,
+            cgroupFd = cgroupFd,
+            traceStartNs = if (traceFd >= 0) 81234000123L else 0L,
+            specCbor = specCbor,
+            seccompBpf = seccompBpf,
+            rlimits = rlimits,
+        )
+
+        test("encode then decode round-trips every field") {
+            val original =
+                sampleConfig(
+                    traceFd = 11,
+                    cgroupFd = 12,
+                    specCbor = byteArrayOf(1, 2, 3, 4, 5),
+                    seccompBpf = ByteArray(16) { it.toByte() },
+                    rlimits = listOf(BootstrapRlimit(7, 1024uL, 4096uL), BootstrapRlimit(3, 8388608uL, ULong.MAX_VALUE)),
+                )
+            val decoded = BootstrapConfig.decode(original.encode())
+
+            decoded.cloneFlags shouldBe original.cloneFlags
+            decoded.nsPaths shouldBe original.nsPaths
+            decoded.bundlePath shouldBe original.bundlePath
+            decoded.rootfsPath shouldBe original.rootfsPath
+            decoded.containerId shouldBe original.containerId
+            decoded.notifySocketPath shouldBe original.notifySocketPath
+            decoded.mainSenderFd shouldBe 5
+            decoded.initReceiverFd shouldBe 8
+            decoded.notifyListenerFd shouldBe 9
+            decoded.traceFd shouldBe 11
+            decoded.cgroupFd shouldBe 12
+            decoded.traceStartNs shouldBe 81234000123L
+            decoded.specCbor.toList() shouldBe listOf<Byte>(1, 2, 3, 4, 5)
+            decoded.seccompBpf.toList() shouldBe original.seccompBpf.toList()
+            decoded.rlimits shouldBe original.rlimits
+        }
+
+        test("encode writes the header and pads attributes to 4 bytes") {
+            val encoded = sampleConfig().encode()
+
+            encoded.copyOfRange(0, 4).toList() shouldBe listOf<Byte>(0x54, 0x53, 0x42, 0x4b)
+            encoded[4] shouldBe BootstrapConfig.VERSION.toByte()
+            val total =
+                (encoded[8].toInt() and 0xFF) or
+                    ((encoded[9].toInt() and 0xFF) shl 8) or
+                    ((encoded[10].toInt() and 0xFF) shl 16) or
+                    ((encoded[11].toInt() and 0xFF) shl 24)
+            total shouldBe encoded.size
+            (encoded.size % 4) shouldBe 0
+        }
+
+        test("decode defaults optional fields when absent") {
+            val decoded = BootstrapConfig.decode(sampleConfig().encode())
+
+            decoded.traceFd shouldBe -1
+            decoded.cgroupFd shouldBe -1
+            decoded.traceStartNs shouldBe 0L
+            decoded.specCbor.size shouldBe 0
+            decoded.seccompBpf.size shouldBe 0
+            decoded.rlimits shouldBe emptyList()
+        }
+
+        test("fdList keeps wire order and omits optional fds when unset") {
+            sampleConfig().fdList() shouldBe
+                listOf(
+                    BootstrapConfig.FD_MAIN_SENDER to 5,
+                    BootstrapConfig.FD_INIT_RECEIVER to 8,
+                    BootstrapConfig.FD_NOTIFY_LISTENER to 9,
+                )
+            sampleConfig(traceFd = 3).fdList().last() shouldBe (BootstrapConfig.FD_TRACE to 3)
+            sampleConfig(traceFd = 3, cgroupFd = 4).fdList().takeLast(2) shouldBe
+                listOf(BootstrapConfig.FD_TRACE to 3, BootstrapConfig.FD_CGROUP to 4)
+        }
+
+        test("decode rejects a bad magic") {
+            val encoded = sampleConfig().encode()
+            encoded[0] = 0
+            shouldThrow<Exception> { BootstrapConfig.decode(encoded) }
+        }
+
+        test("decode rejects a truncated message") {
+            val encoded = sampleConfig().encode()
+            shouldThrow<Exception> { BootstrapConfig.decode(encoded.copyOf(encoded.size - 4)) }
+        }
+
+        test("spec survives the CBOR hop through the config") {
+            val spec =
+                Spec(
+                    root = Root(path = "rootfs"),
+                    process = Process(args = listOf("/bin/sh", "-c", "true"), env = listOf("PATH=/bin")),
+                    hostname = "box",
+                    annotations = mapOf("k" to "v"),
+                    linux = Linux(namespaces = listOf(Namespace("pid"), Namespace("mount"))),
+                )
+            val decoded = BootstrapConfig.decode(sampleConfig(specCbor = CborCodec.encode(spec)).encode())
+
+            CborCodec.decode<Spec>(decoded.specCbor) shouldBe spec
+        }
+    })
@@ -0,0 +1,130 @@
+package process
+
+import bootstrap.kontainer_park
+import channel.SocketNotifyListener
+import channel.SocketNotifySocket
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.ints.shouldBeGreaterThan
+import io.kotest.matchers.longs.shouldBeLessThan
+import io.kotest.matchers.shouldBe
+import kotlinx.cinterop.*
+import platform.posix.*
+import spec.ANNOTATION_INIT_PARK
+import spec.Hook
+import spec.Hooks
+import spec.Process
+import spec.Root
+import spec.Spec
+
+@OptIn(ExperimentalForeignApi::class)
+class ParkedInitTest :
+    FunSpec({
+
+        /** Contents of a small /proc file, empty if it cannot be read */
+        fun procText(path: String): String =
+            memScoped {
+                val fd = open(path, O_RDONLY or O_CLOEXEC)
+                if (fd < 0) return@memScoped ""
+                val buffer = allocArray<ByteVar>(8192)
+                val n = read(fd, buffer, 8192u)
+                close(fd)
+                if (n <= 0) "" else buffer.readBytes(n.toInt()).decodeToString()
+            }
+
+        /** A "<field>: <n> kB" line of /proc/<pid>/status */
+        fun statusKb(
+            pid: Int,
+            field: String,
+        ): Long =
+            procText("/proc/$pid/status")
+                .lineSequence()
+                .first { it.startsWith("$field:") }
+                .substringAfter(':')
+                .trim()
+                .removeSuffix(" kB")
+                .toLong()
+
+        val spec =
+            Spec(
+                root = Root(path = "rootfs"),
+                process = Process(args = listOf("/bin/sleep", "infinity")),
+                annotations = mapOf(ANNOTATION_INIT_PARK to "true"),
+            )
+
+        test("canParkInit needs the annotation") {
+            canParkInit(spec, "c1") shouldBe true
+            canParkInit(spec.copy(annotations = null), "c1") shouldBe false
+            canParkInit(spec.copy(annotations = mapOf(ANNOTATION_INIT_PARK to "false")), "c1") shouldBe false
+        }
+
+        test("canParkInit refuses inits that run Kotlin code after the start signal") {
+            val hook = Hooks(startContainer = listOf(Hook(path = "/bin/true")))
+            canParkInit(spec.copy(hooks = hook), "c1") shouldBe false
+            canParkInit(spec.copy(process = Process(args = emptyList())), "c1") shouldBe false
+            canParkInit(spec, "pool-abc-1-0") shouldBe false
+        }
+
+        test("canParkInit refuses exec labels") {
+            val label = "system_u:system_r:container_t:s0"
+            canParkInit(spec.copy(process = spec.process.copy(selinuxLabel = label)), "c1") shouldBe false
+            canParkInit(spec.copy(process = spec.process.copy(apparmorProfile = "container-default")), "c1") shouldBe false
+        }
+
+        test("poststart hooks do not prevent parking") {
+            canParkInit(spec.copy(hooks = Hooks(poststart = listOf(Hook(path = "/bin/true")))), "c1") shouldBe true
+        }
+
+        test("a parked init holds a few pages until the start message") {
+            val socketPath = "/tmp/kontainer-park-test-${getpid()}.sock"
+            val listener = SocketNotifyListener(socketPath)
+            try {
+                val pid =
+                    memScoped {
+                        val args = listOf("/bin/sh", "-c", "exit 7")
+                        val argv = allocArray<CPointerVar<ByteVar>>(args.size + 1)
+                        args.forEachIndexed { i, arg -> argv[i] = arg.cstr.ptr }
+                        argv[args.size] = null
+                        val envp = allocArray<CPointerVar<ByteVar>>(2)
+                        envp[0] = "PATH=/usr/bin:/bin".cstr.ptr
+                        envp[1] = null
+                        // The child of this threaded runner only calls into C
+                        val child = fork()
+                        if (child == 0) {
+                            kontainer_park(listener.fd(), -1, 0u, argv, envp)
+                            _exit(126)
+                        }
+                        child
+                    }
+                pid shouldBeGreaterThan 0
+
+                repeat(200) {
+                    if (procText("/proc/$pid/comm").trim() != "kontainer-init") usleep(10000u)
+                }
+                procText("/proc/$pid/comm").trim() shouldBe "kontainer-init"
+                // The runner's RSS is tens of MB; the waiter's is its code and stack
+                val parkedKb = statusKb(pid, "VmRSS")
+                parkedKb shouldBeLessThan 256L
+                parkedKb * 10 shouldBeLessThan statusKb(getpid(), "VmRSS")
+
+                SocketNotifySocket(socketPath).notifyContainerStart()
+                val status =
+                    memScoped {
+                        val status = alloc<IntVar>()
+                        waitpid(pid, status.ptr, 0)
+                        status.value
+                    }
+                (status shr 8) and 0xff shouldBe 7
+            } finally {
+                listener.close()
+                unlink(socketPath)
+            }
+        }
+
+        test("execEnvironment replaces duplicate keys in place like setenv") {
+            execEnvironment(listOf("A=1", "B=2", "A=3", "C=x=y")) shouldBe listOf("A=3", "B=2", "C=x=y")
+        }
+
+        test("execEnvironment skips entries without '='") {
+            execEnvironment(listOf("PATH=/bin", "broken", "EMPTY=")) shouldBe listOf("PATH=/bin", "EMPTY=")
+        }
+    })
@@ -0,0 +1,52 @@
+package rootfs
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+import spec.ANNOTATION_DEV_TEMPLATE
+import spec.Linux
+import spec.LinuxDevice
+import spec.Mount
+import spec.Namespace
+import spec.Root
+import spec.Spec
+
+class DevTemplateTest :
+    FunSpec({
+
+        val mountNs = Linux(namespaces = listOf(Namespace("mount")))
+        val annotated = mapOf(ANNOTATION_DEV_TEMPLATE to "true")
+
+        test("makeDev uses the simple layout for small numbers") {
+            makeDev(1, 3) shouldBe 0x103uL
+            makeDev(5, 0) shouldBe 0x500uL
+        }
+
+        test("makeDev spreads large majors and minors like gnu_dev_makedev") {
+            makeDev(0x1234, 0x56789) shouldBe 0x100056723489uL
+        }
+
+        test("the template is used only when annotated and in a mount namespace") {
+            usesDevTemplate(Spec(root = Root("rootfs"), annotations = annotated, linux = mountNs)) shouldBe true
+            usesDevTemplate(Spec(root = Root("rootfs"), linux = mountNs)) shouldBe false
+            usesDevTemplate(Spec(root = Root("rootfs"), annotations = annotated)) shouldBe false
+        }
+
+        test("specs that add to /dev get a tmpfs of their own") {
+            val withDevices =
+                Spec(
+                    root = Root("rootfs"),
+                    annotations = annotated,
+                    linux = mountNs.copy(devices = listOf(LinuxDevice("/dev/fuse", "c", 10, 229))),
+                )
+            usesDevTemplate(withDevices) shouldBe false
+
+            val withDevMount =
+                Spec(
+                    root = Root("rootfs"),
+                    annotations = annotated,
+                    linux = mountNs,
+                    mounts = listOf(Mount("/dev", "tmpfs", "tmpfs")),
+                )
+            usesDevTemplate(withDevMount) shouldBe false
+        }
+    })
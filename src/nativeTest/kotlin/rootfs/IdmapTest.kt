@@ -0,0 +1,83 @@
+package rootfs
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.collections.shouldBeEmpty
+import io.kotest.matchers.collections.shouldContainExactly
+import io.kotest.matchers.shouldBe
+import spec.ANNOTATION_ROOTFS_IDMAP
+import spec.Linux
+import spec.LinuxIdMapping
+import spec.Mount
+import spec.Namespace
+import spec.Root
+import spec.Spec
+import syscall.FakeSyscall
+import syscall.MountAttr
+
+class IdmapTest :
+    FunSpec({
+
+        val userAndMount = Linux(namespaces = listOf(Namespace("user"), Namespace("mount")))
+        val mapping = listOf(LinuxIdMapping(0u, 200000u, 65536u))
+
+        test("idmapTargets picks the annotated rootfs and idmapped bind mounts in spec order") {
+            val spec =
+                Spec(
+                    root = Root("rootfs"),
+                    annotations = mapOf(ANNOTATION_ROOTFS_IDMAP to "true"),
+                    mounts =
+                        listOf(
+                            Mount("/tmp", "tmpfs", "tmpfs"),
+                            Mount("/data", "bind", "/srv/data", listOf("rbind", "ro", "ridmap")),
+                            Mount("/cache", "bind", "/srv/cache", listOf("bind"), uidMappings = mapping, gidMappings = mapping),
+                            Mount("/etc/app", "bind", "/srv/app", listOf("bind")),
+                        ),
+                    linux = userAndMount,
+                )
+            val targets = idmapTargets(spec, "/bundle/rootfs")
+
+            targets.map { it.specIndex to it.source } shouldContainExactly
+                listOf(ROOTFS_IDMAP_INDEX to "/bundle/rootfs", 1 to "/srv/data", 2 to "/srv/cache")
+            targets[1].recursive shouldBe true
+            targets[1].recursiveIdmap shouldBe true
+            targets[1].attr shouldBe MountAttr(attrSet = MOUNT_ATTR_RDONLY)
+            targets[2].recursiveIdmap shouldBe false
+            targets[2].uidMappings shouldBe mapping
+        }
+
+        test("idmapTargets ignores idmap on non-bind mounts") {
+            val spec =
+                Spec(
+                    root = Root("rootfs"),
+                    mounts = listOf(Mount("/tmp", "tmpfs", "tmpfs", listOf("idmap"))),
+                    linux = userAndMount,
+                )
+            idmapTargets(spec, "/rootfs").shouldBeEmpty()
+        }
+
+        test("idmapTargets needs a user namespace") {
+            val spec =
+                Spec(
+                    root = Root("rootfs"),
+                    annotations = mapOf(ANNOTATION_ROOTFS_IDMAP to "true"),
+                    linux = Linux(namespaces = listOf(Namespace("mount"))),
+                )
+            idmapTargets(spec, "/rootfs").shouldBeEmpty()
+        }
+
+        test("idmap options do not leak into the mount data") {
+            parseMountOptions(listOf("rbind", "idmap", "ridmap")).data shouldBe null
+        }
+
+        test("attachIdmappedTree moves the tree into place and then sets propagation") {
+            val syscall = FakeSyscall()
+            attachIdmappedTree(syscall, 1000, "/rootfs/data", MS_SLAVE.toULong(), recursivePropagation = true) shouldBe true
+
+            syscall.calls shouldContainExactly
+                listOf(
+                    "moveMount(fromDirfd=1000, fromPath=, toDirfd=-100, toPath=/rootfs/data, flags=$MOVE_MOUNT_F_EMPTY_PATH)",
+                    "mountSetattr(dirfd=-100, path=/rootfs/data, flags=$AT_RECURSIVE, " +
+                        "attr=${MountAttr(propagation = MS_SLAVE.toULong())})",
+                )
+        }
+    })
@@ -0,0 +1,94 @@
+package rootfs
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.collections.shouldContainExactly
+import io.kotest.matchers.shouldBe
+import io.kotest.matchers.string.shouldStartWith
+import spec.Mount
+import syscall.FakeSyscall
+import syscall.MountAttr
+
+class MountPlanTest :
+    FunSpec({
+
+        beforeEach { mountApiAvailable = true }
+
+        test("planMounts puts parents before children and keeps spec order within a depth") {
+            val mounts =
+                listOf(
+                    Mount("/data/cache/tmp", "tmpfs", "tmpfs"),
+                    Mount("/proc", "proc", "proc"),
+                    Mount("/data", "bind", "/host/a", listOf("rbind")),
+                    Mount("/data/cache", "bind", "/host/b", listOf("bind")),
+                    Mount("/etc/hosts", "bind", "/host/hosts", listOf("bind", "ro")),
+                    Mount("/data", "bind", "/host/c", listOf("bind")),
+                )
+            planMounts(mounts).map { it.destination to it.source } shouldContainExactly
+                listOf(
+                    "/data" to "/host/a",
+                    "/data" to "/host/c",
+                    "/data/cache" to "/host/b",
+                    "/etc/hosts" to "/host/hosts",
+                    "/data/cache/tmp" to "tmpfs",
+                )
+        }
+
+        test("mountAttrOf maps flags and explicit negations") {
+            val attr = mountAttrOf(parseMountOptions(listOf("bind", "ro", "nosuid", "dev", "noatime", "rslave")))
+            attr.attrSet shouldBe (MOUNT_ATTR_RDONLY or MOUNT_ATTR_NOSUID or MOUNT_ATTR_NOATIME)
+            attr.attrClr shouldBe (MOUNT_ATTR_NODEV or MOUNT_ATTR__ATIME)
+            attr.propagation shouldBe MS_SLAVE.toULong()
+        }
+
+        test("mountAttrOf does not clear a flag that a later option sets again") {
+            val attr = mountAttrOf(parseMountOptions(listOf("rw", "ro")))
+            attr.attrSet shouldBe MOUNT_ATTR_RDONLY
+            attr.attrClr shouldBe 0uL
+        }
+
+        test("bindMountDetached applies flags and propagation before attaching") {
+            val syscall = FakeSyscall()
+            val attr = MountAttr(attrSet = MOUNT_ATTR_RDONLY, propagation = MS_PRIVATE.toULong())
+            bindMountDetached(syscall, "/host/a", "/rootfs/data", recursive = false, attr = attr) shouldBe
+                MountApiResult.DONE
+
+            syscall.calls.map { it.substringBefore('(') } shouldContainExactly
+                listOf("openTree", "mountSetattr", "moveMount")
+            syscall.calls[1] shouldBe "mountSetattr(dirfd=1000, path=, flags=${AT_EMPTY_PATH_MOUNT}, attr=$attr)"
+            syscall.calls.none { it.startsWith("mount(") } shouldBe true
+        }
+
+        test("bindMountDetached splits the call when only propagation recurses") {
+            val syscall = FakeSyscall()
+            val attr = MountAttr(attrSet = MOUNT_ATTR_RDONLY, propagation = MS_SHARED.toULong())
+            bindMountDetached(syscall, "/host/a", "/rootfs/data", recursive = true, attr = attr, recursivePropagation = true)
+
+            val setattrs = syscall.calls.filter { it.startsWith("mountSetattr") }
+            setattrs shouldContainExactly
+                listOf(
+                    "mountSetattr(dirfd=1000, path=, flags=$AT_EMPTY_PATH_MOUNT, attr=${attr.copy(propagation = 0uL)})",
+                    "mountSetattr(dirfd=1000, path=, flags=${AT_EMPTY_PATH_MOUNT or AT_RECURSIVE}, " +
+                        "attr=${MountAttr(propagation = MS_SHARED.toULong())})",
+                )
+        }
+
+        test("applyReadonlyPaths makes the whole tree read-only in one recursive setattr") {
+            val syscall = FakeSyscall()
+            applyReadonlyPaths(syscall, listOf("/"))
+
+            syscall.calls[0] shouldStartWith "openTree(dirfd=-100, path=/"
+            syscall.calls[1] shouldBe
+                "mountSetattr(dirfd=1000, path=, flags=${AT_EMPTY_PATH_MOUNT or AT_RECURSIVE}, " +
+                "attr=${MountAttr(attrSet = MOUNT_ATTR_RDONLY)})"
+            syscall.calls[2] shouldStartWith "moveMount(fromDirfd=1000"
+        }
+
+        test("without the new mount API applyReadonlyPaths falls back to bind-remount") {
+            val syscall = FakeSyscall()
+            syscall.mountApiSupported = false
+            applyReadonlyPaths(syscall, listOf("/"))
+
+            mountApiAvailable shouldBe false
+            syscall.calls.filter { it.startsWith("mount(") }.size shouldBe 2
+        }
+    })
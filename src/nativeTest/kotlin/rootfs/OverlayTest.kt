@@ -0,0 +1,79 @@
+package rootfs
+
+import io.kotest.assertions.throwables.shouldThrow
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.collections.shouldBeEmpty
+import io.kotest.matchers.collections.shouldContainExactly
+import io.kotest.matchers.shouldBe
+import spec.ANNOTATION_OVERLAY_LOWER
+import spec.ANNOTATION_OVERLAY_OPTIONS
+import spec.ANNOTATION_OVERLAY_UPPER
+import spec.ANNOTATION_OVERLAY_WORK
+import spec.ANNOTATION_ROOTFS_IDMAP
+import spec.Linux
+import spec.Namespace
+import spec.Root
+import spec.Spec
+
+class OverlayTest :
+    FunSpec({
+
+        fun specWith(annotations: Map<String, String>?) = Spec(root = Root("rootfs"), annotations = annotations)
+
+        test("no lower annotation means a plain rootfs directory") {
+            overlayRootfsOf(specWith(null), "/bundle") shouldBe null
+            overlayRootfsOf(specWith(mapOf(ANNOTATION_OVERLAY_UPPER to "/u")), "/bundle") shouldBe null
+        }
+
+        test("layers resolve against the bundle and options are split") {
+            val overlay =
+                overlayRootfsOf(
+                    specWith(
+                        mapOf(
+                            ANNOTATION_OVERLAY_LOWER to "layers/app:/var/lib/layers/base",
+                            ANNOTATION_OVERLAY_UPPER to "upper",
+                            ANNOTATION_OVERLAY_WORK to "work",
+                            ANNOTATION_OVERLAY_OPTIONS to "volatile, index=off",
+                        ),
+                    ),
+                    "/bundle",
+                )!!
+            overlay.lower shouldContainExactly listOf("/bundle/layers/app", "/var/lib/layers/base")
+            overlay.mountData() shouldBe
+                "lowerdir=/bundle/layers/app:/var/lib/layers/base,upperdir=/bundle/upper,workdir=/bundle/work," +
+                "volatile,index=off"
+        }
+
+        test("an overlay without an upper directory is read-only lower layers only") {
+            val overlay = overlayRootfsOf(specWith(mapOf(ANNOTATION_OVERLAY_LOWER to "/a:/b")), "/bundle")!!
+            overlay.mountData() shouldBe "lowerdir=/a:/b"
+        }
+
+        test("inconsistent annotations are rejected") {
+            shouldThrow<Exception> { overlayRootfsOf(specWith(mapOf(ANNOTATION_OVERLAY_LOWER to "::")), "/b") }
+            shouldThrow<Exception> {
+                overlayRootfsOf(specWith(mapOf(ANNOTATION_OVERLAY_LOWER to "/a", ANNOTATION_OVERLAY_UPPER to "/u")), "/b")
+            }
+            shouldThrow<Exception> {
+                overlayRootfsOf(
+                    specWith(mapOf(ANNOTATION_OVERLAY_LOWER to "/a", ANNOTATION_OVERLAY_OPTIONS to "lowerdir=/x")),
+                    "/b",
+                )
+            }
+        }
+
+        test("mountData refuses options longer than a page") {
+            val overlay = OverlayRootfs(List(200) { "/var/lib/layers/sha256-$it" })
+            shouldThrow<Exception> { overlay.mountData() }
+        }
+
+        test("the rootfs idmap annotation is ignored for an overlay rootfs") {
+            val spec =
+                Spec(
+                    root = Root("rootfs"),
+                    annotations = mapOf(ANNOTATION_ROOTFS_IDMAP to "true", ANNOTATION_OVERLAY_LOWER to "/a"),
+                    linux = Linux(namespaces = listOf(Namespace("user"), Namespace("mount"))),
+                )
+            idmapTargets(spec, "/bundle/rootfs").shouldBeEmpty()
+        }
+    })
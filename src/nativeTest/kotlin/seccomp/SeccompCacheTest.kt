@@ -0,0 +1,53 @@
+package seccomp
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+import io.kotest.matchers.shouldNotBe
+import spec.LinuxSeccomp
+import spec.LinuxSyscall
+
+class SeccompCacheTest :
+    FunSpec({
+
+        val profile =
+            LinuxSeccomp(
+                defaultAction = "SCMP_ACT_ERRNO",
+                architectures = listOf("SCMP_ARCH_X86_64"),
+                syscalls = listOf(LinuxSyscall(names = listOf("read", "write"), action = "SCMP_ACT_ALLOW")),
+            )
+        val bpf = ByteArray(24) { it.toByte() }
+
+        test("seccompCacheKey is stable for equal profiles") {
+            seccompCacheKey(profile, "env") shouldBe seccompCacheKey(profile.copy(), "env")
+        }
+
+        test("seccompCacheKey changes with the profile and the environment") {
+            val other = profile.copy(defaultAction = "SCMP_ACT_KILL")
+            seccompCacheKey(other, "env") shouldNotBe seccompCacheKey(profile, "env")
+            seccompCacheKey(profile, "libseccomp=2.5.5") shouldNotBe seccompCacheKey(profile, "libseccomp=2.5.4")
+        }
+
+        test("seccompCacheFileName is 16 hex digits plus extension") {
+            val name = seccompCacheFileName("key")
+            name.length shouldBe 20
+            name.endsWith(".bpf") shouldBe true
+            seccompCacheFileName("key") shouldBe name
+            seccompCacheFileName("other") shouldNotBe name
+        }
+
+        test("cache entry round-trips the program for the same key") {
+            val entry = encodeSeccompCacheEntry("key", bpf)
+            decodeSeccompCacheEntry(entry, "key")?.toList() shouldBe bpf.toList()
+        }
+
+        test("cache entry written for another key is a miss") {
+            decodeSeccompCacheEntry(encodeSeccompCacheEntry("key", bpf), "kez") shouldBe null
+        }
+
+        test("truncated or misaligned entries are a miss") {
+            val entry = encodeSeccompCacheEntry("key", bpf)
+            decodeSeccompCacheEntry(entry.copyOf(entry.size - 3), "key") shouldBe null
+            decodeSeccompCacheEntry(entry.copyOf(6), "key") shouldBe null
+            decodeSeccompCacheEntry(encodeSeccompCacheEntry("key", ByteArray(0)), "key") shouldBe null
+        }
+    })
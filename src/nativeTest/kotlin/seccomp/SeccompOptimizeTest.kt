@@ -0,0 +1,65 @@
+package seccomp
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+import spec.LinuxSyscall
+import spec.SeccompArg
+
+class SeccompOptimizeTest :
+    FunSpec({
+
+        fun allow(vararg names: String) = LinuxSyscall(names = names.toList(), action = "SCMP_ACT_ALLOW")
+
+        test("rules with the same action are merged in first-seen order") {
+            val rules = listOf(allow("read"), allow("write", "close"), allow("openat"))
+
+            optimizeSyscallRules(rules, "SCMP_ACT_ERRNO", 1u) shouldBe
+                listOf(allow("read", "write", "close", "openat"))
+        }
+
+        test("duplicate names are removed from a merged rule") {
+            optimizeSyscallRules(listOf(allow("read", "read"), allow("read")), "SCMP_ACT_ERRNO", null) shouldBe
+                listOf(allow("read"))
+        }
+
+        test("rules with the default action are dropped") {
+            val rules =
+                listOf(
+                    allow("read"),
+                    LinuxSyscall(names = listOf("ptrace"), action = "SCMP_ACT_ERRNO", errnoRet = 1u),
+                )
+
+            optimizeSyscallRules(rules, "SCMP_ACT_ERRNO", null) shouldBe listOf(allow("read"))
+        }
+
+        test("SCMP_ACT_KILL is treated as SCMP_ACT_KILL_THREAD") {
+            val rules = listOf(LinuxSyscall(names = listOf("reboot"), action = "SCMP_ACT_KILL"))
+
+            optimizeSyscallRules(rules, "SCMP_ACT_KILL_THREAD", null) shouldBe emptyList()
+        }
+
+        test("different errno values are not merged") {
+            val eperm = LinuxSyscall(names = listOf("mount"), action = "SCMP_ACT_ERRNO", errnoRet = 1u)
+            val enosys = LinuxSyscall(names = listOf("bpf"), action = "SCMP_ACT_ERRNO", errnoRet = 38u)
+
+            optimizeSyscallRules(listOf(eperm, enosys), "SCMP_ACT_ALLOW", null) shouldBe listOf(eperm, enosys)
+        }
+
+        test("rules with different argument conditions are not merged") {
+            val conditional =
+                LinuxSyscall(
+                    names = listOf("personality"),
+                    action = "SCMP_ACT_ALLOW",
+                    args = listOf(SeccompArg(index = 0u, value = 0u, op = "SCMP_CMP_EQ")),
+                )
+
+            optimizeSyscallRules(listOf(allow("read"), conditional, allow("write")), "SCMP_ACT_ERRNO", null) shouldBe
+                listOf(allow("read", "write"), conditional)
+        }
+
+        test("comments are dropped from merged rules") {
+            val commented = allow("read").copy(comment = "io")
+
+            optimizeSyscallRules(listOf(commented), "SCMP_ACT_ERRNO", null) shouldBe listOf(allow("read"))
+        }
+    })
@@ -0,0 +1,78 @@
+package spec
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+import io.kotest.matchers.shouldNotBe
+import utils.JsonCodec
+
+class SpecCacheTest :
+    FunSpec({
+
+        val spec =
+            Spec(
+                ociVersion = "1.0.2",
+                root = Root(path = "rootfs"),
+                process = Process(args = listOf("/bin/sh")),
+                hostname = "cached",
+                hooks = Hooks(poststart = listOf(Hook(path = "/usr/bin/notify", args = listOf("notify", "up")))),
+            )
+        val mtime = 1_700_000_000_000_000_001L
+        val key = specCacheKey("/bundles/a/config.json", 64u, 1234u, 4096, mtime, mtime + 1)
+
+        test("specCacheKey changes with the path and every stat field") {
+            val base = specCacheKey("/b/config.json", 1u, 2u, 3, 4, 5)
+            specCacheKey("/b/config.json", 1u, 2u, 3, 4, 5) shouldBe base
+            listOf(
+                specCacheKey("/c/config.json", 1u, 2u, 3, 4, 5),
+                specCacheKey("/b/config.json", 9u, 2u, 3, 4, 5),
+                specCacheKey("/b/config.json", 1u, 9u, 3, 4, 5),
+                specCacheKey("/b/config.json", 1u, 2u, 9, 4, 5),
+                specCacheKey("/b/config.json", 1u, 2u, 3, 9, 5),
+                specCacheKey("/b/config.json", 1u, 2u, 3, 4, 9),
+            ).forEach { it shouldNotBe base }
+        }
+
+        test("specCacheFileName is 16 hex digits plus extension, per config path") {
+            val name = specCacheFileName("/bundles/a/config.json")
+            name.length shouldBe 21
+            name.endsWith(".spec") shouldBe true
+            specCacheFileName("/bundles/a/config.json") shouldBe name
+            specCacheFileName("/bundles/b/config.json") shouldNotBe name
+        }
+
+        test("cache entry round-trips the spec and its hooks") {
+            val entry = encodeSpecCacheEntry(key, spec)
+            decodeSpecCacheEntry(entry, key) shouldBe spec
+            decodeSpecCacheHooks(entry, key) shouldBe SpecHooks(spec.hooks)
+        }
+
+        test("a spec without hooks decodes to empty hooks, not a miss") {
+            val entry = encodeSpecCacheEntry(key, spec.copy(hooks = null))
+            decodeSpecCacheHooks(entry, key) shouldBe SpecHooks(null)
+        }
+
+        test("cache entry written for another key is a miss") {
+            val entry = encodeSpecCacheEntry(key, spec)
+            val touched = specCacheKey("/bundles/a/config.json", 64u, 1234u, 4096, mtime, mtime + 2)
+            decodeSpecCacheEntry(entry, touched) shouldBe null
+            decodeSpecCacheHooks(entry, touched) shouldBe null
+        }
+
+        test("truncated or corrupt entries are a miss") {
+            val entry = encodeSpecCacheEntry(key, spec)
+            decodeSpecCacheEntry(entry.copyOf(entry.size - 5), key) shouldBe null
+            decodeSpecCacheHooks(entry.copyOf(10), key) shouldBe null
+            decodeSpecCacheEntry(entry.copyOf().also { it[0] = 0 }, key) shouldBe null
+        }
+
+        test("SpecHooks decodes only the hooks of a full config.json") {
+            val json = JsonCodec.encode(spec.copy(annotations = mapOf("a" to "b")))
+            JsonCodec.decode<SpecHooks>(json).hooks shouldBe spec.hooks
+            JsonCodec.decode<SpecHooks>(JsonCodec.encode(spec.copy(hooks = null))).hooks shouldBe null
+        }
+
+        test("validateSpec rejects a non-semver ociVersion") {
+            validateSpec(spec)
+            runCatching { validateSpec(spec.copy(ociVersion = "latest")) }.isFailure shouldBe true
+        }
+    })
@@ -0,0 +1,106 @@
+package state
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.collections.shouldContainExactly
+import io.kotest.matchers.ints.shouldBeLessThan
+import io.kotest.matchers.shouldBe
+import io.kotest.matchers.string.shouldStartWith
+import kotlinx.cinterop.ExperimentalForeignApi
+import platform.posix.getpid
+import platform.posix.mkdir
+import platform.posix.system
+import utils.FakeFileSystem
+import utils.JsonCodec
+
+@OptIn(ExperimentalForeignApi::class)
+class IndexTest :
+    FunSpec({
+
+        fun entry(
+            id: String,
+            status: ContainerStatus = ContainerStatus.CREATED,
+            bundle: String = "/bundles/$id",
+        ) = IndexEntry(id, 100, status, "2026-05-10T00:00:00Z", 12345, bundle)
+
+        test("the last record of an id wins and D removes it") {
+            val content =
+                encodeIndexRecord(entry("a")) +
+                    encodeIndexRecord(entry("b")) +
+                    encodeIndexRecord(entry("a", ContainerStatus.RUNNING)) +
+                    encodeIndexRemoval("b")
+
+            parseIndex(content) shouldContainExactly listOf(entry("a", ContainerStatus.RUNNING))
+        }
+
+        test("an unterminated last record is ignored") {
+            val content = encodeIndexRecord(entry("a")) + encodeIndexRecord(entry("b")).dropLast(1)
+
+            parseIndex(content) shouldContainExactly listOf(entry("a"))
+        }
+
+        test("bundle paths with tabs, newlines and backslashes round-trip") {
+            val odd = entry("a", bundle = "/odd\tpath\nwith\\slash")
+
+            parseIndex(encodeIndexRecord(odd)) shouldContainExactly listOf(odd)
+        }
+
+        test("missing fields are encoded as dashes") {
+            val bare = IndexEntry("a", null, ContainerStatus.STOPPED, null, null, "/b")
+
+            encodeIndexRecord(bare) shouldBe "S\ta\t-\tstopped\t-\t-\t/b\n"
+            parseIndex(encodeIndexRecord(bare)) shouldContainExactly listOf(bare)
+        }
+
+        test("save and removeFromIndex keep the index in step with state.json") {
+            val fs = FakeFileSystem()
+            val root = "/nonexistent/kontainer"
+            State("1.0.0", "a", ContainerStatus.CREATED, 100, "/bundles/a").save(fs, root)
+            State("1.0.0", "b", ContainerStatus.CREATED, 200, "/bundles/b").save(fs, root)
+            removeFromIndex(fs, root, "a")
+
+            readIndex(fs, root).map { it.id } shouldContainExactly listOf("b")
+        }
+
+        test("a grown index is compacted to its live records") {
+            val fs = FakeFileSystem()
+            val root = "/nonexistent/kontainer"
+            val state = State("1.0.0", "a", ContainerStatus.RUNNING, 100, "/bundles/a")
+            repeat(2000) { updateIndex(fs, root, state) }
+
+            val content = fs.files.getValue("$root/index")
+            content shouldStartWith "K\t"
+            content.length shouldBeLessThan 64 * 1024
+            parseIndex(content) shouldContainExactly listOf(state.toIndexEntry())
+        }
+
+        test("readIndex builds a missing index from the state directories") {
+            val fs = FakeFileSystem()
+
+            readIndex(fs, "/nonexistent/kontainer") shouldBe emptyList()
+            fs.files["/nonexistent/kontainer/index"] shouldBe "K\t0\n"
+        }
+
+        test("compactIndex records the size of its records in bytes") {
+            val record = encodeIndexRecord(entry("a", bundle = "/bündel/ä"))
+
+            compactIndex(listOf(entry("a", bundle = "/bündel/ä"))) shouldBe "K\t${record.encodeToByteArray().size}\n$record"
+        }
+
+        test("the first save in a root without an index keeps the existing containers") {
+            // listContainerIds scans the real directory; state.json lives in the fake
+            val root = "/tmp/kontainer-index-test-${getpid()}"
+            mkdir(root, 0x1C0u) // 0x1C0 = 0o700
+            mkdir("$root/old", 0x1C0u)
+            try {
+                val fs = FakeFileSystem()
+                val old = State("1.0.0", "old", ContainerStatus.RUNNING, 100, "/bundles/old")
+                fs.files["$root/old/state.json"] = JsonCodec.encode(old)
+
+                State("1.0.0", "new", ContainerStatus.CREATED, 200, "/bundles/new").save(fs, root)
+
+                readIndex(fs, root).map { it.id } shouldContainExactly listOf("old", "new")
+            } finally {
+                system("rm -rf $root")
+            }
+        }
+    })
@@ -87,4 +87,25 @@ class StateRoundtripTest :
             state.save(fs, "/run/kontainer")
             containerExists(fs, "/run/kontainer", "x") shouldBe true
         }
+
+        test("save replaces state.json atomically with one compact record") {
+            val fs = FakeFileSystem()
+            val state =
+                State(
+                    ociVersion = "1.0.0",
+                    id = "x",
+                    status = ContainerStatus.CREATED,
+                    pid = 7,
+                    bundle = "/b",
+                    cgroupPath = "kontainer/x",
+                )
+
+            state.save(fs, "/run/kontainer")
+
+            fs.calls.none { it.startsWith("writeTextFile(") } shouldBe true
+            fs.calls.count { it.startsWith("writeTextFileAtomic(/run/kontainer/x/state.json") } shouldBe 1
+            val record = fs.files.getValue("/run/kontainer/x/state.json")
+            record.contains('\n') shouldBe false
+            loadState(fs, "/run/kontainer", "x").cgroupPath shouldBe "kontainer/x"
+        }
     })
@@ -1,5 +1,8 @@
 package syscall
 
+import kotlinx.cinterop.ExperimentalForeignApi
+import platform.posix.ENOSYS
+import platform.posix.set_posix_errno
 import spec.POSIXRlimit
 
 /**
@@ -17,6 +20,10 @@ class FakeSyscall : Syscall {
     var euid: UInt = 0u
     var egid: UInt = 0u
 
+    /** When false, the new mount API calls fail with ENOSYS like on old kernels */
+    var mountApiSupported = true
+    private var nextTreeFd = 1000
+
     override fun mount(
         source: String?,
         target: String,
@@ -44,6 +51,45 @@ class FakeSyscall : Syscall {
         return 0
     }
 
+    override fun openTree(
+        dirfd: Int,
+        path: String,
+        flags: UInt,
+    ): Int {
+        calls += "openTree(dirfd=$dirfd, path=$path, flags=$flags)"
+        if (!mountApiSupported) return enosys()
+        return nextTreeFd++
+    }
+
+    override fun moveMount(
+        fromDirfd: Int,
+        fromPath: String,
+        toDirfd: Int,
+        toPath: String,
+        flags: UInt,
+    ): Int {
+        calls += "moveMount(fromDirfd=$fromDirfd, fromPath=$fromPath, toDirfd=$toDirfd, toPath=$toPath, flags=$flags)"
+        if (!mountApiSupported) return enosys()
+        return 0
+    }
+
+    override fun mountSetattr(
+        dirfd: Int,
+        path: String,
+        flags: UInt,
+        attr: MountAttr,
+    ): Int {
+        calls += "mountSetattr(dirfd=$dirfd, path=$path, flags=$flags, attr=$attr)"
+        if (!mountApiSupported) return enosys()
+        return 0
+    }
+
+    @OptIn(ExperimentalForeignApi::class)
+    private fun enosys(): Int {
+        set_posix_errno(ENOSYS)
+        return -1
+    }
+
     override fun chroot(path: String): Int {
         calls += "chroot(path=$path)"
         return 0
@@ -113,6 +159,16 @@ class FakeSyscall : Syscall {
         return 0
     }
 
+    override fun setCpuAffinity(cpus: List<Int>): Int {
+        calls += "setCpuAffinity(cpus=$cpus)"
+        return 0
+    }
+
+    override fun bindMemoryPolicy(nodes: List<Int>): Int {
+        calls += "bindMemoryPolicy(nodes=$nodes)"
+        return 0
+    }
+
     override fun applyRlimits(
         pid: Int,
         rlimits: List<POSIXRlimit>?,
@@ -135,6 +191,7 @@ class FakeSyscall : Syscall {
     override fun killProcess(
         pid: Int,
         signal: Int,
+        startTime: Long?,
     ) {
         calls += "killProcess(pid=$pid, signal=$signal)"
     }
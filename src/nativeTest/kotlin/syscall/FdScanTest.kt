@@ -0,0 +1,58 @@
+package syscall
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.collections.shouldContain
+import io.kotest.matchers.collections.shouldContainExactly
+import io.kotest.matchers.ints.shouldBeGreaterThan
+import io.kotest.matchers.shouldBe
+import kotlinx.cinterop.*
+import platform.posix.*
+
+@OptIn(ExperimentalForeignApi::class)
+class FdScanTest :
+    FunSpec({
+
+        /** linux_dirent64 records for [names], padded to 8 bytes like the kernel does */
+        fun NativePlacement.dirents(names: List<String>): Pair<CPointer<ByteVar>, Int> {
+            val buffer = allocArray<ByteVar>(DIRENT_BUFFER_SIZE)
+            var pos = 0
+            for (name in names) {
+                val reclen = (DIRENT_NAME_OFFSET + name.length + 1 + 7) / 8 * 8
+                for (i in 0 until reclen) buffer[pos + i] = 0.toByte()
+                (buffer + (pos + DIRENT_RECLEN_OFFSET))!!.reinterpret<UShortVar>().pointed.value = reclen.toUShort()
+                name.forEachIndexed { i, c -> buffer[pos + DIRENT_NAME_OFFSET + i] = c.code.toByte() }
+                pos += reclen
+            }
+            return buffer to pos
+        }
+
+        test("forEachDirentFd parses fd names in place and skips the rest") {
+            memScoped {
+                val (buffer, length) = dirents(listOf(".", "..", "0", "1", "2", "17", "1024", "x1"))
+                val fds = mutableListOf<Int>()
+                forEachDirentFd(buffer, length) { fds += it }
+                fds shouldContainExactly listOf(0, 1, 2, 17, 1024)
+            }
+        }
+
+        test("forEachOpenFd lists the standard streams and a newly opened fd") {
+            val fd = open("/dev/null", O_RDONLY or O_CLOEXEC)
+            fd shouldBeGreaterThan 2
+            try {
+                val fds = mutableListOf<Int>()
+                forEachOpenFd { fds += it } shouldBe true
+                fds shouldContain 0
+                fds shouldContain fd
+            } finally {
+                close(fd)
+            }
+        }
+
+        test("openFdLimit is at least the soft RLIMIT_NOFILE") {
+            memScoped {
+                val rlim = alloc<rlimit>()
+                getrlimit(RLIMIT_NOFILE, rlim.ptr)
+                (openFdLimit().toULong() >= minOf(rlim.rlim_cur, (1024 * 1024).toULong())) shouldBe true
+            }
+        }
+    })
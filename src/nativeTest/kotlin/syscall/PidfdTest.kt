@@ -0,0 +1,44 @@
+package syscall
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.nulls.shouldBeNull
+import io.kotest.matchers.shouldBe
+import platform.posix.getpid
+
+class PidfdTest :
+    FunSpec({
+
+        val statLine =
+            "4242 (sleep) S 1 4242 4242 0 -1 4194560 100 0 0 0 0 0 0 0 20 0 1 0 987654 2330624 200 " +
+                "18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 3 0 0 0 0 0\n"
+
+        test("parseProcessStat reads the fields the runtime uses") {
+            parseProcessStat(statLine) shouldBe
+                ProcessStat(comm = "sleep", state = 'S', ppid = 1, ttyNr = 0, utime = 0, stime = 0, startTime = 987654L)
+        }
+
+        test("parseProcessStat counts fields from the last parenthesis of comm") {
+            val tricky = statLine.replace("(sleep)", "(a) Z (b)")
+            val stat = parseProcessStat(tricky)!!
+            stat.comm shouldBe "a) Z (b"
+            stat.state shouldBe 'S'
+            stat.startTime shouldBe 987654L
+        }
+
+        test("parseProcessStat rejects truncated content") {
+            parseProcessStat("4242 (sleep) S 1 4242").shouldBeNull()
+            parseProcessStat("garbage").shouldBeNull()
+        }
+
+        test("the current process has a start time and a verifiable pidfd") {
+            val pid = getpid()
+            val startTime = readProcessStartTime(pid)!!
+            val fd = openVerifiedPidfd(pid, startTime)
+            if (fd >= 0) {
+                pidfdHasExited(fd) shouldBe false
+                platform.posix.close(fd)
+                // A different start time means the PID was reused
+                openVerifiedPidfd(pid, startTime + 1) shouldBe -1
+            }
+        }
+    })
@@ -0,0 +1,25 @@
+package trace
+
+import io.kotest.core.spec.style.FunSpec
+import io.kotest.matchers.shouldBe
+
+class TracerTest :
+    FunSpec({
+
+        test("formatSpan emits one JSON object with duration") {
+            formatSpan("init", "pivot_root", 1_000L, 1_750L) shouldBe
+                "{\"stage\":\"init\",\"name\":\"pivot_root\",\"start_ns\":1000," +
+                "\"end_ns\":1750,\"duration_ns\":750}"
+        }
+
+        test("formatSpan matches the bootstrap.c line format for instants") {
+            formatSpan("init", "execve", 42L, 42L) shouldBe
+                "{\"stage\":\"init\",\"name\":\"execve\",\"start_ns\":42,\"end_ns\":42,\"duration_ns\":0}"
+        }
+
+        test("now is monotonic") {
+            val a = Tracer.now()
+            val b = Tracer.now()
+            (b >= a) shouldBe true
+        }
+    })
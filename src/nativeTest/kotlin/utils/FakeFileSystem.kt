@@ -25,6 +25,30 @@ class FakeFileSystem : FileSystem {
         calls += "writeTextFile($path, $content)"
     }
 
+    override fun writeTextFileAtomic(
+        path: String,
+        content: String,
+        durable: Boolean,
+    ) {
+        files[path] = content
+        calls += "writeTextFileAtomic($path, $content, durable=$durable)"
+    }
+
+    override fun appendTextFile(
+        path: String,
+        content: String,
+    ): Long {
+        val updated = (files[path] ?: "") + content
+        files[path] = updated
+        calls += "appendTextFile($path, $content)"
+        return updated.length.toLong()
+    }
+
+    override fun mapTextFile(path: String): String? {
+        calls += "mapTextFile($path)"
+        return files[path]
+    }
+
     override fun readTextFile(path: String): String {
         calls += "readTextFile($path)"
         return files[path] ?: throw Exception("Failed to open $path for reading: errno=2")
@@ -57,4 +81,31 @@ class FakeFileSystem : FileSystem {
         calls += "removeDirectory($path)"
         return directories.remove(path)
     }
+
+    override fun openDirectory(path: String): DirectoryHandle {
+        calls += "openDirectory($path)"
+        return FakeDirectoryHandle(path)
+    }
+
+    /** Resolves names against [path] in the same [files] map */
+    private inner class FakeDirectoryHandle(
+        override val path: String,
+    ) : DirectoryHandle {
+        override fun writeFile(
+            name: String,
+            content: String,
+        ) {
+            files["$path/$name"] = content
+            calls += "writeFile($path/$name, $content)"
+        }
+
+        override fun readFile(name: String): String {
+            calls += "readFile($path/$name)"
+            return files["$path/$name"] ?: throw Exception("Failed to open $path/$name for reading: errno=2")
+        }
+
+        override fun close() {
+            calls += "closeDirectory($path)"
+        }
+    }
 }